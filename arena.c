@@ -1,4 +1,5 @@
 #include "arena.h"
+#include "stats.h"
 #include <stdlib.h>
 #include <stdint.h>
 
@@ -45,6 +46,7 @@ void *arena_alloc(Arena *a, size_t size) {
         b->capacity = cap;
         b->used     = 0;
         a->blocks   = b;
+        if (stats_enabled()) stats_arena_block(cap);
     }
     void *p = b->data + b->used;
     b->used += aligned;
@@ -54,3 +56,31 @@ void *arena_alloc(Arena *a, size_t size) {
     return p;
 }
 
+ArenaMark arena_mark(const Arena *a) {
+    ArenaMark m = { a->blocks, a->blocks ? a->blocks->used : 0 };
+    return m;
+}
+
+void arena_rollback(Arena *a, ArenaMark mark) {
+    while (a->blocks && a->blocks != mark.block) {
+        ArenaBlock *n = a->blocks->next;
+        free(a->blocks);
+        a->blocks = n;
+    }
+    if (a->blocks) a->blocks->used = mark.used;
+#ifndef NDEBUG
+    arena_check(a);
+#endif
+}
+
+void arena_adopt(Arena *a, Arena *from) {
+    ArenaBlock *last = from->blocks;
+    if (!last) return;
+    while (last->next) last = last->next;
+    last->next   = a->blocks;
+    a->blocks    = from->blocks;
+    from->blocks = NULL;
+#ifndef NDEBUG
+    arena_check(a);
+#endif
+}
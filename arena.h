@@ -15,6 +15,12 @@ typedef struct {
     size_t      block_size;
 } Arena;
 
+/* A position in an arena; rolling back frees everything allocated since. */
+typedef struct {
+    ArenaBlock *block;
+    size_t      used;
+} ArenaMark;
+
 #ifndef NDEBUG
   #include <assert.h>
   void arena_check(Arena *a);
@@ -25,6 +31,10 @@ typedef struct {
 void arena_init(Arena *a, size_t block_size);
 void arena_destroy(Arena *a);
 void *arena_alloc(Arena *a, size_t size);
+ArenaMark arena_mark(const Arena *a);
+void arena_rollback(Arena *a, ArenaMark mark);
+/* Moves every block of from into a, leaving from empty. */
+void arena_adopt(Arena *a, Arena *from);
 
 #endif /* ARENA_H */
 
@@ -0,0 +1,73 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Operations are timed in batches of BENCH_BATCH, so one clock read is
+ * spread over many ops; the percentiles are over batch means, per op. */
+#define BENCH_BATCH  256
+
+/* Runs op(ctx, i, thread) for i in [0, ops), each thread taking one
+ * contiguous slice.  The threads start together off a barrier. */
+typedef void (*bench_op)(void *ctx, size_t i, unsigned thread);
+
+/* A whole run of fn, timed once per repetition and divided by units
+ * (records saved, edges walked); bytes > 0 adds MB/s to the result.
+ * after, if set, runs untimed after each repetition. */
+typedef void (*bench_fn)(void *ctx);
+
+typedef struct {
+    int       scale;        /* log2 of the generated graph's vertices */
+    int       edgeFactor;   /* edges per vertex */
+    unsigned  maxThreads;   /* top of the thread sweeps */
+    int       reps;         /* repetitions of whole-run benchmarks */
+    uint64_t  seed;
+    const char *dir;        /* where save/load benchmarks put their files */
+} bench_config;
+
+extern bench_config bench_cfg;
+
+void bench_measure(const char *name, unsigned threads, size_t ops, bench_op op, void *ctx);
+void bench_time(const char *name, unsigned threads, size_t units, size_t bytes,
+                bench_fn fn, bench_fn after, void *ctx);
+
+/* 1, 2, 4, ... up to and including bench_cfg.maxThreads. */
+#define BENCH_SWEEP(t) \
+    for (unsigned t = 1; t <= bench_cfg.maxThreads; \
+         t = (t < bench_cfg.maxThreads && t * 2 > bench_cfg.maxThreads) \
+             ? bench_cfg.maxThreads : t * 2)
+
+/* With no filters every benchmark runs; else those whose name contains one. */
+void bench_set_filters(const char *const *names, int n);
+bool bench_selected(const char *name);
+void bench_write_json(FILE *out, const char *commit);
+
+/* xorshift64*: cheap, and the same seed gives the same graph. */
+static inline uint64_t bench_rand(uint64_t *s) {
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 0x2545F4914F6CDD1DULL;
+}
+
+/* Generators emit edges as (src, tgt) vertex indexes in [0, 1 << scale). */
+typedef struct {
+    size_t    count;
+    uint32_t *src;
+    uint32_t *tgt;
+} bench_edges;
+
+/* R-MAT with the Graph500 quadrant weights: power-law degrees with a few
+ * heavy hubs. */
+bench_edges gen_rmat(int scale, size_t edges, uint64_t seed);
+/* Endpoints drawn uniformly: every vertex has about the same degree. */
+bench_edges gen_uniform(int scale, size_t edges, uint64_t seed);
+void        bench_edges_free(bench_edges *e);
+
+void bench_maps(void);
+void bench_db(void);
+
+#endif /* BENCH_H */
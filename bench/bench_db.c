@@ -0,0 +1,307 @@
+#include "bench.h"
+#include "../eavg.h"
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct {
+    eavgDB      *db;
+    bench_edges  edges;
+    size_t       vertices;
+    eavg_u64    *ids;       /* vertex index -> entity id */
+    eavg_u64     attr, rel;
+    double      *weights;
+    double       minWeight;
+    const char  *path;
+    eavgSaveOptions save;
+    eavgLoadOptions load;
+    eavgDB      *loaded;
+    unsigned     threads;
+    size_t       walked;
+} db_ctx;
+
+static void op_add_entity(void *p, size_t i, unsigned t) {
+    (void)t;
+    db_ctx *c = p;
+    eavgEntity *e = eavgDB_addEntity(c->db, 1, NULL);
+    if (!e) abort();
+    c->ids[i] = e->id;
+}
+
+static void op_add_value(void *p, size_t i, unsigned t) {
+    (void)t;
+    db_ctx *c = p;
+    if (!eavgDB_addIntValue(c->db, c->ids[i], c->attr, (long)i)) abort();
+}
+
+static void op_add_edge(void *p, size_t i, unsigned t) {
+    (void)t;
+    db_ctx *c = p;
+    if (!eavgDB_addEdgeEx(c->db, c->ids[c->edges.src[i]], c->ids[c->edges.tgt[i]], c->rel,
+                          c->weights[i], EAVG_EDGE_DIR_OUT, NULL, 0))
+        abort();
+}
+
+static void op_find_entity(void *p, size_t i, unsigned t) {
+    (void)t;
+    db_ctx *c = p;
+    if (!eavgDB_findEntityById(c->db, c->ids[(i * 7919) & (c->vertices - 1)])) abort();
+}
+
+static bool heavy_edge(const eavgEdgeRec *e, void *userData) {
+    return e->weight >= *(const double *)userData;
+}
+
+/* Sources follow the edge list, so hubs are queried as often as they
+ * occur in it. */
+static void op_filtered_edges(void *p, size_t i, unsigned t) {
+    (void)t;
+    db_ctx *c = p;
+    size_t n;
+    eavgEdgeRec *r = eavgDB_getFilteredEdges(c->db, c->ids[c->edges.src[i % c->edges.count]],
+                                             EAVG_EDGE_DIR_OUT, heavy_edge, &c->minWeight, &n);
+    free(r);
+}
+
+static int count_edge(eavgDB *db, eavgEdgeRec *e, void *userData) {
+    (void)db; (void)e;
+    ++*(size_t *)userData;
+    return 0;
+}
+
+static void run_for_each_edge(void *p) {
+    db_ctx *c = p;
+    c->walked = 0;
+    eavgDB_forEachEdge(c->db, count_edge, &c->walked);
+}
+
+static void run_parallel_for_each_edge(void *p) {
+    db_ctx *c = p;
+    /* Per-worker counters, so the walk is not one contended cache line. */
+    eavgParallelOptions opt = { .threads = c->threads, .stateSize = sizeof(size_t) };
+    eavgDB_parallelForEachEdge(c->db, &opt, count_edge, NULL);
+}
+
+/* Sources with a low score, out-edges to targets with a high one: once
+ * as a pattern query, once as the loop it replaces. */
+static bool score_below(const eavgValRec *v, void *userData) {
+    return v->data.intValue < *(const long *)userData;
+}
+
+static int count_rows(const eavgQueryCell *rows, size_t count, void *userData) {
+    (void)rows;
+    *(size_t *)userData += count;
+    return 0;
+}
+
+static void run_query(void *p) {
+    db_ctx *c = p;
+    char    pattern[128];
+    snprintf(pattern, sizeof pattern, "(a {score<%zu})-[links]->(b {score>=%zu})",
+             c->vertices / 64, c->vertices / 2);
+    eavgQuery *q = eavgQuery_compile(c->db, pattern, NULL, 0);
+    c->walked = 0;
+    if (!q || eavgQuery_run(q, count_rows, &c->walked) != 0) abort();
+    eavgQuery_free(q);
+}
+
+struct loop_ctx {
+    db_ctx *c;
+    size_t  rows;
+};
+
+static int loop_source(eavg_u64 id, void *userData) {
+    struct loop_ctx *l = userData;
+    size_t n;
+    eavgEdgeRec *r = eavgDB_getFilteredEdges(l->c->db, id, EAVG_EDGE_DIR_OUT, NULL, NULL, &n);
+    for (size_t i = 0; i < n; i++) {
+        if (r[i].relationTypeId != l->c->rel) continue;
+        eavgValueList *vl = eavgDB_getValueList(l->c->db, r[i].targetEntity);
+        for (size_t j = 0; vl && j < vl->count; j++)
+            if (vl->values[j].attributeId == l->c->attr &&
+                vl->values[j].data.intValue >= (long)(l->c->vertices / 2)) {
+                l->rows++;
+                break;
+            }
+    }
+    free(r);
+    return 0;
+}
+
+static void run_query_loop(void *p) {
+    db_ctx *c   = p;
+    long    max = (long)(c->vertices / 64);
+    id_bitmap *from = eavgDB_findEntitiesByValueBitmap(c->db, c->attr, score_below, &max);
+    struct loop_ctx l = { c, 0 };
+    if (!from) abort();
+    id_bitmap_foreach(from, loop_source, &l);
+    id_bitmap_destroy(from);
+    c->walked = l.rows;
+}
+
+static void run_save(void *p) {
+    db_ctx *c = p;
+    if (eavgDB_saveEx(c->db, c->path, &c->save) != 0) abort();
+}
+
+static void run_load(void *p) {
+    db_ctx *c = p;
+    c->loaded = eavgDB_loadEx(c->path, &c->load);
+    if (!c->loaded) abort();
+}
+
+static void drop_loaded(void *p) {
+    db_ctx *c = p;
+    eavgDB_destroy(c->loaded);
+    c->loaded = NULL;
+}
+
+static size_t file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+static void db_fresh(db_ctx *c) {
+    c->db = eavgDB_create(c->vertices);
+    if (!c->db) abort();
+    c->attr = eavgDB_addAttribute(c->db, "score", EAVG_DATA_TYPE_INT)->id;
+    c->rel  = eavgDB_addRelationType(c->db, "links")->id;
+}
+
+/* Loads the entities and the edges of c->edges into a fresh db. */
+static void db_build(db_ctx *c) {
+    db_fresh(c);
+    for (size_t i = 0; i < c->vertices; i++) op_add_entity(c, i, 0);
+    for (size_t i = 0; i < c->edges.count; i++) op_add_edge(c, i, 0);
+}
+
+static void bench_entities(db_ctx *c) {
+    if (bench_selected("db/add_entity")) {
+        BENCH_SWEEP(t) {
+            db_fresh(c);
+            eavgDB_setIdBlock(c->db, t > 1 ? 64 : 0);
+            bench_measure("db/add_entity", t, c->vertices, op_add_entity, c);
+            eavgDB_destroy(c->db);
+        }
+    }
+    if (bench_selected("db/add_value")) {
+        db_fresh(c);
+        for (size_t i = 0; i < c->vertices; i++) op_add_entity(c, i, 0);
+        bench_measure("db/add_value", 1, c->vertices, op_add_value, c);
+        eavgDB_destroy(c->db);
+    }
+}
+
+static void bench_inserts(db_ctx *c, const char *graph) {
+    char name[64];
+    snprintf(name, sizeof name, "db/add_edge/%s", graph);
+    if (bench_selected(name)) {
+        BENCH_SWEEP(t) {
+            db_fresh(c);
+            eavgDB_setIdBlock(c->db, t > 1 ? 64 : 0);
+            for (size_t i = 0; i < c->vertices; i++) op_add_entity(c, i, 0);
+            bench_measure(name, t, c->edges.count, op_add_edge, c);
+            eavgDB_destroy(c->db);
+        }
+    }
+}
+
+static void bench_reads(db_ctx *c, const char *graph) {
+    char name[64];
+    size_t queries = c->edges.count < c->vertices * 4 ? c->edges.count : c->vertices * 4;
+
+    BENCH_SWEEP(t) {
+        snprintf(name, sizeof name, "db/find_entity/%s", graph);
+        if (bench_selected(name)) bench_measure(name, t, c->vertices, op_find_entity, c);
+        snprintf(name, sizeof name, "db/filtered_edges/%s", graph);
+        if (bench_selected(name)) bench_measure(name, t, queries, op_filtered_edges, c);
+        snprintf(name, sizeof name, "db/filtered_edges_cached/%s", graph);
+        if (bench_selected(name)) {
+            eavgCacheOptions opt = { .filtered = true };
+            if (eavgDB_cacheEnable(c->db, &opt) < 0) abort();
+            bench_measure(name, t, queries, op_filtered_edges, c);
+            eavgDB_cacheDisable(c->db);
+        }
+    }
+
+    snprintf(name, sizeof name, "db/for_each_edge/%s", graph);
+    if (bench_selected(name))
+        bench_time(name, 1, c->edges.count, 0, run_for_each_edge, NULL, c);
+    snprintf(name, sizeof name, "db/query/%s", graph);
+    if (bench_selected(name)) bench_time(name, 1, c->vertices / 64, 0, run_query, NULL, c);
+    snprintf(name, sizeof name, "db/query_loop/%s", graph);
+    if (bench_selected(name)) bench_time(name, 1, c->vertices / 64, 0, run_query_loop, NULL, c);
+    snprintf(name, sizeof name, "db/parallel_for_each_edge/%s", graph);
+    if (bench_selected(name)) {
+        BENCH_SWEEP(t) {
+            c->threads = t;
+            bench_time(name, t, c->edges.count, 0, run_parallel_for_each_edge, NULL, c);
+        }
+    }
+}
+
+static void bench_persistence(db_ctx *c, const char *graph) {
+    char name[64];
+    char loadName[64];
+    size_t records = c->vertices * 2 + c->edges.count;
+
+    snprintf(name, sizeof name, "db/save/%s", graph);
+    snprintf(loadName, sizeof loadName, "db/load/%s", graph);
+    bool saves = bench_selected(name), loads = bench_selected(loadName);
+
+    if (saves) {
+        BENCH_SWEEP(t) {
+            c->save = (eavgSaveOptions){ .threads = t };
+            bench_time(name, t, records, 0, run_save, NULL, c);
+        }
+    } else if (loads) {
+        c->save = (eavgSaveOptions){ .threads = 0 };
+        run_save(c);
+    }
+    if (loads) {
+        size_t bytes = file_size(c->path);
+        BENCH_SWEEP(t) {
+            c->load = (eavgLoadOptions){ .threads = t };
+            bench_time(loadName, t, records, bytes, run_load, drop_loaded, c);
+        }
+    }
+    unlink(c->path);
+}
+
+static void bench_graph(db_ctx *c, const char *graph) {
+    bench_inserts(c, graph);
+
+    db_build(c);
+    for (size_t i = 0; i < c->vertices; i++) op_add_value(c, i, 0);
+    bench_reads(c, graph);
+    bench_persistence(c, graph);
+    eavgDB_destroy(c->db);
+    c->db = NULL;
+}
+
+void bench_db(void) {
+    char path[512];
+    snprintf(path, sizeof path, "%s/eavg_bench_%d.db", bench_cfg.dir, (int)getpid());
+
+    db_ctx c = { .vertices = (size_t)1 << bench_cfg.scale, .minWeight = 0.5, .path = path };
+    size_t m = c.vertices * (size_t)bench_cfg.edgeFactor;
+    c.ids     = malloc(c.vertices * sizeof *c.ids);
+    c.weights = malloc(m * sizeof *c.weights);
+    if (!c.ids || !c.weights) { perror("malloc"); exit(1); }
+    uint64_t s = bench_cfg.seed ^ 0x9E3779B97F4A7C15ULL;
+    for (size_t i = 0; i < m; i++) c.weights[i] = (double)(bench_rand(&s) >> 11) / 9007199254740992.0;
+
+    bench_entities(&c);
+
+    c.edges = gen_rmat(bench_cfg.scale, m, bench_cfg.seed);
+    bench_graph(&c, "rmat");
+    bench_edges_free(&c.edges);
+
+    c.edges = gen_uniform(bench_cfg.scale, m, bench_cfg.seed);
+    bench_graph(&c, "uniform");
+    bench_edges_free(&c.edges);
+
+    free(c.weights);
+    free(c.ids);
+}
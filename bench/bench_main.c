@@ -0,0 +1,61 @@
+#include "bench.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [-s scale] [-e edgefactor] [-t maxthreads] [-r reps] [-S seed]\n"
+            "          [-d dir] [-o out.json] [-c commit] [name-filter...]\n",
+            argv0);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *tmp = getenv("TMPDIR");
+    bench_cfg = (bench_config){
+        .scale      = 16,
+        .edgeFactor = 8,
+        .maxThreads = cpus > 0 ? (unsigned)cpus : 1,
+        .reps       = 5,
+        .seed       = 42,
+        .dir        = tmp && *tmp ? tmp : "/tmp",
+    };
+    const char *outPath = NULL, *commit = getenv("BENCH_COMMIT");
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:e:t:r:S:d:o:c:h")) != -1) {
+        switch (opt) {
+        case 's': bench_cfg.scale      = atoi(optarg); break;
+        case 'e': bench_cfg.edgeFactor = atoi(optarg); break;
+        case 't': bench_cfg.maxThreads = (unsigned)atoi(optarg); break;
+        case 'r': bench_cfg.reps       = atoi(optarg); break;
+        case 'S': bench_cfg.seed       = strtoull(optarg, NULL, 0); break;
+        case 'd': bench_cfg.dir        = optarg; break;
+        case 'o': outPath = optarg; break;
+        case 'c': commit  = optarg; break;
+        default:  usage(argv[0]);
+        }
+    }
+    if (bench_cfg.scale < 4 || bench_cfg.scale > 28 || bench_cfg.edgeFactor < 1 ||
+        bench_cfg.maxThreads < 1 || bench_cfg.reps < 1)
+        usage(argv[0]);
+    bench_set_filters((const char *const *)argv + optind, argc - optind);
+
+    bench_maps();
+    bench_db();
+
+    FILE *out = outPath ? fopen(outPath, "w") : stdout;
+    if (!out) {
+        perror(outPath);
+        return 1;
+    }
+    bench_write_json(out, commit);
+    if (out != stdout && fclose(out) != 0) {
+        perror(outPath);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include "bench.h"
+#include "../hashmap.h"
+#include "../arena.h"
+
+#include <stdlib.h>
+
+typedef struct {
+    size_t     n;
+    uint64_t  *keys;
+    char     **names;
+    u64_map   *u64;
+    str_map   *str;
+    Arena      arena;
+    size_t     allocSize;
+} maps_ctx;
+
+static void u64_put(void *p, size_t i, unsigned t) {
+    (void)t;
+    maps_ctx *c = p;
+    u64_map_put(c->u64, c->keys[i], &c->keys[i]);
+}
+
+static void u64_get(void *p, size_t i, unsigned t) {
+    (void)t;
+    maps_ctx *c = p;
+    /* Lookups in a scrambled order, so they miss the cache like real ones. */
+    if (!u64_map_get(c->u64, c->keys[(i * 7919) % c->n])) abort();
+}
+
+static void u64_remove(void *p, size_t i, unsigned t) {
+    (void)t;
+    maps_ctx *c = p;
+    u64_map_remove(c->u64, c->keys[i]);
+}
+
+static void str_put(void *p, size_t i, unsigned t) {
+    (void)t;
+    maps_ctx *c = p;
+    str_map_put(c->str, c->names[i], c->names[i]);
+}
+
+static void str_get(void *p, size_t i, unsigned t) {
+    (void)t;
+    maps_ctx *c = p;
+    if (!str_map_get(c->str, c->names[(i * 7919) % c->n])) abort();
+}
+
+static void str_remove(void *p, size_t i, unsigned t) {
+    (void)t;
+    maps_ctx *c = p;
+    str_map_remove(c->str, c->names[i]);
+}
+
+static void arena_op(void *p, size_t i, unsigned t) {
+    (void)i; (void)t;
+    maps_ctx *c = p;
+    if (!arena_alloc(&c->arena, c->allocSize)) abort();
+}
+
+void bench_maps(void) {
+    maps_ctx c = { .n = (size_t)1 << (bench_cfg.scale + 2) };
+    c.keys  = malloc(c.n * sizeof *c.keys);
+    c.names = malloc(c.n * sizeof *c.names);
+    if (!c.keys || !c.names) { perror("malloc"); exit(1); }
+    uint64_t s = bench_cfg.seed | 1;
+    for (size_t i = 0; i < c.n; i++) {
+        do c.keys[i] = bench_rand(&s); while (c.keys[i] == 0);   /* 0 marks empty slots */
+        c.names[i] = malloc(24);
+        if (!c.names[i]) { perror("malloc"); exit(1); }
+        snprintf(c.names[i], 24, "entity-%016llx", (unsigned long long)c.keys[i]);
+    }
+
+    if (bench_selected("u64_map")) {
+        c.u64 = u64_map_create(16);
+        bench_measure("u64_map/put",    1, c.n, u64_put, &c);
+        bench_measure("u64_map/get",    1, c.n, u64_get, &c);
+        bench_measure("u64_map/remove", 1, c.n, u64_remove, &c);
+        u64_map_destroy(c.u64);
+
+        c.u64 = u64_map_create(16);
+        u64_map_reserve(c.u64, c.n);
+        bench_measure("u64_map/put_reserved", 1, c.n, u64_put, &c);
+        u64_map_destroy(c.u64);
+    }
+
+    if (bench_selected("str_map")) {
+        c.str = str_map_create(16);
+        bench_measure("str_map/put",    1, c.n, str_put, &c);
+        bench_measure("str_map/get",    1, c.n, str_get, &c);
+        bench_measure("str_map/remove", 1, c.n, str_remove, &c);
+        str_map_destroy(c.str);
+    }
+
+    if (bench_selected("arena")) {
+        static const size_t sizes[] = { 16, 64, 256 };
+        for (size_t k = 0; k < sizeof sizes / sizeof *sizes; k++) {
+            char name[48];
+            snprintf(name, sizeof name, "arena_alloc/%zu", sizes[k]);
+            arena_init(&c.arena, 1 << 16);
+            c.allocSize = sizes[k];
+            bench_measure(name, 1, c.n, arena_op, &c);
+            arena_destroy(&c.arena);
+        }
+    }
+
+    for (size_t i = 0; i < c.n; i++) free(c.names[i]);
+    free(c.names);
+    free(c.keys);
+}
@@ -0,0 +1,57 @@
+#include "bench.h"
+
+#include <stdlib.h>
+
+static bench_edges edges_alloc(size_t n) {
+    bench_edges e = { n, malloc(n * sizeof(uint32_t)), malloc(n * sizeof(uint32_t)) };
+    if (!e.src || !e.tgt) { perror("malloc"); exit(1); }
+    return e;
+}
+
+/* Each edge picks one quadrant of the adjacency matrix per bit of scale,
+ * with probabilities a, b, c and 1 - a - b - c. */
+bench_edges gen_rmat(int scale, size_t edges, uint64_t seed) {
+    const uint64_t A = (uint64_t)(0.57 * 4294967296.0);
+    const uint64_t B = (uint64_t)(0.19 * 4294967296.0);
+    const uint64_t C = (uint64_t)(0.19 * 4294967296.0);
+    uint64_t s = seed | 1;
+    bench_edges e = edges_alloc(edges);
+    for (size_t i = 0; i < edges; i++) {
+        uint32_t u = 0, v = 0;
+        for (int bit = 0; bit < scale; bit++) {
+            uint64_t r = bench_rand(&s) >> 32;
+            u <<= 1;
+            v <<= 1;
+            if (r >= A + B + C) {
+                u |= 1;
+                v |= 1;
+            } else if (r >= A + B) {
+                u |= 1;
+            } else if (r >= A) {
+                v |= 1;
+            }
+        }
+        e.src[i] = u;
+        e.tgt[i] = v;
+    }
+    return e;
+}
+
+bench_edges gen_uniform(int scale, size_t edges, uint64_t seed) {
+    uint64_t s = seed | 1;
+    uint32_t mask = (uint32_t)((1ull << scale) - 1);
+    bench_edges e = edges_alloc(edges);
+    for (size_t i = 0; i < edges; i++) {
+        uint64_t r = bench_rand(&s);
+        e.src[i] = (uint32_t)r & mask;
+        e.tgt[i] = (uint32_t)(r >> 32) & mask;
+    }
+    return e;
+}
+
+void bench_edges_free(bench_edges *e) {
+    free(e->src);
+    free(e->tgt);
+    e->src = e->tgt = NULL;
+    e->count = 0;
+}
@@ -0,0 +1,216 @@
+#include "bench.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+bench_config bench_cfg;
+
+typedef struct {
+    char     name[96];
+    unsigned threads;
+    size_t   ops;
+    double   nsPerOp;       /* wall time over all ops */
+    double   p50, p90, p99; /* per-op latency, from batch means */
+    double   opsPerSec;
+    double   mbPerSec;      /* 0 when not a throughput benchmark */
+} bench_result;
+
+static bench_result *results;
+static size_t        resultCount, resultCap;
+
+static const char *const *filters;
+static int                filterCount;
+
+void bench_set_filters(const char *const *names, int n) {
+    filters = names;
+    filterCount = n;
+}
+
+bool bench_selected(const char *name) {
+    if (filterCount == 0) return true;
+    for (int i = 0; i < filterCount; i++)
+        if (strstr(name, filters[i])) return true;
+    return false;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, size_t n, double p) {
+    if (n == 0) return 0;
+    size_t i = (size_t)(p * (double)(n - 1) + 0.5);
+    return sorted[i < n ? i : n - 1];
+}
+
+static void record(const char *name, unsigned threads, size_t ops, uint64_t wallNs,
+                   double *samples, size_t nSamples, size_t bytes) {
+    if (resultCount == resultCap) {
+        size_t cap = resultCap ? resultCap * 2 : 64;
+        bench_result *r = realloc(results, cap * sizeof *r);
+        if (!r) { perror("realloc"); exit(1); }
+        results = r;
+        resultCap = cap;
+    }
+    qsort(samples, nSamples, sizeof *samples, cmp_double);
+
+    bench_result *r = &results[resultCount++];
+    memset(r, 0, sizeof *r);
+    snprintf(r->name, sizeof r->name, "%s", name);
+    r->threads   = threads;
+    r->ops       = ops;
+    r->nsPerOp   = ops ? (double)wallNs / (double)ops : 0;
+    r->p50       = percentile(samples, nSamples, 0.50);
+    r->p90       = percentile(samples, nSamples, 0.90);
+    r->p99       = percentile(samples, nSamples, 0.99);
+    r->opsPerSec = wallNs ? (double)ops * 1e9 / (double)wallNs : 0;
+    if (bytes && wallNs)
+        r->mbPerSec = (double)bytes / (1024.0 * 1024.0) * 1e9 / (double)wallNs;
+
+    fprintf(stderr, "%-36s %3u thr %10zu ops %10.1f ns/op  p50 %8.1f  p99 %8.1f",
+            r->name, threads, ops, r->nsPerOp, r->p50, r->p99);
+    if (r->mbPerSec) fprintf(stderr, "  %8.1f MB/s", r->mbPerSec);
+    fputc('\n', stderr);
+}
+
+typedef struct {
+    bench_op            op;
+    void               *ctx;
+    size_t              from, to;
+    unsigned            thread;
+    pthread_barrier_t  *start;
+    double             *samples;
+    size_t              nSamples;
+    uint64_t            began, ended;
+} worker;
+
+static void *run_worker(void *arg) {
+    worker *w = arg;
+    if (w->start) pthread_barrier_wait(w->start);
+    w->began = now_ns();
+    for (size_t i = w->from; i < w->to; ) {
+        size_t end = i + BENCH_BATCH < w->to ? i + BENCH_BATCH : w->to;
+        uint64_t t0 = now_ns();
+        for (size_t j = i; j < end; j++) w->op(w->ctx, j, w->thread);
+        w->samples[w->nSamples++] = (double)(now_ns() - t0) / (double)(end - i);
+        i = end;
+    }
+    w->ended = now_ns();
+    return NULL;
+}
+
+void bench_measure(const char *name, unsigned threads, size_t ops, bench_op op, void *ctx) {
+    if (threads == 0) threads = 1;
+    worker *ws = calloc(threads, sizeof *ws);
+    double *samples = malloc((ops / BENCH_BATCH + threads + 1) * sizeof *samples);
+    pthread_t *tids = calloc(threads, sizeof *tids);
+    if (!ws || !samples || !tids) { perror("malloc"); exit(1); }
+
+    pthread_barrier_t start;
+    if (threads > 1) pthread_barrier_init(&start, NULL, threads + 1);
+
+    size_t off = 0;
+    for (unsigned t = 0; t < threads; t++) {
+        size_t n = ops / threads + (t < ops % threads);
+        ws[t] = (worker){ .op = op, .ctx = ctx, .from = off, .to = off + n, .thread = t,
+                          .start = threads > 1 ? &start : NULL,
+                          .samples = samples + off / BENCH_BATCH + t };
+        off += n;
+    }
+
+    if (threads == 1) {
+        run_worker(&ws[0]);
+    } else {
+        for (unsigned t = 0; t < threads; t++)
+            if (pthread_create(&tids[t], NULL, run_worker, &ws[t]) != 0) {
+                perror("pthread_create");
+                exit(1);
+            }
+        pthread_barrier_wait(&start);
+        for (unsigned t = 0; t < threads; t++) pthread_join(tids[t], NULL);
+        pthread_barrier_destroy(&start);
+    }
+    /* The workers' own clocks: the caller may not run again until they
+     * are done. */
+    uint64_t began = ws[0].began, ended = ws[0].ended;
+    for (unsigned t = 1; t < threads; t++) {
+        if (ws[t].began < began) began = ws[t].began;
+        if (ws[t].ended > ended) ended = ws[t].ended;
+    }
+    uint64_t wall = ended - began;
+
+    /* Each worker's samples sit in its own stretch of the array; pack them. */
+    size_t n = 0;
+    for (unsigned t = 0; t < threads; t++) {
+        memmove(samples + n, ws[t].samples, ws[t].nSamples * sizeof *samples);
+        n += ws[t].nSamples;
+    }
+    record(name, threads, ops, wall, samples, n, 0);
+    free(samples);
+    free(ws);
+    free(tids);
+}
+
+void bench_time(const char *name, unsigned threads, size_t units, size_t bytes,
+                bench_fn fn, bench_fn after, void *ctx) {
+    int reps = bench_cfg.reps > 0 ? bench_cfg.reps : 1;
+    double *samples = malloc((size_t)reps * sizeof *samples);
+    if (!samples) { perror("malloc"); exit(1); }
+
+    uint64_t total = 0;
+    for (int r = 0; r < reps; r++) {
+        uint64_t t0 = now_ns();
+        fn(ctx);
+        uint64_t dt = now_ns() - t0;
+        if (after) after(ctx);
+        total += dt;
+        samples[r] = units ? (double)dt / (double)units : (double)dt;
+    }
+    record(name, threads, units * (size_t)reps, total, samples, (size_t)reps,
+           bytes * (size_t)reps);
+    free(samples);
+}
+
+static void json_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fputc('\\', out);
+        if ((unsigned char)*s < 0x20) fprintf(out, "\\u%04x", *s);
+        else fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+void bench_write_json(FILE *out, const char *commit) {
+    fprintf(out, "{\n  \"commit\": ");
+    if (commit && *commit) json_string(out, commit);
+    else fputs("null", out);
+    fprintf(out, ",\n  \"config\": {\"scale\": %d, \"edge_factor\": %d, \"max_threads\": %u, "
+                 "\"reps\": %d, \"seed\": %llu, \"batch\": %d},\n  \"results\": [",
+            bench_cfg.scale, bench_cfg.edgeFactor, bench_cfg.maxThreads, bench_cfg.reps,
+            (unsigned long long)bench_cfg.seed, BENCH_BATCH);
+    for (size_t i = 0; i < resultCount; i++) {
+        const bench_result *r = &results[i];
+        fprintf(out, "%s\n    {\"name\": ", i ? "," : "");
+        json_string(out, r->name);
+        fprintf(out, ", \"threads\": %u, \"ops\": %zu, \"ns_per_op\": %.2f, "
+                     "\"p50_ns\": %.2f, \"p90_ns\": %.2f, \"p99_ns\": %.2f, "
+                     "\"ops_per_sec\": %.0f",
+                r->threads, r->ops, r->nsPerOp, r->p50, r->p90, r->p99, r->opsPerSec);
+        if (r->mbPerSec) fprintf(out, ", \"mb_per_sec\": %.1f", r->mbPerSec);
+        fputc('}', out);
+    }
+    fprintf(out, "\n  ]\n}\n");
+    free(results);
+    results = NULL;
+    resultCount = resultCap = 0;
+}
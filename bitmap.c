@@ -0,0 +1,576 @@
+#include "bitmap.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CONT_IS_BITSET(c)  ((c)->cap == 0)
+
+static uint32_t words_popcount(const uint64_t *w) {
+    uint32_t card = 0;
+    for (size_t i = 0; i < ID_BITMAP_WORDS; i++)
+        card += (uint32_t)__builtin_popcountll(w[i]);
+    return card;
+}
+
+void id_bitmap_check(const id_bitmap *b) {
+    assert(b);
+    assert(b->count <= b->cap);
+    for (size_t i = 0; i < b->count; i++) {
+        const id_container *c = &b->containers[i];
+        assert(c->card > 0);
+        if (i) assert(b->containers[i-1].key < c->key);
+        if (CONT_IS_BITSET(c)) {
+            assert(words_popcount(c->u.words) == c->card);
+        } else {
+            assert(c->card <= c->cap);
+            for (uint32_t j = 1; j < c->card; j++)
+                assert(c->u.array[j-1] < c->u.array[j]);
+        }
+    }
+}
+
+static void cont_free(id_container *c) {
+    if (CONT_IS_BITSET(c)) free(c->u.words);
+    else                   free(c->u.array);
+}
+
+static int cont_init_array(id_container *c, uint64_t key, uint32_t cap) {
+    c->key     = key;
+    c->card    = 0;
+    c->cap     = cap ? cap : 1;
+    c->u.array = malloc(c->cap * sizeof *c->u.array);
+    return c->u.array ? 0 : -1;
+}
+
+static int cont_init_bitset(id_container *c, uint64_t key) {
+    c->key     = key;
+    c->card    = 0;
+    c->cap     = 0;
+    c->u.words = calloc(ID_BITMAP_WORDS, sizeof *c->u.words);
+    return c->u.words ? 0 : -1;
+}
+
+static int cont_to_bitset(id_container *c) {
+    uint64_t *w = calloc(ID_BITMAP_WORDS, sizeof *w);
+    if (!w) return -1;
+    for (uint32_t i = 0; i < c->card; i++) {
+        uint16_t v = c->u.array[i];
+        w[v >> 6] |= 1ULL << (v & 63);
+    }
+    free(c->u.array);
+    c->u.words = w;
+    c->cap     = 0;
+    return 0;
+}
+
+static int cont_to_array(id_container *c) {
+    uint32_t  cap = c->card ? c->card : 1;
+    uint16_t *a   = malloc(cap * sizeof *a);
+    uint32_t  n   = 0;
+    if (!a) return -1;
+    for (uint32_t i = 0; i < ID_BITMAP_WORDS; i++) {
+        uint64_t w = c->u.words[i];
+        while (w) {
+            a[n++] = (uint16_t)(i * 64 + (uint32_t)__builtin_ctzll(w));
+            w &= w - 1;
+        }
+    }
+    free(c->u.words);
+    c->u.array = a;
+    c->cap     = cap;
+    return 0;
+}
+
+/* Switches to the cheaper representation after card changed in bulk. */
+static int cont_normalize(id_container *c) {
+    if (CONT_IS_BITSET(c) && c->card <= ID_BITMAP_ARRAY_MAX) return cont_to_array(c);
+    if (!CONT_IS_BITSET(c) && c->card > ID_BITMAP_ARRAY_MAX) return cont_to_bitset(c);
+    return 0;
+}
+
+static int cont_copy(const id_container *src, id_container *dst) {
+    *dst = *src;
+    if (CONT_IS_BITSET(src)) {
+        dst->u.words = malloc(ID_BITMAP_WORDS * sizeof *dst->u.words);
+        if (!dst->u.words) return -1;
+        memcpy(dst->u.words, src->u.words, ID_BITMAP_WORDS * sizeof *dst->u.words);
+    } else {
+        dst->cap     = src->card ? src->card : 1;
+        dst->u.array = malloc(dst->cap * sizeof *dst->u.array);
+        if (!dst->u.array) return -1;
+        memcpy(dst->u.array, src->u.array, src->card * sizeof *dst->u.array);
+    }
+    return 0;
+}
+
+static uint32_t array_lower_bound(const uint16_t *a, uint32_t n, uint16_t v) {
+    uint32_t lo = 0, hi = n;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) >> 1;
+        if (a[mid] < v) lo = mid + 1;
+        else            hi = mid;
+    }
+    return lo;
+}
+
+static int cont_contains(const id_container *c, uint16_t low) {
+    if (CONT_IS_BITSET(c))
+        return (c->u.words[low >> 6] >> (low & 63)) & 1;
+    uint32_t pos = array_lower_bound(c->u.array, c->card, low);
+    return pos < c->card && c->u.array[pos] == low;
+}
+
+/* Set operations on a single pair of containers with the same key.  The
+ * result is written to out, which may end up empty (card == 0). */
+
+static int cont_and(const id_container *a, const id_container *b, id_container *out) {
+    if (CONT_IS_BITSET(a) && CONT_IS_BITSET(b)) {
+        if (cont_init_bitset(out, a->key) < 0) return -1;
+        for (size_t i = 0; i < ID_BITMAP_WORDS; i++)
+            out->u.words[i] = a->u.words[i] & b->u.words[i];
+        out->card = words_popcount(out->u.words);
+        return cont_normalize(out);
+    }
+    if (CONT_IS_BITSET(a)) {
+        const id_container *t = a; a = b; b = t;
+    }
+    if (cont_init_array(out, a->key, a->card) < 0) return -1;
+    if (CONT_IS_BITSET(b)) {
+        for (uint32_t i = 0; i < a->card; i++) {
+            uint16_t v = a->u.array[i];
+            if ((b->u.words[v >> 6] >> (v & 63)) & 1)
+                out->u.array[out->card++] = v;
+        }
+        return 0;
+    }
+    {
+        uint32_t i = 0, j = 0;
+        while (i < a->card && j < b->card) {
+            uint16_t x = a->u.array[i], y = b->u.array[j];
+            if (x < y)      i++;
+            else if (y < x) j++;
+            else { out->u.array[out->card++] = x; i++; j++; }
+        }
+    }
+    return 0;
+}
+
+static int cont_or(const id_container *a, const id_container *b, id_container *out) {
+    if (CONT_IS_BITSET(a) || CONT_IS_BITSET(b)) {
+        if (CONT_IS_BITSET(b)) {
+            const id_container *t = a; a = b; b = t;
+        }
+        if (cont_copy(a, out) < 0) return -1;
+        if (CONT_IS_BITSET(b)) {
+            for (size_t i = 0; i < ID_BITMAP_WORDS; i++)
+                out->u.words[i] |= b->u.words[i];
+        } else {
+            for (uint32_t i = 0; i < b->card; i++) {
+                uint16_t v = b->u.array[i];
+                out->u.words[v >> 6] |= 1ULL << (v & 63);
+            }
+        }
+        out->card = words_popcount(out->u.words);
+        return 0;
+    }
+    if (cont_init_array(out, a->key, a->card + b->card) < 0) return -1;
+    {
+        uint32_t i = 0, j = 0;
+        while (i < a->card || j < b->card) {
+            uint16_t v;
+            if (j == b->card || (i < a->card && a->u.array[i] < b->u.array[j])) {
+                v = a->u.array[i++];
+            } else if (i == a->card || b->u.array[j] < a->u.array[i]) {
+                v = b->u.array[j++];
+            } else {
+                v = a->u.array[i++];
+                j++;
+            }
+            out->u.array[out->card++] = v;
+        }
+    }
+    return cont_normalize(out);
+}
+
+static int cont_andnot(const id_container *a, const id_container *b, id_container *out) {
+    if (CONT_IS_BITSET(a)) {
+        if (cont_copy(a, out) < 0) return -1;
+        if (CONT_IS_BITSET(b)) {
+            for (size_t i = 0; i < ID_BITMAP_WORDS; i++)
+                out->u.words[i] &= ~b->u.words[i];
+        } else {
+            for (uint32_t i = 0; i < b->card; i++) {
+                uint16_t v = b->u.array[i];
+                out->u.words[v >> 6] &= ~(1ULL << (v & 63));
+            }
+        }
+        out->card = words_popcount(out->u.words);
+        return cont_normalize(out);
+    }
+    if (cont_init_array(out, a->key, a->card) < 0) return -1;
+    if (CONT_IS_BITSET(b)) {
+        for (uint32_t i = 0; i < a->card; i++) {
+            uint16_t v = a->u.array[i];
+            if (!((b->u.words[v >> 6] >> (v & 63)) & 1))
+                out->u.array[out->card++] = v;
+        }
+        return 0;
+    }
+    {
+        uint32_t i = 0, j = 0;
+        while (i < a->card) {
+            uint16_t x = a->u.array[i];
+            while (j < b->card && b->u.array[j] < x) j++;
+            if (j == b->card || b->u.array[j] != x)
+                out->u.array[out->card++] = x;
+            i++;
+        }
+    }
+    return 0;
+}
+
+static uint32_t cont_and_card(const id_container *a, const id_container *b) {
+    uint32_t card = 0;
+    if (CONT_IS_BITSET(a) && CONT_IS_BITSET(b)) {
+        for (size_t i = 0; i < ID_BITMAP_WORDS; i++)
+            card += (uint32_t)__builtin_popcountll(a->u.words[i] & b->u.words[i]);
+        return card;
+    }
+    if (CONT_IS_BITSET(a)) {
+        const id_container *t = a; a = b; b = t;
+    }
+    if (CONT_IS_BITSET(b)) {
+        for (uint32_t i = 0; i < a->card; i++) {
+            uint16_t v = a->u.array[i];
+            card += (uint32_t)((b->u.words[v >> 6] >> (v & 63)) & 1);
+        }
+        return card;
+    }
+    {
+        uint32_t i = 0, j = 0;
+        while (i < a->card && j < b->card) {
+            uint16_t x = a->u.array[i], y = b->u.array[j];
+            if (x < y)      i++;
+            else if (y < x) j++;
+            else { card++; i++; j++; }
+        }
+    }
+    return card;
+}
+
+static size_t bitmap_lower_bound(const id_bitmap *b, uint64_t key) {
+    size_t lo = 0, hi = b->count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) >> 1;
+        if (b->containers[mid].key < key) lo = mid + 1;
+        else                              hi = mid;
+    }
+    return lo;
+}
+
+static int bitmap_reserve(id_bitmap *b, size_t need) {
+    if (need <= b->cap) return 0;
+    size_t newcap = b->cap ? b->cap * 2 : 4;
+    while (newcap < need) newcap *= 2;
+    id_container *nc = realloc(b->containers, newcap * sizeof *nc);
+    if (!nc) return -1;
+    b->containers = nc;
+    b->cap        = newcap;
+    return 0;
+}
+
+/* Inserts c at position i, taking ownership of its storage. */
+static int bitmap_insert_at(id_bitmap *b, size_t i, const id_container *c) {
+    if (bitmap_reserve(b, b->count + 1) < 0) return -1;
+    memmove(&b->containers[i + 1], &b->containers[i],
+            (b->count - i) * sizeof *b->containers);
+    b->containers[i] = *c;
+    b->count++;
+    return 0;
+}
+
+/* Appends a result container, dropping it if it came out empty. */
+static int bitmap_push(id_bitmap *b, id_container *c) {
+    if (c->card == 0) {
+        cont_free(c);
+        return 0;
+    }
+    if (bitmap_insert_at(b, b->count, c) < 0) {
+        cont_free(c);
+        return -1;
+    }
+    return 0;
+}
+
+static void bitmap_remove_at(id_bitmap *b, size_t i) {
+    cont_free(&b->containers[i]);
+    memmove(&b->containers[i], &b->containers[i + 1],
+            (b->count - i - 1) * sizeof *b->containers);
+    b->count--;
+}
+
+id_bitmap *id_bitmap_create(void) {
+    id_bitmap *b = malloc(sizeof *b);
+    if (!b) return NULL;
+    b->count      = 0;
+    b->cap        = 0;
+    b->containers = NULL;
+    return b;
+}
+
+id_bitmap *id_bitmap_copy(const id_bitmap *src) {
+    id_bitmap *b = id_bitmap_create();
+    if (!b) return NULL;
+    if (bitmap_reserve(b, src->count) < 0) {
+        id_bitmap_destroy(b);
+        return NULL;
+    }
+    for (size_t i = 0; i < src->count; i++) {
+        if (cont_copy(&src->containers[i], &b->containers[i]) < 0) {
+            id_bitmap_destroy(b);
+            return NULL;
+        }
+        b->count++;
+    }
+    return b;
+}
+
+void id_bitmap_destroy(id_bitmap *b) {
+    if (!b) return;
+    for (size_t i = 0; i < b->count; i++)
+        cont_free(&b->containers[i]);
+    free(b->containers);
+    free(b);
+}
+
+int id_bitmap_add(id_bitmap *b, uint64_t id) {
+    uint64_t key = id >> 16;
+    uint16_t low = (uint16_t)id;
+    size_t   i   = bitmap_lower_bound(b, key);
+
+    if (i == b->count || b->containers[i].key != key) {
+        id_container c;
+        if (cont_init_array(&c, key, 4) < 0) return -1;
+        if (bitmap_insert_at(b, i, &c) < 0) {
+            cont_free(&c);
+            return -1;
+        }
+    }
+
+    id_container *c = &b->containers[i];
+    if (!CONT_IS_BITSET(c)) {
+        uint32_t pos = array_lower_bound(c->u.array, c->card, low);
+        if (pos < c->card && c->u.array[pos] == low) return 0;
+        if (c->card < ID_BITMAP_ARRAY_MAX) {
+            if (c->card == c->cap) {
+                uint32_t  newcap = c->cap * 2 < ID_BITMAP_ARRAY_MAX
+                                 ? c->cap * 2 : ID_BITMAP_ARRAY_MAX;
+                uint16_t *na     = realloc(c->u.array, newcap * sizeof *na);
+                if (!na) return -1;
+                c->u.array = na;
+                c->cap     = newcap;
+            }
+            memmove(&c->u.array[pos + 1], &c->u.array[pos],
+                    (c->card - pos) * sizeof *c->u.array);
+            c->u.array[pos] = low;
+            c->card++;
+            return 0;
+        }
+        if (cont_to_bitset(c) < 0) return -1;
+    }
+    {
+        uint64_t bit = 1ULL << (low & 63);
+        if (!(c->u.words[low >> 6] & bit)) {
+            c->u.words[low >> 6] |= bit;
+            c->card++;
+        }
+    }
+    return 0;
+}
+
+int id_bitmap_remove(id_bitmap *b, uint64_t id) {
+    uint64_t key = id >> 16;
+    uint16_t low = (uint16_t)id;
+    size_t   i   = bitmap_lower_bound(b, key);
+    if (i == b->count || b->containers[i].key != key) return -1;
+
+    id_container *c = &b->containers[i];
+    if (CONT_IS_BITSET(c)) {
+        uint64_t bit = 1ULL << (low & 63);
+        if (!(c->u.words[low >> 6] & bit)) return -1;
+        c->u.words[low >> 6] &= ~bit;
+        c->card--;
+        /* a failed shrink leaves a valid bitset behind */
+        if (c->card && c->card <= ID_BITMAP_ARRAY_MAX) (void)cont_to_array(c);
+    } else {
+        uint32_t pos = array_lower_bound(c->u.array, c->card, low);
+        if (pos == c->card || c->u.array[pos] != low) return -1;
+        memmove(&c->u.array[pos], &c->u.array[pos + 1],
+                (c->card - pos - 1) * sizeof *c->u.array);
+        c->card--;
+    }
+    if (c->card == 0) bitmap_remove_at(b, i);
+    return 0;
+}
+
+bool id_bitmap_contains(const id_bitmap *b, uint64_t id) {
+    uint64_t key = id >> 16;
+    size_t   i   = bitmap_lower_bound(b, key);
+    if (i == b->count || b->containers[i].key != key) return false;
+    return cont_contains(&b->containers[i], (uint16_t)id);
+}
+
+uint64_t id_bitmap_cardinality(const id_bitmap *b) {
+    uint64_t card = 0;
+    for (size_t i = 0; i < b->count; i++)
+        card += b->containers[i].card;
+    return card;
+}
+
+id_bitmap *id_bitmap_and(const id_bitmap *a, const id_bitmap *b) {
+    id_bitmap *r = id_bitmap_create();
+    size_t     i = 0, j = 0;
+    if (!r) return NULL;
+    while (i < a->count && j < b->count) {
+        const id_container *x = &a->containers[i], *y = &b->containers[j];
+        if (x->key < y->key)      i++;
+        else if (y->key < x->key) j++;
+        else {
+            id_container c;
+            if (cont_and(x, y, &c) < 0 || bitmap_push(r, &c) < 0) goto oom;
+            i++; j++;
+        }
+    }
+    id_bitmap_check(r);
+    return r;
+
+ oom:
+    id_bitmap_destroy(r);
+    return NULL;
+}
+
+id_bitmap *id_bitmap_or(const id_bitmap *a, const id_bitmap *b) {
+    id_bitmap *r = id_bitmap_create();
+    size_t     i = 0, j = 0;
+    if (!r || bitmap_reserve(r, a->count + b->count) < 0) goto oom;
+    while (i < a->count || j < b->count) {
+        id_container c;
+        int rc;
+        if (j == b->count || (i < a->count && a->containers[i].key < b->containers[j].key)) {
+            rc = cont_copy(&a->containers[i++], &c);
+        } else if (i == a->count || b->containers[j].key < a->containers[i].key) {
+            rc = cont_copy(&b->containers[j++], &c);
+        } else {
+            rc = cont_or(&a->containers[i++], &b->containers[j++], &c);
+        }
+        if (rc < 0 || bitmap_push(r, &c) < 0) goto oom;
+    }
+    id_bitmap_check(r);
+    return r;
+
+ oom:
+    id_bitmap_destroy(r);
+    return NULL;
+}
+
+id_bitmap *id_bitmap_andnot(const id_bitmap *a, const id_bitmap *b) {
+    id_bitmap *r = id_bitmap_create();
+    size_t     i = 0, j = 0;
+    if (!r) return NULL;
+    while (i < a->count) {
+        const id_container *x = &a->containers[i];
+        id_container c;
+        int rc;
+        while (j < b->count && b->containers[j].key < x->key) j++;
+        if (j < b->count && b->containers[j].key == x->key)
+            rc = cont_andnot(x, &b->containers[j], &c);
+        else
+            rc = cont_copy(x, &c);
+        if (rc < 0 || bitmap_push(r, &c) < 0) goto oom;
+        i++;
+    }
+    id_bitmap_check(r);
+    return r;
+
+ oom:
+    id_bitmap_destroy(r);
+    return NULL;
+}
+
+int id_bitmap_or_into(id_bitmap *dst, const id_bitmap *src) {
+    for (size_t j = 0; j < src->count; j++) {
+        const id_container *y = &src->containers[j];
+        size_t       i = bitmap_lower_bound(dst, y->key);
+        id_container c;
+        if (i < dst->count && dst->containers[i].key == y->key) {
+            if (cont_or(&dst->containers[i], y, &c) < 0) return -1;
+            cont_free(&dst->containers[i]);
+            dst->containers[i] = c;
+        } else {
+            if (cont_copy(y, &c) < 0) return -1;
+            if (bitmap_insert_at(dst, i, &c) < 0) {
+                cont_free(&c);
+                return -1;
+            }
+        }
+    }
+    id_bitmap_check(dst);
+    return 0;
+}
+
+uint64_t id_bitmap_and_cardinality(const id_bitmap *a, const id_bitmap *b) {
+    uint64_t card = 0;
+    size_t   i = 0, j = 0;
+    while (i < a->count && j < b->count) {
+        const id_container *x = &a->containers[i], *y = &b->containers[j];
+        if (x->key < y->key)      i++;
+        else if (y->key < x->key) j++;
+        else { card += cont_and_card(x, y); i++; j++; }
+    }
+    return card;
+}
+
+int id_bitmap_foreach(const id_bitmap *b, id_bitmap_callback cb, void *userData) {
+    for (size_t i = 0; i < b->count; i++) {
+        const id_container *c    = &b->containers[i];
+        uint64_t            base = c->key << 16;
+        int                 rc;
+        if (CONT_IS_BITSET(c)) {
+            for (uint32_t k = 0; k < ID_BITMAP_WORDS; k++) {
+                uint64_t w = c->u.words[k];
+                while (w) {
+                    rc = cb(base | (k * 64 + (uint32_t)__builtin_ctzll(w)), userData);
+                    if (rc) return rc;
+                    w &= w - 1;
+                }
+            }
+        } else {
+            for (uint32_t k = 0; k < c->card; k++) {
+                rc = cb(base | c->u.array[k], userData);
+                if (rc) return rc;
+            }
+        }
+    }
+    return 0;
+}
+
+size_t id_bitmap_to_array(const id_bitmap *b, uint64_t *out, size_t max) {
+    size_t n = 0;
+    for (size_t i = 0; i < b->count && n < max; i++) {
+        const id_container *c    = &b->containers[i];
+        uint64_t            base = c->key << 16;
+        if (CONT_IS_BITSET(c)) {
+            for (uint32_t k = 0; k < ID_BITMAP_WORDS && n < max; k++) {
+                uint64_t w = c->u.words[k];
+                while (w && n < max) {
+                    out[n++] = base | (k * 64 + (uint32_t)__builtin_ctzll(w));
+                    w &= w - 1;
+                }
+            }
+        } else {
+            for (uint32_t k = 0; k < c->card && n < max; k++)
+                out[n++] = base | c->u.array[k];
+        }
+    }
+    return n;
+}
@@ -0,0 +1,57 @@
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Roaring-style compressed set of 64-bit ids.  The upper 48 bits of an id
+ * select a container, the low 16 bits are stored in it: as a sorted uint16
+ * array while the container is sparse, as a 65536-bit bitset once it holds
+ * more than ID_BITMAP_ARRAY_MAX ids. */
+
+#define ID_BITMAP_ARRAY_MAX  4096
+#define ID_BITMAP_WORDS      1024
+
+typedef struct {
+    uint64_t  key;       /* id >> 16 */
+    uint32_t  card;
+    uint32_t  cap;       /* array capacity, 0 when the container is a bitset */
+    union {
+        uint16_t *array;
+        uint64_t *words;
+    } u;
+} id_container;
+
+typedef struct {
+    size_t        count;
+    size_t        cap;
+    id_container *containers;   /* sorted by key */
+} id_bitmap;
+
+typedef int (*id_bitmap_callback)(uint64_t id, void *userData);
+
+/* Asserts the invariants above; does nothing under NDEBUG. */
+void       id_bitmap_check(const id_bitmap *b);
+
+id_bitmap *id_bitmap_create(void);
+id_bitmap *id_bitmap_copy(const id_bitmap *b);
+void       id_bitmap_destroy(id_bitmap *b);
+
+int        id_bitmap_add(id_bitmap *b, uint64_t id);
+int        id_bitmap_remove(id_bitmap *b, uint64_t id);
+bool       id_bitmap_contains(const id_bitmap *b, uint64_t id);
+uint64_t   id_bitmap_cardinality(const id_bitmap *b);
+
+id_bitmap *id_bitmap_and(const id_bitmap *a, const id_bitmap *b);
+id_bitmap *id_bitmap_or(const id_bitmap *a, const id_bitmap *b);
+id_bitmap *id_bitmap_andnot(const id_bitmap *a, const id_bitmap *b);
+int        id_bitmap_or_into(id_bitmap *dst, const id_bitmap *src);
+uint64_t   id_bitmap_and_cardinality(const id_bitmap *a, const id_bitmap *b);
+
+/* Visits ids in ascending order; a non-zero return from cb stops the walk
+ * and is returned. */
+int        id_bitmap_foreach(const id_bitmap *b, id_bitmap_callback cb, void *userData);
+size_t     id_bitmap_to_array(const id_bitmap *b, uint64_t *out, size_t max);
+
+#endif /* BITMAP_H */
@@ -0,0 +1,123 @@
+#include "brlock.h"
+#include <assert.h>
+#include <time.h>
+#include <sched.h>
+#include <stdbool.h>
+
+static _Atomic(const br_lock *) br_table[BR_TABLE_SIZE];
+
+/* Per-thread record of held read locks.  slot is the visible-readers slot
+ * or BR_SLOW for the rwlock path; nested counts the times the thread took
+ * the lock again while holding it, which only bumps the count: re-taking
+ * the rwlock could deadlock behind a writer that is draining this
+ * thread's own slot.  A thread holding BR_MAX_HELD other locks takes the
+ * rwlock without a record, and an unlock that finds none releases it. */
+#define BR_SLOW    (-1)
+
+static _Thread_local struct {
+    const br_lock *lock;
+    int            slot;
+    int            nested;
+} br_held[BR_MAX_HELD];
+static _Thread_local int  br_depth;
+static _Thread_local char br_self;   /* its address identifies the thread */
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int br_slot(const br_lock *l) {
+    uint64_t h = ((uintptr_t)&br_self ^ ((uintptr_t)l << 7)) * 11400714819323198485ULL;
+    return (int)(h >> 52) & (BR_TABLE_SIZE - 1);
+}
+
+static void br_push(const br_lock *l, int slot) {
+    assert(br_depth < BR_MAX_HELD);
+    br_held[br_depth].lock   = l;
+    br_held[br_depth].slot   = slot;
+    br_held[br_depth].nested = 0;
+    br_depth++;
+}
+
+int br_lock_init(br_lock *l) {
+    atomic_init(&l->rbias, 1);
+    atomic_init(&l->inhibitUntil, 0);
+    return pthread_rwlock_init(&l->rw, NULL);
+}
+
+void br_lock_destroy(br_lock *l) {
+    pthread_rwlock_destroy(&l->rw);
+}
+
+static int br_find(const br_lock *l) {
+    for (int i = br_depth - 1; i >= 0; i--)
+        if (br_held[i].lock == l) return i;
+    return -1;
+}
+
+void br_lock_rd(br_lock *l) {
+    int held = br_find(l);
+    if (held >= 0) {
+        br_held[held].nested++;
+        return;
+    }
+    if (br_depth == BR_MAX_HELD) {
+        pthread_rwlock_rdlock(&l->rw);
+        return;
+    }
+    if (atomic_load_explicit(&l->rbias, memory_order_relaxed)) {
+        int            slot = br_slot(l);
+        const br_lock *none = NULL;
+        if (atomic_compare_exchange_strong(&br_table[slot], &none, l)) {
+            /* seq_cst pairs with the writer clearing rbias before its scan */
+            if (atomic_load(&l->rbias)) {
+                br_push(l, slot);
+                return;
+            }
+            atomic_store(&br_table[slot], NULL);
+        }
+    }
+    pthread_rwlock_rdlock(&l->rw);
+    if (!atomic_load_explicit(&l->rbias, memory_order_relaxed) &&
+        now_ns() >= atomic_load_explicit(&l->inhibitUntil, memory_order_relaxed))
+        atomic_store(&l->rbias, 1);
+    br_push(l, BR_SLOW);
+}
+
+void br_unlock_rd(br_lock *l) {
+    int i = br_find(l);
+    if (i < 0) {
+        pthread_rwlock_unlock(&l->rw);
+        return;
+    }
+    if (br_held[i].nested) {
+        br_held[i].nested--;
+        return;
+    }
+    int slot = br_held[i].slot;
+    for (; i < br_depth - 1; i++) br_held[i] = br_held[i + 1];
+    br_depth--;
+
+    if (slot >= 0) atomic_store_explicit(&br_table[slot], NULL, memory_order_release);
+    else           pthread_rwlock_unlock(&l->rw);
+}
+
+void br_lock_wr(br_lock *l) {
+    pthread_rwlock_wrlock(&l->rw);
+    if (!atomic_load(&l->rbias)) return;
+
+    uint64_t start = now_ns();
+    atomic_store(&l->rbias, 0);
+    for (int i = 0; i < BR_TABLE_SIZE; i++) {
+        while (atomic_load(&br_table[i]) == l) sched_yield();
+    }
+    uint64_t now = now_ns();
+    atomic_store_explicit(&l->inhibitUntil, now + (now - start) * BR_INHIBIT_FACTOR,
+                          memory_order_relaxed);
+}
+
+void br_unlock_wr(br_lock *l) {
+    pthread_rwlock_unlock(&l->rw);
+}
@@ -0,0 +1,36 @@
+#ifndef BRLOCK_H
+#define BRLOCK_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+/* Reader-biased rwlock in the style of BRAVO.  While the lock is biased,
+ * a reader publishes itself in a slot of a global visible-readers table
+ * and never touches the shared rwlock, so concurrent readers do not
+ * bounce a cache line.  A writer revokes the bias, waits for the slots
+ * naming its lock to drain, and keeps the bias off for a while in
+ * proportion to how long the revocation took.
+ *
+ * Read locks may nest and be released in any order.  Past BR_MAX_HELD
+ * distinct read locks, a thread takes further ones on the rwlock. */
+
+#define BR_TABLE_SIZE      4096   /* visible-readers slots, shared by all locks */
+#define BR_MAX_HELD        32     /* read locks one thread tracks at once */
+#define BR_INHIBIT_FACTOR  9      /* bias stays off for N x the revocation time */
+
+typedef struct {
+    pthread_rwlock_t  rw;
+    _Atomic int       rbias;
+    _Atomic uint64_t  inhibitUntil;   /* monotonic ns */
+} br_lock;
+
+int  br_lock_init(br_lock *l);
+void br_lock_destroy(br_lock *l);
+
+void br_lock_rd(br_lock *l);
+void br_unlock_rd(br_lock *l);
+void br_lock_wr(br_lock *l);
+void br_unlock_wr(br_lock *l);
+
+#endif /* BRLOCK_H */
@@ -0,0 +1,312 @@
+#include "cache.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_SHARDS          16
+#define CACHE_STRIPES         (1u << 16)
+#define CACHE_DEFAULT_BUDGET  ((size_t)64 << 20)
+
+typedef struct {
+    uint32_t stripe, version;
+} cache_ver;
+
+typedef struct cache_entry {
+    struct cache_entry *next;       /* hash chain */
+    uint64_t            hash;
+    uint32_t            op;
+    uint32_t            ndeps;
+    size_t              keyLen;
+    size_t              ring;       /* slot in the shard's CLOCK ring */
+    bool                referenced;
+    bool                bitmap;
+    size_t              count, itemSize;
+    size_t              bytes;      /* everything the entry holds, for the budget */
+    void               *value;      /* items, or an id_bitmap */
+    cache_ver          *deps;       /* after the key */
+    uint64_t            key[];
+} cache_entry;
+
+typedef struct {
+    pthread_mutex_t  mu;
+    cache_entry    **buckets;
+    size_t           mask;          /* buckets - 1 */
+    cache_entry    **ring;
+    size_t           entries, ringCap, hand;
+    size_t           bytes, budget;
+    eavg_u64         hits, misses, invalidated, evicted, inserts;
+} cache_shard;
+
+struct eavgCache {
+    bool              filtered;
+    _Atomic uint32_t  versions[CACHE_STRIPES];
+    cache_shard       shards[CACHE_SHARDS];
+};
+
+static inline uint64_t cache_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t cache_hash(uint32_t op, const uint64_t *key, size_t words) {
+    uint64_t h = 0x9e3779b97f4a7c15ULL * (op + 1);
+    for (size_t i = 0; i < words; i++) h = (h ^ key[i]) * 0x9e3779b97f4a7c15ULL;
+    return cache_mix(h);
+}
+
+static inline uint32_t cache_stripe(int kind, eavg_u64 id) {
+    return (uint32_t)cache_mix(id * 2 + (uint64_t)kind) & (CACHE_STRIPES - 1);
+}
+
+eavgCache *cache_create(const eavgCacheOptions *opt) {
+    eavgCache *c = calloc(1, sizeof *c);
+    if (!c) return NULL;
+    size_t budget = opt && opt->budget ? opt->budget : CACHE_DEFAULT_BUDGET;
+    c->filtered = opt && opt->filtered;
+    for (size_t i = 0; i < CACHE_STRIPES; i++) atomic_init(&c->versions[i], 0);
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        cache_shard *s = &c->shards[i];
+        pthread_mutex_init(&s->mu, NULL);
+        s->budget = budget / CACHE_SHARDS;
+    }
+    return c;
+}
+
+static void entry_free(cache_entry *e) {
+    if (e->bitmap) id_bitmap_destroy(e->value);
+    else           free(e->value);
+    free(e);
+}
+
+void cache_destroy(eavgCache *c) {
+    if (!c) return;
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        cache_shard *s = &c->shards[i];
+        for (size_t j = 0; j < s->entries; j++) entry_free(s->ring[j]);
+        free(s->buckets);
+        free(s->ring);
+        pthread_mutex_destroy(&s->mu);
+    }
+    free(c);
+}
+
+bool cache_accepts(const eavgCache *c, eavgEdgeFilter filter) {
+    return c && (!filter || c->filtered);
+}
+
+void cache_bump(eavgCache *c, int kind, eavg_u64 id) {
+    if (!c) return;
+    atomic_fetch_add_explicit(&c->versions[cache_stripe(kind, id)], 1, memory_order_relaxed);
+}
+
+static inline cache_shard *shard_of(eavgCache *c, uint64_t hash) {
+    return &c->shards[hash >> 60];
+}
+
+static void shard_unlink(cache_shard *s, cache_entry *e) {
+    cache_entry **p = &s->buckets[e->hash & s->mask];
+    while (*p != e) p = &(*p)->next;
+    *p = e->next;
+    cache_entry *last = s->ring[--s->entries];
+    s->ring[e->ring] = last;
+    last->ring = e->ring;
+    s->bytes -= e->bytes;
+    entry_free(e);
+}
+
+static cache_entry *shard_find(cache_shard *s, uint64_t hash, uint32_t op,
+                               const void *key, size_t keyLen)
+{
+    if (!s->buckets) return NULL;
+    for (cache_entry *e = s->buckets[hash & s->mask]; e; e = e->next) {
+        if (e->hash == hash && e->op == op && e->keyLen == keyLen &&
+            memcmp(e->key, key, keyLen) == 0) return e;
+    }
+    return NULL;
+}
+
+static bool entry_fresh(eavgCache *c, const cache_entry *e) {
+    for (uint32_t i = 0; i < e->ndeps; i++) {
+        if (atomic_load_explicit(&c->versions[e->deps[i].stripe], memory_order_relaxed) !=
+            e->deps[i].version) return false;
+    }
+    return true;
+}
+
+bool cache_get(eavgCache *c, uint32_t op, const void *key, size_t keyLen,
+               void **out, size_t *count)
+{
+    uint64_t     hash = cache_hash(op, key, keyLen / 8);
+    cache_shard *s    = shard_of(c, hash);
+    bool         hit  = false;
+    pthread_mutex_lock(&s->mu);
+    cache_entry *e = shard_find(s, hash, op, key, keyLen);
+    if (e && !entry_fresh(c, e)) {
+        shard_unlink(s, e);
+        s->invalidated++;
+        e = NULL;
+    }
+    if (e) {
+        void *copy = NULL;
+        if (e->bitmap) {
+            copy = id_bitmap_copy(e->value);
+        } else if (e->count) {
+            copy = malloc(e->count * e->itemSize);
+            if (copy) memcpy(copy, e->value, e->count * e->itemSize);
+        }
+        hit = copy || (!e->bitmap && !e->count);
+        if (hit) {
+            e->referenced = true;
+            *out   = copy;
+            *count = e->count;
+        }
+    }
+    if (hit) s->hits++;
+    else     s->misses++;
+    pthread_mutex_unlock(&s->mu);
+    return hit;
+}
+
+static int shard_grow(cache_shard *s) {
+    if (s->entries == s->ringCap) {
+        size_t        cap  = s->ringCap ? s->ringCap * 2 : 64;
+        cache_entry **ring = realloc(s->ring, cap * sizeof *ring);
+        if (!ring) return -1;
+        s->ring    = ring;
+        s->ringCap = cap;
+    }
+    if (s->buckets && s->entries < s->mask + 1) return 0;
+
+    size_t        n       = s->buckets ? (s->mask + 1) * 2 : 64;
+    cache_entry **buckets = calloc(n, sizeof *buckets);
+    if (!buckets) return -1;
+    for (size_t i = 0; i < s->entries; i++) {
+        cache_entry *e = s->ring[i];
+        e->next = buckets[e->hash & (n - 1)];
+        buckets[e->hash & (n - 1)] = e;
+    }
+    free(s->buckets);
+    s->buckets = buckets;
+    s->mask    = n - 1;
+    return 0;
+}
+
+/* CLOCK: sweep the ring, sparing (once) whatever was hit since the hand
+ * last passed it. */
+static void shard_evict(cache_shard *s, size_t need) {
+    while (s->entries && s->bytes + need > s->budget) {
+        if (s->hand >= s->entries) s->hand = 0;
+        cache_entry *e = s->ring[s->hand];
+        if (e->referenced) {
+            e->referenced = false;
+            s->hand++;
+        } else {
+            shard_unlink(s, e);   /* the last entry takes its slot */
+            s->evicted++;
+        }
+    }
+}
+
+/* Takes ownership of value (freed on failure). */
+static void cache_put(eavgCache *c, uint32_t op, const void *key, size_t keyLen,
+                      const cache_dep *deps, size_t ndeps,
+                      bool bitmap, void *value, size_t count, size_t itemSize,
+                      size_t valueBytes)
+{
+    cache_entry *e = NULL;
+    if (ndeps > CACHE_MAX_DEPS || (!value && (bitmap || count))) goto fail;
+    size_t bytes = sizeof *e + keyLen + ndeps * sizeof(cache_ver) + valueBytes;
+    if (bytes > c->shards[0].budget) goto fail;
+
+    e = malloc(sizeof *e + keyLen + ndeps * sizeof(cache_ver));
+    if (!e) goto fail;
+    e->hash       = cache_hash(op, key, keyLen / 8);
+    e->op         = op;
+    e->ndeps      = (uint32_t)ndeps;
+    e->keyLen     = keyLen;
+    e->referenced = false;
+    e->bitmap     = bitmap;
+    e->count      = count;
+    e->itemSize   = itemSize;
+    e->bytes      = bytes;
+    e->value      = value;
+    e->deps       = (cache_ver*)((char*)e->key + keyLen);
+    memcpy(e->key, key, keyLen);
+    for (size_t i = 0; i < ndeps; i++) {
+        uint32_t stripe = cache_stripe(deps[i].kind, deps[i].id);
+        e->deps[i] = (cache_ver){ stripe,
+            atomic_load_explicit(&c->versions[stripe], memory_order_relaxed) };
+    }
+
+    cache_shard *s = shard_of(c, e->hash);
+    pthread_mutex_lock(&s->mu);
+    cache_entry *old = shard_find(s, e->hash, op, key, keyLen);
+    if (old) shard_unlink(s, old);   /* another reader got there first */
+    shard_evict(s, bytes);
+    if (shard_grow(s) < 0) {
+        pthread_mutex_unlock(&s->mu);
+        goto fail;
+    }
+    e->next = s->buckets[e->hash & s->mask];
+    s->buckets[e->hash & s->mask] = e;
+    e->ring = s->entries;
+    s->ring[s->entries++] = e;
+    s->bytes += bytes;
+    s->inserts++;
+    pthread_mutex_unlock(&s->mu);
+    return;
+
+ fail:
+    if (bitmap) id_bitmap_destroy(value);
+    else        free(value);
+    free(e);
+}
+
+void cache_put_array(eavgCache *c, uint32_t op, const void *key, size_t keyLen,
+                     const cache_dep *deps, size_t ndeps,
+                     const void *items, size_t count, size_t itemSize)
+{
+    void *copy = NULL;
+    if (count) {
+        copy = malloc(count * itemSize);
+        if (copy) memcpy(copy, items, count * itemSize);
+    }
+    cache_put(c, op, key, keyLen, deps, ndeps, false, copy, count, itemSize, count * itemSize);
+}
+
+static size_t bitmap_bytes(const id_bitmap *b) {
+    size_t n = sizeof *b + b->cap * sizeof *b->containers;
+    for (size_t i = 0; i < b->count; i++) {
+        const id_container *k = &b->containers[i];
+        n += k->cap ? k->cap * sizeof *k->u.array : ID_BITMAP_WORDS * sizeof *k->u.words;
+    }
+    return n;
+}
+
+void cache_put_bitmap(eavgCache *c, uint32_t op, const void *key, size_t keyLen,
+                      const cache_dep *deps, size_t ndeps, const id_bitmap *b)
+{
+    if (ndeps > CACHE_MAX_DEPS || bitmap_bytes(b) > c->shards[0].budget) return;
+    id_bitmap *copy = id_bitmap_copy(b);
+    cache_put(c, op, key, keyLen, deps, ndeps, true, copy,
+              (size_t)id_bitmap_cardinality(b), 0, copy ? bitmap_bytes(copy) : 0);
+}
+
+void cache_stats(eavgCache *c, eavgCacheStats *out) {
+    memset(out, 0, sizeof *out);
+    if (!c) return;
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        cache_shard *s = &c->shards[i];
+        pthread_mutex_lock(&s->mu);
+        out->hits        += s->hits;
+        out->misses      += s->misses;
+        out->invalidated += s->invalidated;
+        out->evicted     += s->evicted;
+        out->inserts     += s->inserts;
+        out->bytes       += s->bytes;
+        out->entries     += s->entries;
+        pthread_mutex_unlock(&s->mu);
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "eavg.h"
+
+/* Result cache (eavgDB_cacheEnable).  Entries are found by hashing the
+ * call's key bytes into one of a few shards, each a chained table with
+ * its own mutex, budget and CLOCK ring.  Every entry remembers the
+ * versions of what its result was read from: the edges of an entity or
+ * the entities of a type.  Writers bump those versions under the db
+ * write lock, and a lookup finding a stale entry drops it.  Versions
+ * live in a fixed table of counters indexed by a hash of the dependency,
+ * so a write may also drop entries that share a counter with it, never
+ * keep a stale one.  Gets and puts run under the db read lock, which
+ * keeps the versions still while a result is read and recorded. */
+
+enum { CACHE_DEP_EDGES, CACHE_DEP_TYPE };
+
+/* Which call an entry answers; part of its key. */
+enum { CACHE_OP_EDGES, CACHE_OP_TYPE, CACHE_OP_TYPE_BITMAP, CACHE_OP_EXPAND };
+
+/* What a cached call read; more than CACHE_MAX_DEPS and it is not cached. */
+#define CACHE_MAX_DEPS  256
+
+typedef struct {
+    int       kind;     /* CACHE_DEP_* */
+    eavg_u64  id;       /* entity or type id */
+} cache_dep;
+
+typedef struct eavgCache eavgCache;
+
+eavgCache *cache_create(const eavgCacheOptions *opt);
+void       cache_destroy(eavgCache *c);
+/* Whether calls with this filter may be cached. */
+bool       cache_accepts(const eavgCache *c, eavgEdgeFilter filter);
+/* Under the db write lock; c may be NULL. */
+void       cache_bump(eavgCache *c, int kind, eavg_u64 id);
+
+/* key is keyLen bytes, a multiple of 8.  A hit returns true with a copy
+ * of the result in *out: a malloc'd array (NULL when empty) for arrays,
+ * an id_bitmap for bitmaps. */
+bool       cache_get(eavgCache *c, uint32_t op, const void *key, size_t keyLen,
+                     void **out, size_t *count);
+/* Record copies of a result; silently skipped when out of memory or the
+ * result would take more than a shard's share of the budget. */
+void       cache_put_array(eavgCache *c, uint32_t op, const void *key, size_t keyLen,
+                           const cache_dep *deps, size_t ndeps,
+                           const void *items, size_t count, size_t itemSize);
+void       cache_put_bitmap(eavgCache *c, uint32_t op, const void *key, size_t keyLen,
+                            const cache_dep *deps, size_t ndeps, const id_bitmap *b);
+void       cache_stats(eavgCache *c, eavgCacheStats *out);
+
+#endif /* CACHE_H */
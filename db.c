@@ -1,11 +1,27 @@
+#define _GNU_SOURCE   /* O_DIRECT */
 #include "eavg.h"
+#include "feed.h"
+#include "wal.h"
+#include "stats.h"
+#include "cache.h"
+#include "save.h"
+#include "tx.h"
+#include "pool.h"
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define EAVG_PERS_MAGIC  "EAVGPERS"
-#define EAVG_PERS_VERSION 1
+#define EAVG_PERS_VERSION 2    /* v2: BINARY values carry their payload */
+#define EAVG_PERS_COMPACT 3    /* v3: varints, a string table, values and edges by list */
 
 static char *strdup_arena(Arena *a, const char *s) {
     if (!s) return NULL;
@@ -15,23 +31,516 @@ static char *strdup_arena(Arena *a, const char *s) {
     return d;
 }
 
-static char *strdup_arena_intern(Arena *arena, str_map *internTable, const char *s) {
-    if (!s) return NULL;
-    char *interned = str_map_get(internTable, s);
-    if (interned) return interned;
+/* Points *name at the symbol pool's copy of the n bytes at s; a NULL s
+ * clears both.  Fails only when out of memory. */
+static int name_intern(const char *s, size_t n, char **name, eavgSymbol *sym) {
+    *sym  = s ? eavgSymbol_internLen(s, n) : 0;
+    *name = (char*)eavgSymbol_name(*sym);
+    return s && !*sym ? -1 : 0;
+}
+
+/* What an edge labelled with the n bytes at s keeps: its symbol's name,
+ * or, when the pool did not take the label (sym 0), a copy in arena.
+ * NULL for a NULL s or out of memory. */
+static char *label_text(Arena *arena, const char *s, size_t n, eavgSymbol sym) {
+    if (!s || sym) return (char*)eavgSymbol_name(sym);
+    char *copy = arena_alloc(arena, n + 1);
+    if (!copy) return NULL;
+    memcpy(copy, s, n);
+    copy[n] = '\0';
+    return copy;
+}
+
+static eavgSymbol label_sym(const char *s, size_t n) {
+    return s ? eavgSymbol_internLabel(s, n) : 0;
+}
+
+/* A lazily opened db (eavgDB_openLazy) holds entities, attributes and
+ * relation types from the start; an operation loads the value and edge
+ * chunks of the keys it touches with lazy_fault before taking the lock,
+ * and one that needs a whole section (a by-id lookup that missed, a save)
+ * loads it with lazy_settle.  Both return -1 when a chunk they need is
+ * bad, and the operation fails. */
+enum { CHK_ENTITIES, CHK_ATTRIBUTES, CHK_RELTYPES, CHK_VALUES, CHK_OUT, CHK_IN, CHK_SECTIONS };
+#define CHK_MASK(section)  (1u << (section))
+#define CHK_ALL            (CHK_MASK(CHK_SECTIONS) - 1)
+static int  lazy_fault(eavgDB *db, int section, eavg_u64 key);
+static int  lazy_settle(eavgDB *db, unsigned sections);
+static bool lazy_pending(const eavgDB *db, int section);
+static bool lazy_bad(const eavgDB *db, int section);
+static void lazy_free(struct eavgLazy *lz);
+/* A db loaded from an image resolves its lists the same way, on first
+ * touch (see eavgDB_saveImage); lazy_fault and lazy_settle dispatch. */
+static int  img_resolve(eavgDB *db, int section, void *list);
+static int  img_fault(eavgDB *db, int section, eavg_u64 key);
+static int  img_find_value(eavgDB *db, eavg_u64 id);
+static int  img_settle(eavgDB *db, unsigned sections);
+static bool img_pending(const struct eavgImage *img, int section);
+static bool img_bad(const struct eavgImage *img, int section);
+static void img_free(struct eavgImage *img);
+/* Whether db may have lists left to fault in. */
+static bool lazy_any(const eavgDB *db) { return db->lazy || db->image; }
+#define LOCK_RD(db)  stats_lock_rd(&((db)->lock))
+#define UNLOCK_RD(db) stats_unlock_rd(&((db)->lock))
+#define LOCK_WR(db)  stats_lock_wr(&((db)->lock))
+#define UNLOCK_WR(db) stats_unlock_wr(&((db)->lock))
+
+/* what eavgDB.dirty tracks, by entity id */
+enum { DIRTY_ENTITIES, DIRTY_VALUES, DIRTY_EDGES, DIRTY_SETS };
+
+static void dirty_mark(eavgDB *db, int set, eavg_u64 id) {
+    id_bitmap_add(db->dirty[set], id);
+}
+
+/* Change events are stamped under the write lock, so seq follows commit
+ * order, and published once it is released.  kind stays 0, which the feed
+ * skips, while nobody is subscribed.  The change_* helpers also append
+ * each change to the write-ahead log, when there is one. */
+static bool change_begin(eavgDB *db, eavgChange *c, eavg_u32 kind, eavg_u32 op,
+                         eavg_u64 entityId)
+{
+    c->kind = 0;
+    if (!change_feed_active(db->feed)) return false;
+    c->seq      = db->nextChangeSeq++;
+    c->kind     = kind;
+    c->op       = op;
+    c->entityId = entityId;
+    return true;
+}
+
+static void change_entity(eavgDB *db, eavgChange *c, eavg_u32 op, const eavgEntity *e) {
+    dirty_mark(db, DIRTY_ENTITIES, e->id);
+    cache_bump(db->cache, CACHE_DEP_TYPE, e->typeId);
+    cache_bump(db->cache, CACHE_DEP_EDGES, e->id);
+    wal_log_entity(db->wal, op, e);
+    if (change_begin(db, c, EAVG_CHANGE_ENTITY, op, e->id)) c->entity = *e;
+}
+
+/* Removals are logged by remove_value, which knows how it removes. */
+static void change_value(eavgDB *db, eavgChange *c, eavg_u32 op,
+                         eavg_u64 entityId, const eavgValRec *r)
+{
+    dirty_mark(db, DIRTY_VALUES, entityId);
+    if (db->wal && op != EAVG_CHANGE_REMOVE) {
+        const eavgAttribute *at = eavgDB_findAttributeByIdNoLock(db, r->attributeId);
+        wal_log_value(db->wal, op, entityId, r, at ? at->dataType : 0);
+    }
+    if (change_begin(db, c, EAVG_CHANGE_VALUE, op, entityId)) c->value = *r;
+}
+
+static void change_edge(eavgDB *db, eavgChange *c, eavg_u32 op, const eavgEdgeRec *e) {
+    dirty_mark(db, DIRTY_EDGES, e->sourceEntity);
+    cache_bump(db->cache, CACHE_DEP_EDGES, e->sourceEntity);
+    cache_bump(db->cache, CACHE_DEP_EDGES, e->targetEntity);
+    wal_log_edge(db->wal, op, e);
+    if (change_begin(db, c, EAVG_CHANGE_EDGE, op, e->sourceEntity)) c->edge = *e;
+}
+
+/* After the write lock is released: makes the writes as durable as the
+ * log's sync policy asks, then hands their events to subscribers. */
+static void change_publish(eavgDB *db, const eavgChange *c, size_t count) {
+    wal_commit(db->wal);
+    change_feed_publish(db->feed, c, count);
+}
+
+static void index_add(u64_map *index, eavg_u64 key, eavg_u64 id) {
+    id_bitmap *b = u64_map_get(index, key);
+    if (!b) {
+        b = id_bitmap_create();
+        if (!b) return;
+        u64_map_put(index, key, b);
+    }
+    id_bitmap_add(b, id);
+}
+
+static void index_remove(u64_map *index, eavg_u64 key, eavg_u64 id) {
+    id_bitmap *b = u64_map_get(index, key);
+    if (b) id_bitmap_remove(b, id);
+}
+
+static void index_destroy(u64_map *index) {
+    if (!index) return;
+    for (size_t i = 0; i < index->capacity; i++)
+        id_bitmap_destroy((id_bitmap*)index->values[i]);
+    u64_map_destroy(index);
+}
+
+static bool value_list_has_attribute(const eavgValueList *vl, eavg_u64 attributeId) {
+    for (size_t i = 0; i < vl->count; i++)
+        if (vl->values[i].attributeId == attributeId) return true;
+    return false;
+}
+
+/* Maps a snapshot pins.  A writer copies a table the newest snapshot
+ * still reads before changing it, and retires the old table until the
+ * last snapshot that can reach it has ended. */
+enum {
+    SNAP_ENTITIES, SNAP_ATTRIBUTES, SNAP_RELTYPES, SNAP_VALUES, SNAP_OUT, SNAP_IN,
+    SNAP_U64_MAPS
+};
+#define SNAP_MAP(which)  (1u << (which))
+#define SNAP_NAMES       (1u << SNAP_U64_MAPS)
+#define SNAP_EDGES       (SNAP_MAP(SNAP_OUT) | SNAP_MAP(SNAP_IN))
+
+struct eavgSnapshot {
+    eavgDB              *db;
+    eavg_u64             epoch;
+    u64_map             *maps[SNAP_U64_MAPS];
+    str_map             *entitiesByName;
+    struct eavgSnapshot *older, *newer;
+    /* A lazily opened db: the sections (CHK_MASK) it had wholly loaded
+     * when pinned, and the lists of keys it had not, decoded from the
+     * file as they are read (see snap_list). */
+    unsigned             whole;
+    pthread_mutex_t      lazyLock;
+    Arena                lazyArena;
+    u64_map             *lazyLists[3];   /* values, out, in */
+};
+
+static void  *snap_list(eavgSnapshot *s, int section, eavg_u64 key);
+static size_t snap_chunk_slots(const eavgSnapshot *s);
+static bool   snap_sees_key(const eavgSnapshot *s, int section, eavg_u64 key);
+static int    snap_walk_chunk(eavgSnapshot *s, size_t j, eavgEdgeCallback cb, void *userData);
+
+/* A retired table, or a heap list a writer replaced or dropped. */
+typedef struct eavgRetiredMap {
+    struct eavgRetiredMap *next;
+    eavg_u64               epoch;   /* snapshots older than this may still read it */
+    u64_map               *u64;
+    str_map               *str;
+    eavgAdjList           *adj;
+    eavgValueList         *vals;
+} eavgRetiredMap;
+
+static u64_map **snap_field(eavgDB *db, int which) {
+    switch (which) {
+    case SNAP_ENTITIES:   return &db->entitiesById;
+    case SNAP_ATTRIBUTES: return &db->attributesById;
+    case SNAP_RELTYPES:   return &db->relationTypesById;
+    case SNAP_VALUES:     return &db->valuesByEntity;
+    case SNAP_OUT:        return &db->adjIndexBySource;
+    default:              return &db->reverseAdjIndexByTarget;
+    }
+}
+
+/* Whether an active snapshot may read a list stamped with `version`. */
+static bool snap_pinned(const eavgDB *db, eavg_u64 version) {
+    return db->snapNewest && version <= db->snapNewest->epoch;
+}
+
+static int snap_retire(eavgDB *db, u64_map *u64, str_map *str) {
+    eavgRetiredMap *r = calloc(1, sizeof *r);
+    if (!r) return -1;
+    r->epoch        = db->epoch;
+    r->u64          = u64;
+    r->str          = str;
+    r->next         = db->retiredMaps;
+    db->retiredMaps = r;
+    return 0;
+}
+
+static void adjlist_free(eavgAdjList *al) {
+    if (!al || !al->heap) return;
+    free(al->edges);
+    free(al);
+}
+
+static void valuelist_free(eavgValueList *vl) {
+    if (!vl || !vl->heap) return;
+    free(vl->values);
+    free(vl);
+}
+
+/* Lets go of a list the writer replaced or took out of its index: a heap
+ * list a snapshot may still read is retired, one nobody can reach is
+ * freed.  Lists carved from arenas (or an image) stay where they are. */
+static int snap_release(eavgDB *db, eavgAdjList *adj, eavgValueList *vals) {
+    eavg_u64 version = adj ? adj->version : vals ? vals->version : 0;
+    if (!(adj && adj->heap) && !(vals && vals->heap)) return 0;
+    if (!snap_pinned(db, version)) {
+        adjlist_free(adj);
+        valuelist_free(vals);
+        return 0;
+    }
+    if (snap_retire(db, NULL, NULL) < 0) return -1;
+    db->retiredMaps->adj  = adj;
+    db->retiredMaps->vals = vals;
+    return 0;
+}
+
+/* Frees retired tables that no remaining snapshot can reach. */
+static void snap_reclaim(eavgDB *db, bool all) {
+    eavg_u64         oldest = db->snapOldest ? db->snapOldest->epoch : UINT64_MAX;
+    eavgRetiredMap **p      = &db->retiredMaps;
+    while (*p) {
+        eavgRetiredMap *r = *p;
+        if (!all && r->epoch > oldest) {
+            p = &r->next;
+            continue;
+        }
+        *p = r->next;
+        u64_map_destroy(r->u64);
+        str_map_destroy(r->str);
+        adjlist_free(r->adj);
+        valuelist_free(r->vals);
+        free(r);
+    }
+}
+
+/* Makes the maps named in `which` private to the writer.  Call under the
+ * write lock before changing them; a -1 (OOM) leaves nothing half-done. */
+static int snap_unshare(eavgDB *db, unsigned which) {
+    eavgSnapshot *s = db->snapNewest;
+    if (!s) return 0;
+    for (int i = 0; i < SNAP_U64_MAPS; i++) {
+        u64_map **field = snap_field(db, i);
+        if (!(which & SNAP_MAP(i)) || s->maps[i] != *field) continue;
+        u64_map *copy = u64_map_copy(*field);
+        if (!copy || snap_retire(db, *field, NULL) < 0) {
+            u64_map_destroy(copy);
+            return -1;
+        }
+        *field = copy;
+    }
+    if ((which & SNAP_NAMES) && s->entitiesByName == db->entitiesByName) {
+        str_map *copy = str_map_copy(db->entitiesByName);
+        if (!copy || snap_retire(db, NULL, db->entitiesByName) < 0) {
+            str_map_destroy(copy);
+            return -1;
+        }
+        db->entitiesByName = copy;
+    }
+    return 0;
+}
 
-    size_t len = strlen(s);
-    char *copy = arena_alloc(arena, len + 1);
-    memcpy(copy, s, len + 1);
+/* Grows al to hold at least `need` edges, keeping the records it has. */
+static int adjlist_reserve(eavgDB *db, eavgAdjList *al, size_t need);
 
-    str_map_put(internTable, copy, copy);
+/* Returns a list the writer may change: al itself, or a copy replacing it
+ * in `index` when a snapshot can see al.  NULL on OOM. */
+static eavgAdjList *adjlist_unshare(eavgDB *db, u64_map *index, eavgAdjList *al) {
+    if (!al || !snap_pinned(db, al->version)) return al;
+    eavgAdjList *copy = calloc(1, sizeof *copy);
+    if (!copy) return NULL;
+    copy->srcId   = al->srcId;
+    copy->version = db->epoch;
+    copy->heap    = true;
+    if (adjlist_reserve(db, copy, al->count + 1) < 0 || snap_release(db, al, NULL) < 0) {
+        adjlist_free(copy);
+        return NULL;
+    }
+    if (al->count) memcpy(copy->edges, al->edges, al->count * sizeof *al->edges);
+    copy->count = al->count;
+    u64_map_put(index, copy->srcId, copy);
+    return copy;
+}
+
+/* The list for key, created if missing, ready for writing. */
+static eavgAdjList *adjlist_get_or_create(eavgDB *db, u64_map *index, eavg_u64 key) {
+    eavgAdjList *al = u64_map_get(index, key);
+    if (al) return adjlist_unshare(db, index, al);
+    al = EAVG_ADJLIST_ALLOC(db);
+    if (!al) return NULL;
+    al->srcId   = key;
+    al->edges   = NULL;
+    al->count   = al->cap = 0;
+    al->version = db->epoch;
+    al->heap    = false;
+    u64_map_put(index, key, al);
+    return al;
+}
+
+static int adjlist_reserve(eavgDB *db, eavgAdjList *al, size_t need) {
+    if (need <= al->cap) return 0;
+    size_t newCap = al->cap ? al->cap * 2 : 4;
+    while (newCap < need) newCap *= 2;
+    eavgEdgeRec *edges = al->heap ? realloc(al->edges, newCap * sizeof *edges)
+                                  : arena_alloc(&db->edgeArena, newCap * sizeof *edges);
+    if (!edges) return -1;
+    if (al->count && !al->heap) memcpy(edges, al->edges, al->count * sizeof *edges);
+    al->edges = edges;
+    al->cap   = newCap;
+    return 0;
+}
+
+/** Where a value record lives: its entity's list and the slot within it. */
+typedef struct eavgValueLoc {
+    union {
+        eavgValueList       *list;
+        struct eavgValueLoc *nextFree;
+    };
+    size_t slot;
+} eavgValueLoc;
+
+static int value_index_put(eavgDB *db, eavgValueList *vl, size_t slot) {
+    eavgValueLoc *loc = db->freeValueLocs;
+    if (loc) {
+        db->freeValueLocs = loc->nextFree;
+    } else {
+        loc = arena_alloc(&db->valueArena, sizeof *loc);
+        if (!loc) return -1;
+    }
+    loc->list = vl;
+    loc->slot = slot;
+    return u64_map_put(db->valuesById, vl->values[slot].id, loc);
+}
+
+static void value_index_drop(eavgDB *db, eavg_u64 id) {
+    eavgValueLoc *loc = u64_map_get(db->valuesById, id);
+    if (!loc) return;
+    u64_map_remove(db->valuesById, id);
+    loc->nextFree     = db->freeValueLocs;
+    db->freeValueLocs = loc;
+}
+
+static void value_index_move(eavgDB *db, eavgValueList *vl, size_t slot) {
+    eavgValueLoc *loc = u64_map_get(db->valuesById, vl->values[slot].id);
+    if (loc) loc->slot = slot;
+}
+
+static int valuelist_reserve(eavgDB *db, eavgValueList *vl, size_t need) {
+    if (need <= vl->cap) return 0;
+    size_t newCap = vl->cap ? vl->cap * 2 : 4;
+    while (newCap < need) newCap *= 2;
+    eavgValRec *values = vl->heap ? realloc(vl->values, newCap * sizeof *values)
+                                  : arena_alloc(&db->valueArena, newCap * sizeof *values);
+    if (!values) return -1;
+    if (vl->count && !vl->heap) memcpy(values, vl->values, vl->count * sizeof *values);
+    vl->values = values;
+    vl->cap    = newCap;
+    return 0;
+}
+
+/* As adjlist_unshare; the copy also takes over the value locators. */
+static eavgValueList *valuelist_unshare(eavgDB *db, eavgValueList *vl) {
+    if (!vl || !snap_pinned(db, vl->version)) return vl;
+    eavgValueList *copy = calloc(1, sizeof *copy);
+    if (!copy) return NULL;
+    copy->entityId = vl->entityId;
+    copy->version  = db->epoch;
+    copy->heap     = true;
+    if (valuelist_reserve(db, copy, vl->count + 1) < 0 || snap_release(db, NULL, vl) < 0) {
+        valuelist_free(copy);
+        return NULL;
+    }
+    if (vl->count) memcpy(copy->values, vl->values, vl->count * sizeof *vl->values);
+    copy->count = vl->count;
+    for (size_t i = 0; i < copy->count; i++) {
+        eavgValueLoc *loc = u64_map_get(db->valuesById, copy->values[i].id);
+        if (loc) loc->list = copy;
+    }
+    u64_map_put(db->valuesByEntity, copy->entityId, copy);
     return copy;
 }
 
-#define LOCK_RD(db)  pthread_rwlock_rdlock(&((db)->lock))
-#define UNLOCK_RD(db) pthread_rwlock_unlock(&((db)->lock))
-#define LOCK_WR(db)  pthread_rwlock_wrlock(&((db)->lock))
-#define UNLOCK_WR(db) pthread_rwlock_unlock(&((db)->lock))
+static eavgValueList *valuelist_get_or_create(eavgDB *db, eavg_u64 entityId) {
+    eavgValueList *vl = u64_map_get(db->valuesByEntity, entityId);
+    if (vl) return valuelist_unshare(db, vl);
+    vl = arena_alloc(&db->valueArena, sizeof *vl);
+    if (!vl) return NULL;
+    vl->entityId = entityId;
+    vl->values   = NULL;
+    vl->count    = vl->cap = 0;
+    vl->version  = db->epoch;
+    vl->heap     = false;
+    u64_map_put(db->valuesByEntity, entityId, vl);
+    return vl;
+}
+
+/* Insert fast path.  New entity records and names are carved out of a
+ * per-thread chunk of insertArena, and ids come from the atomic counters
+ * (or a per-thread block of them), so the write lock only covers linking
+ * a finished record into the indexes.  A thread keeps a cache for each of
+ * the last few dbs it inserted into, most recent first; serial keeps a
+ * recycled db address from inheriting one.  A cache only takes a chunk
+ * once it has served a few allocations, so a thread cycling through more
+ * dbs than it has slots allocates each record under the lock instead of
+ * stranding most of a chunk in every db it touches. */
+#define INSERT_CHUNK   (16 * 1024)
+#define INSERT_SLOTS   4
+#define INSERT_WARMUP  8
+
+static _Atomic eavg_u64 db_serials;
+
+typedef struct {
+    eavg_u64  serial;
+    char     *chunk;
+    size_t    left;
+    unsigned  uses;      /* allocations served, up to INSERT_WARMUP */
+    eavg_u64  entityNext, entityEnd;
+    eavg_u64  edgeNext,   edgeEnd;
+} insert_cache;
+
+static _Thread_local insert_cache tl_insert[INSERT_SLOTS];
+
+static insert_cache *insert_cache_for(eavgDB *db) {
+    if (tl_insert[0].serial == db->serial) return &tl_insert[0];
+    size_t i = 1;
+    while (i < INSERT_SLOTS - 1 && tl_insert[i].serial != db->serial) i++;
+    insert_cache c = tl_insert[i].serial == db->serial ? tl_insert[i]
+                                                        : (insert_cache){ .serial = db->serial };
+    memmove(&tl_insert[1], &tl_insert[0], i * sizeof *tl_insert);
+    tl_insert[0] = c;
+    return &tl_insert[0];
+}
+
+static void *insert_alloc(eavgDB *db, size_t size) {
+    insert_cache *c = insert_cache_for(db);
+    void         *p;
+    size = (size + 7) & ~(size_t)7;
+    if (c->uses < INSERT_WARMUP) c->uses++;
+    if (size > INSERT_CHUNK / 4 || (c->left < size && c->uses < INSERT_WARMUP)) {
+        pthread_mutex_lock(&db->insertLock);
+        p = arena_alloc(&db->insertArena, size);
+        pthread_mutex_unlock(&db->insertLock);
+        return p;
+    }
+    if (c->left < size) {
+        pthread_mutex_lock(&db->insertLock);
+        c->chunk = arena_alloc(&db->insertArena, INSERT_CHUNK);
+        pthread_mutex_unlock(&db->insertLock);
+        c->left  = c->chunk ? INSERT_CHUNK : 0;
+        if (!c->chunk) return NULL;
+    }
+    p         = c->chunk;
+    c->chunk += size;
+    c->left  -= size;
+    return p;
+}
+
+static char *insert_strdup(eavgDB *db, const char *s) {
+    if (!s) return NULL;
+    size_t n = strlen(s) + 1;
+    char  *d = insert_alloc(db, n);
+    if (d) memcpy(d, s, n);
+    return d;
+}
+
+static eavg_u64 id_alloc(eavgDB *db, _Atomic eavg_u64 *next, eavg_u64 *blockNext,
+                         eavg_u64 *blockEnd)
+{
+    size_t block = atomic_load_explicit(&db->idBlock, memory_order_relaxed);
+    if (block <= 1) return atomic_fetch_add(next, 1);
+    if (*blockNext == *blockEnd) {
+        *blockNext = atomic_fetch_add(next, block);
+        *blockEnd  = *blockNext + block;
+    }
+    return (*blockNext)++;
+}
+
+static eavg_u64 entity_id_alloc(eavgDB *db) {
+    insert_cache *c = insert_cache_for(db);
+    return id_alloc(db, &db->nextEntityId, &c->entityNext, &c->entityEnd);
+}
+
+static eavg_u64 edge_id_alloc(eavgDB *db) {
+    insert_cache *c = insert_cache_for(db);
+    return id_alloc(db, &db->nextEdgeId, &c->edgeNext, &c->edgeEnd);
+}
+
+void eavgDB_setIdBlock(eavgDB *db, size_t ids) {
+    atomic_store(&db->idBlock, ids);
+}
 
 eavgDB *eavgDB_create(size_t initial_capacity) {
     eavgDB *db = malloc(sizeof *db);
@@ -44,28 +553,62 @@ eavgDB *eavgDB_create(size_t initial_capacity) {
     db->relationTypesById   = u64_map_create(initial_capacity);
     db->relationTypesByName = str_map_create(initial_capacity);
     db->valuesByEntity         = u64_map_create(initial_capacity);
+    db->valuesById             = u64_map_create(initial_capacity);
     db->adjIndexBySource       = u64_map_create(initial_capacity);
     db->reverseAdjIndexByTarget= u64_map_create(initial_capacity);
+    db->entitiesByType         = u64_map_create(16);
+    db->entitiesByAttribute    = u64_map_create(16);
 
     arena_init(&db->entityArena,    1<<16);
     arena_init(&db->attributeArena, 1<<16);
     arena_init(&db->valueArena,     1<<20);
     arena_init(&db->edgeArena,      1<<20);
 
+    arena_init(&db->insertArena,    1<<20);
+    db->image               = NULL;
+    db->basePath            = NULL;
+    memset(db->baseGen, 0, sizeof db->baseGen);
+    db->lazy                = NULL;
+    pthread_mutex_init(&db->insertLock, NULL);
+    db->serial              = atomic_fetch_add(&db_serials, 1) + 1;
+    atomic_init(&db->idBlock, 0);
+
     db->nextEntityId        = 1;
     db->nextAttributeId     = 1;
     db->nextValueId         = 1;
     db->nextRelationTypeId  = 1;
     db->nextEdgeId          = 1;
+    db->freeValueLocs       = NULL;
+    db->feed                = change_feed_create();
+    db->wal                 = NULL;
+    db->cache               = NULL;
+    db->walkPool            = NULL;
+    db->nextChangeSeq       = 1;
+    for (int i = 0; i < DIRTY_SETS; i++) db->dirty[i] = id_bitmap_create();
+    db->epoch               = 1;
+    db->snapOldest          = db->snapNewest = NULL;
+    db->retiredMaps         = NULL;
+    pthread_mutex_init(&db->snapLock, NULL);
 
-    pthread_rwlock_init(&db->lock, NULL);
+    br_lock_init(&db->lock);
     return db;
 }
 
 void eavgDB_destroy(eavgDB *db) {
     if (!db) return;
 
+    /* outside the lock: consumers may still be reading the db */
+    eavgExecutor_destroy(atomic_load(&db->walkPool));
+    change_feed_destroy(db->feed);
+    wal_close(db->wal);
+
     LOCK_WR(db);
+    for (size_t i = 0; i < db->valuesByEntity->capacity; i++)
+        valuelist_free(db->valuesByEntity->values[i]);
+    for (size_t i = 0; i < db->adjIndexBySource->capacity; i++)
+        adjlist_free(db->adjIndexBySource->values[i]);
+    for (size_t i = 0; i < db->reverseAdjIndexByTarget->capacity; i++)
+        adjlist_free(db->reverseAdjIndexByTarget->values[i]);
     u64_map_destroy(db->entitiesById);
     str_map_destroy(db->entitiesByName);
     u64_map_destroy(db->attributesById);
@@ -73,16 +616,28 @@ void eavgDB_destroy(eavgDB *db) {
     u64_map_destroy(db->relationTypesById);
     str_map_destroy(db->relationTypesByName);
     u64_map_destroy(db->valuesByEntity);
+    u64_map_destroy(db->valuesById);
     u64_map_destroy(db->adjIndexBySource);
     u64_map_destroy(db->reverseAdjIndexByTarget);
+    index_destroy(db->entitiesByType);
+    index_destroy(db->entitiesByAttribute);
+    for (int i = 0; i < DIRTY_SETS; i++) id_bitmap_destroy(db->dirty[i]);
+    cache_destroy(db->cache);
+    snap_reclaim(db, true);
 
     arena_destroy(&db->entityArena);
     arena_destroy(&db->attributeArena);
     arena_destroy(&db->valueArena);
     arena_destroy(&db->edgeArena);
+    arena_destroy(&db->insertArena);
     UNLOCK_WR(db);
 
-    pthread_rwlock_destroy(&db->lock);
+    br_lock_destroy(&db->lock);
+    pthread_mutex_destroy(&db->insertLock);
+    img_free(db->image);
+    free(db->basePath);
+    lazy_free(db->lazy);
+    pthread_mutex_destroy(&db->snapLock);
     free(db);
 }
 
@@ -90,19 +645,31 @@ eavgEntity *eavgDB_addEntity(eavgDB *db,
                              eavg_u32 typeId,
                              const char *name)
 {
-    LOCK_WR(db);
-    eavgEntity *e = EAVG_ENTITY_ALLOC(db);
-    EAVG_ASSERT(e);
-    e->id     = db->nextEntityId++;
+    STATS_OP(EAVG_OP_ADD_ENTITY);
+    eavgChange  ch;
+    eavgEntity *e = insert_alloc(db, sizeof *e);
+    if (!e) return NULL;
     e->typeId = typeId;
-    e->name   = strdup_arena(&db->entityArena, name);
+    e->name   = insert_strdup(db, name);
+    if (name && !e->name) return NULL;
+    e->id     = entity_id_alloc(db);
+
+    LOCK_WR(db);
+    if (snap_unshare(db, SNAP_MAP(SNAP_ENTITIES) | SNAP_NAMES) < 0) {
+        UNLOCK_WR(db);
+        return NULL;
+    }
     u64_map_put(db->entitiesById, e->id, e);
     if (name) str_map_put(db->entitiesByName, e->name, e);
+    index_add(db->entitiesByType, EAVG_TYPE_KEY(typeId), e->id);
+    change_entity(db, &ch, EAVG_CHANGE_ADD, e);
     UNLOCK_WR(db);
+    change_publish(db, &ch, 1);
     return e;
 }
 
 eavgEntity *eavgDB_findEntityById(eavgDB *db, eavg_u64 id) {
+    STATS_OP(EAVG_OP_FIND_ENTITY);
     LOCK_RD(db);
     eavgEntity *e = u64_map_get(db->entitiesById, id);
     UNLOCK_RD(db);
@@ -110,6 +677,7 @@ eavgEntity *eavgDB_findEntityById(eavgDB *db, eavg_u64 id) {
 }
 
 eavgEntity *eavgDB_findEntityByName(eavgDB *db, const char *name) {
+    STATS_OP(EAVG_OP_FIND_ENTITY);
     LOCK_RD(db);
     eavgEntity *e = str_map_get(db->entitiesByName, name);
     UNLOCK_RD(db);
@@ -120,6 +688,7 @@ void eavgDB_forEachEntity(eavgDB *db,
                           eavgEntityCallback cb,
                           void *userData)
 {
+    STATS_OP(EAVG_OP_FOR_EACH_ENTITY);
     LOCK_RD(db);
     size_t cap = db->entitiesById->capacity;
     for (size_t i = 0; i < cap; i++) {
@@ -133,21 +702,36 @@ eavgAttribute *eavgDB_addAttribute(eavgDB *db,
                                    const char *name,
                                    eavg_u32 dataType)
 {
+    STATS_OP(EAVG_OP_ADD_ATTRIBUTE);
     LOCK_WR(db);
+    if (snap_unshare(db, SNAP_MAP(SNAP_ATTRIBUTES)) < 0) {
+        UNLOCK_WR(db);
+        return NULL;
+    }
     eavgAttribute *a = EAVG_ATTR_ALLOC(db);
     EAVG_ASSERT(a);
-    a->id       = db->nextAttributeId++;
+    a->id       = atomic_fetch_add(&db->nextAttributeId, 1);
     a->dataType = dataType;
-    a->name     = strdup_arena(&db->attributeArena, name);
+    if (a->id > EAVG_ATTRIBUTE_ID_MAX) {
+        UNLOCK_WR(db);
+        return NULL;
+    }
+    if (name_intern(name, name ? strlen(name) : 0, &a->name, &a->nameSym) < 0) {
+        UNLOCK_WR(db);
+        return NULL;
+    }
     a->onValueAdded = NULL;
     a->userData     = NULL;
     u64_map_put(db->attributesById, a->id, a);
     if (name) str_map_put(db->attributesByName, a->name, a);
+    wal_log_attribute(db->wal, a);
     UNLOCK_WR(db);
+    wal_commit(db->wal);
     return a;
 }
 
 eavgAttribute *eavgDB_findAttributeById(eavgDB *db, eavg_u64 id) {
+    STATS_OP(EAVG_OP_FIND_ATTRIBUTE);
     LOCK_RD(db);
     eavgAttribute *a = u64_map_get(db->attributesById, id);
     UNLOCK_RD(db);
@@ -155,6 +739,7 @@ eavgAttribute *eavgDB_findAttributeById(eavgDB *db, eavg_u64 id) {
 }
 
 eavgAttribute *eavgDB_findAttributeByName(eavgDB *db, const char *name) {
+    STATS_OP(EAVG_OP_FIND_ATTRIBUTE);
     LOCK_RD(db);
     eavgAttribute *a = str_map_get(db->attributesByName, name);
     UNLOCK_RD(db);
@@ -165,40 +750,128 @@ static eavgValRec *add_value_rec(eavgDB *db,
                                  eavg_u64 entityId,
                                  eavg_u64 attributeId)
 {
-    eavgValueList *vl = u64_map_get(db->valuesByEntity, entityId);
-    if (!vl) {
-        vl = arena_alloc(&db->valueArena, sizeof *vl);
-        vl->entityId = entityId;
-        vl->values   = NULL;
-        vl->count    = vl->cap = 0;
-        u64_map_put(db->valuesByEntity, entityId, vl);
-    }
-    if (vl->count == vl->cap) {
-        size_t newCap = vl->cap ? vl->cap * 2 : 4;
-        vl->values    = arena_alloc(&db->valueArena,
-                                    newCap * sizeof *vl->values);
-        vl->cap       = newCap;
-    }
-    eavgValRec *rec = &vl->values[vl->count++];
-    rec->id          = db->nextValueId++;
+    if (snap_unshare(db, SNAP_MAP(SNAP_VALUES)) < 0) return NULL;
+    eavgValueList *vl = valuelist_get_or_create(db, entityId);
+    if (!vl || valuelist_reserve(db, vl, vl->count + 1) < 0) return NULL;
+    eavgValRec *rec = &vl->values[vl->count];
+    rec->id          = atomic_load(&db->nextValueId);
     rec->attributeId = attributeId;
+    if (value_index_put(db, vl, vl->count) < 0) return NULL;
+    vl->count++;
+    atomic_fetch_add(&db->nextValueId, 1);
+    index_add(db->entitiesByAttribute, attributeId, entityId);
     return rec;
 }
 
+/* Returns where `len` payload bytes (+1 when terminate) go: the record's
+ * inline buffer when they fit, arena otherwise.  Sets r->length. */
+static unsigned char *value_payload(Arena *arena, eavgValRec *r, size_t len, bool terminate) {
+    size_t         need = len + (terminate ? 1 : 0);
+    unsigned char *p;
+    if (len > EAVG_VALUE_LENGTH_MAX) return NULL;
+    if (need <= EAVG_VALUE_INLINE_MAX) {
+        memset(r->data.inlineBytes, 0, sizeof r->data.inlineBytes);
+        r->length = (eavg_u32)len | EAVG_VALUE_INLINE;
+        return r->data.inlineBytes;
+    }
+    p = arena_alloc(arena, need);
+    if (!p) return NULL;
+    if (terminate) p[len] = '\0';
+    r->data.binaryValue = p;
+    r->length           = (eavg_u32)len;
+    return p;
+}
+
+/* Copies string and binary payloads inline or into valueArena.  A NULL
+ * string stays NULL (out of line, length 0). */
+static int value_store(eavgDB *db, eavg_u32 dataType, eavgValRec *r,
+                       eavgValueData data, size_t length)
+{
+    unsigned char *p;
+    switch (dataType) {
+    case EAVG_DATA_TYPE_STRING:
+        if (!data.stringValue) {
+            r->data.stringValue = NULL;
+            r->length           = 0;
+            return 0;
+        }
+        length = strlen(data.stringValue);
+        p      = value_payload(&db->valueArena, r, length, true);
+        if (!p) return -1;
+        memcpy(p, data.stringValue, length);
+        return 0;
+    case EAVG_DATA_TYPE_BINARY:
+        p = value_payload(&db->valueArena, r, length, false);
+        if (!p) return -1;
+        if (data.binaryValue) memcpy(p, data.binaryValue, length);
+        else                  memset(p, 0, length);
+        return 0;
+    default:
+        r->data   = data;
+        r->length = 0;
+        return 0;
+    }
+}
+
+/* Takes the record at slot out of vl.  Ordered removal shifts the later
+ * records down; unordered removal moves the last record into the gap. */
+static void value_cut(eavgDB *db, eavgValueList *vl, size_t slot, bool ordered) {
+    size_t last = vl->count - 1;
+    value_index_drop(db, vl->values[slot].id);
+    if (ordered) {
+        memmove(&vl->values[slot], &vl->values[slot + 1],
+                (last - slot) * sizeof *vl->values);
+        for (size_t k = slot; k < last; k++) value_index_move(db, vl, k);
+    } else if (slot != last) {
+        vl->values[slot] = vl->values[last];
+        value_index_move(db, vl, slot);
+    }
+    vl->count--;
+}
+
+/* Fills *ch (may be NULL) with the removal event. */
+static int remove_value(eavgDB *db, eavg_u64 id, bool ordered, eavgChange *ch) {
+    eavgValueLoc *loc = u64_map_get(db->valuesById, id);
+    if (!loc || snap_unshare(db, SNAP_MAP(SNAP_VALUES)) < 0) return -1;
+
+    eavgValueList *vl = valuelist_unshare(db, loc->list);
+    if (!vl) return -1;
+
+    size_t   slot        = loc->slot;
+    eavg_u64 attributeId = vl->values[slot].attributeId;
+
+    if (ch) {
+        change_value(db, ch, EAVG_CHANGE_REMOVE, vl->entityId, &vl->values[slot]);
+        wal_log_value_remove(db->wal, id, vl->entityId, ordered);
+    }
+    value_cut(db, vl, slot, ordered);
+
+    if (!value_list_has_attribute(vl, attributeId))
+        index_remove(db->entitiesByAttribute, attributeId, vl->entityId);
+    return 0;
+}
+
 #define DEFINE_ADD_VALUE_FN(NAME, TYPECHECK, FIELD, ASSIGN) \
 eavgValRec *eavgDB_add##NAME##Value(eavgDB *db,                  \
     eavg_u64 entityId, eavg_u64 attributeId, TYPECHECK v)      \
 {                                                               \
+    STATS_OP(EAVG_OP_ADD_VALUE);                                \
+    eavgChange ch;                                              \
+    if (lazy_fault(db, CHK_VALUES, entityId) < 0) return NULL;  \
     LOCK_WR(db);                                                \
     eavgAttribute *at = eavgDB_findAttributeByIdNoLock(db, attributeId); \
     if (!at || at->dataType != EAVG_DATA_TYPE_##ASSIGN) {       \
         UNLOCK_WR(db); return NULL;                            \
     }                                                           \
     eavgValRec *r = add_value_rec(db, entityId, attributeId);  \
+    if (!r) { UNLOCK_WR(db); return NULL; }                     \
     r->data.FIELD = v;                                          \
+    r->length     = 0;                                          \
+    change_value(db, &ch, EAVG_CHANGE_ADD, entityId, r);        \
+    UNLOCK_WR(db);                                              \
+    change_publish(db, &ch, 1);                                 \
     if (at->onValueAdded)                                       \
         at->onValueAdded(at, r, at->userData);                  \
-    UNLOCK_WR(db);                                              \
     return r;                                                   \
 }
 
@@ -210,15 +883,24 @@ eavgValRec *eavgDB_addStringValue(eavgDB *db,
                                   eavg_u64 attributeId,
                                   const char *s)
 {
+    STATS_OP(EAVG_OP_ADD_VALUE);
+    eavgChange ch;
+    if (lazy_fault(db, CHK_VALUES, entityId) < 0) return NULL;
     LOCK_WR(db);
     eavgAttribute *at = eavgDB_findAttributeByIdNoLock(db, attributeId);
     if (!at || at->dataType != EAVG_DATA_TYPE_STRING) {
         UNLOCK_WR(db); return NULL;
     }
     eavgValRec *r = add_value_rec(db, entityId, attributeId);
-    r->data.stringValue = strdup_arena(&db->valueArena, s);
-    if (at->onValueAdded) at->onValueAdded(at, r, at->userData);
+    if (!r) { UNLOCK_WR(db); return NULL; }
+    if (value_store(db, at->dataType, r, (eavgValueData){ .stringValue = (char*)s }, 0) < 0) {
+        remove_value(db, r->id, false, NULL);
+        UNLOCK_WR(db); return NULL;
+    }
+    change_value(db, &ch, EAVG_CHANGE_ADD, entityId, r);
     UNLOCK_WR(db);
+    change_publish(db, &ch, 1);
+    if (at->onValueAdded) at->onValueAdded(at, r, at->userData);
     return r;
 }
 
@@ -228,17 +910,25 @@ eavgValRec *eavgDB_addBinaryValue(eavgDB *db,
                                   const unsigned char *buf,
                                   size_t len)
 {
+    STATS_OP(EAVG_OP_ADD_VALUE);
+    eavgChange ch;
+    if (lazy_fault(db, CHK_VALUES, entityId) < 0) return NULL;
     LOCK_WR(db);
     eavgAttribute *at = eavgDB_findAttributeByIdNoLock(db, attributeId);
     if (!at || at->dataType != EAVG_DATA_TYPE_BINARY) {
         UNLOCK_WR(db); return NULL;
     }
     eavgValRec *r = add_value_rec(db, entityId, attributeId);
-    unsigned char *b = arena_alloc(&db->valueArena, len);
-    if (b && buf) memcpy(b, buf, len);
-    r->data.binaryValue = b;
-    if (at->onValueAdded) at->onValueAdded(at, r, at->userData);
+    if (!r) { UNLOCK_WR(db); return NULL; }
+    if (value_store(db, at->dataType, r,
+                    (eavgValueData){ .binaryValue = (unsigned char*)buf }, len) < 0) {
+        remove_value(db, r->id, false, NULL);
+        UNLOCK_WR(db); return NULL;
+    }
+    change_value(db, &ch, EAVG_CHANGE_ADD, entityId, r);
     UNLOCK_WR(db);
+    change_publish(db, &ch, 1);
+    if (at->onValueAdded) at->onValueAdded(at, r, at->userData);
     return r;
 }
 
@@ -247,35 +937,53 @@ eavgValRec *eavgDB_addEntityRefValue(eavgDB *db,
                                      eavg_u64 attributeId,
                                      eavg_u64 refId)
 {
+    STATS_OP(EAVG_OP_ADD_VALUE);
+    eavgChange ch;
+    if (lazy_fault(db, CHK_VALUES, entityId) < 0) return NULL;
     LOCK_WR(db);
     eavgAttribute *at = eavgDB_findAttributeByIdNoLock(db, attributeId);
     if (!at || at->dataType != EAVG_DATA_TYPE_ENTITY) {
         UNLOCK_WR(db); return NULL;
     }
     eavgValRec *r = add_value_rec(db, entityId, attributeId);
+    if (!r) { UNLOCK_WR(db); return NULL; }
     r->data.entityRef = refId;
-    if (at->onValueAdded) at->onValueAdded(at, r, at->userData);
+    r->length         = 0;
+    change_value(db, &ch, EAVG_CHANGE_ADD, entityId, r);
     UNLOCK_WR(db);
+    change_publish(db, &ch, 1);
+    if (at->onValueAdded) at->onValueAdded(at, r, at->userData);
     return r;
 }
 
 eavgRelationType *
 eavgDB_addRelationType(eavgDB *db, const char *name)
 {
+    STATS_OP(EAVG_OP_ADD_RELTYPE);
     LOCK_WR(db);
+    if (snap_unshare(db, SNAP_MAP(SNAP_RELTYPES)) < 0) {
+        UNLOCK_WR(db);
+        return NULL;
+    }
     eavgRelationType *rt = EAVG_RELTYPE_ALLOC(db);
     EAVG_ASSERT(rt);
-    rt->id   = db->nextRelationTypeId++;
-    rt->name = strdup_arena(&db->attributeArena, name);
+    if (name_intern(name, name ? strlen(name) : 0, &rt->name, &rt->nameSym) < 0) {
+        UNLOCK_WR(db);
+        return NULL;
+    }
+    rt->id   = atomic_fetch_add(&db->nextRelationTypeId, 1);
     u64_map_put(db->relationTypesById, rt->id, rt);
     if (name) str_map_put(db->relationTypesByName, rt->name, rt);
+    wal_log_reltype(db->wal, EAVG_CHANGE_ADD, rt);
     UNLOCK_WR(db);
+    wal_commit(db->wal);
     return rt;
 }
 
 eavgRelationType *
 eavgDB_findRelationTypeById(eavgDB *db, eavg_u64 id)
 {
+    STATS_OP(EAVG_OP_FIND_RELTYPE);
     LOCK_RD(db);
     eavgRelationType *rt = u64_map_get(db->relationTypesById, id);
     UNLOCK_RD(db);
@@ -285,6 +993,7 @@ eavgDB_findRelationTypeById(eavgDB *db, eavg_u64 id)
 eavgRelationType *
 eavgDB_findRelationTypeByName(eavgDB *db, const char *name)
 {
+    STATS_OP(EAVG_OP_FIND_RELTYPE);
     LOCK_RD(db);
     eavgRelationType *rt = str_map_get(db->relationTypesByName, name);
     UNLOCK_RD(db);
@@ -298,12 +1007,11 @@ eavgDB_addEdge(eavgDB *db,
                eavg_u64 relTypeId,
                double weight)
 {
+    /* The name is a pooled symbol, so it stays valid even if the type is
+     * removed meanwhile. */
     const eavgRelationType *rel = eavgDB_findRelationTypeById(db, relTypeId);
-    const char *label = rel ? strdup_arena_intern(&db->edgeArena, db->relationTypesByName, rel->name) : NULL;
-
-
     return eavgDB_addEdgeEx(db, src, tgt, relTypeId, weight,
-                            EAVG_EDGE_DIR_OUT, label,
+                            EAVG_EDGE_DIR_OUT, rel ? rel->name : NULL,
                             (uint64_t)(time(NULL)) * 1000);
 }
 
@@ -317,687 +1025,5278 @@ eavgDB_addEdgeEx(eavgDB *db,
                  const char *label,
                  uint64_t    timestamp)
 {
+    STATS_OP(EAVG_OP_ADD_EDGE);
+    eavgChange   ch;
+    eavgAdjList *fwd = NULL, *rev = NULL;
+    eavgEdgeRec  rec = {
+        .relationTypeId = relTypeId,
+        .sourceEntity   = src,
+        .targetEntity   = tgt,
+        .weight         = weight,
+        .direction      = direction,
+        .timestamp      = timestamp,
+    };
+    if (lazy_fault(db, CHK_OUT, src) < 0 || lazy_fault(db, CHK_IN, tgt) < 0) return NULL;
+    size_t labelLen = label ? strlen(label) : 0;
+    rec.labelSym = label_sym(label, labelLen);
+    rec.id       = edge_id_alloc(db);
+
     LOCK_WR(db);
-    eavgAdjList *fwd = u64_map_get(db->adjIndexBySource, src);
-    if (!fwd) {
-        fwd        = EAVG_ADJLIST_ALLOC(db);
-        fwd->srcId = src;
-        fwd->edges = NULL;
-        fwd->count = fwd->cap = 0;
-        u64_map_put(db->adjIndexBySource, src, fwd);
-    }
-    if (fwd->count == fwd->cap) {
-        size_t newCap = fwd->cap ? fwd->cap * 2 : 4;
-        fwd->edges     = arena_alloc(&db->edgeArena, newCap * sizeof *fwd->edges);
-        fwd->cap       = newCap;
-    }
-
-    eavgAdjList *rev = u64_map_get(db->reverseAdjIndexByTarget, tgt);
-    if (!rev) {
-        rev        = EAVG_ADJLIST_ALLOC(db);
-        rev->srcId = tgt;
-        rev->edges = NULL;
-        rev->count = rev->cap = 0;
-        u64_map_put(db->reverseAdjIndexByTarget, tgt, rev);
-    }
-    if (rev->count == rev->cap) {
-        size_t newCap = rev->cap ? rev->cap * 2 : 4;
-        rev->edges     = arena_alloc(&db->edgeArena, newCap * sizeof *rev->edges);
-        rev->cap       = newCap;
+    rec.label = label_text(&db->edgeArena, label, labelLen, rec.labelSym);
+    if (snap_unshare(db, SNAP_EDGES) == 0 && (rec.label || !label)) {
+        fwd = adjlist_get_or_create(db, db->adjIndexBySource, src);
+        rev = adjlist_get_or_create(db, db->reverseAdjIndexByTarget, tgt);
+    }
+    if (!fwd || !rev ||
+        adjlist_reserve(db, fwd, fwd->count + 1) < 0 ||
+        adjlist_reserve(db, rev, rev->count + 1) < 0) {
+        UNLOCK_WR(db);
+        return NULL;
     }
 
     eavgEdgeRec *e = &fwd->edges[fwd->count++];
-    e->id             = db->nextEdgeId++;
-    e->relationTypeId = relTypeId;
-    e->targetEntity   = tgt;
-    e->weight         = weight;
-    e->direction      = direction;
-    e->label = label ? strdup_arena(&db->edgeArena, label) : NULL;
-    e->timestamp      = timestamp;
-
-    rev->edges[rev->count++] = *e;
+    *e = rec;
+    rev->edges[rev->count++] = rec;
+    change_edge(db, &ch, EAVG_CHANGE_ADD, e);
     UNLOCK_WR(db);
+    change_publish(db, &ch, 1);
     return e;
 }
 
-eavgAdjList *eavgDB_getAdjList(eavgDB *db, eavg_u64 src) {
-    LOCK_RD(db);
-    eavgAdjList *al = u64_map_get(db->adjIndexBySource, src);
-    UNLOCK_RD(db);
-    return al;
+static eavg_u64 bulk_resolve(eavg_u64 firstEntityId, eavg_u64 id) {
+    return (id & EAVG_BULK_REF_BIT) ? firstEntityId + (id & ~EAVG_BULK_REF_BIT) : id;
 }
-eavgAdjList *eavgDB_getReverseAdjList(eavgDB *db, eavg_u64 tgt) {
-    LOCK_RD(db);
-    eavgAdjList *al = u64_map_get(db->reverseAdjIndexByTarget, tgt);
-    UNLOCK_RD(db);
-    return al;
+
+static bool bulk_ref_ok(const eavgBulkBatch *b, eavg_u64 id) {
+    return !(id & EAVG_BULK_REF_BIT) || (id & ~EAVG_BULK_REF_BIT) < b->entityCount;
 }
 
-void eavgDB_forEachEdge(eavgDB *db,
-                        eavgEdgeCallback cb,
-                        void *userData)
-{
-    LOCK_RD(db);
-    size_t cap = db->adjIndexBySource->capacity;
-    for (size_t i = 0; i < cap; i++) {
-        eavgAdjList *al = (eavgAdjList*)db->adjIndexBySource->values[i];
-        if (!al) continue;
-        for (size_t j = 0; j < al->count; j++) {
-            if (cb(db, &al->edges[j], userData) != 0) {
-                UNLOCK_RD(db);
-                return;
-            }
-        }
+static int bulk_validate(eavgDB *db, const eavgBulkBatch *b) {
+    for (size_t i = 0; i < b->valueCount; i++) {
+        const eavgBulkValue *v  = &b->values[i];
+        eavgAttribute       *at = eavgDB_findAttributeByIdNoLock(db, v->attributeId);
+        if (!at || !bulk_ref_ok(b, v->entityId)) return -1;
+        if (at->dataType == EAVG_DATA_TYPE_ENTITY && !bulk_ref_ok(b, v->data.entityRef))
+            return -1;
     }
-    UNLOCK_RD(db);
+    for (size_t i = 0; i < b->edgeCount; i++) {
+        if (!bulk_ref_ok(b, b->edges[i].src) || !bulk_ref_ok(b, b->edges[i].tgt))
+            return -1;
+    }
+    return 0;
 }
 
-int eavgDB_removeRelationType(eavgDB *db, eavg_u64 id) {
-    LOCK_WR(db);
-    eavgRelationType *rt = u64_map_get(db->relationTypesById, id);
-    if (!rt) { UNLOCK_WR(db); return -1; }
-
-    u64_map_remove(db->relationTypesById, id);
-    str_map_remove(db->relationTypesByName, rt->name);
-    UNLOCK_WR(db);
-    return 0;
+/* Scratch maps count records per list key; the count lives in the value. */
+static void bulk_count(u64_map *counts, eavg_u64 key) {
+    uintptr_t n = (uintptr_t)u64_map_get(counts, key);
+    u64_map_put(counts, key, (void*)(n + 1));
 }
 
-int eavgDB_removeValue(eavgDB *db, eavg_u64 id) {
-    LOCK_WR(db);
-    for (size_t i = 0; i < db->valuesByEntity->capacity; i++) {
-        eavgValueList *vl = (eavgValueList*)db->valuesByEntity->values[i];
-        if (!vl) continue;
-        for (size_t j = 0; j < vl->count; j++) {
-            if (vl->values[j].id == id) {
-                for (size_t k = j + 1; k < vl->count; k++) {
-                    vl->values[k-1] = vl->values[k];
-                }
-                vl->count--;
-                UNLOCK_WR(db);
-                return 0;
-            }
-        }
-    }
-    UNLOCK_WR(db);
-    return -1;
+struct bulk_edge_job {
+    const eavgBulkBatch  *batch;
+    eavgAdjList         **fwdOf;
+    eavgAdjList         **revOf;
+    const eavgSymbol     *labels;
+    char *const          *labelText;
+    eavg_u64              firstEntityId;
+    eavg_u64              firstEdgeId;
+    const size_t         *slots;      /* edge index * 2, +1 for the reverse list */
+    size_t                begin, end;
+    eavgFuture           *future;
+};
+
+static void bulk_edge_rec(const struct bulk_edge_job *job, size_t i, eavgEdgeRec *rec) {
+    const eavgBulkEdge *in = &job->batch->edges[i];
+    rec->id             = job->firstEdgeId + i;
+    rec->relationTypeId = in->relationTypeId;
+    rec->sourceEntity   = bulk_resolve(job->firstEntityId, in->src);
+    rec->targetEntity   = bulk_resolve(job->firstEntityId, in->tgt);
+    rec->weight         = in->weight;
+    rec->direction      = in->direction;
+    rec->labelSym       = job->labels[i];
+    rec->label          = job->labelText[i];
+    rec->timestamp      = in->timestamp;
 }
 
-int
-eavgDB_removeEntity(eavgDB *db, eavg_u64 entityId)
-{
-    LOCK_WR(db);
-    eavgEntity *e = u64_map_get(db->entitiesById, entityId);
-    if (!e) {
-        UNLOCK_WR(db);
-        return -1;
+/* Each worker owns a disjoint set of lists and gets just their slots, so
+ * all capacity must have been reserved before the workers start. */
+static void bulk_fill_edges(const struct bulk_edge_job *job) {
+    for (size_t k = job->begin; k < job->end; k++) {
+        size_t       i  = job->slots[k] >> 1;
+        eavgAdjList *al = job->slots[k] & 1 ? job->revOf[i] : job->fwdOf[i];
+        bulk_edge_rec(job, i, &al->edges[al->count++]);
     }
+}
 
-    u64_map_remove(db->valuesByEntity, entityId);
+static int bulk_fill_job(eavgDB *db, eavgFuture *f, void *arg) {
+    (void)db;
+    (void)f;
+    bulk_fill_edges(arg);
+    return 0;
+}
 
-    u64_map_remove(db->adjIndexBySource, entityId);
-    u64_map_remove(db->reverseAdjIndexByTarget, entityId);
+static unsigned bulk_owner(const eavgAdjList *al, unsigned workers) {
+    return ((uintptr_t)al >> 5) % workers;
+}
 
-    for (size_t i = 0; i < db->adjIndexBySource->capacity; i++) {
-        eavgAdjList *al = (eavgAdjList*)db->adjIndexBySource->values[i];
-        if (!al) continue;
-        size_t w = 0;
-        for (size_t j = 0; j < al->count; j++) {
-            if (al->edges[j].targetEntity != entityId) {
-                al->edges[w++] = al->edges[j];
-            }
-        }
-        al->count = w;
+/* Buckets the list slots by owning worker, in edge order, and fills them
+ * with the calling thread as worker 0 and the rest on the db's pool.  A
+ * job the pool has not started yet is cancelled and run here instead. */
+static int bulk_fill_parallel(eavgDB *db, struct bulk_edge_job *base, unsigned workers) {
+    size_t                n     = base->batch->edgeCount;
+    size_t               *slots = malloc(2 * n * sizeof *slots);
+    size_t               *start = calloc(workers + 1, sizeof *start);
+    struct bulk_edge_job *jobs  = calloc(workers, sizeof *jobs);
+    if (!slots || !start || !jobs) {
+        free(slots);
+        free(start);
+        free(jobs);
+        return -1;
     }
-
-    u64_map_remove(db->entitiesById, entityId);
-    if (e->name) {
-        str_map_remove(db->entitiesByName, e->name);
+    for (size_t i = 0; i < n; i++) {
+        start[bulk_owner(base->fwdOf[i], workers) + 1]++;
+        start[bulk_owner(base->revOf[i], workers) + 1]++;
+    }
+    for (unsigned w = 0; w < workers; w++) start[w + 1] += start[w];
+    for (unsigned w = 0; w < workers; w++) {
+        jobs[w]       = *base;
+        jobs[w].slots = slots;
+        jobs[w].begin = jobs[w].end = start[w];
+    }
+    for (size_t i = 0; i < n; i++) {
+        slots[jobs[bulk_owner(base->fwdOf[i], workers)].end++] = i << 1;
+        slots[jobs[bulk_owner(base->revOf[i], workers)].end++] = i << 1 | 1;
     }
 
-    UNLOCK_WR(db);
+    eavgExecutor *ex = db_pool(db);
+    for (unsigned w = 1; ex && w < workers; w++)
+        jobs[w].future = eavgExecutor_submit(ex, bulk_fill_job, &jobs[w], NULL, NULL);
+    bulk_fill_edges(&jobs[0]);
+    for (unsigned w = 1; w < workers; w++) {
+        if (!jobs[w].future || eavgFuture_cancel(jobs[w].future))
+            bulk_fill_edges(&jobs[w]);
+        else
+            eavgFuture_wait(jobs[w].future, -1);
+        eavgFuture_release(jobs[w].future);
+    }
+    free(slots);
+    free(start);
+    free(jobs);
     return 0;
 }
 
-int eavgDB_removeEdge(eavgDB *db, eavg_u64 id) {
-    int removed = 0;
-    LOCK_WR(db);
-    for (size_t i = 0; i < db->adjIndexBySource->capacity; i++) {
-        eavgAdjList *al = (eavgAdjList*)db->adjIndexBySource->values[i];
-        if (!al) continue;
-        for (size_t j = 0; j < al->count; j++) {
-            if (al->edges[j].id == id) {
-                for (size_t k = j+1; k < al->count; k++)
-                    al->edges[k-1] = al->edges[k];
-                al->count--;
-                removed++;
-                break;
-            }
-        }
+static int bulk_reserve_lists(eavgDB *db, u64_map *index, u64_map *counts) {
+    if (u64_map_reserve(index, counts->count) < 0) return -1;
+    for (size_t i = 0; i < counts->capacity; i++) {
+        if (!counts->keys[i]) continue;
+        eavgAdjList *al = adjlist_get_or_create(db, index, counts->keys[i]);
+        size_t       n  = (uintptr_t)counts->values[i];
+        if (!al || adjlist_reserve(db, al, al->count + n) < 0) return -1;
+        counts->values[i] = al;
     }
-    for (size_t i = 0; i < db->reverseAdjIndexByTarget->capacity; i++) {
-        eavgAdjList *al = (eavgAdjList*)db->reverseAdjIndexByTarget->values[i];
+    return 0;
+}
+
+/* What bulk_apply has linked in so far, for bulk_rollback to take back
+ * out, and what bulk_changes needs to report a batch that went in whole. */
+struct bulk_undo {
+    eavg_u64     firstEntityId;
+    size_t       entities, values;   /* linked so far */
+    bool         edges;              /* the lists are filled */
+    eavgEntity **shadowed;           /* per entity: whom its name found before */
+    eavgSymbol  *labels;             /* per edge */
+    char       **labelText;
+};
+
+static void bulk_undo_free(struct bulk_undo *u) {
+    free(u->shadowed);
+    free(u->labels);
+    free(u->labelText);
+}
+
+static int bulk_insert_edges(eavgDB *db, eavgBulkBatch *b, struct bulk_undo *u) {
+    size_t          n      = b->edgeCount;
+    eavg_u64        first  = u->firstEntityId;
+    u64_map        *outCnt = u64_map_create(n * 2);
+    u64_map        *inCnt  = u64_map_create(n * 2);
+    eavgAdjList   **fwdOf  = malloc(n * sizeof *fwdOf);
+    eavgAdjList   **revOf  = malloc(n * sizeof *revOf);
+    int             rc     = -1;
+
+    u->labels    = malloc(n * sizeof *u->labels);
+    u->labelText = malloc(n * sizeof *u->labelText);
+    if (!outCnt || !inCnt || !fwdOf || !revOf || !u->labels || !u->labelText) goto out;
+
+    for (size_t i = 0; i < n; i++) {
+        const eavgBulkEdge *e = &b->edges[i];
+        bulk_count(outCnt, bulk_resolve(first, e->src));
+        bulk_count(inCnt,  bulk_resolve(first, e->tgt));
+        size_t len = e->label ? strlen(e->label) : 0;
+        u->labels[i]    = label_sym(e->label, len);
+        u->labelText[i] = label_text(&db->edgeArena, e->label, len, u->labels[i]);
+        if (e->label && !u->labelText[i]) goto out;
+    }
+    if (bulk_reserve_lists(db, db->adjIndexBySource, outCnt) < 0 ||
+        bulk_reserve_lists(db, db->reverseAdjIndexByTarget, inCnt) < 0) goto out;
+    for (size_t i = 0; i < n; i++) {
+        fwdOf[i] = u64_map_get(outCnt, bulk_resolve(first, b->edges[i].src));
+        revOf[i] = u64_map_get(inCnt,  bulk_resolve(first, b->edges[i].tgt));
+    }
+
+    b->firstEdgeId = atomic_fetch_add(&db->nextEdgeId, n);
+    {
+        struct bulk_edge_job job = { b, fwdOf, revOf, u->labels, u->labelText, first,
+                                     b->firstEdgeId, NULL, 0, 0, NULL };
+        unsigned             workers = b->threads ? b->threads : 1;
+        if (workers > 64) workers = 64;
+        if (workers == 1 || bulk_fill_parallel(db, &job, workers) < 0) {
+            for (size_t i = 0; i < n; i++) {
+                bulk_edge_rec(&job, i, &fwdOf[i]->edges[fwdOf[i]->count++]);
+                revOf[i]->edges[revOf[i]->count++] = fwdOf[i]->edges[fwdOf[i]->count - 1];
+            }
+        }
+    }
+    u->edges = true;
+    rc       = 0;
+
+ out:
+    u64_map_destroy(outCnt);
+    u64_map_destroy(inCnt);
+    free(fwdOf);
+    free(revOf);
+    return rc;
+}
+
+static int bulk_insert_values(eavgDB *db, eavgBulkBatch *b, struct bulk_undo *u) {
+    eavg_u64 first  = u->firstEntityId;
+    u64_map *counts = u64_map_create(b->valueCount * 2);
+    if (!counts) return -1;
+    for (size_t i = 0; i < b->valueCount; i++)
+        bulk_count(counts, bulk_resolve(first, b->values[i].entityId));
+    if (u64_map_reserve(db->valuesByEntity, counts->count) < 0) {
+        u64_map_destroy(counts);
+        return -1;
+    }
+    for (size_t i = 0; i < counts->capacity; i++) {
+        if (!counts->keys[i]) continue;
+        eavgValueList *vl = valuelist_get_or_create(db, counts->keys[i]);
+        if (!vl || valuelist_reserve(db, vl, vl->count + (uintptr_t)counts->values[i]) < 0) {
+            u64_map_destroy(counts);
+            return -1;
+        }
+    }
+    u64_map_destroy(counts);
+
+    b->firstValueId = db->nextValueId;
+    for (size_t i = 0; i < b->valueCount; i++) {
+        const eavgBulkValue *v  = &b->values[i];
+        eavgAttribute       *at = eavgDB_findAttributeByIdNoLock(db, v->attributeId);
+        eavgValRec          *r  = add_value_rec(db, bulk_resolve(first, v->entityId),
+                                                v->attributeId);
+        eavgValueData        data = v->data;
+        if (!r) return -1;
+        u->values++;
+        if (at->dataType == EAVG_DATA_TYPE_ENTITY)
+            data.entityRef = bulk_resolve(first, data.entityRef);
+        if (value_store(db, at->dataType, r, data, v->length) < 0) return -1;
+    }
+    return 0;
+}
+
+/* Drops the batch's edge from the end of a list, when the fill got that
+ * far, and the list itself once the batch left it empty. */
+static void bulk_unlink_edge(eavgDB *db, u64_map *index, eavg_u64 key, bool filled) {
+    eavgAdjList *al = u64_map_get(index, key);
+    if (!al) return;
+    if (filled) al->count--;
+    if (al->count) return;
+    u64_map_remove(index, key);
+    snap_release(db, al, NULL);
+}
+
+/* Takes a batch back out, newest record first, so each one is the last
+ * of its lists again.  Nothing here allocates: map puts only restore keys
+ * just removed.  Ids the batch used stay used. */
+static void bulk_rollback(eavgDB *db, const eavgBulkBatch *b, struct bulk_undo *u) {
+    eavg_u64 first = u->firstEntityId;
+    for (size_t i = b->edgeCount; i-- > 0; ) {
+        const eavgBulkEdge *e = &b->edges[i];
+        bulk_unlink_edge(db, db->adjIndexBySource, bulk_resolve(first, e->src), u->edges);
+        bulk_unlink_edge(db, db->reverseAdjIndexByTarget, bulk_resolve(first, e->tgt), u->edges);
+    }
+    u->edges = false;
+
+    for (size_t i = b->valueCount; i-- > 0; ) {
+        eavg_u64       entityId = bulk_resolve(first, b->values[i].entityId);
+        eavgValueList *vl       = u64_map_get(db->valuesByEntity, entityId);
+        if (!vl) continue;
+        if (i < u->values) {
+            eavg_u64 attributeId = b->values[i].attributeId;
+            value_index_drop(db, b->firstValueId + i);
+            vl->count--;
+            if (!value_list_has_attribute(vl, attributeId))
+                index_remove(db->entitiesByAttribute, attributeId, entityId);
+        }
+        if (!vl->count) {
+            u64_map_remove(db->valuesByEntity, entityId);
+            snap_release(db, NULL, vl);
+        }
+    }
+    u->values = 0;
+
+    for (size_t i = u->entities; i-- > 0; ) {
+        eavgEntity *e = u64_map_get(db->entitiesById, first + i);
+        index_remove(db->entitiesByType, EAVG_TYPE_KEY(e->typeId), e->id);
+        if (e->name) {
+            str_map_remove(db->entitiesByName, e->name);
+            if (u->shadowed[i])
+                str_map_put(db->entitiesByName, u->shadowed[i]->name, u->shadowed[i]);
+        }
+        u64_map_remove(db->entitiesById, e->id);
+    }
+    u->entities = 0;
+}
+
+/* Links a batch in under the write lock without reporting it.  When it
+ * fails part way it takes back what it linked, so either the whole batch
+ * is in or the db is as it was; *u needs bulk_undo_free either way. */
+static int bulk_apply(eavgDB *db, eavgBulkBatch *b, struct bulk_undo *u) {
+    *u = (struct bulk_undo){ 0 };
+    if (bulk_validate(db, b) < 0 ||
+        snap_unshare(db, SNAP_MAP(SNAP_ENTITIES) | SNAP_NAMES |
+                         SNAP_MAP(SNAP_VALUES) | SNAP_EDGES) < 0) return -1;
+    if (b->entityCount && !(u->shadowed = calloc(b->entityCount, sizeof *u->shadowed)))
+        return -1;
+    if (u64_map_reserve(db->entitiesById, b->entityCount) < 0 ||
+        str_map_reserve(db->entitiesByName, b->entityCount) < 0) return -1;
+
+    u->firstEntityId = atomic_fetch_add(&db->nextEntityId, b->entityCount);
+    for (size_t i = 0; i < b->entityCount; i++) {
+        const eavgBulkEntity *in = &b->entities[i];
+        eavgEntity *e = EAVG_ENTITY_ALLOC(db);
+        if (!e) goto fail;
+        e->id     = u->firstEntityId + i;
+        e->typeId = in->typeId;
+        e->name   = strdup_arena(&db->entityArena, in->name);
+        if (in->name && !e->name) goto fail;
+        u64_map_put(db->entitiesById, e->id, e);
+        if (e->name) {
+            u->shadowed[i] = str_map_get(db->entitiesByName, e->name);
+            str_map_put(db->entitiesByName, e->name, e);
+        }
+        index_add(db->entitiesByType, EAVG_TYPE_KEY(e->typeId), e->id);
+        u->entities++;
+        if (b->entityIds) b->entityIds[i] = e->id;
+    }
+    if (b->valueCount && bulk_insert_values(db, b, u) < 0) goto fail;
+    if (b->edgeCount && bulk_insert_edges(db, b, u) < 0) goto fail;
+    return 0;
+
+ fail:
+    bulk_rollback(db, b, u);
+    return -1;
+}
+
+/* Stamps one event per record of a batch that went in whole, or, with
+ * nobody to tell, only marks what it touched. */
+static void bulk_changes(eavgDB *db, const eavgBulkBatch *b, const struct bulk_undo *u,
+                         eavgChange *changes)
+{
+    eavgChange *c = changes;
+    for (size_t i = 0; i < b->entityCount; i++) {
+        eavgEntity *e = u64_map_get(db->entitiesById, u->firstEntityId + i);
+        if (c) {
+            change_entity(db, c++, EAVG_CHANGE_ADD, e);
+        } else {
+            dirty_mark(db, DIRTY_ENTITIES, e->id);
+            cache_bump(db->cache, CACHE_DEP_TYPE, e->typeId);
+        }
+    }
+    for (size_t i = 0; i < b->valueCount; i++) {
+        eavgValueLoc *loc = u64_map_get(db->valuesById, b->firstValueId + i);
+        if (c)
+            change_value(db, c++, EAVG_CHANGE_ADD, loc->list->entityId,
+                         &loc->list->values[loc->slot]);
+        else
+            dirty_mark(db, DIRTY_VALUES, loc->list->entityId);
+    }
+    struct bulk_edge_job job = { b, NULL, NULL, u->labels, u->labelText, u->firstEntityId,
+                                 b->firstEdgeId, NULL, 0, 0, NULL };
+    for (size_t i = 0; i < b->edgeCount; i++) {
+        eavgEdgeRec rec;
+        bulk_edge_rec(&job, i, &rec);
+        if (c) {
+            change_edge(db, c++, EAVG_CHANGE_ADD, &rec);
+        } else {
+            dirty_mark(db, DIRTY_EDGES, rec.sourceEntity);
+            cache_bump(db->cache, CACHE_DEP_EDGES, rec.sourceEntity);
+            cache_bump(db->cache, CACHE_DEP_EDGES, rec.targetEntity);
+        }
+    }
+}
+
+/* Bulk inserts run onValueAdded hooks under the read lock once the batch
+ * is in, since record pointers are only stable while no writer runs. */
+static void bulk_value_hooks(eavgDB *db, const eavgBulkBatch *b) {
+    LOCK_RD(db);
+    for (size_t i = 0; i < b->valueCount; i++) {
+        eavgAttribute *at = eavgDB_findAttributeByIdNoLock(db, b->values[i].attributeId);
+        if (!at || !at->onValueAdded) continue;
+        eavgValueLoc *loc = u64_map_get(db->valuesById, b->firstValueId + i);
+        if (loc) at->onValueAdded(at, &loc->list->values[loc->slot], at->userData);
+    }
+    UNLOCK_RD(db);
+}
+
+/* Faults in the lists of the db's own entities the batch adds to. */
+static int bulk_fault(eavgDB *db, const eavgBulkBatch *b) {
+    for (size_t i = 0; lazy_any(db) && i < b->valueCount; i++) {
+        eavg_u64 id = b->values[i].entityId;
+        if (!(id & EAVG_BULK_REF_BIT) && lazy_fault(db, CHK_VALUES, id) < 0) return -1;
+    }
+    for (size_t i = 0; lazy_any(db) && i < b->edgeCount; i++) {
+        const eavgBulkEdge *e = &b->edges[i];
+        if (!(e->src & EAVG_BULK_REF_BIT) && lazy_fault(db, CHK_OUT, e->src) < 0) return -1;
+        if (!(e->tgt & EAVG_BULK_REF_BIT) && lazy_fault(db, CHK_IN, e->tgt) < 0) return -1;
+    }
+    return 0;
+}
+
+int eavgDB_bulkInsert(eavgDB *db, eavgBulkBatch *b) {
+    STATS_OP(EAVG_OP_BULK_INSERT);
+    return tx_apply(db, b, NULL, 0);
+}
+
+eavgSubscription *eavgDB_subscribe(eavgDB *db, size_t capacity, size_t batchMax,
+                                   eavgFeedPolicy policy,
+                                   eavgChangeCallback cb, void *userData)
+{
+    /* under the write lock, so every write that commits after this
+     * returns is delivered */
+    LOCK_WR(db);
+    eavgSubscription *s = change_feed_subscribe(db->feed, capacity, batchMax,
+                                                policy, cb, userData);
+    UNLOCK_WR(db);
+    return s;
+}
+
+int eavgDB_unsubscribe(eavgDB *db, eavgSubscription *sub) {
+    return sub ? change_feed_unsubscribe(db->feed, sub) : -1;
+}
+
+eavgAdjList *eavgDB_getAdjList(eavgDB *db, eavg_u64 src) {
+    STATS_OP(EAVG_OP_GET_EDGES);
+    if (lazy_fault(db, CHK_OUT, src) < 0) return NULL;
+    LOCK_RD(db);
+    eavgAdjList *al = u64_map_get(db->adjIndexBySource, src);
+    UNLOCK_RD(db);
+    return al;
+}
+eavgAdjList *eavgDB_getReverseAdjList(eavgDB *db, eavg_u64 tgt) {
+    STATS_OP(EAVG_OP_GET_EDGES);
+    if (lazy_fault(db, CHK_IN, tgt) < 0) return NULL;
+    LOCK_RD(db);
+    eavgAdjList *al = u64_map_get(db->reverseAdjIndexByTarget, tgt);
+    UNLOCK_RD(db);
+    return al;
+}
+
+/* Pins the db's current tables for s.  The caller holds the lock, which
+ * keeps writers out; snapLock orders concurrent begins. */
+static void snapshot_pin(eavgDB *db, eavgSnapshot *s) {
+    pthread_mutex_lock(&db->snapLock);
+    s->db    = db;
+    s->epoch = db->epoch++;
+    s->whole = CHK_ALL;
+    for (int sec = 0; sec < CHK_SECTIONS; sec++)
+        if (lazy_pending(db, sec) || lazy_bad(db, sec)) s->whole &= ~CHK_MASK(sec);
+    pthread_mutex_init(&s->lazyLock, NULL);
+    arena_init(&s->lazyArena, 1 << 16);
+    memset(s->lazyLists, 0, sizeof s->lazyLists);
+    for (int i = 0; i < SNAP_U64_MAPS; i++) s->maps[i] = *snap_field(db, i);
+    s->entitiesByName = db->entitiesByName;
+    s->older = db->snapNewest;
+    s->newer = NULL;
+    if (db->snapNewest) db->snapNewest->newer = s;
+    else                db->snapOldest        = s;
+    db->snapNewest = s;
+    pthread_mutex_unlock(&db->snapLock);
+}
+
+eavgSnapshot *eavgDB_snapshotBeginWith(eavgDB *db, void (*pinned)(eavgDB*, void*),
+                                       void *userData)
+{
+    STATS_OP(EAVG_OP_SNAPSHOT);
+    eavgSnapshot *s = malloc(sizeof *s);
+    if (!s) return NULL;
+    LOCK_RD(db);
+    snapshot_pin(db, s);
+    if (pinned) pinned(db, userData);
+    UNLOCK_RD(db);
+    return s;
+}
+
+eavgSnapshot *eavgDB_snapshotBegin(eavgDB *db) {
+    return eavgDB_snapshotBeginWith(db, NULL, NULL);
+}
+
+void eavgDB_snapshotEnd(eavgSnapshot *s) {
+    if (!s) return;
+    eavgDB *db = s->db;
+    LOCK_WR(db);
+    if (s->older) s->older->newer = s->newer;
+    else          db->snapOldest  = s->newer;
+    if (s->newer) s->newer->older = s->older;
+    else          db->snapNewest  = s->older;
+    snap_reclaim(db, false);
+    UNLOCK_WR(db);
+    for (int i = 0; i < 3; i++) u64_map_destroy(s->lazyLists[i]);
+    arena_destroy(&s->lazyArena);
+    pthread_mutex_destroy(&s->lazyLock);
+    free(s);
+}
+
+eavgEntity *eavgSnapshot_findEntityById(eavgSnapshot *s, eavg_u64 id) {
+    return u64_map_get(s->maps[SNAP_ENTITIES], id);
+}
+
+eavgEntity *eavgSnapshot_findEntityByName(eavgSnapshot *s, const char *name) {
+    return str_map_get(s->entitiesByName, name);
+}
+
+eavgValueList *eavgSnapshot_getValueList(eavgSnapshot *s, eavg_u64 entityId) {
+    return snap_list(s, CHK_VALUES, entityId);
+}
+
+eavgAdjList *eavgSnapshot_getAdjList(eavgSnapshot *s, eavg_u64 src) {
+    return snap_list(s, CHK_OUT, src);
+}
+
+eavgAdjList *eavgSnapshot_getReverseAdjList(eavgSnapshot *s, eavg_u64 tgt) {
+    return snap_list(s, CHK_IN, tgt);
+}
+
+size_t eavgSnapshot_entitySlots(const eavgSnapshot *s) {
+    return s->maps[SNAP_ENTITIES]->capacity;
+}
+
+size_t eavgSnapshot_edgeSlots(const eavgSnapshot *s) {
+    return s->maps[SNAP_OUT]->capacity + snap_chunk_slots(s);
+}
+
+int eavgSnapshot_forEachEntityInRange(eavgSnapshot *s, size_t begin, size_t end,
+                                      eavgEntityCallback cb, void *userData)
+{
+    u64_map *m = s->maps[SNAP_ENTITIES];
+    if (end > m->capacity) end = m->capacity;
+    for (size_t i = begin; i < end; i++) {
+        eavgEntity *e = (eavgEntity*)m->values[i];
+        int         rc;
+        if (e && (rc = cb(s->db, e, userData)) != 0) return rc;
+    }
+    return 0;
+}
+
+int eavgSnapshot_forEachEdgeInRange(eavgSnapshot *s, size_t begin, size_t end,
+                                    eavgEdgeCallback cb, void *userData)
+{
+    u64_map *m     = s->maps[SNAP_OUT];
+    bool     whole = !snap_chunk_slots(s);
+    if (end > eavgSnapshot_edgeSlots(s)) end = eavgSnapshot_edgeSlots(s);
+    for (size_t i = begin; i < end; i++) {
+        int rc = 0;
+        if (i >= m->capacity) {
+            rc = snap_walk_chunk(s, i - m->capacity, cb, userData);
+        } else {
+            eavgAdjList *al = (eavgAdjList*)m->values[i];
+            if (!al || (!whole && !snap_sees_key(s, CHK_OUT, al->srcId))) continue;
+            if (s->db->image && img_resolve(s->db, CHK_OUT, al) < 0) continue;
+            for (size_t j = 0; j < al->count && rc == 0; j++) rc = cb(s->db, &al->edges[j], userData);
+        }
+        if (rc != 0) return rc;
+    }
+    return 0;
+}
+
+void eavgSnapshot_forEachEntity(eavgSnapshot *s, eavgEntityCallback cb, void *userData) {
+    eavgSnapshot_forEachEntityInRange(s, 0, eavgSnapshot_entitySlots(s), cb, userData);
+}
+
+void eavgSnapshot_forEachEdge(eavgSnapshot *s, eavgEdgeCallback cb, void *userData) {
+    eavgSnapshot_forEachEdgeInRange(s, 0, eavgSnapshot_edgeSlots(s), cb, userData);
+}
+
+#define PAR_MAX_THREADS        64
+#define PAR_MIN_CHUNK          1024   /* slots; smaller chunks cost more to hand out than they save */
+#define PAR_CHUNKS_PER_WORKER  16     /* slack for uneven chunks */
+#define PAR_STATE_ALIGN        64     /* keeps worker states off each other's cache lines */
+
+struct par_walk {
+    eavgSnapshot       *snap;
+    eavgEntityCallback  entityCb;   /* exactly one of the two is set */
+    eavgEdgeCallback    edgeCb;
+    size_t              slots;
+    size_t              chunkSlots;
+    _Atomic size_t      nextSlot;
+    _Atomic int         stop;
+};
+
+struct par_worker {
+    struct par_walk *walk;
+    void            *state;
+    eavgFuture      *job;
+};
+
+static void par_run(struct par_worker *w) {
+    struct par_walk *walk = w->walk;
+    while (!atomic_load_explicit(&walk->stop, memory_order_relaxed)) {
+        size_t begin = atomic_fetch_add(&walk->nextSlot, walk->chunkSlots);
+        if (begin >= walk->slots) break;
+        size_t end = begin + walk->chunkSlots;
+        int    rc  = walk->entityCb
+            ? eavgSnapshot_forEachEntityInRange(walk->snap, begin, end, walk->entityCb, w->state)
+            : eavgSnapshot_forEachEdgeInRange(walk->snap, begin, end, walk->edgeCb, w->state);
+        if (rc != 0) atomic_store(&walk->stop, 1);
+    }
+}
+
+static int par_job(eavgDB *db, eavgFuture *f, void *arg) {
+    (void)db;
+    (void)f;
+    par_run(arg);
+    return 0;
+}
+
+eavgExecutor *db_pool(eavgDB *db) {
+    eavgExecutor *ex = atomic_load(&db->walkPool);
+    if (ex) return ex;
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1)               n = 1;
+    if (n > PAR_MAX_THREADS) n = PAR_MAX_THREADS;
+    ex = eavgExecutor_create(db, (unsigned)n, 0);
+    eavgExecutor *none = NULL;
+    if (ex && !atomic_compare_exchange_strong(&db->walkPool, &none, ex)) {
+        eavgExecutor_destroy(ex);
+        ex = none;
+    }
+    return ex;
+}
+
+/* Worker 0 is the calling thread.  It hands out chunks until none are
+ * left, so the walk completes even when no job gets a thread (a busy or
+ * full executor, a refused submission); jobs still queued by then are
+ * cancelled rather than waited for. */
+static int par_for_each(eavgDB *db, const eavgParallelOptions *opt,
+                        eavgEntityCallback entityCb, eavgEdgeCallback edgeCb,
+                        void *userData)
+{
+    static const eavgParallelOptions defaults = { 0 };
+    if (!opt) opt = &defaults;
+
+    unsigned threads = opt->threads;
+    if (!threads) {
+        long n  = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = n > 0 ? (unsigned)n : 1;
+    }
+    if (threads > PAR_MAX_THREADS) threads = PAR_MAX_THREADS;
+    size_t stride = (opt->stateSize + PAR_STATE_ALIGN - 1) & ~(size_t)(PAR_STATE_ALIGN - 1);
+
+    struct par_worker *workers = calloc(threads, sizeof *workers);
+    char              *states  = stride ? aligned_alloc(PAR_STATE_ALIGN, threads * stride) : NULL;
+    eavgSnapshot      *s       = eavgDB_snapshotBegin(db);
+    if (!workers || (stride && !states) || !s) {
+        free(workers);
+        free(states);
+        eavgDB_snapshotEnd(s);
+        return -1;
+    }
+    if (states) memset(states, 0, threads * stride);
+
+    struct par_walk walk = { .snap = s, .entityCb = entityCb, .edgeCb = edgeCb };
+    walk.slots      = entityCb ? eavgSnapshot_entitySlots(s) : eavgSnapshot_edgeSlots(s);
+    walk.chunkSlots = opt->chunkSlots;
+    if (!walk.chunkSlots) {
+        walk.chunkSlots = walk.slots / ((size_t)threads * PAR_CHUNKS_PER_WORKER);
+        if (walk.chunkSlots < PAR_MIN_CHUNK) walk.chunkSlots = PAR_MIN_CHUNK;
+    }
+    atomic_init(&walk.nextSlot, 0);
+    atomic_init(&walk.stop, 0);
+
+    for (unsigned w = 0; w < threads; w++) {
+        workers[w].walk  = &walk;
+        workers[w].state = stride ? states + w * stride : userData;
+        if (stride && opt->init) opt->init(workers[w].state, userData);
+    }
+    eavgExecutor *ex = threads > 1 ? (opt->executor ? opt->executor : db_pool(db)) : NULL;
+    for (unsigned w = 1; ex && w < threads; w++)
+        workers[w].job = eavgExecutor_submit(ex, par_job, &workers[w], NULL, NULL);
+    par_run(&workers[0]);
+    for (unsigned w = 1; w < threads; w++) {
+        if (!workers[w].job) continue;
+        if (!eavgFuture_cancel(workers[w].job)) eavgFuture_wait(workers[w].job, -1);
+        eavgFuture_release(workers[w].job);
+    }
+    for (unsigned w = 0; stride && opt->reduce && w < threads; w++)
+        opt->reduce(workers[w].state, userData);
+
+    int stopped = atomic_load(&walk.stop);
+    eavgDB_snapshotEnd(s);
+    free(states);
+    free(workers);
+    return stopped;
+}
+
+int eavgDB_parallelForEachEntity(eavgDB *db, const eavgParallelOptions *opt,
+                                 eavgEntityCallback cb, void *userData)
+{
+    STATS_OP(EAVG_OP_FOR_EACH_ENTITY);
+    return par_for_each(db, opt, cb, NULL, userData);
+}
+
+int eavgDB_parallelForEachEdge(eavgDB *db, const eavgParallelOptions *opt,
+                               eavgEdgeCallback cb, void *userData)
+{
+    STATS_OP(EAVG_OP_FOR_EACH_EDGE);
+    return par_for_each(db, opt, NULL, cb, userData);
+}
+
+void eavgDB_forEachEdge(eavgDB *db,
+                        eavgEdgeCallback cb,
+                        void *userData)
+{
+    STATS_OP(EAVG_OP_FOR_EACH_EDGE);
+    eavgSnapshot *s = eavgDB_snapshotBegin(db);
+    if (!s) return;
+    eavgSnapshot_forEachEdge(s, cb, userData);
+    eavgDB_snapshotEnd(s);
+}
+
+int eavgDB_removeRelationType(eavgDB *db, eavg_u64 id) {
+    STATS_OP(EAVG_OP_REMOVE_RELTYPE);
+    LOCK_WR(db);
+    eavgRelationType *rt = u64_map_get(db->relationTypesById, id);
+    if (!rt || snap_unshare(db, SNAP_MAP(SNAP_RELTYPES)) < 0) { UNLOCK_WR(db); return -1; }
+
+    u64_map_remove(db->relationTypesById, id);
+    str_map_remove(db->relationTypesByName, rt->name);
+    wal_log_reltype(db->wal, EAVG_CHANGE_REMOVE, rt);
+    UNLOCK_WR(db);
+    wal_commit(db->wal);
+    return 0;
+}
+
+/* Faults in the list holding value id, loading the rest of the values
+ * section when what is loaded lacks it (an image looks the list up in
+ * its own table).  -1 when a chunk is bad. */
+static int lazy_find_value(eavgDB *db, eavg_u64 id) {
+    if (!lazy_pending(db, CHK_VALUES) && !lazy_bad(db, CHK_VALUES)) return 0;
+    LOCK_RD(db);
+    eavgValueLoc *loc      = u64_map_get(db->valuesById, id);
+    eavg_u64      entityId = loc ? loc->list->entityId : 0;
+    UNLOCK_RD(db);
+    if (loc)       return lazy_fault(db, CHK_VALUES, entityId);
+    if (db->image) return img_find_value(db, id);
+    return lazy_settle(db, CHK_MASK(CHK_VALUES));
+}
+
+int eavgDB_removeValue(eavgDB *db, eavg_u64 id) {
+    STATS_OP(EAVG_OP_REMOVE_VALUE);
+    eavgChange ch = { 0 };
+    if (lazy_find_value(db, id) < 0) return -1;
+    LOCK_WR(db);
+    int rc = remove_value(db, id, false, &ch);
+    UNLOCK_WR(db);
+    change_publish(db, &ch, 1);
+    return rc;
+}
+
+int eavgDB_removeValueOrdered(eavgDB *db, eavg_u64 id) {
+    STATS_OP(EAVG_OP_REMOVE_VALUE);
+    eavgChange ch = { 0 };
+    if (lazy_find_value(db, id) < 0) return -1;
+    LOCK_WR(db);
+    int rc = remove_value(db, id, true, &ch);
+    UNLOCK_WR(db);
+    change_publish(db, &ch, 1);
+    return rc;
+}
+
+int eavgDB_updateValue(eavgDB *db, eavg_u64 valueId, eavgValueData data, size_t length) {
+    STATS_OP(EAVG_OP_UPDATE_VALUE);
+    int        rc = -1;
+    eavgChange ch = { 0 };
+    if (lazy_find_value(db, valueId) < 0) return -1;
+    LOCK_WR(db);
+    eavgValueLoc *loc = u64_map_get(db->valuesById, valueId);
+    if (loc && snap_unshare(db, SNAP_MAP(SNAP_VALUES)) == 0 && valuelist_unshare(db, loc->list)) {
+        eavgValRec    *r  = &loc->list->values[loc->slot];
+        eavgAttribute *at = eavgDB_findAttributeByIdNoLock(db, r->attributeId);
+        if (at) rc = value_store(db, at->dataType, r, data, length);
+        if (rc == 0) change_value(db, &ch, EAVG_CHANGE_UPDATE, loc->list->entityId, r);
+    }
+    UNLOCK_WR(db);
+    change_publish(db, &ch, 1);
+    return rc;
+}
+
+eavgValRec *eavgDB_findValueById(eavgDB *db, eavg_u64 valueId) {
+    STATS_OP(EAVG_OP_FIND_VALUE);
+    if (lazy_find_value(db, valueId) < 0) return NULL;
+    LOCK_RD(db);
+    eavgValueLoc *loc = u64_map_get(db->valuesById, valueId);
+    eavgValRec   *r   = loc ? &loc->list->values[loc->slot] : NULL;
+    UNLOCK_RD(db);
+    return r;
+}
+
+eavgValueList *eavgDB_getValueList(eavgDB *db, eavg_u64 entityId) {
+    STATS_OP(EAVG_OP_FIND_VALUE);
+    if (lazy_fault(db, CHK_VALUES, entityId) < 0) return NULL;
+    LOCK_RD(db);
+    eavgValueList *vl = u64_map_get(db->valuesByEntity, entityId);
+    UNLOCK_RD(db);
+    return vl;
+}
+
+/* Drops the records of al whose source (or target) endpoint is entityId. */
+static void adjlist_drop_endpoint(eavgAdjList *al, eavg_u64 entityId, bool bySource) {
+    if (!al) return;
+    size_t w = 0;
+    for (size_t j = 0; j < al->count; j++) {
+        eavg_u64 endpoint = bySource ? al->edges[j].sourceEntity
+                                     : al->edges[j].targetEntity;
+        if (endpoint != entityId) al->edges[w++] = al->edges[j];
+    }
+    al->count = w;
+}
+
+/* Faults in entityId's lists and the neighbours' lists its edges are in. */
+static int lazy_fault_entity(eavgDB *db, eavg_u64 entityId) {
+    if (!lazy_any(db)) return 0;
+    if (lazy_fault(db, CHK_VALUES, entityId) < 0 || lazy_fault(db, CHK_OUT, entityId) < 0 ||
+        lazy_fault(db, CHK_IN, entityId) < 0) return -1;
+    for (int x = 0; x < 2; x++) {
+        eavg_u64 *ids = NULL;
+        size_t    n   = 0;
+        LOCK_RD(db);
+        const eavgAdjList *al = u64_map_get(x ? db->reverseAdjIndexByTarget
+                                              : db->adjIndexBySource, entityId);
+        if (al && al->count && (ids = malloc(al->count * sizeof *ids))) {
+            for (n = 0; n < al->count; n++)
+                ids[n] = x ? al->edges[n].sourceEntity : al->edges[n].targetEntity;
+        }
+        bool oom = al && al->count && !ids;
+        UNLOCK_RD(db);
+        int rc = oom ? -1 : 0;
+        for (size_t i = 0; i < n && rc == 0; i++)
+            rc = lazy_fault(db, x ? CHK_OUT : CHK_IN, ids[i]);
+        free(ids);
+        if (rc < 0) return -1;
+    }
+    return 0;
+}
+
+int
+eavgDB_removeEntity(eavgDB *db, eavg_u64 entityId)
+{
+    STATS_OP(EAVG_OP_REMOVE_ENTITY);
+    eavgChange ch;
+    if (lazy_fault_entity(db, entityId) < 0) return -1;
+    LOCK_WR(db);
+    eavgEntity *e = u64_map_get(db->entitiesById, entityId);
+    if (!e || snap_unshare(db, SNAP_MAP(SNAP_ENTITIES) | SNAP_NAMES |
+                               SNAP_MAP(SNAP_VALUES) | SNAP_EDGES) < 0) {
+        UNLOCK_WR(db);
+        return -1;
+    }
+    change_entity(db, &ch, EAVG_CHANGE_REMOVE, e);
+
+    eavgValueList *vl = u64_map_get(db->valuesByEntity, entityId);
+    if (vl) {
+        for (size_t j = 0; j < vl->count; j++) {
+            index_remove(db->entitiesByAttribute, vl->values[j].attributeId, entityId);
+            value_index_drop(db, vl->values[j].id);
+        }
+    }
+    u64_map_remove(db->valuesByEntity, entityId);
+    snap_release(db, NULL, vl);
+
+    /* edges carry both endpoints, so only the neighbours' lists need fixing */
+    eavgAdjList *out = u64_map_get(db->adjIndexBySource, entityId);
+    if (out) {
+        for (size_t j = 0; j < out->count; j++) {
+            u64_map *index = db->reverseAdjIndexByTarget;
+            cache_bump(db->cache, CACHE_DEP_EDGES, out->edges[j].targetEntity);
+            adjlist_drop_endpoint(adjlist_unshare(db, index,
+                                                  u64_map_get(index, out->edges[j].targetEntity)),
+                                  entityId, true);
+        }
+    }
+    eavgAdjList *in = u64_map_get(db->reverseAdjIndexByTarget, entityId);
+    if (in) {
+        for (size_t j = 0; j < in->count; j++) {
+            u64_map *index = db->adjIndexBySource;
+            dirty_mark(db, DIRTY_EDGES, in->edges[j].sourceEntity);
+            cache_bump(db->cache, CACHE_DEP_EDGES, in->edges[j].sourceEntity);
+            adjlist_drop_endpoint(adjlist_unshare(db, index,
+                                                  u64_map_get(index, in->edges[j].sourceEntity)),
+                                  entityId, false);
+        }
+    }
+    in = u64_map_get(db->reverseAdjIndexByTarget, entityId);
+    out = u64_map_get(db->adjIndexBySource, entityId);
+    u64_map_remove(db->adjIndexBySource, entityId);
+    u64_map_remove(db->reverseAdjIndexByTarget, entityId);
+    snap_release(db, out, NULL);
+    snap_release(db, in, NULL);
+
+    index_remove(db->entitiesByType, EAVG_TYPE_KEY(e->typeId), entityId);
+    u64_map_remove(db->entitiesById, entityId);
+    if (e->name) {
+        str_map_remove(db->entitiesByName, e->name);
+    }
+
+    UNLOCK_WR(db);
+    change_publish(db, &ch, 1);
+    return 0;
+}
+
+/* The slot of edge id in al, or al->count when al lacks it. */
+static size_t adjlist_slot(const eavgAdjList *al, eavg_u64 id) {
+    size_t j = 0;
+    while (j < al->count && al->edges[j].id != id) j++;
+    return j;
+}
+
+static void adjlist_cut(eavgAdjList *al, size_t slot) {
+    memmove(&al->edges[slot], &al->edges[slot + 1], (al->count - slot - 1) * sizeof *al->edges);
+    al->count--;
+}
+
+/* Finds edge `id` in an adjacency index and returns its list, ready for
+ * writing, with the record at *slot. */
+static eavgAdjList *adjlist_find_edge(eavgDB *db, u64_map *index, eavg_u64 id, size_t *slot) {
+    for (size_t i = 0; i < index->capacity; i++) {
+        eavgAdjList *al = (eavgAdjList*)index->values[i];
         if (!al) continue;
         for (size_t j = 0; j < al->count; j++) {
-            if (al->edges[j].id == id) {
-                for (size_t k = j+1; k < al->count; k++)
-                    al->edges[k-1] = al->edges[k];
-                al->count--;
-                removed++;
+            if (al->edges[j].id != id) continue;
+            *slot = j;
+            return adjlist_unshare(db, index, al);
+        }
+    }
+    return NULL;
+}
+
+/* Faults in both lists holding edge id, loading the rest of the out-edge
+ * section when what is loaded lacks it.  -1 when a chunk is bad.  An
+ * image's out-edge lists are resolved first, since the scan reads them. */
+static int lazy_find_edge(eavgDB *db, eavg_u64 id) {
+    if (!lazy_pending(db, CHK_OUT) && !lazy_pending(db, CHK_IN) &&
+        !lazy_bad(db, CHK_OUT) && !lazy_bad(db, CHK_IN)) return 0;
+    if (db->image && img_settle(db, CHK_MASK(CHK_OUT)) < 0) return -1;
+    for (int pass = 0; pass < 2; pass++) {
+        eavg_u64 src = 0, tgt = 0;
+        bool     found = false;
+        LOCK_RD(db);
+        u64_map *index = db->adjIndexBySource;
+        for (size_t i = 0; i < index->capacity && !found; i++) {
+            const eavgAdjList *al = index->values[i];
+            for (size_t j = 0; al && j < al->count; j++) {
+                if (al->edges[j].id != id) continue;
+                src   = al->edges[j].sourceEntity;
+                tgt   = al->edges[j].targetEntity;
+                found = true;
+                break;
+            }
+        }
+        UNLOCK_RD(db);
+        if (found)
+            return lazy_fault(db, CHK_OUT, src) < 0 || lazy_fault(db, CHK_IN, tgt) < 0 ? -1 : 0;
+        if (pass == 0 && lazy_settle(db, CHK_MASK(CHK_OUT)) < 0) return -1;
+    }
+    return 0;
+}
+
+int eavgDB_removeEdge(eavgDB *db, eavg_u64 id) {
+    STATS_OP(EAVG_OP_REMOVE_EDGE);
+    int        removed = 0;
+    eavgChange ch      = { 0 };
+    if (lazy_find_edge(db, id) < 0) return -1;
+    LOCK_WR(db);
+    if (snap_unshare(db, SNAP_EDGES) == 0) {
+        u64_map *indexes[2] = { db->adjIndexBySource, db->reverseAdjIndexByTarget };
+        for (int x = 0; x < 2; x++) {
+            size_t       j;
+            eavgAdjList *al = adjlist_find_edge(db, indexes[x], id, &j);
+            if (!al) continue;
+            if (!removed) change_edge(db, &ch, EAVG_CHANGE_REMOVE, &al->edges[j]);
+            adjlist_cut(al, j);
+            removed++;
+        }
+    }
+    UNLOCK_WR(db);
+    change_publish(db, &ch, 1);
+    return removed ? 0 : -1;
+}
+
+const char *eavgValRec_getString(const eavgValRec *rec) {
+    if (rec->length & EAVG_VALUE_INLINE) return (const char*)rec->data.inlineBytes;
+    return rec->data.stringValue;
+}
+
+const unsigned char *eavgValRec_getBinary(const eavgValRec *rec, size_t *outLen) {
+    if (outLen) *outLen = rec->length & EAVG_VALUE_LENGTH_MAX;
+    if (rec->length & EAVG_VALUE_INLINE) return rec->data.inlineBytes;
+    return rec->data.binaryValue;
+}
+
+size_t eavgValRec_getLength(const eavgValRec *rec) {
+    return rec->length & EAVG_VALUE_LENGTH_MAX;
+}
+
+long eavgValRec_getInt(const eavgValRec *rec) {
+    return rec->data.intValue;
+}
+
+double eavgValRec_getDouble(const eavgValRec *rec) {
+    return rec->data.doubleValue;
+}
+
+eavg_u64 eavgValRec_getEntityRef(const eavgValRec *rec) {
+    return rec->data.entityRef;
+}
+
+int eavgDB_updateEdgeLabel(eavgDB *db, eavg_u64 edgeId, const char *newLabel) {
+    STATS_OP(EAVG_OP_UPDATE_EDGE);
+    int        updated = 0;
+    eavgChange ch      = { 0 };
+    size_t     len     = newLabel ? strlen(newLabel) : 0;
+    eavgSymbol sym     = label_sym(newLabel, len);
+
+    if (lazy_find_edge(db, edgeId) < 0) return -1;
+    LOCK_WR(db);
+    char *name = label_text(&db->edgeArena, newLabel, len, sym);
+    if ((name || !newLabel) && snap_unshare(db, SNAP_EDGES) == 0) {
+        u64_map *indexes[2] = { db->adjIndexBySource, db->reverseAdjIndexByTarget };
+        for (int x = 0; x < 2; x++) {
+            size_t       j;
+            eavgAdjList *al = adjlist_find_edge(db, indexes[x], edgeId, &j);
+            if (!al) continue;
+            al->edges[j].label    = name;
+            al->edges[j].labelSym = sym;
+            if (!updated) change_edge(db, &ch, EAVG_CHANGE_UPDATE, &al->edges[j]);
+            updated++;
+        }
+    }
+    UNLOCK_WR(db);
+    change_publish(db, &ch, 1);
+    return updated ? 0 : -1;
+}
+
+int eavgDB_updateEdgeWeight(eavgDB *db, eavg_u64 edgeId, double newWeight) {
+    STATS_OP(EAVG_OP_UPDATE_EDGE);
+    int        updated = 0;
+    eavgChange ch      = { 0 };
+    if (lazy_find_edge(db, edgeId) < 0) return -1;
+    LOCK_WR(db);
+    if (snap_unshare(db, SNAP_EDGES) == 0) {
+        u64_map *indexes[2] = { db->adjIndexBySource, db->reverseAdjIndexByTarget };
+        for (int x = 0; x < 2; x++) {
+            size_t       j;
+            eavgAdjList *al = adjlist_find_edge(db, indexes[x], edgeId, &j);
+            if (!al) continue;
+            al->edges[j].weight = newWeight;
+            if (!updated) change_edge(db, &ch, EAVG_CHANGE_UPDATE, &al->edges[j]);
+            updated++;
+        }
+    }
+    UNLOCK_WR(db);
+    change_publish(db, &ch, 1);
+    return updated ? 0 : -1;
+}
+
+/* Replay knows the endpoints from the record, so it looks only in src's
+ * out list and tgt's in list rather than scanning every list for the id
+ * as the calls above must. */
+int wal_replay_edge(eavgDB *db, bool remove, eavg_u64 id, eavg_u64 src, eavg_u64 tgt,
+                    double weight, const char *label)
+{
+    int        found = 0, done = 0;
+    eavgChange ch    = { 0 };
+    size_t     len   = label ? strlen(label) : 0;
+    eavgSymbol sym   = label_sym(label, len);
+
+    if (lazy_fault(db, CHK_OUT, src) < 0 || lazy_fault(db, CHK_IN, tgt) < 0) return -1;
+    LOCK_WR(db);
+    char *name = remove ? NULL : label_text(&db->edgeArena, label, len, sym);
+    if ((remove || name || !label) && snap_unshare(db, SNAP_EDGES) == 0) {
+        u64_map *indexes[2] = { db->adjIndexBySource, db->reverseAdjIndexByTarget };
+        eavg_u64 keys[2]    = { src, tgt };
+        for (int x = 0; x < 2; x++) {
+            eavgAdjList *al = u64_map_get(indexes[x], keys[x]);
+            size_t       j  = al ? adjlist_slot(al, id) : 0;
+            if (!al || j == al->count) continue;
+            found++;
+            if (!(al = adjlist_unshare(db, indexes[x], al))) continue;
+            if (!remove) {
+                al->edges[j].weight   = weight;
+                al->edges[j].label    = name;
+                al->edges[j].labelSym = sym;
+            }
+            if (!done) change_edge(db, &ch, remove ? EAVG_CHANGE_REMOVE : EAVG_CHANGE_UPDATE,
+                                   &al->edges[j]);
+            if (remove) adjlist_cut(al, j);
+            done++;
+        }
+    } else {
+        found = -1;
+    }
+    UNLOCK_WR(db);
+    change_publish(db, &ch, 1);
+    return found < 0 || done < found ? -1 : found ? 0 : 1;
+}
+
+/* Transactions.  tx_apply links a tx's adds in as a bulk batch, then
+ * applies its removes and updates one step at a time.  Each step pushes
+ * an undo entry for what it is about to change just before changing it;
+ * when a step fails, tx_undo walks the log back, newest entry first, so
+ * every entry finds the db as its step left it.  Undoing never allocates:
+ * list capacity only grows, map puts restore keys just removed, and
+ * value locators go back on the free list they came from.  Index
+ * removals, list releases and change events wait for tx_finish, which
+ * only runs once every step is in. */
+enum {
+    UNDO_VALUE_SET,       /* a value record overwritten in place */
+    UNDO_VALUE_CUT,       /* a value record taken out of its list */
+    UNDO_EDGE_SET,        /* both copies of an edge record overwritten */
+    UNDO_EDGE_CUT,        /* both copies of an edge record taken out */
+    UNDO_LIST_CUT,        /* a neighbour's list lost a removed entity's edges */
+    UNDO_UNINDEXED,       /* a removed entity's values left valuesById */
+    UNDO_LIST_DROPPED,    /* a removed entity's list left its index */
+    UNDO_ENTITY_DROPPED   /* a removed entity left entitiesById and its name */
+};
+
+typedef struct {
+    int kind;
+    union {
+        struct { eavg_u64 entityId; eavgValRec before, after; }              valueSet;
+        struct { eavg_u64 entityId; size_t slot; bool ordered; eavgValRec rec; } valueCut;
+        struct { eavgEdgeRec before, after; }                                edgeSet;
+        struct { eavgEdgeRec rec; size_t outSlot, inSlot; }                  edgeCut;
+        struct { int which; eavg_u64 key; eavgEdgeRec *saved; size_t count; } listCut;
+        struct { eavgValueList *vl; }                                        unindexed;
+        struct { int which; eavg_u64 key; void *list; }                      listDropped;
+        struct { eavgEntity *e; bool named; }                                entityDropped;
+    };
+} tx_undo;
+
+typedef struct {
+    tx_undo *entries;
+    size_t   count, cap;
+} tx_log;
+
+/* A new entry of kind at the end of the log; NULL on OOM.  The pointer
+ * lasts until the next push. */
+static tx_undo *tx_push(tx_log *log, int kind) {
+    if (log->count == log->cap) {
+        size_t   ncap    = log->cap ? log->cap * 2 : 16;
+        tx_undo *entries = realloc(log->entries, ncap * sizeof *entries);
+        if (!entries) return NULL;
+        log->entries = entries;
+        log->cap     = ncap;
+    }
+    tx_undo *u = &log->entries[log->count++];
+    memset(u, 0, sizeof *u);
+    u->kind = kind;
+    return u;
+}
+
+static void tx_log_free(tx_log *log) {
+    for (size_t k = 0; k < log->count; k++) {
+        if (log->entries[k].kind == UNDO_LIST_CUT) free(log->entries[k].listCut.saved);
+    }
+    free(log->entries);
+}
+
+/* Puts rec back at slot, into room an earlier cut left. */
+static void adjlist_uncut(eavgAdjList *al, size_t slot, const eavgEdgeRec *rec) {
+    EAVG_ASSERT(al && al->count < al->cap && slot <= al->count);
+    memmove(&al->edges[slot + 1], &al->edges[slot], (al->count - slot) * sizeof *al->edges);
+    al->edges[slot] = *rec;
+    al->count++;
+}
+
+/* Undoes value_cut, putting the locator back too. */
+static void value_uncut(eavgDB *db, eavgValueList *vl, size_t slot, const eavgValRec *rec,
+                        bool ordered)
+{
+    EAVG_ASSERT(vl && vl->count < vl->cap && slot <= vl->count);
+    if (ordered) {
+        memmove(&vl->values[slot + 1], &vl->values[slot],
+                (vl->count - slot) * sizeof *vl->values);
+        for (size_t k = slot + 1; k <= vl->count; k++) value_index_move(db, vl, k);
+    } else if (slot < vl->count) {
+        vl->values[vl->count] = vl->values[slot];
+        value_index_move(db, vl, vl->count);
+    }
+    vl->values[slot] = *rec;
+    vl->count++;
+    value_index_put(db, vl, slot);
+}
+
+/* Finds both copies of edge id, ready for writing: the out-list copy by
+ * a scan of the out index, the in-list copy in its target's list alone. */
+static int edge_locate(eavgDB *db, eavg_u64 id, eavgAdjList **out, size_t *outSlot,
+                       eavgAdjList **in, size_t *inSlot)
+{
+    u64_map *index = db->reverseAdjIndexByTarget;
+    *out = adjlist_find_edge(db, db->adjIndexBySource, id, outSlot);
+    if (!*out) return -1;
+    *in = adjlist_unshare(db, index, u64_map_get(index, (*out)->edges[*outSlot].targetEntity));
+    if (!*in) return -1;
+    *inSlot = adjlist_slot(*in, id);
+    return *inSlot < (*in)->count ? 0 : -1;
+}
+
+static int tx_update_value(eavgDB *db, tx_log *log, const eavgTxOp *op) {
+    eavgValueLoc *loc = u64_map_get(db->valuesById, op->id);
+    if (!loc || !valuelist_unshare(db, loc->list)) return -1;
+    eavgValRec    *r  = &loc->list->values[loc->slot];
+    eavgAttribute *at = eavgDB_findAttributeByIdNoLock(db, r->attributeId);
+    tx_undo       *u  = at ? tx_push(log, UNDO_VALUE_SET) : NULL;
+    if (!u) return -1;
+    u->valueSet.entityId = loc->list->entityId;
+    u->valueSet.before   = *r;
+    if (value_store(db, at->dataType, r, op->data, op->length) < 0) return -1;
+    u->valueSet.after = *r;
+    return 0;
+}
+
+static int tx_remove_value(eavgDB *db, tx_log *log, const eavgTxOp *op) {
+    eavgValueLoc  *loc = u64_map_get(db->valuesById, op->id);
+    eavgValueList *vl  = loc ? valuelist_unshare(db, loc->list) : NULL;
+    tx_undo       *u   = vl ? tx_push(log, UNDO_VALUE_CUT) : NULL;
+    if (!u) return -1;
+    u->valueCut.entityId = vl->entityId;
+    u->valueCut.slot     = loc->slot;
+    u->valueCut.ordered  = op->ordered;
+    u->valueCut.rec      = vl->values[loc->slot];
+    value_cut(db, vl, u->valueCut.slot, op->ordered);
+    return 0;
+}
+
+static int tx_update_edge(eavgDB *db, tx_log *log, const eavgTxOp *op) {
+    eavgAdjList *out, *in;
+    size_t       i, j;
+    eavgSymbol   sym  = 0;
+    char        *name = NULL;
+    if (op->kind == EAVG_TX_UPDATE_EDGE_LABEL) {
+        size_t len = op->label ? strlen(op->label) : 0;
+        sym  = label_sym(op->label, len);
+        name = label_text(&db->edgeArena, op->label, len, sym);
+        if (op->label && !name) return -1;
+    }
+    if (edge_locate(db, op->id, &out, &i, &in, &j) < 0) return -1;
+    tx_undo *u = tx_push(log, UNDO_EDGE_SET);
+    if (!u) return -1;
+
+    eavgEdgeRec *rec = &out->edges[i];
+    u->edgeSet.before = *rec;
+    if (op->kind == EAVG_TX_UPDATE_EDGE_LABEL) {
+        rec->label    = name;
+        rec->labelSym = sym;
+    } else {
+        rec->weight = op->weight;
+    }
+    in->edges[j]     = *rec;
+    u->edgeSet.after = *rec;
+    return 0;
+}
+
+static int tx_remove_edge(eavgDB *db, tx_log *log, const eavgTxOp *op) {
+    eavgAdjList *out, *in;
+    size_t       i, j;
+    if (edge_locate(db, op->id, &out, &i, &in, &j) < 0) return -1;
+    tx_undo *u = tx_push(log, UNDO_EDGE_CUT);
+    if (!u) return -1;
+    u->edgeCut.rec     = out->edges[i];
+    u->edgeCut.outSlot = i;
+    u->edgeCut.inSlot  = j;
+    adjlist_cut(out, i);
+    adjlist_cut(in, j);
+    return 0;
+}
+
+/* Cuts entityId's edges out of the list of `key` in index `which` (an in
+ * list holds them by source, an out list by target), saving it first. */
+static int tx_cut_list(eavgDB *db, tx_log *log, int which, eavg_u64 key, eavg_u64 entityId) {
+    u64_map     *index    = *snap_field(db, which);
+    eavgAdjList *al       = u64_map_get(index, key);
+    bool         bySource = which == SNAP_IN;
+    size_t       j        = 0;
+    while (al && j < al->count &&
+           (bySource ? al->edges[j].sourceEntity : al->edges[j].targetEntity) != entityId) j++;
+    if (!al || j == al->count) return 0;
+
+    eavgEdgeRec *saved = malloc(al->count * sizeof *saved);
+    tx_undo     *u     = NULL;
+    if (!saved || !(al = adjlist_unshare(db, index, al)) || !(u = tx_push(log, UNDO_LIST_CUT))) {
+        free(saved);
+        return -1;
+    }
+    memcpy(saved, al->edges, al->count * sizeof *saved);
+    u->listCut.which = which;
+    u->listCut.key   = key;
+    u->listCut.saved = saved;
+    u->listCut.count = al->count;
+    adjlist_drop_endpoint(al, entityId, bySource);
+    return 0;
+}
+
+/* As eavgDB_removeEntity, in steps the log can undo. */
+static int tx_remove_entity(eavgDB *db, tx_log *log, eavg_u64 entityId) {
+    static const int own[3] = { SNAP_VALUES, SNAP_OUT, SNAP_IN };
+    eavgEntity *e = u64_map_get(db->entitiesById, entityId);
+    if (!e) return -1;
+
+    /* edges carry both endpoints, so only the neighbours' lists need cutting */
+    for (int x = 0; x < 2; x++) {
+        const eavgAdjList *al = u64_map_get(*snap_field(db, x ? SNAP_IN : SNAP_OUT), entityId);
+        for (size_t j = 0; al && j < al->count; j++) {
+            eavg_u64 key = x ? al->edges[j].sourceEntity : al->edges[j].targetEntity;
+            if (tx_cut_list(db, log, x ? SNAP_OUT : SNAP_IN, key, entityId) < 0) return -1;
+        }
+    }
+
+    eavgValueList *vl = u64_map_get(db->valuesByEntity, entityId);
+    tx_undo       *u;
+    if (vl) {
+        if (!(u = tx_push(log, UNDO_UNINDEXED))) return -1;
+        u->unindexed.vl = vl;
+        for (size_t j = 0; j < vl->count; j++) value_index_drop(db, vl->values[j].id);
+    }
+    for (int k = 0; k < 3; k++) {
+        u64_map *index = *snap_field(db, own[k]);
+        void    *list  = u64_map_get(index, entityId);
+        if (!list) continue;
+        if (!(u = tx_push(log, UNDO_LIST_DROPPED))) return -1;
+        u->listDropped.which = own[k];
+        u->listDropped.key   = entityId;
+        u->listDropped.list  = list;
+        u64_map_remove(index, entityId);
+    }
+
+    if (!(u = tx_push(log, UNDO_ENTITY_DROPPED))) return -1;
+    u->entityDropped.e     = e;
+    u->entityDropped.named = e->name && str_map_get(db->entitiesByName, e->name) == e;
+    u64_map_remove(db->entitiesById, entityId);
+    if (u->entityDropped.named) str_map_remove(db->entitiesByName, e->name);
+    return 0;
+}
+
+static int tx_step(eavgDB *db, tx_log *log, const eavgTxOp *op) {
+    switch (op->kind) {
+    case EAVG_TX_REMOVE_ENTITY: return tx_remove_entity(db, log, op->id);
+    case EAVG_TX_REMOVE_VALUE:  return tx_remove_value(db, log, op);
+    case EAVG_TX_UPDATE_VALUE:  return tx_update_value(db, log, op);
+    case EAVG_TX_REMOVE_EDGE:   return tx_remove_edge(db, log, op);
+    default:                    return tx_update_edge(db, log, op);
+    }
+}
+
+static void tx_undo_all(eavgDB *db, tx_log *log) {
+    for (size_t k = log->count; k-- > 0; ) {
+        tx_undo *u = &log->entries[k];
+        switch (u->kind) {
+        case UNDO_VALUE_SET: {
+            eavgValueLoc *loc = u64_map_get(db->valuesById, u->valueSet.before.id);
+            loc->list->values[loc->slot] = u->valueSet.before;
+            break;
+        }
+        case UNDO_VALUE_CUT:
+            value_uncut(db, u64_map_get(db->valuesByEntity, u->valueCut.entityId),
+                        u->valueCut.slot, &u->valueCut.rec, u->valueCut.ordered);
+            break;
+        case UNDO_EDGE_SET: {
+            const eavgEdgeRec *rec = &u->edgeSet.before;
+            eavgAdjList *out = u64_map_get(db->adjIndexBySource, rec->sourceEntity);
+            eavgAdjList *in  = u64_map_get(db->reverseAdjIndexByTarget, rec->targetEntity);
+            out->edges[adjlist_slot(out, rec->id)] = *rec;
+            in->edges[adjlist_slot(in, rec->id)]   = *rec;
+            break;
+        }
+        case UNDO_EDGE_CUT: {
+            const eavgEdgeRec *rec = &u->edgeCut.rec;
+            adjlist_uncut(u64_map_get(db->adjIndexBySource, rec->sourceEntity),
+                          u->edgeCut.outSlot, rec);
+            adjlist_uncut(u64_map_get(db->reverseAdjIndexByTarget, rec->targetEntity),
+                          u->edgeCut.inSlot, rec);
+            break;
+        }
+        case UNDO_LIST_CUT: {
+            eavgAdjList *al = u64_map_get(*snap_field(db, u->listCut.which), u->listCut.key);
+            EAVG_ASSERT(al && u->listCut.count <= al->cap);
+            memcpy(al->edges, u->listCut.saved, u->listCut.count * sizeof *al->edges);
+            al->count = u->listCut.count;
+            break;
+        }
+        case UNDO_UNINDEXED:
+            for (size_t j = 0; j < u->unindexed.vl->count; j++)
+                value_index_put(db, u->unindexed.vl, j);
+            break;
+        case UNDO_LIST_DROPPED:
+            u64_map_put(*snap_field(db, u->listDropped.which), u->listDropped.key,
+                        u->listDropped.list);
+            break;
+        case UNDO_ENTITY_DROPPED: {
+            eavgEntity *e = u->entityDropped.e;
+            u64_map_put(db->entitiesById, e->id, e);
+            if (u->entityDropped.named) str_map_put(db->entitiesByName, e->name, e);
+            break;
+        }
+        }
+    }
+}
+
+/* Once every step is in: stamps one event per op, in op order, and does
+ * the index removals and list releases the steps put off. */
+static void tx_finish(eavgDB *db, tx_log *log, eavgChange *changes) {
+    eavgChange scratch;
+    for (size_t k = 0; k < log->count; k++) {
+        tx_undo    *u = &log->entries[k];
+        eavgChange *c = changes ? changes : &scratch;
+        switch (u->kind) {
+        case UNDO_VALUE_SET:
+            change_value(db, c, EAVG_CHANGE_UPDATE, u->valueSet.entityId, &u->valueSet.after);
+            break;
+        case UNDO_VALUE_CUT: {
+            eavg_u64       entityId    = u->valueCut.entityId;
+            eavg_u64       attributeId = u->valueCut.rec.attributeId;
+            eavgValueList *vl          = u64_map_get(db->valuesByEntity, entityId);
+            change_value(db, c, EAVG_CHANGE_REMOVE, entityId, &u->valueCut.rec);
+            wal_log_value_remove(db->wal, u->valueCut.rec.id, entityId, u->valueCut.ordered);
+            if (!vl || !value_list_has_attribute(vl, attributeId))
+                index_remove(db->entitiesByAttribute, attributeId, entityId);
+            break;
+        }
+        case UNDO_EDGE_SET:
+            change_edge(db, c, EAVG_CHANGE_UPDATE, &u->edgeSet.after);
+            break;
+        case UNDO_EDGE_CUT:
+            change_edge(db, c, EAVG_CHANGE_REMOVE, &u->edgeCut.rec);
+            break;
+        case UNDO_LIST_CUT:
+            if (u->listCut.which == SNAP_OUT) dirty_mark(db, DIRTY_EDGES, u->listCut.key);
+            cache_bump(db->cache, CACHE_DEP_EDGES, u->listCut.key);
+            continue;
+        case UNDO_UNINDEXED: {
+            const eavgValueList *vl = u->unindexed.vl;
+            for (size_t j = 0; j < vl->count; j++)
+                index_remove(db->entitiesByAttribute, vl->values[j].attributeId, vl->entityId);
+            continue;
+        }
+        case UNDO_LIST_DROPPED:
+            if (u->listDropped.which == SNAP_VALUES) snap_release(db, NULL, u->listDropped.list);
+            else                                     snap_release(db, u->listDropped.list, NULL);
+            continue;
+        case UNDO_ENTITY_DROPPED: {
+            eavgEntity *e = u->entityDropped.e;
+            index_remove(db->entitiesByType, EAVG_TYPE_KEY(e->typeId), e->id);
+            change_entity(db, c, EAVG_CHANGE_REMOVE, e);
+            break;
+        }
+        }
+        if (changes) changes++;
+    }
+}
+
+/* Faults in every list the tx adds to or changes. */
+static int tx_fault(eavgDB *db, const eavgBulkBatch *adds, const eavgTxOp *ops, size_t n) {
+    if (bulk_fault(db, adds) < 0) return -1;
+    for (size_t i = 0; lazy_any(db) && i < n; i++) {
+        int rc;
+        switch (ops[i].kind) {
+        case EAVG_TX_REMOVE_ENTITY: rc = lazy_fault_entity(db, ops[i].id); break;
+        case EAVG_TX_REMOVE_VALUE:
+        case EAVG_TX_UPDATE_VALUE:  rc = lazy_find_value(db, ops[i].id);   break;
+        default:                    rc = lazy_find_edge(db, ops[i].id);    break;
+        }
+        if (rc < 0) return -1;
+    }
+    return 0;
+}
+
+int tx_apply(eavgDB *db, eavgBulkBatch *adds, const eavgTxOp *ops, size_t opCount) {
+    size_t           added   = adds->entityCount + adds->valueCount + adds->edgeCount;
+    size_t           total   = added + opCount;
+    eavgChange      *changes = NULL;
+    struct bulk_undo bu;
+    tx_log           log     = { 0 };
+    int              rc      = -1;
+    if (tx_fault(db, adds, ops, opCount) < 0) return -1;
+    LOCK_WR(db);
+    if (total && (change_feed_active(db->feed) || db->wal)) {
+        changes = calloc(total, sizeof *changes);
+        if (!changes) {
+            UNLOCK_WR(db);
+            return -1;
+        }
+    }
+    if (bulk_apply(db, adds, &bu) == 0) {
+        size_t i = 0;
+        while (i < opCount && tx_step(db, &log, &ops[i]) == 0) i++;
+        if (i == opCount) {
+            bulk_changes(db, adds, &bu, changes);
+            tx_finish(db, &log, changes ? changes + added : NULL);
+            rc = 0;
+        } else {
+            tx_undo_all(db, &log);
+            bulk_rollback(db, adds, &bu);
+        }
+    }
+    UNLOCK_WR(db);
+    bulk_undo_free(&bu);
+    tx_log_free(&log);
+    if (rc == 0 && changes) change_publish(db, changes, total);
+    if (rc == 0 && adds->valueCount) bulk_value_hooks(db, adds);
+    free(changes);
+    return rc;
+}
+
+struct collect_entities {
+    eavgDB      *db;
+    eavgEntity **out;
+    size_t       count;
+};
+
+static int collect_entity_cb(eavg_u64 id, void *ud) {
+    struct collect_entities *ctx = ud;
+    eavgEntity *e = u64_map_get(ctx->db->entitiesById, id);
+    if (e) ctx->out[ctx->count++] = e;
+    return 0;
+}
+
+eavgEntity **eavgDB_findEntitiesByType(eavgDB *db,
+                                       eavg_u32 typeId,
+                                       size_t *outCount)
+{
+    STATS_OP(EAVG_OP_FIND_BY_TYPE);
+    LOCK_RD(db);
+    eavg_u64   key[1] = { typeId };
+    cache_dep  dep    = { CACHE_DEP_TYPE, typeId };
+    void      *hit;
+    if (db->cache && cache_get(db->cache, CACHE_OP_TYPE, key, sizeof key, &hit, outCount)) {
+        UNLOCK_RD(db);
+        return hit;
+    }
+    id_bitmap   *ids     = u64_map_get(db->entitiesByType, EAVG_TYPE_KEY(typeId));
+    size_t       cnt     = ids ? (size_t)id_bitmap_cardinality(ids) : 0;
+    eavgEntity **results = NULL;
+
+    if (cnt) {
+        results = malloc(cnt * sizeof *results);
+        if (results) {
+            struct collect_entities ctx = { db, results, 0 };
+            id_bitmap_foreach(ids, collect_entity_cb, &ctx);
+            cnt = ctx.count;
+        } else {
+            UNLOCK_RD(db);
+            *outCount = 0;
+            return NULL;
+        }
+    }
+    if (db->cache)
+        cache_put_array(db->cache, CACHE_OP_TYPE, key, sizeof key, &dep, 1,
+                        results, cnt, sizeof *results);
+    UNLOCK_RD(db);
+
+    *outCount = cnt;
+    return results;
+}
+
+int eavgDB_getFilteredEdgesEx(
+    eavgDB *db,
+    eavg_u64 entityId,
+    eavgEdgeDir dir,
+    eavgEdgeFilter filter,
+    void *userData,
+    eavgEdgeRec **out,
+    size_t *outCount)
+{
+    STATS_OP(EAVG_OP_GET_EDGES);
+    if (((dir & EAVG_EDGE_DIR_OUT) && lazy_fault(db, CHK_OUT, entityId) < 0) ||
+        ((dir & EAVG_EDGE_DIR_IN) && lazy_fault(db, CHK_IN, entityId) < 0)) {
+        *out      = NULL;
+        *outCount = 0;
+        return -1;
+    }
+    LOCK_RD(db);
+
+    /* the versions a cached result depends on only move under the write lock */
+    eavgCache *cache  = cache_accepts(db->cache, filter) ? db->cache : NULL;
+    eavg_u64   key[4] = { entityId, dir, (uintptr_t)filter, (uintptr_t)userData };
+    cache_dep  dep    = { CACHE_DEP_EDGES, entityId };
+    void      *hit;
+    if (cache && cache_get(cache, CACHE_OP_EDGES, key, sizeof key, &hit, outCount)) {
+        UNLOCK_RD(db);
+        *out = hit;
+        return 0;
+    }
+
+    eavgAdjList *fwd = NULL, *rev = NULL;
+    if (dir & EAVG_EDGE_DIR_OUT) {
+        fwd = u64_map_get(db->adjIndexBySource, entityId);
+    }
+    if (dir & EAVG_EDGE_DIR_IN) {
+        rev = u64_map_get(db->reverseAdjIndexByTarget, entityId);
+    }
+
+    eavgEdgeRec *results = NULL;
+    size_t       count   = 0;
+
+    #define TRY_APPEND(edge_ptr)                                       \
+        do {                                                           \
+            if (!filter || filter(edge_ptr, userData)) {              \
+                eavgEdgeRec *tmp =                                     \
+                  realloc(results, (count + 1) * sizeof *results);    \
+                if (!tmp) {                                            \
+                    free(results);                                     \
+                    UNLOCK_RD(db);                                     \
+                    *out      = NULL;                                  \
+                    *outCount = 0;                                     \
+                    return -1;                                         \
+                }                                                      \
+                results = tmp;                                         \
+                results[count++] = *(edge_ptr);                       \
+            }                                                          \
+        } while (0)
+
+    if (fwd) {
+        for (size_t i = 0; i < fwd->count; i++) {
+            TRY_APPEND(&fwd->edges[i]);
+        }
+    }
+    if (rev) {
+        for (size_t i = 0; i < rev->count; i++) {
+            TRY_APPEND(&rev->edges[i]);
+        }
+    }
+
+    #undef TRY_APPEND
+
+    if (cache) cache_put_array(cache, CACHE_OP_EDGES, key, sizeof key, &dep, 1,
+                               results, count, sizeof *results);
+    UNLOCK_RD(db);
+
+    *out      = results;
+    *outCount = count;
+    return 0;
+}
+
+eavgEdgeRec *eavgDB_getFilteredEdges(eavgDB *db, eavg_u64 entityId, eavgEdgeDir dir,
+                                     eavgEdgeFilter filter, void *userData, size_t *outCount)
+{
+    eavgEdgeRec *results;
+    eavgDB_getFilteredEdgesEx(db, entityId, dir, filter, userData, &results, outCount);
+    return results;
+}
+
+id_bitmap *eavgDB_findEntitiesByTypeBitmap(eavgDB *db, eavg_u32 typeId) {
+    STATS_OP(EAVG_OP_FIND_BY_TYPE);
+    LOCK_RD(db);
+    eavg_u64   key[1] = { typeId };
+    cache_dep  dep    = { CACHE_DEP_TYPE, typeId };
+    void      *out;
+    size_t     n;
+    if (db->cache && cache_get(db->cache, CACHE_OP_TYPE_BITMAP, key, sizeof key, &out, &n)) {
+        UNLOCK_RD(db);
+        return out;
+    }
+    id_bitmap *ids = u64_map_get(db->entitiesByType, EAVG_TYPE_KEY(typeId));
+    out = ids ? id_bitmap_copy(ids) : id_bitmap_create();
+    if (db->cache && out)
+        cache_put_bitmap(db->cache, CACHE_OP_TYPE_BITMAP, key, sizeof key, &dep, 1, out);
+    UNLOCK_RD(db);
+    return out;
+}
+
+struct value_match {
+    eavgDB          *db;
+    eavg_u64         attributeId;
+    eavgValueFilter  filter;
+    void            *userData;
+    id_bitmap       *out;
+};
+
+static int value_match_cb(eavg_u64 entityId, void *ud) {
+    struct value_match *m  = ud;
+    eavgValueList      *vl = u64_map_get(m->db->valuesByEntity, entityId);
+    if (!vl) return 0;
+    for (size_t i = 0; i < vl->count; i++) {
+        const eavgValRec *r = &vl->values[i];
+        if (r->attributeId == m->attributeId && m->filter(r, m->userData))
+            return id_bitmap_add(m->out, entityId) < 0 ? -1 : 0;
+    }
+    return 0;
+}
+
+id_bitmap *eavgDB_findEntitiesByValueBitmap(eavgDB *db,
+                                            eavg_u64 attributeId,
+                                            eavgValueFilter filter,
+                                            void *userData)
+{
+    STATS_OP(EAVG_OP_FIND_BY_VALUE);
+    if (lazy_settle(db, CHK_MASK(CHK_VALUES)) < 0) return NULL;
+    LOCK_RD(db);
+    id_bitmap *ids = u64_map_get(db->entitiesByAttribute, attributeId);
+    id_bitmap *out;
+    if (!ids) {
+        out = id_bitmap_create();
+    } else if (!filter) {
+        out = id_bitmap_copy(ids);
+    } else {
+        struct value_match m = { db, attributeId, filter, userData, id_bitmap_create() };
+        if (m.out && id_bitmap_foreach(ids, value_match_cb, &m) != 0) {
+            id_bitmap_destroy(m.out);
+            m.out = NULL;
+        }
+        out = m.out;
+    }
+    UNLOCK_RD(db);
+    return out;
+}
+
+struct neighbor_expand {
+    eavgDB         *db;
+    eavgEdgeDir     dir;
+    eavgEdgeFilter  filter;
+    void           *userData;
+    id_bitmap      *out;
+};
+
+static int neighbor_expand_cb(eavg_u64 entityId, void *ud) {
+    struct neighbor_expand *x = ud;
+    if (x->dir & EAVG_EDGE_DIR_OUT) {
+        eavgAdjList *al = u64_map_get(x->db->adjIndexBySource, entityId);
+        for (size_t i = 0; al && i < al->count; i++) {
+            const eavgEdgeRec *e = &al->edges[i];
+            if (x->filter && !x->filter(e, x->userData)) continue;
+            if (id_bitmap_add(x->out, e->targetEntity) < 0) return -1;
+        }
+    }
+    if (x->dir & EAVG_EDGE_DIR_IN) {
+        eavgAdjList *al = u64_map_get(x->db->reverseAdjIndexByTarget, entityId);
+        for (size_t i = 0; al && i < al->count; i++) {
+            const eavgEdgeRec *e = &al->edges[i];
+            if (x->filter && !x->filter(e, x->userData)) continue;
+            if (id_bitmap_add(x->out, e->sourceEntity) < 0) return -1;
+        }
+    }
+    return 0;
+}
+
+static int neighbor_fault_cb(eavg_u64 entityId, void *ud) {
+    struct neighbor_expand *x = ud;
+    if ((x->dir & EAVG_EDGE_DIR_OUT) && lazy_fault(x->db, CHK_OUT, entityId) < 0) return -1;
+    if ((x->dir & EAVG_EDGE_DIR_IN) && lazy_fault(x->db, CHK_IN, entityId) < 0) return -1;
+    return 0;
+}
+
+id_bitmap *eavgDB_expandNeighbors(eavgDB *db,
+                                  const id_bitmap *from,
+                                  eavgEdgeDir dir,
+                                  eavgEdgeFilter filter,
+                                  void *userData)
+{
+    STATS_OP(EAVG_OP_EXPAND);
+    struct neighbor_expand fault = { db, dir, NULL, NULL, NULL };
+    if (lazy_any(db) && id_bitmap_foreach(from, neighbor_fault_cb, &fault) != 0) return NULL;
+    LOCK_RD(db);
+    /* cached when small enough to key on, by the ids it starts from */
+    eavgCache *cache = cache_accepts(db->cache, filter) &&
+                       id_bitmap_cardinality(from) <= CACHE_MAX_DEPS ? db->cache : NULL;
+    eavg_u64   key[3 + CACHE_MAX_DEPS];
+    cache_dep  deps[CACHE_MAX_DEPS];
+    size_t     n = 0;
+    if (cache) {
+        key[0] = dir;
+        key[1] = (uintptr_t)filter;
+        key[2] = (uintptr_t)userData;
+        n = id_bitmap_to_array(from, key + 3, CACHE_MAX_DEPS);
+        for (size_t i = 0; i < n; i++) deps[i] = (cache_dep){ CACHE_DEP_EDGES, key[3 + i] };
+        void  *hit;
+        size_t card;
+        if (cache_get(cache, CACHE_OP_EXPAND, key, (3 + n) * sizeof *key, &hit, &card)) {
+            UNLOCK_RD(db);
+            return hit;
+        }
+    }
+
+    struct neighbor_expand x = { db, dir, filter, userData, id_bitmap_create() };
+    int rc = x.out ? id_bitmap_foreach(from, neighbor_expand_cb, &x) : -1;
+    if (rc == 0 && cache)
+        cache_put_bitmap(cache, CACHE_OP_EXPAND, key, (3 + n) * sizeof *key, deps, n, x.out);
+    UNLOCK_RD(db);
+    if (rc != 0) {
+        id_bitmap_destroy(x.out);
+        return NULL;
+    }
+    return x.out;
+}
+
+int eavgDB_cacheEnable(eavgDB *db, const eavgCacheOptions *opt) {
+    eavgCache *c = cache_create(opt);
+    if (!c) return -1;
+    LOCK_WR(db);
+    eavgCache *old = db->cache;
+    db->cache = c;
+    UNLOCK_WR(db);
+    cache_destroy(old);
+    return 0;
+}
+
+void eavgDB_cacheDisable(eavgDB *db) {
+    LOCK_WR(db);
+    eavgCache *old = db->cache;
+    db->cache = NULL;
+    UNLOCK_WR(db);
+    cache_destroy(old);
+}
+
+void eavgDB_cacheStats(eavgDB *db, eavgCacheStats *out) {
+    LOCK_RD(db);
+    cache_stats(db->cache, out);
+    UNLOCK_RD(db);
+}
+
+struct entity_visit {
+    eavgDB             *db;
+    eavgEntityCallback  cb;
+    void               *userData;
+};
+
+static int entity_visit_cb(eavg_u64 id, void *ud) {
+    struct entity_visit *v = ud;
+    eavgEntity *e = u64_map_get(v->db->entitiesById, id);
+    return e ? v->cb(v->db, e, v->userData) : 0;
+}
+
+void eavgDB_forEachEntityIn(eavgDB *db,
+                            const id_bitmap *ids,
+                            eavgEntityCallback cb,
+                            void *userData)
+{
+    STATS_OP(EAVG_OP_FOR_EACH_ENTITY);
+    struct entity_visit v = { db, cb, userData };
+    LOCK_RD(db);
+    id_bitmap_foreach(ids, entity_visit_cb, &v);
+    UNLOCK_RD(db);
+}
+
+/* Stream saves.  Each section's table is cut into chunks of slots, which
+ * worker threads encode into buffers of their own; the calling thread
+ * writes finished chunks in file order and encodes whatever no worker has
+ * picked up yet.  Workers stay at most SAVE_WINDOW chunks per thread ahead
+ * of the writer, so encoding overlaps the writes and memory stays bounded.
+ * The file is written under a temporary name, synced and renamed over the
+ * target, so it is either the old file or the complete new one. */
+#define SAVE_CHUNK_SLOTS   8192
+#define SAVE_WINDOW        2
+#define SAVE_MAX_THREADS   16
+#define SAVE_DIRECT_ALIGN  4096
+#define SAVE_STAGE_SIZE    (4u << 20)
+
+/* file sections, in order, and the snapshot table each one walks */
+enum { SAVE_ENTITIES, SAVE_ATTRIBUTES, SAVE_RELTYPES, SAVE_VALUES, SAVE_EDGES, SAVE_SECTIONS };
+static const int save_table[SAVE_SECTIONS] = {
+    SNAP_ENTITIES, SNAP_ATTRIBUTES, SNAP_RELTYPES, SNAP_VALUES, SNAP_OUT,
+};
+
+typedef struct {
+    unsigned char *p;
+    size_t         len, cap;
+    bool           oom;
+} save_buf;
+
+static void sb_put(save_buf *b, const void *p, size_t n) {
+    if (!n || b->oom) return;
+    if (b->len + n > b->cap) {
+        size_t cap = b->cap ? b->cap : 64 * 1024;
+        while (cap < b->len + n) cap *= 2;
+        unsigned char *q = realloc(b->p, cap);
+        if (!q) {
+            b->oom = true;
+            return;
+        }
+        b->p   = q;
+        b->cap = cap;
+    }
+    memcpy(b->p + b->len, p, n);
+    b->len += n;
+}
+
+static void sb_u32(save_buf *b, uint32_t v) { sb_put(b, &v, sizeof v); }
+static void sb_u64(save_buf *b, uint64_t v) { sb_put(b, &v, sizeof v); }
+
+static void sb_cstr(save_buf *b, const char *s) {
+    uint32_t len = s ? (uint32_t)strlen(s) : 0;
+    sb_u32(b, len);
+    sb_put(b, s, len);
+}
+
+static void sb_varint(save_buf *b, uint64_t v) {
+    unsigned char tmp[10];
+    size_t        n = 0;
+    while (v >= 0x80) {
+        tmp[n++] = (unsigned char)v | 0x80;
+        v >>= 7;
+    }
+    tmp[n++] = (unsigned char)v;
+    sb_put(b, tmp, n);
+}
+
+/* Zigzag, so that small differences of either sign stay short. */
+static void sb_delta(save_buf *b, uint64_t v, uint64_t *prev) {
+    int64_t d = (int64_t)(v - *prev);
+    *prev = v;
+    sb_varint(b, ((uint64_t)d << 1) ^ (uint64_t)(d >> 63));
+}
+
+static void sb_vstr(save_buf *b, const char *s) {
+    size_t len = s ? strlen(s) : 0;
+    sb_varint(b, len);
+    sb_put(b, s, len);
+}
+
+static uint64_t save_count(eavgSnapshot *s, int section) {
+    u64_map *m = s->maps[save_table[section]];
+    uint64_t n = 0;
+    for (size_t i = 0; i < m->capacity; i++) {
+        if (!m->values[i]) continue;
+        if (section == SAVE_VALUES)     n += ((eavgValueList*)m->values[i])->count;
+        else if (section == SAVE_EDGES) n += ((eavgAdjList*)m->values[i])->count;
+        else                            n++;
+    }
+    return n;
+}
+
+static void save_value(save_buf *b, u64_map *attrs, eavg_u64 entityId,
+                       const eavgValRec *r)
+{
+    const eavgAttribute *at    = u64_map_get(attrs, r->attributeId);
+    eavg_u32             dtype = at ? at->dataType : 0;   /* 0: loads without payload */
+    sb_u64(b, r->id);
+    sb_u64(b, entityId);
+    sb_u64(b, r->attributeId);
+    sb_u32(b, dtype);
+    switch (dtype) {
+    case EAVG_DATA_TYPE_INT:
+    case EAVG_DATA_TYPE_DOUBLE:
+    case EAVG_DATA_TYPE_ENTITY:
+        sb_put(b, &r->data, 8);
+        break;
+    case EAVG_DATA_TYPE_STRING:
+        sb_cstr(b, eavgValRec_getString(r));
+        break;
+    case EAVG_DATA_TYPE_BINARY: {
+        size_t               len;
+        const unsigned char *p = eavgValRec_getBinary(r, &len);
+        sb_u32(b, (uint32_t)len);
+        sb_put(b, p, len);
+        break;
+    }
+    }
+}
+
+static void save_edge(save_buf *b, const eavgEdgeRec *e) {
+    sb_u64(b, e->id);
+    sb_u64(b, e->sourceEntity);
+    sb_u64(b, e->targetEntity);
+    sb_u64(b, e->relationTypeId);
+    sb_put(b, &e->weight, sizeof e->weight);
+    sb_u32(b, (uint32_t)e->direction);
+    sb_u64(b, e->timestamp);
+    sb_cstr(b, e->label);
+}
+
+struct save_job {
+    int       section;
+    size_t    begin, end;     /* table slots */
+    bool      first;          /* starts the section: writes its count */
+    bool      ready;          /* guarded by save_run.mu */
+    save_buf  out;
+};
+
+struct save_run {
+    eavgSnapshot     *snap;
+    bool              compact;
+    str_map          *strings;    /* compact: string -> table index + 1 */
+    save_buf          table;
+    uint64_t          counts[SAVE_SECTIONS];
+    struct save_job  *jobs;
+    size_t            jobCount;
+    size_t            window;
+    size_t            next;       /* next job to encode */
+    size_t            written;    /* jobs written out */
+    bool              abort;
+    void            (*progress)(size_t done, size_t total, void *userData);
+    void             *progressData;
+    pthread_mutex_t   mu;
+    pthread_cond_t    cv;
+};
+
+/* Compact saves refer to attribute and relation type names and edge
+ * labels by their place in a table written ahead of the sections.
+ * Entity names are mostly unique, so they stay inline. */
+static int save_string(struct save_run *run, const char *s) {
+    if (!s || str_map_get(run->strings, s)) return 0;
+    sb_vstr(&run->table, s);
+    return str_map_put(run->strings, s, (void*)(uintptr_t)(run->strings->count + 1));
+}
+
+static int save_strings(struct save_run *run) {
+    eavgSnapshot *s    = run->snap;
+    const char   *last = NULL;
+    u64_map      *m;
+    if (!(run->strings = str_map_create(64))) return -1;
+    m = s->maps[SNAP_ATTRIBUTES];
+    for (size_t i = 0; i < m->capacity; i++) {
+        const eavgAttribute *a = m->values[i];
+        if (a && save_string(run, a->name) < 0) return -1;
+    }
+    m = s->maps[SNAP_RELTYPES];
+    for (size_t i = 0; i < m->capacity; i++) {
+        const eavgRelationType *rt = m->values[i];
+        if (rt && save_string(run, rt->name) < 0) return -1;
+    }
+    m = s->maps[SNAP_OUT];
+    for (size_t i = 0; i < m->capacity; i++) {
+        const eavgAdjList *al = m->values[i];
+        for (size_t k = 0; al && k < al->count; k++) {
+            if (al->edges[k].label == last) continue;
+            last = al->edges[k].label;
+            if (save_string(run, last) < 0) return -1;
+        }
+    }
+    return run->table.oom ? -1 : 0;
+}
+
+static uint64_t save_ref(struct save_run *run, const char *s) {
+    return s ? (uintptr_t)str_map_get(run->strings, s) : 0;
+}
+
+/* Values and edges go by list: the key and length, then the records,
+ * whose ids (and targets, timestamps) are deltas within the list.  The
+ * value type comes from the attribute. */
+static void save_compact(struct save_run *run, int section, save_buf *b, const void *v) {
+    switch (section) {
+    case SAVE_ENTITIES: {
+        const eavgEntity *e = v;
+        sb_varint(b, e->id);
+        sb_varint(b, e->typeId);
+        sb_vstr(b, e->name);
+        break;
+    }
+    case SAVE_ATTRIBUTES: {
+        const eavgAttribute *a = v;
+        sb_varint(b, a->id);
+        sb_varint(b, a->dataType);
+        sb_varint(b, save_ref(run, a->name));
+        break;
+    }
+    case SAVE_RELTYPES: {
+        const eavgRelationType *r = v;
+        sb_varint(b, r->id);
+        sb_varint(b, save_ref(run, r->name));
+        break;
+    }
+    case SAVE_VALUES: {
+        const eavgValueList *vl = v;
+        uint64_t             id = 0;
+        if (!vl->count) break;
+        sb_varint(b, vl->entityId);
+        sb_varint(b, vl->count);
+        for (size_t k = 0; k < vl->count; k++) {
+            const eavgValRec    *r  = &vl->values[k];
+            const eavgAttribute *at = u64_map_get(run->snap->maps[SNAP_ATTRIBUTES],
+                                                  r->attributeId);
+            uint64_t             zero = 0;
+            sb_delta(b, r->id, &id);
+            sb_varint(b, r->attributeId);
+            switch (at ? at->dataType : 0) {
+            case EAVG_DATA_TYPE_INT:
+                sb_delta(b, (uint64_t)r->data.intValue, &zero);
+                break;
+            case EAVG_DATA_TYPE_DOUBLE:
+                sb_put(b, &r->data.doubleValue, 8);
+                break;
+            case EAVG_DATA_TYPE_ENTITY:
+                sb_varint(b, r->data.entityRef);
+                break;
+            case EAVG_DATA_TYPE_STRING:
+                sb_vstr(b, eavgValRec_getString(r));
+                break;
+            case EAVG_DATA_TYPE_BINARY: {
+                size_t               len;
+                const unsigned char *p = eavgValRec_getBinary(r, &len);
+                sb_varint(b, len);
+                sb_put(b, p, len);
+                break;
+            }
+            }
+        }
+        break;
+    }
+    case SAVE_EDGES: {
+        const eavgAdjList *al    = v;
+        uint64_t           id    = 0, target = 0, ts = 0, ref = 0;
+        const char        *label = NULL;
+        if (!al->count) break;
+        sb_varint(b, al->srcId);
+        sb_varint(b, al->count);
+        for (size_t k = 0; k < al->count; k++) {
+            const eavgEdgeRec *e = &al->edges[k];
+            if (k == 0 || e->label != label) {
+                label = e->label;
+                ref   = save_ref(run, label);
+            }
+            sb_delta(b, e->id, &id);
+            sb_delta(b, e->targetEntity, &target);
+            sb_varint(b, e->relationTypeId);
+            sb_put(b, &e->weight, sizeof e->weight);
+            sb_varint(b, (uint64_t)e->direction);
+            sb_delta(b, e->timestamp, &ts);
+            sb_varint(b, ref);
+        }
+        break;
+    }
+    }
+}
+
+static void save_encode(struct save_run *run, struct save_job *j) {
+    eavgSnapshot *s = run->snap;
+    u64_map      *m = s->maps[save_table[j->section]];
+    save_buf     *b = &j->out;
+    if (j->first) sb_u64(b, run->counts[j->section]);
+    for (size_t i = j->begin; i < j->end; i++) {
+        void *v = m->values[i];
+        if (!v) continue;
+        if (run->compact) {
+            save_compact(run, j->section, b, v);
+            continue;
+        }
+        switch (j->section) {
+        case SAVE_ENTITIES: {
+            const eavgEntity *e = v;
+            sb_u64(b, e->id);
+            sb_u32(b, e->typeId);
+            sb_cstr(b, e->name);
+            break;
+        }
+        case SAVE_ATTRIBUTES: {
+            const eavgAttribute *a = v;
+            sb_u64(b, a->id);
+            sb_u32(b, a->dataType);
+            sb_cstr(b, a->name);
+            break;
+        }
+        case SAVE_RELTYPES: {
+            const eavgRelationType *r = v;
+            sb_u64(b, r->id);
+            sb_cstr(b, r->name);
+            break;
+        }
+        case SAVE_VALUES: {
+            const eavgValueList *vl = v;
+            for (size_t k = 0; k < vl->count; k++)
+                save_value(b, s->maps[SNAP_ATTRIBUTES], vl->entityId, &vl->values[k]);
+            break;
+        }
+        case SAVE_EDGES: {
+            const eavgAdjList *al = v;
+            for (size_t k = 0; k < al->count; k++) save_edge(b, &al->edges[k]);
+            break;
+        }
+        }
+    }
+}
+
+static void *save_worker(void *arg) {
+    struct save_run *run = arg;
+    pthread_mutex_lock(&run->mu);
+    for (;;) {
+        while (!run->abort && run->next < run->jobCount &&
+               run->next >= run->written + run->window)
+            pthread_cond_wait(&run->cv, &run->mu);
+        if (run->abort || run->next >= run->jobCount) break;
+        struct save_job *j = &run->jobs[run->next++];
+        pthread_mutex_unlock(&run->mu);
+        save_encode(run, j);
+        pthread_mutex_lock(&run->mu);
+        j->ready = true;
+        pthread_cond_broadcast(&run->cv);
+    }
+    pthread_mutex_unlock(&run->mu);
+    return NULL;
+}
+
+/* Output, staged through an aligned buffer when writing with O_DIRECT. */
+typedef struct {
+    int            fd;
+    bool           direct;
+    unsigned char *stage;
+    size_t         staged;
+} save_out;
+
+static int save_write_fd(int fd, const void *p, size_t n) {
+    const char *c = p;
+    while (n) {
+        ssize_t k = write(fd, c, n);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) return -1;
+        c += k;
+        n -= (size_t)k;
+    }
+    return 0;
+}
+
+static int save_write(save_out *o, const void *p, size_t n) {
+    if (!o->direct) return save_write_fd(o->fd, p, n);
+    const unsigned char *c = p;
+    while (n) {
+        size_t k = SAVE_STAGE_SIZE - o->staged;
+        if (k > n) k = n;
+        memcpy(o->stage + o->staged, c, k);
+        o->staged += k;
+        c         += k;
+        n         -= k;
+        if (o->staged == SAVE_STAGE_SIZE) {
+            if (save_write_fd(o->fd, o->stage, SAVE_STAGE_SIZE) < 0) return -1;
+            o->staged = 0;
+        }
+    }
+    return 0;
+}
+
+/* O_DIRECT only takes whole blocks, so the tail goes through the page
+ * cache. */
+static int save_finish(save_out *o) {
+    if (!o->direct || !o->staged) return 0;
+    size_t whole = o->staged & ~(size_t)(SAVE_DIRECT_ALIGN - 1);
+    if (whole && save_write_fd(o->fd, o->stage, whole) < 0) return -1;
+    if (whole == o->staged) return 0;
+#ifdef O_DIRECT
+    int fl = fcntl(o->fd, F_GETFL);
+    if (fl < 0 || fcntl(o->fd, F_SETFL, fl & ~O_DIRECT) < 0) return -1;
+#endif
+    return save_write_fd(o->fd, o->stage + whole, o->staged - whole);
+}
+
+static int save_open(const char *tmp, bool direct, save_out *o) {
+    o->fd     = -1;
+    o->direct = false;
+    o->stage  = NULL;
+    o->staged = 0;
+#ifdef O_DIRECT
+    if (direct) {
+        o->stage = aligned_alloc(SAVE_DIRECT_ALIGN, SAVE_STAGE_SIZE);
+        if (o->stage) o->fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+        o->direct = o->fd >= 0;   /* e.g. tmpfs refuses O_DIRECT */
+    }
+#else
+    (void)direct;
+#endif
+    if (o->fd < 0) o->fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    return o->fd < 0 ? -1 : 0;
+}
+
+static int save_jobs(struct save_run *run, save_out *o, unsigned threads) {
+    pthread_t tids[SAVE_MAX_THREADS];
+    unsigned  started = 0;
+    int       rc      = 0;
+    for (unsigned t = 1; t < threads; t++) {
+        if (pthread_create(&tids[started], NULL, save_worker, run) == 0) started++;
+    }
+    for (size_t i = 0; i < run->jobCount && rc == 0; i++) {
+        struct save_job *j = &run->jobs[i];
+        pthread_mutex_lock(&run->mu);
+        if (!j->ready && run->next == i) {
+            run->next++;
+            pthread_mutex_unlock(&run->mu);
+            save_encode(run, j);
+            pthread_mutex_lock(&run->mu);
+            j->ready = true;
+        }
+        while (!j->ready) pthread_cond_wait(&run->cv, &run->mu);
+        pthread_mutex_unlock(&run->mu);
+
+        if (j->out.oom || save_write(o, j->out.p, j->out.len) < 0) rc = -1;
+        free(j->out.p);
+        j->out.p = NULL;
+
+        pthread_mutex_lock(&run->mu);
+        run->written++;
+        if (rc < 0) run->abort = true;
+        pthread_cond_broadcast(&run->cv);
+        pthread_mutex_unlock(&run->mu);
+        if (rc == 0 && run->progress) run->progress(i + 1, run->jobCount, run->progressData);
+    }
+    for (unsigned t = 0; t < started; t++) pthread_join(tids[t], NULL);
+    for (size_t i = 0; i < run->jobCount; i++) free(run->jobs[i].out.p);
+    return rc;
+}
+
+static int save_snapshot(eavgSnapshot *snap, const char *filename, const eavgSaveOptions *opt) {
+    static const eavgSaveOptions defaults = { 0 };
+    if (!opt) opt = &defaults;
+
+    unsigned threads = opt->threads;
+    if (!threads) {
+        long n  = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = n > 0 ? (unsigned)n : 1;
+    }
+    if (threads > SAVE_MAX_THREADS) threads = SAVE_MAX_THREADS;
+
+    struct save_run run = { .snap = snap, .compact = opt->compact,
+                            .window = SAVE_WINDOW * threads,
+                            .progress = opt->progress, .progressData = opt->progressData };
+    for (int sec = 0; sec < SAVE_SECTIONS; sec++) {
+        run.counts[sec] = save_count(snap, sec);
+        size_t slots    = snap->maps[save_table[sec]]->capacity;
+        run.jobCount   += (slots + SAVE_CHUNK_SLOTS - 1) / SAVE_CHUNK_SLOTS;
+    }
+    run.jobs = calloc(run.jobCount, sizeof *run.jobs);
+    size_t tmpLen = strlen(filename) + sizeof ".tmp";
+    char  *tmp    = malloc(tmpLen);
+    if (!run.jobs || !tmp || (run.compact && save_strings(&run) < 0)) {
+        str_map_destroy(run.strings);
+        free(run.table.p);
+        free(run.jobs);
+        free(tmp);
+        return -1;
+    }
+    snprintf(tmp, tmpLen, "%s.tmp", filename);
+    for (int sec = 0, k = 0; sec < SAVE_SECTIONS; sec++) {
+        size_t slots = snap->maps[save_table[sec]]->capacity;
+        for (size_t b = 0; b < slots; b += SAVE_CHUNK_SLOTS, k++) {
+            size_t e = b + SAVE_CHUNK_SLOTS < slots ? b + SAVE_CHUNK_SLOTS : slots;
+            run.jobs[k] = (struct save_job){ .section = sec, .begin = b, .end = e,
+                                             .first = b == 0 };
+        }
+    }
+    pthread_mutex_init(&run.mu, NULL);
+    pthread_cond_init(&run.cv, NULL);
+
+    save_out o;
+    int      rc = save_open(tmp, opt->directIO, &o);
+    if (rc == 0) {
+        unsigned char head[20];
+        uint32_t      version = run.compact ? EAVG_PERS_COMPACT : EAVG_PERS_VERSION;
+        uint64_t      strings = run.compact ? run.strings->count : 0;
+        memcpy(head, EAVG_PERS_MAGIC, 8);
+        memcpy(head + 8, &version, 4);
+        memcpy(head + 12, &strings, 8);
+        rc = save_write(&o, head, run.compact ? 20 : 12);
+        if (rc == 0 && run.compact) rc = save_write(&o, run.table.p, run.table.len);
+        if (rc == 0) rc = save_jobs(&run, &o, threads);
+        if (rc == 0) rc = save_finish(&o);
+        if (rc == 0) rc = fsync(o.fd);
+        if (close(o.fd) != 0) rc = -1;
+        if (rc == 0) rc = rename(tmp, filename) == 0 ? wal_sync_dir(filename) : -1;
+        if (rc != 0) unlink(tmp);
+    }
+
+    pthread_mutex_destroy(&run.mu);
+    pthread_cond_destroy(&run.cv);
+    str_map_destroy(run.strings);
+    free(run.table.p);
+    free(o.stage);
+    free(run.jobs);
+    free(tmp);
+    return rc;
+}
+
+/* Delta baselines.  The dirty sets count from one saved file, the
+ * baseline: the file the db was loaded from, or the last save that took
+ * the sets over.  Only eavgDB_saveIncremental and a full save to the
+ * baseline's file (or the first full save, when there is none) take them
+ * over; a copy saved anywhere else leaves them be.  The baseline is kept
+ * by path and by the generation that save wrote (device, inode, size and
+ * mtime), and a delta must name exactly that generation as its parent.
+ * Guarded by snapLock. */
+static bool file_gen(const char *path, eavg_u64 gen[4]) {
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+    gen[0] = (eavg_u64)st.st_dev;
+    gen[1] = (eavg_u64)st.st_ino;
+    gen[2] = (eavg_u64)st.st_size;
+    gen[3] = (eavg_u64)st.st_mtim.tv_sec * 1000000000u + (eavg_u64)st.st_mtim.tv_nsec;
+    return true;
+}
+
+/* Makes path, as it is on disk now, the baseline. */
+static void base_set(eavgDB *db, const char *path) {
+    eavg_u64 gen[4] = { 0 };
+    char    *copy   = strdup(path);
+    file_gen(path, gen);
+    pthread_mutex_lock(&db->snapLock);
+    free(db->basePath);
+    db->basePath = copy;
+    memcpy(db->baseGen, gen, sizeof gen);
+    pthread_mutex_unlock(&db->snapLock);
+}
+
+/* Whether a full save to path (parent NULL) or a delta on parent takes
+ * the dirty sets over: 1 if so, 0 if not, -1 for a delta whose parent is
+ * not the baseline.  Under snapLock. */
+static int base_takes(const eavgDB *db, const char *path, const char *parent) {
+    eavg_u64 gen[4];
+    if (parent)
+        return db->basePath && file_gen(parent, gen) &&
+               memcmp(gen, db->baseGen, sizeof gen) == 0 ? 1 : -1;
+    if (!db->basePath || strcmp(path, db->basePath) == 0) return 1;
+    return file_gen(path, gen) && gen[0] == db->baseGen[0] && gen[1] == db->baseGen[1];
+}
+
+/* A save takes over the dirty sets when it pins its snapshot, under the
+ * same lock, and leaves fresh ones for the writes that follow; a save that
+ * fails hands them back. */
+static int dirty_alloc(id_bitmap **sets) {
+    for (int i = 0; i < DIRTY_SETS; i++) {
+        if ((sets[i] = id_bitmap_create())) continue;
+        while (i--) id_bitmap_destroy(sets[i]);
+        return -1;
+    }
+    return 0;
+}
+
+/* Swaps the dirty sets for the fresh ones in sets when a save to path
+ * (or a delta on parent) takes them over, as base_takes says.  The caller
+ * holds the lock; snapLock orders concurrent saves. */
+static int dirty_swap(eavgDB *db, id_bitmap **sets, const char *path, const char *parent) {
+    pthread_mutex_lock(&db->snapLock);
+    int takes = base_takes(db, path, parent);
+    for (int i = 0; takes > 0 && i < DIRTY_SETS; i++) {
+        id_bitmap *t = db->dirty[i];
+        db->dirty[i] = sets[i];
+        sets[i]      = t;
+    }
+    pthread_mutex_unlock(&db->snapLock);
+    return takes;
+}
+
+/* Pins a snapshot for a save to path (a delta on parent, when not NULL);
+ * *takes tells whether it took the dirty sets over.  NULL on OOM, or for
+ * a delta whose parent is not the baseline. */
+static eavgSnapshot *save_begin(eavgDB *db, id_bitmap **sets, const char *path,
+                                const char *parent, bool *takes)
+{
+    eavgSnapshot *s = malloc(sizeof *s);
+    if (!s || dirty_alloc(sets) < 0) {
+        free(s);
+        return NULL;
+    }
+    LOCK_RD(db);
+    snapshot_pin(db, s);
+    int rc = dirty_swap(db, sets, path, parent);
+    UNLOCK_RD(db);
+    *takes = rc > 0;
+    if (rc < 0) {
+        eavgDB_snapshotEnd(s);
+        for (int i = 0; i < DIRTY_SETS; i++) id_bitmap_destroy(sets[i]);
+        return NULL;
+    }
+    return s;
+}
+
+/* Ends a save begun with save_begin; base is the file written when the
+ * save took the dirty sets over, and becomes the baseline if it
+ * succeeded. */
+static int save_end(eavgSnapshot *s, id_bitmap **sets, const char *base, int rc) {
+    eavgDB *db = s->db;
+    eavgDB_snapshotEnd(s);
+    if (rc != 0) {
+        LOCK_WR(db);
+        for (int i = 0; i < DIRTY_SETS; i++) id_bitmap_or_into(db->dirty[i], sets[i]);
+        UNLOCK_WR(db);
+    } else if (base) {
+        base_set(db, base);
+    }
+    for (int i = 0; i < DIRTY_SETS; i++) id_bitmap_destroy(sets[i]);
+    return rc;
+}
+
+int eavgDB_saveEx(eavgDB *db, const char *filename, const eavgSaveOptions *opt) {
+    STATS_OP(EAVG_OP_SAVE);
+    id_bitmap    *sets[DIRTY_SETS];
+    bool          takes;
+    if (lazy_settle(db, CHK_ALL) < 0) return -1;
+    eavgSnapshot *snap = save_begin(db, sets, filename, NULL, &takes);
+    if (!snap) return -1;
+    return save_end(snap, sets, takes ? filename : NULL, save_snapshot(snap, filename, opt));
+}
+
+int eavgDB_save(eavgDB *db, const char *filename) {
+    return eavgDB_saveEx(db, filename, NULL);
+}
+
+/* Pinned saves.  save_pin fixes the point in time; whoever writes the
+ * save later does so like any other while writers copy what they touch. */
+struct eavgPinnedSave {
+    eavgSnapshot  *snap;
+    id_bitmap     *dirty[DIRTY_SETS];
+    bool           takes;      /* of the dirty sets */
+    char          *filename;
+};
+
+eavgPinnedSave *save_pin(eavgDB *db, const char *filename) {
+    STATS_OP(EAVG_OP_SAVE);
+    if (lazy_settle(db, CHK_ALL) < 0) return NULL;
+    eavgPinnedSave *p = calloc(1, sizeof *p);
+    if (!p) return NULL;
+    p->filename = strdup(filename);
+    p->snap     = p->filename ? save_begin(db, p->dirty, p->filename, NULL, &p->takes) : NULL;
+    if (!p->snap) {
+        free(p->filename);
+        free(p);
+        return NULL;
+    }
+    return p;
+}
+
+static int save_unpin_rc(eavgPinnedSave *p, int rc) {
+    rc = save_end(p->snap, p->dirty, p->takes ? p->filename : NULL, rc);
+    free(p->filename);
+    free(p);
+    return rc;
+}
+
+int save_pinned(eavgPinnedSave *p, const eavgSaveOptions *opt) {
+    return save_unpin_rc(p, save_snapshot(p->snap, p->filename, opt));
+}
+
+void save_unpin(eavgPinnedSave *p) {
+    if (p) save_unpin_rc(p, -1);
+}
+
+/* Stream loads.  The file is mapped and parsed in place, and each
+ * section's count sizes its maps and record arrays before any record goes
+ * in.  Values and edges take three passes: a scan cuts the section into
+ * one run of records per thread; the threads count their run's records
+ * per list; the counts, taken in file order, give each run its first slot
+ * in every list, all of which are carved at their final size from one
+ * array per section; then the threads fill their slots.  Lists keep file
+ * order however many threads load them.  Payloads go to per-thread
+ * arenas that the db adopts at the end; labels to the symbol pool. */
+#define LOAD_MAX_THREADS  16
+#define LOAD_MIN_RUN      1024     /* records; shorter sections load on fewer threads */
+#define LOAD_ARENA_BLOCK  (64 * 1024)
+
+typedef struct {
+    const unsigned char *p, *end;
+} load_cursor;
+
+static int lc_take(load_cursor *c, void *out, size_t n) {
+    if ((size_t)(c->end - c->p) < n) return -1;
+    memcpy(out, c->p, n);
+    c->p += n;
+    return 0;
+}
+
+static int lc_u32(load_cursor *c, uint32_t *out) {
+    return lc_take(c, out, sizeof *out);
+}
+static int lc_u64(load_cursor *c, uint64_t *out) {
+    return lc_take(c, out, sizeof *out);
+}
+
+/* u32 length, then that many bytes, left in the file. */
+static int lc_bytes(load_cursor *c, const unsigned char **p, uint32_t *len) {
+    if (lc_u32(c, len) < 0 || (size_t)(c->end - c->p) < *len) return -1;
+    *p    = c->p;
+    c->p += *len;
+    return 0;
+}
+
+/* A length-prefixed string copied into arena; length 0 reads as NULL. */
+static int lc_cstr(load_cursor *c, Arena *arena, char **out) {
+    const unsigned char *p;
+    uint32_t             len;
+    *out = NULL;
+    if (lc_bytes(c, &p, &len) < 0) return -1;
+    if (!len) return 0;
+    if (!(*out = arena_alloc(arena, (size_t)len + 1))) return -1;
+    memcpy(*out, p, len);
+    (*out)[len] = '\0';
+    return 0;
+}
+
+/* A length-prefixed string interned into the symbol pool; length 0
+ * reads as NULL. */
+static int lc_name(load_cursor *c, char **out, eavgSymbol *sym) {
+    const unsigned char *p;
+    uint32_t             len;
+    if (lc_bytes(c, &p, &len) < 0) return -1;
+    return name_intern(len ? (const char*)p : NULL, len, out, sym);
+}
+
+static int lc_varint(load_cursor *c, uint64_t *out) {
+    uint64_t v = 0;
+    for (unsigned shift = 0; shift < 64 && c->p < c->end; shift += 7) {
+        unsigned char byte = *c->p++;
+        v |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *out = v;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Adds a zigzag-encoded difference to *prev. */
+static int lc_delta(load_cursor *c, uint64_t *prev) {
+    uint64_t z;
+    if (lc_varint(c, &z) < 0) return -1;
+    *prev += (z >> 1) ^ (0 - (z & 1));
+    return 0;
+}
+
+/* varint length, then that many bytes, left in the file. */
+static int lc_vbytes(load_cursor *c, const unsigned char **p, uint32_t *len) {
+    uint64_t n;
+    if (lc_varint(c, &n) < 0 || n > EAVG_VALUE_LENGTH_MAX ||
+        n > (uint64_t)(c->end - c->p)) return -1;
+    *p    = c->p;
+    *len  = (uint32_t)n;
+    c->p += n;
+    return 0;
+}
+
+static int lc_vstr(load_cursor *c, Arena *arena, char **out) {
+    const unsigned char *p;
+    uint32_t             len;
+    *out = NULL;
+    if (lc_vbytes(c, &p, &len) < 0) return -1;
+    if (!len) return 0;
+    if (!(*out = arena_alloc(arena, (size_t)len + 1))) return -1;
+    memcpy(*out, p, len);
+    (*out)[len] = '\0';
+    return 0;
+}
+
+/* What decoding a file needs beyond the cursor. */
+struct load_format {
+    uint32_t   version;
+    char     **strings;       /* compact: the string table, pooled */
+    eavgSymbol *symbols;      /* compact: the table's symbols */
+    uint64_t   stringCount;
+    u64_map   *attrs;         /* compact: value types come from attributes */
+};
+
+#define LOAD_COMPACT(fmt)  ((fmt)->version >= EAVG_PERS_COMPACT)
+
+/* A string table reference: 0 is NULL, k the table's k-th string. */
+static int lc_ref(load_cursor *c, const struct load_format *fmt, char **out,
+                  eavgSymbol *sym)
+{
+    uint64_t k;
+    if (lc_varint(c, &k) < 0 || k > fmt->stringCount) return -1;
+    *out = k ? fmt->strings[k - 1] : NULL;
+    *sym = k ? fmt->symbols[k - 1] : 0;
+    return 0;
+}
+
+/* lc_ref for an attribute or relation type name, which needs a symbol
+ * even where the table entry, a label past the pool's budget, has none. */
+static int lc_name_ref(load_cursor *c, const struct load_format *fmt, char **out,
+                       eavgSymbol *sym)
+{
+    if (lc_ref(c, fmt, out, sym) < 0) return -1;
+    return *out && !*sym ? name_intern(*out, strlen(*out), out, sym) : 0;
+}
+
+/* Interns the table, as labels, so names and labels share the pool's
+ * copies; whatever the label budget refuses is copied into the db's
+ * edgeArena instead. */
+static int load_strings(eavgDB *db, load_cursor *c, struct load_format *fmt) {
+    uint64_t n;
+    if (lc_u64(c, &n) < 0 || n > (uint64_t)(c->end - c->p)) return -1;
+    if (!n) return 0;
+    if (!(fmt->strings = malloc(n * sizeof *fmt->strings)) ||
+        !(fmt->symbols = malloc(n * sizeof *fmt->symbols))) return -1;
+    fmt->stringCount = n;
+    for (uint64_t i = 0; i < n; i++) {
+        const unsigned char *p;
+        uint32_t             len;
+        if (lc_vbytes(c, &p, &len) < 0) return -1;
+        const char *s = len ? (const char*)p : NULL;
+        fmt->symbols[i] = label_sym(s, len);
+        fmt->strings[i] = label_text(&db->edgeArena, s, len, fmt->symbols[i]);
+        if (s && !fmt->strings[i]) return -1;
+    }
+    return 0;
+}
+
+/* A section count, refused when the rest of the file cannot hold that
+ * many records of at least minSize bytes. */
+static int lc_count(load_cursor *c, size_t minSize, uint64_t *n) {
+    if (lc_u64(c, n) < 0) return -1;
+    return *n <= (uint64_t)(c->end - c->p) / minSize ? 0 : -1;
+}
+
+/* Reads one entity record into e and indexes it. */
+static int load_entity(eavgDB *db, load_cursor *c, const struct load_format *fmt,
+                       eavgEntity *e)
+{
+    if (LOAD_COMPACT(fmt)) {
+        uint64_t typeId;
+        if (lc_varint(c, &e->id) < 0 ||
+            lc_varint(c, &typeId) < 0 ||
+            lc_vstr(c, &db->entityArena, &e->name) < 0) return -1;
+        e->typeId = (eavg_u32)typeId;
+    } else if (lc_u64(c, &e->id) < 0 ||
+               lc_u32(c, &e->typeId) < 0 ||
+               lc_cstr(c, &db->entityArena, &e->name) < 0) return -1;
+    u64_map_put(db->entitiesById, e->id, e);
+    if (e->name) str_map_put(db->entitiesByName, e->name, e);
+    index_add(db->entitiesByType, EAVG_TYPE_KEY(e->typeId), e->id);
+    if (e->id >= db->nextEntityId) db->nextEntityId = e->id + 1;
+    return 0;
+}
+
+static int load_entities(eavgDB *db, load_cursor *c, const struct load_format *fmt) {
+    uint64_t n;
+    if (lc_count(c, LOAD_COMPACT(fmt) ? 3 : 16, &n) < 0) return -1;
+    if (!n) return 0;
+    eavgEntity *recs = arena_alloc(&db->entityArena, n * sizeof *recs);
+    if (!recs ||
+        u64_map_reserve(db->entitiesById, n) < 0 ||
+        str_map_reserve(db->entitiesByName, n) < 0) return -1;
+    for (uint64_t i = 0; i < n; i++) {
+        if (load_entity(db, c, fmt, &recs[i]) < 0) return -1;
+    }
+    return 0;
+}
+
+static int load_attribute(eavgDB *db, load_cursor *c, const struct load_format *fmt,
+                          eavgAttribute *a)
+{
+    if (LOAD_COMPACT(fmt)) {
+        uint64_t dataType;
+        if (lc_varint(c, &a->id) < 0 ||
+            lc_varint(c, &dataType) < 0 ||
+            lc_name_ref(c, fmt, &a->name, &a->nameSym) < 0) return -1;
+        a->dataType = (eavg_u32)dataType;
+    } else if (lc_u64(c, &a->id) < 0 ||
+               lc_u32(c, &a->dataType) < 0 ||
+               lc_name(c, &a->name, &a->nameSym) < 0) return -1;
+    if (a->id > EAVG_ATTRIBUTE_ID_MAX) return -1;
+    a->onValueAdded = NULL;
+    a->userData     = NULL;
+    u64_map_put(db->attributesById, a->id, a);
+    if (a->name) str_map_put(db->attributesByName, a->name, a);
+    if (a->id >= db->nextAttributeId) db->nextAttributeId = a->id + 1;
+    return 0;
+}
+
+static int load_attributes(eavgDB *db, load_cursor *c, const struct load_format *fmt) {
+    uint64_t n;
+    if (lc_count(c, LOAD_COMPACT(fmt) ? 3 : 16, &n) < 0) return -1;
+    if (!n) return 0;
+    eavgAttribute *recs = arena_alloc(&db->attributeArena, n * sizeof *recs);
+    if (!recs ||
+        u64_map_reserve(db->attributesById, n) < 0 ||
+        str_map_reserve(db->attributesByName, n) < 0) return -1;
+    for (uint64_t i = 0; i < n; i++) {
+        if (load_attribute(db, c, fmt, &recs[i]) < 0) return -1;
+    }
+    return 0;
+}
+
+static int load_reltype(eavgDB *db, load_cursor *c, const struct load_format *fmt,
+                        eavgRelationType *rt)
+{
+    if (LOAD_COMPACT(fmt)) {
+        if (lc_varint(c, &rt->id) < 0 || lc_name_ref(c, fmt, &rt->name, &rt->nameSym) < 0)
+            return -1;
+    } else if (lc_u64(c, &rt->id) < 0 ||
+               lc_name(c, &rt->name, &rt->nameSym) < 0) return -1;
+    u64_map_put(db->relationTypesById, rt->id, rt);
+    if (rt->name) str_map_put(db->relationTypesByName, rt->name, rt);
+    if (rt->id >= db->nextRelationTypeId) db->nextRelationTypeId = rt->id + 1;
+    return 0;
+}
+
+static int load_reltypes(eavgDB *db, load_cursor *c, const struct load_format *fmt) {
+    uint64_t n;
+    if (lc_count(c, LOAD_COMPACT(fmt) ? 2 : 12, &n) < 0) return -1;
+    if (!n) return 0;
+    eavgRelationType *recs = arena_alloc(&db->attributeArena, n * sizeof *recs);
+    if (!recs ||
+        u64_map_reserve(db->relationTypesById, n) < 0 ||
+        str_map_reserve(db->relationTypesByName, n) < 0) return -1;
+    for (uint64_t i = 0; i < n; i++) {
+        if (load_reltype(db, c, fmt, &recs[i]) < 0) return -1;
+    }
+    return 0;
+}
+
+/* One value record as it sits in the file. */
+struct load_value {
+    uint64_t             id, entityId, attributeId;
+    uint32_t             dtype;
+    unsigned char        fixed[8];    /* INT, DOUBLE, ENTITY */
+    const unsigned char *payload;     /* STRING, BINARY */
+    uint32_t             length;
+};
+
+/* Where a reader is in a compact section: the current list, the records
+ * left in it and the values the next deltas apply to. */
+struct load_list {
+    uint64_t key, left;
+    uint64_t id, target, timestamp;
+};
+
+static int load_list_next(load_cursor *c, struct load_list *l) {
+    while (!l->left) {
+        if (lc_varint(c, &l->key) < 0 || lc_varint(c, &l->left) < 0) return -1;
+        l->id = l->target = l->timestamp = 0;
+    }
+    l->left--;
+    return 0;
+}
+
+static int load_value_compact(load_cursor *c, const struct load_format *fmt,
+                              struct load_list *l, struct load_value *v)
+{
+    if (load_list_next(c, l) < 0 ||
+        lc_delta(c, &l->id) < 0 ||
+        lc_varint(c, &v->attributeId) < 0 ||
+        v->attributeId > EAVG_ATTRIBUTE_ID_MAX) return -1;
+    const eavgAttribute *at = u64_map_get(fmt->attrs, v->attributeId);
+    uint64_t             x  = 0;
+    v->id       = l->id;
+    v->entityId = l->key;
+    v->dtype    = at ? at->dataType : 0;
+    v->length   = 0;
+    switch (v->dtype) {
+    case EAVG_DATA_TYPE_INT:
+        if (lc_delta(c, &x) < 0) return -1;
+        memcpy(v->fixed, &x, sizeof x);
+        return 0;
+    case EAVG_DATA_TYPE_DOUBLE:
+        return lc_take(c, v->fixed, sizeof v->fixed);
+    case EAVG_DATA_TYPE_ENTITY:
+        if (lc_varint(c, &x) < 0) return -1;
+        memcpy(v->fixed, &x, sizeof x);
+        return 0;
+    case EAVG_DATA_TYPE_STRING:
+    case EAVG_DATA_TYPE_BINARY:
+        return lc_vbytes(c, &v->payload, &v->length);
+    default:
+        return 0;
+    }
+}
+
+static int load_value_next(load_cursor *c, const struct load_format *fmt,
+                           struct load_list *l, struct load_value *v)
+{
+    uint32_t version = fmt->version;
+    if (LOAD_COMPACT(fmt)) return load_value_compact(c, fmt, l, v);
+    if (lc_u64(c, &v->id) < 0 ||
+        lc_u64(c, &v->entityId) < 0 ||
+        lc_u64(c, &v->attributeId) < 0 ||
+        v->attributeId > EAVG_ATTRIBUTE_ID_MAX ||
+        lc_u32(c, &v->dtype) < 0) return -1;
+    v->length = 0;
+    switch (v->dtype) {
+    case EAVG_DATA_TYPE_INT:
+    case EAVG_DATA_TYPE_DOUBLE:
+    case EAVG_DATA_TYPE_ENTITY:
+        return lc_take(c, v->fixed, sizeof v->fixed);
+    case EAVG_DATA_TYPE_STRING:
+        return lc_bytes(c, &v->payload, &v->length);
+    case EAVG_DATA_TYPE_BINARY:
+        /* v1 wrote no payload for BINARY values; they load empty */
+        return version >= 2 ? lc_bytes(c, &v->payload, &v->length) : 0;
+    default:
+        return 0;   /* unknown types load without payload */
+    }
+}
+
+/* Reads everything but a label stored inline, which stays in the file
+ * for edge_label to intern; a label from the string table is set on e. */
+static int load_edge_next(load_cursor *c, const struct load_format *fmt,
+                          struct load_list *l, eavgEdgeRec *e,
+                          const unsigned char **label, uint32_t *labelLen)
+{
+    uint32_t dir;
+    if (LOAD_COMPACT(fmt)) {
+        uint64_t d;
+        if (load_list_next(c, l) < 0 ||
+            lc_delta(c, &l->id) < 0 ||
+            lc_delta(c, &l->target) < 0 ||
+            lc_varint(c, &e->relationTypeId) < 0 ||
+            lc_take(c, &e->weight, sizeof e->weight) < 0 ||
+            lc_varint(c, &d) < 0 ||
+            lc_delta(c, &l->timestamp) < 0 ||
+            lc_ref(c, fmt, &e->label, &e->labelSym) < 0) return -1;
+        e->id           = l->id;
+        e->sourceEntity = l->key;
+        e->targetEntity = l->target;
+        e->timestamp    = l->timestamp;
+        e->direction    = (eavgEdgeDir)d;
+        *labelLen       = 0;
+        return 0;
+    }
+    if (lc_u64(c, &e->id) < 0 ||
+        lc_u64(c, &e->sourceEntity) < 0 ||
+        lc_u64(c, &e->targetEntity) < 0 ||
+        lc_u64(c, &e->relationTypeId) < 0 ||
+        lc_take(c, &e->weight, sizeof e->weight) < 0 ||
+        lc_u32(c, &dir) < 0 ||
+        lc_u64(c, &e->timestamp) < 0 ||
+        lc_bytes(c, label, labelLen) < 0) return -1;
+    e->direction = (eavgEdgeDir)dir;
+    e->label     = NULL;
+    e->labelSym  = 0;
+    return 0;
+}
+
+/* Sets an inline label load_edge_next left in the file; one the pool
+ * does not take is copied into arena. */
+static int edge_label(Arena *arena, eavgEdgeRec *e, const unsigned char *label,
+                      uint32_t labelLen)
+{
+    if (!labelLen) return 0;
+    e->labelSym = label_sym((const char*)label, labelLen);
+    e->label    = label_text(arena, (const char*)label, labelLen, e->labelSym);
+    return e->label ? 0 : -1;
+}
+
+enum { LOAD_VALUES, LOAD_EDGES };
+enum { LOAD_COUNT, LOAD_FILL };
+
+/* A list's slots one run fills, from next on. */
+struct load_slot {
+    void   *list;
+    size_t  next;
+};
+
+/* A run of consecutive records, loaded by one thread.  Compact sections
+ * are cut between lists. */
+struct load_run {
+    int                        section;
+    int                        pass;
+    const struct load_format  *fmt;
+    load_cursor                in;
+    uint64_t                   first, count;   /* record numbers within the section */
+    u64_map                   *keys[2];   /* list key -> record count, then -> load_slot */
+    struct load_slot          *slots[2];
+    eavgValueLoc              *locs;      /* values: the section's locators, by record */
+    Arena                      arena;     /* payloads */
+    uint64_t                   maxId;
+    bool                       failed;
+};
+
+static void load_count(struct load_run *r, int k, eavg_u64 key) {
+    uintptr_t n = (uintptr_t)u64_map_get(r->keys[k], key);
+    if (u64_map_put(r->keys[k], key, (void*)(n + 1)) < 0) r->failed = true;
+}
+
+/* Fills rec from v, copying a payload that does not fit inline into arena. */
+static int load_value_set(Arena *arena, eavgValRec *rec, const struct load_value *v) {
+    rec->id          = v->id;
+    rec->attributeId = (eavg_u32)v->attributeId;   /* checked by load_value_next */
+    rec->length      = 0;
+    memset(&rec->data, 0, sizeof rec->data);
+    switch (v->dtype) {
+    case EAVG_DATA_TYPE_INT:
+    case EAVG_DATA_TYPE_DOUBLE:
+    case EAVG_DATA_TYPE_ENTITY:
+        memcpy(&rec->data, v->fixed, sizeof v->fixed);
+        break;
+    case EAVG_DATA_TYPE_STRING:
+    case EAVG_DATA_TYPE_BINARY: {
+        bool str = v->dtype == EAVG_DATA_TYPE_STRING;
+        if (str && !v->length) break;   /* NULL string */
+        unsigned char *p = value_payload(arena, rec, v->length, str);
+        if (!p) return -1;
+        if (v->length) memcpy(p, v->payload, v->length);
+        break;
+    }
+    }
+    return 0;
+}
+
+static void load_value_fill(struct load_run *r, const struct load_value *v, uint64_t i) {
+    struct load_slot *s  = u64_map_get(r->keys[0], v->entityId);
+    eavgValueList    *vl = s->list;
+    r->locs[r->first + i].list = vl;
+    r->locs[r->first + i].slot = s->next;
+    if (load_value_set(&r->arena, &vl->values[s->next++], v) < 0) r->failed = true;
+}
+
+static void load_edge_fill(struct load_run *r, const eavgEdgeRec *e,
+                           const unsigned char *label, uint32_t labelLen)
+{
+    struct load_slot *out = u64_map_get(r->keys[0], e->sourceEntity);
+    struct load_slot *in  = u64_map_get(r->keys[1], e->targetEntity);
+    eavgEdgeRec      *rec = &((eavgAdjList*)out->list)->edges[out->next++];
+    *rec = *e;
+    if (edge_label(&r->arena, rec, label, labelLen) < 0) {
+        r->failed = true;
+        return;
+    }
+    ((eavgAdjList*)in->list)->edges[in->next++] = *rec;
+}
+
+static void *load_worker(void *arg) {
+    struct load_run  *r = arg;
+    load_cursor       c = r->in;
+    struct load_list  l = { 0 };
+    for (uint64_t i = 0; i < r->count && !r->failed; i++) {
+        if (r->section == LOAD_VALUES) {
+            struct load_value v;
+            load_value_next(&c, r->fmt, &l, &v);   /* checked by load_split */
+            if (v.id > r->maxId) r->maxId = v.id;
+            if (r->pass == LOAD_COUNT) load_count(r, 0, v.entityId);
+            else                       load_value_fill(r, &v, i);
+        } else {
+            eavgEdgeRec          e;
+            const unsigned char *label;
+            uint32_t             labelLen;
+            load_edge_next(&c, r->fmt, &l, &e, &label, &labelLen);
+            if (e.id > r->maxId) r->maxId = e.id;
+            if (r->pass == LOAD_COUNT) {
+                load_count(r, 0, e.sourceEntity);
+                load_count(r, 1, e.targetEntity);
+            } else {
+                load_edge_fill(r, &e, label, labelLen);
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Runs pass over every run, one thread each (the caller takes the first). */
+static int load_pass(struct load_run *runs, unsigned n, int pass) {
+    pthread_t tids[LOAD_MAX_THREADS];
+    bool      started[LOAD_MAX_THREADS];
+    for (unsigned i = 0; i < n; i++) {
+        runs[i].pass = pass;
+        started[i]   = i > 0 && pthread_create(&tids[i], NULL, load_worker, &runs[i]) == 0;
+    }
+    for (unsigned i = 0; i < n; i++) {
+        if (!started[i]) load_worker(&runs[i]);
+    }
+    for (unsigned i = 1; i < n; i++) {
+        if (started[i]) pthread_join(tids[i], NULL);
+    }
+    for (unsigned i = 0; i < n; i++) {
+        if (runs[i].failed) return -1;
+    }
+    return 0;
+}
+
+/* Walks the section once, checking every record and cutting the records
+ * into at most n runs of nearly equal length; c is left after the
+ * section.  Returns how many runs there are, or -1. */
+static int load_split(load_cursor *c, int section, const struct load_format *fmt,
+                      uint64_t count, struct load_run *runs, unsigned n)
+{
+    struct load_list l    = { 0 };
+    unsigned         next = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        bool cut = !LOAD_COMPACT(fmt) || !l.left;
+        if (cut && next < n && i >= count * next / n) {
+            runs[next].first  = i;
+            runs[next++].in.p = c->p;
+        }
+        if (section == LOAD_VALUES) {
+            struct load_value v;
+            if (load_value_next(c, fmt, &l, &v) < 0) return -1;
+        } else {
+            eavgEdgeRec          e;
+            const unsigned char *label;
+            uint32_t             labelLen;
+            if (load_edge_next(c, fmt, &l, &e, &label, &labelLen) < 0) return -1;
+        }
+    }
+    for (unsigned i = 0; i < next; i++) {
+        uint64_t end   = i + 1 < next ? runs[i + 1].first : count;
+        runs[i].count  = end - runs[i].first;
+        runs[i].in.end = i + 1 < next ? runs[i + 1].in.p : c->p;
+    }
+    return (int)next;
+}
+
+static void *load_list_create(eavgDB *db, u64_map *index, eavg_u64 key) {
+    return index == db->valuesByEntity ? (void*)valuelist_get_or_create(db, key)
+                                       : (void*)adjlist_get_or_create(db, index, key);
+}
+
+static size_t *load_list_count(eavgDB *db, u64_map *index, void *list) {
+    return index == db->valuesByEntity ? &((eavgValueList*)list)->count
+                                       : &((eavgAdjList*)list)->count;
+}
+
+/* Creates the lists the runs' keys[k] name, and turns each run's counts
+ * into its first slot in each list.  Afterwards every list's count is its
+ * final length; the records are carved for it from one array of recSize
+ * records per section. */
+static int load_lists(eavgDB *db, struct load_run *runs, unsigned n, int k,
+                      u64_map *index, Arena *arena, size_t recSize, uint64_t records)
+{
+    size_t keys = 0;
+    for (unsigned i = 0; i < n; i++) keys += runs[i].keys[k]->count;
+    if (keys > db->entitiesById->count) keys = db->entitiesById->count;   /* lists <= entities */
+    if (u64_map_reserve(index, keys) < 0) return -1;
+
+    for (unsigned i = 0; i < n; i++) {
+        u64_map          *m = runs[i].keys[k];
+        struct load_slot *s = runs[i].slots[k] = malloc(m->count * sizeof *s);
+        if (!s) return -1;
+        for (size_t j = 0; j < m->capacity; j++) {
+            if (!m->keys[j]) continue;
+            void *list = load_list_create(db, index, m->keys[j]);
+            if (!list) return -1;
+            size_t *len = load_list_count(db, index, list);
+            s->list     = list;
+            s->next     = *len;
+            *len       += (uintptr_t)m->values[j];
+            m->values[j] = s++;
+        }
+    }
+
+    char *recs = arena_alloc(arena, records * recSize);
+    if (!recs) return -1;
+    for (size_t j = 0; j < index->capacity; j++) {
+        if (!index->keys[j]) continue;
+        if (index == db->valuesByEntity) {
+            eavgValueList *vl = index->values[j];
+            vl->values = (eavgValRec*)recs;
+            vl->cap    = vl->count;
+        } else {
+            eavgAdjList *al = index->values[j];
+            al->edges = (eavgEdgeRec*)recs;
+            al->cap   = al->count;
+        }
+        recs += *load_list_count(db, index, index->values[j]) * recSize;
+    }
+    return 0;
+}
+
+static int load_records(eavgDB *db, load_cursor *c, int section,
+                        const struct load_format *fmt, unsigned threads)
+{
+    static const size_t minSize[2][2] = { { 28, 56 }, { 2, 14 } };   /* [compact][section] */
+    uint64_t count;
+    if (lc_count(c, minSize[LOAD_COMPACT(fmt)][section], &count) < 0) return -1;
+    if (!count) return 0;
+
+    unsigned n = threads;
+    if (count / LOAD_MIN_RUN < n) n = count / LOAD_MIN_RUN ? (unsigned)(count / LOAD_MIN_RUN) : 1;
+    struct load_run runs[LOAD_MAX_THREADS];
+    int             rc = -1, used;
+    memset(runs, 0, sizeof runs);
+    for (unsigned i = 0; i < n; i++) {
+        runs[i].section = section;
+        runs[i].fmt     = fmt;
+        arena_init(&runs[i].arena, LOAD_ARENA_BLOCK);
+        runs[i].keys[0] = u64_map_create(64);
+        runs[i].keys[1] = section == LOAD_EDGES ? u64_map_create(64) : NULL;
+        if (!runs[i].keys[0] || (section == LOAD_EDGES && !runs[i].keys[1])) goto out;
+    }
+    if ((used = load_split(c, section, fmt, count, runs, n)) < 0 ||
+        load_pass(runs, (unsigned)used, LOAD_COUNT) < 0) goto out;
+
+    if (section == LOAD_VALUES) {
+        eavgValueLoc *locs = arena_alloc(&db->valueArena, count * sizeof *locs);
+        if (!locs ||
+            load_lists(db, runs, (unsigned)used, 0, db->valuesByEntity, &db->valueArena,
+                       sizeof(eavgValRec), count) < 0) goto out;
+        for (int i = 0; i < used; i++) runs[i].locs = locs;
+        if (load_pass(runs, (unsigned)used, LOAD_FILL) < 0 ||
+            u64_map_reserve(db->valuesById, count) < 0) goto out;
+        for (uint64_t i = 0; i < count; i++) {
+            eavgValueList *vl = locs[i].list;
+            eavgValRec    *r  = &vl->values[locs[i].slot];
+            u64_map_put(db->valuesById, r->id, &locs[i]);
+            index_add(db->entitiesByAttribute, r->attributeId, vl->entityId);
+        }
+    } else {
+        if (load_lists(db, runs, (unsigned)used, 0, db->adjIndexBySource, &db->edgeArena,
+                       sizeof(eavgEdgeRec), count) < 0 ||
+            load_lists(db, runs, (unsigned)used, 1, db->reverseAdjIndexByTarget,
+                       &db->edgeArena, sizeof(eavgEdgeRec), count) < 0 ||
+            load_pass(runs, (unsigned)used, LOAD_FILL) < 0) goto out;
+    }
+    for (int i = 0; i < used; i++) {
+        if (section == LOAD_VALUES && runs[i].maxId >= db->nextValueId)
+            db->nextValueId = runs[i].maxId + 1;
+        if (section == LOAD_EDGES && runs[i].maxId >= db->nextEdgeId)
+            db->nextEdgeId = runs[i].maxId + 1;
+    }
+    rc = 0;
+
+ out:
+    for (unsigned i = 0; i < n; i++) {
+        for (int k = 0; k < 2; k++) {
+            u64_map_destroy(runs[i].keys[k]);
+            free(runs[i].slots[k]);
+        }
+        arena_adopt(section == LOAD_VALUES ? &db->valueArena : &db->edgeArena, &runs[i].arena);
+    }
+    return rc;
+}
+
+static eavgDB *image_load(const char *filename);
+static eavgDB *chunked_load(const char *filename);
+static eavgDB *delta_load(load_cursor *c, const eavgLoadOptions *opt);
+#define EAVG_IMAGE_MAGIC    "EAVGIMG1"
+#define CHK_MAGIC           "EAVGCHK1"
+#define EAVG_DELTA_MAGIC    "EAVGDLT1"
+
+static eavgDB *snapshot_load(const char *filename, const eavgLoadOptions *opt) {
+    static const eavgLoadOptions defaults = { 0 };
+    if (!opt) opt = &defaults;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    void       *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= 12)
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    load_cursor        c   = { map, (const unsigned char*)map + st.st_size };
+    struct load_format fmt = { 0 };
+    eavgDB            *db  = NULL;
+    if (memcmp(map, EAVG_IMAGE_MAGIC, 8) == 0) {
+        munmap(map, (size_t)st.st_size);
+        return image_load(filename);
+    }
+    if (memcmp(map, CHK_MAGIC, 8) == 0) {
+        munmap(map, (size_t)st.st_size);
+        return chunked_load(filename);
+    }
+    c.p += 8;
+    if (memcmp(map, EAVG_DELTA_MAGIC, 8) == 0) {
+        db = delta_load(&c, opt);
+        goto out;
+    }
+    if (memcmp(map, EAVG_PERS_MAGIC, 8) != 0 ||
+        lc_u32(&c, &fmt.version) < 0 || fmt.version < 1 || fmt.version > EAVG_PERS_COMPACT ||
+        !(db = eavgDB_create(128))) goto out;
+    fmt.attrs = db->attributesById;
+
+    unsigned threads = opt->threads;
+    if (!threads) {
+        long n  = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = n > 0 ? (unsigned)n : 1;
+    }
+    if (threads > LOAD_MAX_THREADS) threads = LOAD_MAX_THREADS;
+
+    LOCK_WR(db);
+    int rc = (LOAD_COMPACT(&fmt) && load_strings(db, &c, &fmt) < 0) ||
+             load_entities(db, &c, &fmt) < 0 ||
+             load_attributes(db, &c, &fmt) < 0 ||
+             load_reltypes(db, &c, &fmt) < 0 ||
+             load_records(db, &c, LOAD_VALUES, &fmt, threads) < 0 ||
+             load_records(db, &c, LOAD_EDGES, &fmt, threads) < 0 ? -1 : 0;
+    UNLOCK_WR(db);
+    if (rc < 0) {
+        eavgDB_destroy(db);
+        db = NULL;
+    }
+
+ out:
+    free(fmt.strings);
+    free(fmt.symbols);
+    munmap(map, (size_t)st.st_size);
+    return db;
+}
+
+/* Chunked files.  After a short header come the chunks; each holds whole
+ * records of one section in the stream (v2) encoding and ends at the
+ * first key boundary past CHK_CHUNK_SIZE, so a key's records share one
+ * chunk.  Value and edge lists are written in entity id order, so each of
+ * their chunks covers a range of ids.  The index at the
+ * end gives every chunk's place, CRC-32C and id range, and a fixed
+ * trailer locates and checksums the index.  A lazily opened db loads the
+ * chunks of an entity the first time it is asked for. */
+#define CHK_VERSION     1
+#define CHK_CHUNK_SIZE  (64 * 1024)
+#define CHK_HEADER_SIZE 16
+
+static const char *const chk_names[CHK_SECTIONS] = {
+    "entities", "attributes", "relation types", "values", "out-edges", "in-edges",
+};
+static const int chk_table[CHK_SECTIONS] = {
+    SNAP_ENTITIES, SNAP_ATTRIBUTES, SNAP_RELTYPES, SNAP_VALUES, SNAP_OUT, SNAP_IN,
+};
+
+typedef struct {
+    uint32_t section, crc;
+    uint64_t offset;
+    uint32_t length, records;
+    uint64_t firstKey, lastKey;
+} chk_entry;
+
+typedef struct {
+    uint64_t indexOffset, chunkCount;
+    uint64_t nextIds[5];     /* entity, attribute, relation type, value, edge */
+    uint32_t crc;            /* of the index and the fields above */
+    uint32_t reserved;
+    char     magic[8];
+} chk_trailer;
+
+enum { CHK_UNLOADED, CHK_LOADED, CHK_BAD };
+
+struct eavgLazy {
+    unsigned char           *map;
+    size_t                   size;
+    chk_entry               *index;
+    size_t                   count;
+    size_t                   first[CHK_SECTIONS], end[CHK_SECTIONS];
+    chk_trailer              trailer;
+    _Atomic unsigned char   *state;
+    eavg_u64                *loadedAt;  /* db epoch of the load, set before state */
+    _Atomic size_t           unloaded[CHK_SECTIONS];
+    _Atomic size_t           bad[CHK_SECTIONS];
+    void                   (*onBadChunk)(const eavgChunkError *err, void *userData);
+    void                    *onBadChunkData;
+};
+
+struct chk_writer {
+    save_out    out;
+    uint64_t    offset;
+    save_buf    chunk;
+    chk_entry   cur;
+    chk_entry  *index;
+    size_t      count, cap;
+    bool        failed;
+};
+
+static void chk_flush(struct chk_writer *w) {
+    if (!w->cur.records || w->failed) return;
+    if (w->count == w->cap) {
+        size_t     cap   = w->cap ? w->cap * 2 : 64;
+        chk_entry *index = realloc(w->index, cap * sizeof *index);
+        if (!index) {
+            w->failed = true;
+            return;
+        }
+        w->index = index;
+        w->cap   = cap;
+    }
+    if (w->chunk.oom || save_write(&w->out, w->chunk.p, w->chunk.len) < 0) {
+        w->failed = true;
+        return;
+    }
+    w->cur.offset = w->offset;
+    w->cur.length = (uint32_t)w->chunk.len;
+    w->cur.crc    = wal_crc32c(w->chunk.p, w->chunk.len);
+    w->index[w->count++] = w->cur;
+    w->offset    += w->chunk.len;
+    w->chunk.len   = 0;
+    w->cur.records = 0;
+}
+
+/* Accounts for a record just encoded into the chunk. */
+static void chk_record(struct chk_writer *w, int section, uint64_t key) {
+    if (!w->cur.records++) {
+        w->cur.section  = (uint32_t)section;
+        w->cur.firstKey = key;
+    }
+    w->cur.lastKey = key;
+}
+
+/* Ends the chunk if full, once a key's records are all in. */
+static void chk_key_end(struct chk_writer *w) {
+    if (w->chunk.len >= CHK_CHUNK_SIZE) chk_flush(w);
+}
+
+static int chk_list_cmp(const void *a, const void *b) {
+    eavg_u64 x = **(const eavg_u64 *const *)a, y = **(const eavg_u64 *const *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* The lists of a value or adjacency map in key order.  Both list types
+ * start with their key. */
+static void **chk_sorted(u64_map *m) {
+    void  **lists = malloc((m->count ? m->count : 1) * sizeof *lists);
+    size_t  n     = 0;
+    if (!lists) return NULL;
+    for (size_t i = 0; i < m->capacity; i++) {
+        if (m->values[i]) lists[n++] = m->values[i];
+    }
+    qsort(lists, n, sizeof *lists, chk_list_cmp);
+    return lists;
+}
+
+static void chk_section(struct chk_writer *w, eavgSnapshot *s, int section) {
+    u64_map  *m     = s->maps[chk_table[section]];
+    void    **lists = section >= CHK_VALUES ? chk_sorted(m) : NULL;
+    save_buf *b     = &w->chunk;
+    if (section >= CHK_VALUES && !lists) {
+        w->failed = true;
+        return;
+    }
+    size_t   n     = lists ? m->count : m->capacity;
+    for (size_t i = 0; i < n && !w->failed; i++) {
+        void *v = lists ? lists[i] : m->values[i];
+        if (!v) continue;
+        switch (section) {
+        case CHK_ENTITIES: {
+            const eavgEntity *e = v;
+            sb_u64(b, e->id);
+            sb_u32(b, e->typeId);
+            sb_cstr(b, e->name);
+            chk_record(w, section, e->id);
+            break;
+        }
+        case CHK_ATTRIBUTES: {
+            const eavgAttribute *a = v;
+            sb_u64(b, a->id);
+            sb_u32(b, a->dataType);
+            sb_cstr(b, a->name);
+            chk_record(w, section, a->id);
+            break;
+        }
+        case CHK_RELTYPES: {
+            const eavgRelationType *r = v;
+            sb_u64(b, r->id);
+            sb_cstr(b, r->name);
+            chk_record(w, section, r->id);
+            break;
+        }
+        case CHK_VALUES: {
+            const eavgValueList *vl = v;
+            for (size_t k = 0; k < vl->count; k++) {
+                save_value(b, s->maps[SNAP_ATTRIBUTES], vl->entityId, &vl->values[k]);
+                chk_record(w, section, vl->entityId);
+            }
+            break;
+        }
+        default: {
+            const eavgAdjList *al = v;
+            for (size_t k = 0; k < al->count; k++) {
+                save_edge(b, &al->edges[k]);
+                chk_record(w, section, al->srcId);
+            }
+            break;
+        }
+        }
+        chk_key_end(w);
+    }
+    chk_flush(w);
+    free(lists);
+}
+
+static int chunked_save(eavgSnapshot *s, const char *filename) {
+    eavgDB            *db     = s->db;
+    size_t             tmpLen = strlen(filename) + sizeof ".tmp";
+    char              *tmp    = malloc(tmpLen);
+    struct chk_writer  w      = { .offset = CHK_HEADER_SIZE };
+    int                rc     = -1;
+    if (!tmp) return -1;
+    snprintf(tmp, tmpLen, "%s.tmp", filename);
+    if (save_open(tmp, false, &w.out) < 0) {
+        free(tmp);
+        return -1;
+    }
+
+    unsigned char head[CHK_HEADER_SIZE];
+    uint32_t      version = CHK_VERSION, chunkSize = CHK_CHUNK_SIZE;
+    memcpy(head, CHK_MAGIC, 8);
+    memcpy(head + 8, &version, 4);
+    memcpy(head + 12, &chunkSize, 4);
+    w.failed = save_write(&w.out, head, sizeof head) < 0;
+    for (int sec = 0; sec < CHK_SECTIONS; sec++) chk_section(&w, s, sec);
+
+    if (!w.failed) {
+        chk_trailer t = { .indexOffset = w.offset, .chunkCount = w.count };
+        save_buf    tail = { 0 };
+        t.nextIds[0] = db->nextEntityId;
+        t.nextIds[1] = db->nextAttributeId;
+        t.nextIds[2] = db->nextRelationTypeId;
+        t.nextIds[3] = db->nextValueId;
+        t.nextIds[4] = db->nextEdgeId;
+        memcpy(t.magic, CHK_MAGIC, 8);
+        sb_put(&tail, w.index, w.count * sizeof *w.index);
+        sb_put(&tail, &t, offsetof(chk_trailer, crc));
+        t.crc = tail.oom ? 0 : wal_crc32c(tail.p, tail.len);
+        sb_put(&tail, &t.crc, sizeof t - offsetof(chk_trailer, crc));
+        rc = tail.oom ? -1 : save_write(&w.out, tail.p, tail.len);
+        free(tail.p);
+    }
+    if (rc == 0) rc = fsync(w.out.fd);
+    if (close(w.out.fd) != 0) rc = -1;
+    if (rc == 0) rc = rename(tmp, filename) == 0 ? wal_sync_dir(filename) : -1;
+    if (rc != 0) unlink(tmp);
+    free(w.chunk.p);
+    free(w.index);
+    free(tmp);
+    return rc;
+}
+
+int eavgDB_saveChunked(eavgDB *db, const char *filename) {
+    STATS_OP(EAVG_OP_SAVE);
+    id_bitmap    *sets[DIRTY_SETS];
+    bool          takes;
+    if (lazy_settle(db, CHK_ALL) < 0) return -1;
+    eavgSnapshot *snap = save_begin(db, sets, filename, NULL, &takes);
+    if (!snap) return -1;
+    return save_end(snap, sets, takes ? filename : NULL, chunked_save(snap, filename));
+}
+
+static void lazy_free(struct eavgLazy *lz) {
+    if (!lz) return;
+    if (lz->map) munmap(lz->map, lz->size);
+    free(lz->index);
+    free((void*)lz->state);
+    free(lz->loadedAt);
+    free(lz);
+}
+
+/* Maps filename and checks its header, trailer and index (not yet the
+ * chunks).  NULL if it is not a sound chunked file. */
+static struct eavgLazy *chk_open(const char *filename) {
+    struct eavgLazy *lz = calloc(1, sizeof *lz);
+    struct stat      st;
+    int              fd = open(filename, O_RDONLY);
+    if (!lz || fd < 0) goto fail;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < CHK_HEADER_SIZE + sizeof lz->trailer) goto fail;
+    lz->size = (size_t)st.st_size;
+    lz->map  = mmap(NULL, lz->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (lz->map == MAP_FAILED) {
+        lz->map = NULL;
+        goto fail;
+    }
+    close(fd);
+    fd = -1;
+
+    uint32_t     version;
+    chk_trailer *t = &lz->trailer;
+    memcpy(&version, lz->map + 8, 4);
+    memcpy(t, lz->map + lz->size - sizeof *t, sizeof *t);
+    if (memcmp(lz->map, CHK_MAGIC, 8) != 0 || version != CHK_VERSION ||
+        memcmp(t->magic, CHK_MAGIC, 8) != 0 ||
+        t->indexOffset < CHK_HEADER_SIZE || t->indexOffset > lz->size - sizeof *t ||
+        (lz->size - sizeof *t - t->indexOffset) % sizeof(chk_entry) != 0 ||
+        t->chunkCount != (lz->size - sizeof *t - t->indexOffset) / sizeof(chk_entry) ||
+        wal_crc32c(lz->map + t->indexOffset,
+                   lz->size - sizeof *t - t->indexOffset + offsetof(chk_trailer, crc)) != t->crc)
+        goto fail;
+
+    lz->count    = t->chunkCount;
+    lz->index    = malloc((lz->count ? lz->count : 1) * sizeof *lz->index);
+    lz->state    = calloc(lz->count ? lz->count : 1, sizeof *lz->state);
+    lz->loadedAt = calloc(lz->count ? lz->count : 1, sizeof *lz->loadedAt);
+    if (!lz->index || !lz->state || !lz->loadedAt) goto fail;
+    memcpy(lz->index, lz->map + t->indexOffset, lz->count * sizeof *lz->index);
+    for (int sec = 0; sec < CHK_SECTIONS; sec++) lz->first[sec] = lz->end[sec] = 0;
+    for (size_t i = 0; i < lz->count; i++) {
+        const chk_entry *e = &lz->index[i];
+        if (e->section >= CHK_SECTIONS || (i && e->section < lz->index[i - 1].section) ||
+            e->offset < CHK_HEADER_SIZE || e->offset > t->indexOffset ||
+            e->length > t->indexOffset - e->offset) goto fail;
+        if (!lz->end[e->section]) lz->first[e->section] = i;
+        lz->end[e->section] = i + 1;
+    }
+    for (int sec = 1; sec < CHK_SECTIONS; sec++) {
+        if (!lz->end[sec]) lz->first[sec] = lz->end[sec] = lz->end[sec - 1];
+    }
+    for (int sec = 0; sec < CHK_SECTIONS; sec++) {
+        atomic_init(&lz->unloaded[sec], lz->end[sec] - lz->first[sec]);
+        atomic_init(&lz->bad[sec], 0);
+    }
+    return lz;
+
+ fail:
+    if (fd >= 0) close(fd);
+    lazy_free(lz);
+    return NULL;
+}
+
+static bool chk_intact(const struct eavgLazy *lz, size_t i) {
+    const chk_entry *e = &lz->index[i];
+    return wal_crc32c(lz->map + e->offset, e->length) == e->crc;
+}
+
+static void chk_error(const struct eavgLazy *lz, size_t i, eavgChunkError *err) {
+    const chk_entry *e = &lz->index[i];
+    *err = (eavgChunkError){ i, chk_names[e->section], e->offset, e->firstKey, e->lastKey };
+}
+
+/* Adds chunk i's records to db; the caller holds the write lock. */
+static int chk_load(eavgDB *db, struct eavgLazy *lz, size_t i) {
+    static const struct load_format stream = { .version = EAVG_PERS_VERSION };
+    const chk_entry *e = &lz->index[i];
+    load_cursor      c = { lz->map + e->offset, lz->map + e->offset + e->length };
+    struct load_list l = { 0 };
+    for (uint32_t k = 0; k < e->records; k++) {
+        switch (e->section) {
+        case CHK_ENTITIES: {
+            eavgEntity *ent = EAVG_ENTITY_ALLOC(db);
+            if (!ent || load_entity(db, &c, &stream, ent) < 0) return -1;
+            break;
+        }
+        case CHK_ATTRIBUTES: {
+            eavgAttribute *a = EAVG_ATTR_ALLOC(db);
+            if (!a || load_attribute(db, &c, &stream, a) < 0) return -1;
+            break;
+        }
+        case CHK_RELTYPES: {
+            eavgRelationType *rt = EAVG_RELTYPE_ALLOC(db);
+            if (!rt || load_reltype(db, &c, &stream, rt) < 0) return -1;
+            break;
+        }
+        case CHK_VALUES: {
+            struct load_value v;
+            if (load_value_next(&c, &stream, &l, &v) < 0) return -1;
+            eavgValueList *vl = valuelist_get_or_create(db, v.entityId);
+            if (!vl || valuelist_reserve(db, vl, vl->count + 1) < 0 ||
+                load_value_set(&db->valueArena, &vl->values[vl->count], &v) < 0 ||
+                value_index_put(db, vl, vl->count) < 0) return -1;
+            vl->count++;
+            index_add(db->entitiesByAttribute, v.attributeId, v.entityId);
+            break;
+        }
+        default: {
+            eavgEdgeRec          ed;
+            const unsigned char *label;
+            uint32_t             labelLen;
+            if (load_edge_next(&c, &stream, &l, &ed, &label, &labelLen) < 0 ||
+                edge_label(&db->edgeArena, &ed, label, labelLen) < 0) return -1;
+            bool         out = e->section == CHK_OUT;
+            eavgAdjList *al  = adjlist_get_or_create(db, out ? db->adjIndexBySource
+                                                             : db->reverseAdjIndexByTarget,
+                                                     out ? ed.sourceEntity : ed.targetEntity);
+            if (!al || adjlist_reserve(db, al, al->count + 1) < 0) return -1;
+            al->edges[al->count++] = ed;
+            break;
+        }
+        }
+    }
+    return 0;
+}
+
+/* Loads the chunks in [from, to) that are not loaded yet, widened to
+ * the neighbours sharing a key with its ends, and once the lock is
+ * released reports those whose checksum or records turned out bad.
+ * Returns -1 when a chunk of the range is bad (or on OOM).  A key is thus
+ * loaded whole, in file order, or not at all. */
+static int lazy_load(eavgDB *db, size_t from, size_t to) {
+    struct eavgLazy *lz      = db->lazy;
+    size_t          *bad     = NULL, nbad = 0;
+    bool             pending = false;
+    int              rc      = 0;
+    while (from > 0 && from < to && lz->index[from - 1].section == lz->index[from].section &&
+           lz->index[from - 1].lastKey == lz->index[from].firstKey) from--;
+    while (to < lz->count && from < to && lz->index[to].section == lz->index[to - 1].section &&
+           lz->index[to].firstKey == lz->index[to - 1].lastKey) to++;
+    for (size_t i = from; i < to; i++) {
+        unsigned char st = atomic_load_explicit(&lz->state[i], memory_order_acquire);
+        if (st == CHK_BAD)      rc = -1;
+        if (st == CHK_UNLOADED) pending = true;
+    }
+    if (!pending) return rc;
+
+    br_lock_wr(&db->lock);
+    for (size_t i = from; i < to; i++) {
+        int           sec = (int)lz->index[i].section;
+        unsigned char st  = atomic_load_explicit(&lz->state[i], memory_order_relaxed);
+        if (st == CHK_UNLOADED) {
+            /* a snapshot sees what it pinned: the lists loaded now go into copies */
+            if (snap_unshare(db, SNAP_MAP(chk_table[sec])) < 0) {
+                rc = -1;
                 break;
             }
+            st = chk_intact(lz, i) && chk_load(db, lz, i) == 0 ? CHK_LOADED : CHK_BAD;
+            lz->loadedAt[i] = db->epoch;
+            if (st == CHK_BAD) {
+                size_t *more = realloc(bad, (nbad + 1) * sizeof *bad);
+                if (more) (bad = more)[nbad++] = i;
+                atomic_fetch_add(&lz->bad[sec], 1);
+            }
+            atomic_store_explicit(&lz->state[i], st, memory_order_release);
+            atomic_fetch_sub(&lz->unloaded[sec], 1);
+        }
+        if (st == CHK_BAD) rc = -1;
+    }
+    br_unlock_wr(&db->lock);
+
+    for (size_t k = 0; k < nbad && lz->onBadChunk; k++) {
+        eavgChunkError err;
+        chk_error(lz, bad[k], &err);
+        lz->onBadChunk(&err, lz->onBadChunkData);
+    }
+    free(bad);
+    return rc;
+}
+
+/* The chunks of section that may hold key's records: [*lo, *hi). */
+static void lazy_range(const struct eavgLazy *lz, int section, eavg_u64 key,
+                       size_t *lo, size_t *hi)
+{
+    size_t l = lz->first[section], h = lz->end[section];
+    while (l < h) {
+        size_t mid = l + (h - l) / 2;
+        if (lz->index[mid].lastKey < key) l = mid + 1;
+        else                              h = mid;
+    }
+    h = l;
+    while (h < lz->end[section] && lz->index[h].firstKey <= key) h++;
+    *lo = l;
+    *hi = h;
+}
+
+/* Loads the chunks of section that may hold key's records. */
+static int lazy_fault(eavgDB *db, int section, eavg_u64 key) {
+    struct eavgLazy *lz = db->lazy;
+    if (db->image) return img_fault(db, section, key);
+    if (!lz || (!atomic_load(&lz->unloaded[section]) && !atomic_load(&lz->bad[section])))
+        return 0;
+    size_t lo, hi;
+    lazy_range(lz, section, key, &lo, &hi);
+    return lazy_load(db, lo, hi);
+}
+
+/* Loads what is left of the sections in the CHK_MASK set. */
+static int lazy_settle(eavgDB *db, unsigned sections) {
+    struct eavgLazy *lz = db->lazy;
+    int              rc = 0;
+    if (db->image) return img_settle(db, sections);
+    for (int sec = 0; lz && sec < CHK_SECTIONS; sec++) {
+        if (!(sections & CHK_MASK(sec))) continue;
+        if (atomic_load(&lz->unloaded[sec]) && lazy_load(db, lz->first[sec], lz->end[sec]) < 0)
+            rc = -1;
+        if (atomic_load(&lz->bad[sec])) rc = -1;
+    }
+    return rc;
+}
+
+static bool lazy_pending(const eavgDB *db, int section) {
+    if (db->image) return img_pending(db->image, section);
+    return db->lazy && atomic_load(&db->lazy->unloaded[section]);
+}
+
+static bool lazy_bad(const eavgDB *db, int section) {
+    if (db->image) return img_bad(db->image, section);
+    return db->lazy && atomic_load(&db->lazy->bad[section]);
+}
+
+/* Whether chunk i was loaded by the time a snapshot pinned at epoch. */
+static bool chk_seen(struct eavgLazy *lz, size_t i, eavg_u64 epoch) {
+    return atomic_load_explicit(&lz->state[i], memory_order_acquire) == CHK_LOADED &&
+           lz->loadedAt[i] <= epoch;
+}
+
+/* Marks a key a snapshot decoded and found no records for. */
+static char snap_none;
+
+/* The records of one key, gathered while decoding chunks for a snapshot. */
+struct snap_run {
+    eavg_u64  key;
+    char     *recs;
+    size_t    count, cap;
+};
+
+/* Adds run's list to s->lazyLists unless its key has records outside the
+ * chunks [lo, hi) just decoded, or the list is there already. */
+static int snap_keep(eavgSnapshot *s, int section, size_t lo, size_t hi,
+                     const struct snap_run *run, size_t recSize)
+{
+    u64_map *lists = s->lazyLists[section - CHK_VALUES];
+    size_t   first, last;
+    lazy_range(s->db->lazy, section, run->key, &first, &last);
+    if (first < lo || last > hi || u64_map_get(lists, run->key)) return 0;
+
+    void *recs = arena_alloc(&s->lazyArena, run->count * recSize);
+    void *list = arena_alloc(&s->lazyArena, section == CHK_VALUES ? sizeof(eavgValueList)
+                                                                  : sizeof(eavgAdjList));
+    if (!recs || !list) return -1;
+    memcpy(recs, run->recs, run->count * recSize);
+    if (section == CHK_VALUES)
+        *(eavgValueList*)list = (eavgValueList){ run->key, recs, run->count, run->count, 0, false };
+    else
+        *(eavgAdjList*)list   = (eavgAdjList){ run->key, recs, run->count, run->count, 0, false };
+    return u64_map_put(lists, run->key, list);
+}
+
+/* Decodes chunks [lo, hi) of a list section into s->lazyLists: every key
+ * whose records all lie in them.  keys, when not NULL, receives the keys
+ * met, in order (malloc'd, *nkeys of them).  Under s->lazyLock; -1 on
+ * OOM. */
+static int snap_decode(eavgSnapshot *s, int section, size_t lo, size_t hi,
+                       eavg_u64 **keys, size_t *nkeys)
+{
+    static const struct load_format stream = { .version = EAVG_PERS_VERSION };
+    struct eavgLazy *lz      = s->db->lazy;
+    u64_map        **lists   = &s->lazyLists[section - CHK_VALUES];
+    size_t           recSize = section == CHK_VALUES ? sizeof(eavgValRec) : sizeof(eavgEdgeRec);
+    struct snap_run  run     = { 0 };
+    size_t           keyCap  = 0;
+    int              rc      = 0;
+    if (keys) {
+        *keys  = NULL;
+        *nkeys = 0;
+    }
+    if (!*lists && !(*lists = u64_map_create(64))) return -1;
+
+    for (size_t i = lo; i < hi && rc == 0; i++) {
+        const chk_entry *e = &lz->index[i];
+        load_cursor      c = { lz->map + e->offset, lz->map + e->offset + e->length };
+        struct load_list l = { 0 };
+        for (uint32_t k = 0; k < e->records && rc == 0; k++) {
+            union { eavgValRec v; eavgEdgeRec e; } rec;
+            eavg_u64 key;
+            if (section == CHK_VALUES) {
+                struct load_value v;
+                if (load_value_next(&c, &stream, &l, &v) < 0 ||
+                    load_value_set(&s->lazyArena, &rec.v, &v) < 0) rc = -1;
+                key = v.entityId;
+            } else {
+                const unsigned char *label;
+                uint32_t             labelLen;
+                if (load_edge_next(&c, &stream, &l, &rec.e, &label, &labelLen) < 0 ||
+                    edge_label(&s->lazyArena, &rec.e, label, labelLen) < 0) rc = -1;
+                key = section == CHK_OUT ? rec.e.sourceEntity : rec.e.targetEntity;
+            }
+            if (rc < 0) break;
+
+            if (!run.count || key != run.key) {
+                if (run.count && snap_keep(s, section, lo, hi, &run, recSize) < 0) {
+                    rc = -1;
+                    break;
+                }
+                if (keys && *nkeys == keyCap) {
+                    size_t    cap   = keyCap ? 2 * keyCap : 64;
+                    eavg_u64 *grown = realloc(*keys, cap * sizeof *grown);
+                    if (!grown) {
+                        rc = -1;
+                        break;
+                    }
+                    *keys  = grown;
+                    keyCap = cap;
+                }
+                if (keys) (*keys)[(*nkeys)++] = key;
+                run.key   = key;
+                run.count = 0;
+            }
+            if (run.count == run.cap) {
+                size_t cap  = run.cap ? 2 * run.cap : 16;
+                char  *recs = realloc(run.recs, cap * recSize);
+                if (!recs) {
+                    rc = -1;
+                    break;
+                }
+                run.recs = recs;
+                run.cap  = cap;
+            }
+            memcpy(run.recs + run.count++ * recSize, &rec, recSize);
+        }
+    }
+    if (rc == 0 && run.count) rc = snap_keep(s, section, lo, hi, &run, recSize);
+    free(run.recs);
+    return rc;
+}
+
+/* The list s sees for key in a list section.  A key the db had not wholly
+ * loaded when s was pinned has not been written since the file either,
+ * since a write loads its key first: s reads it from the file, decoded
+ * into a list of its own.  NULL when there is none or a chunk is bad.
+ * An image's lists are resolved in place, which changes nothing s sees. */
+static void *snap_list(eavgSnapshot *s, int section, eavg_u64 key) {
+    struct eavgLazy *lz = s->db->lazy;
+    u64_map         *m  = s->maps[chk_table[section]];
+    if (s->db->image) {
+        void *list = u64_map_get(m, key);
+        return img_resolve(s->db, section, list) < 0 ? NULL : list;
+    }
+    if (!lz || (s->whole & CHK_MASK(section))) return u64_map_get(m, key);
+    size_t lo, hi, i;
+    lazy_range(lz, section, key, &lo, &hi);
+    for (i = lo; i < hi && chk_seen(lz, i, s->epoch); i++) {}
+    if (i == hi) return u64_map_get(m, key);
+    if (lazy_load(s->db, lo, hi) < 0) return NULL;
+
+    pthread_mutex_lock(&s->lazyLock);
+    u64_map *lists = s->lazyLists[section - CHK_VALUES];
+    void    *list  = lists ? u64_map_get(lists, key) : NULL;
+    if (!list && snap_decode(s, section, lo, hi, NULL, NULL) == 0) {
+        lists = s->lazyLists[section - CHK_VALUES];
+        list  = u64_map_get(lists, key);
+        if (!list && u64_map_put(lists, key, &snap_none) == 0) list = &snap_none;
+    }
+    pthread_mutex_unlock(&s->lazyLock);
+    return list == &snap_none ? NULL : list;
+}
+
+/* Slots eavgSnapshot_forEachEdgeInRange walks past the table's: one per
+ * out-edge chunk, unless s saw them all loaded. */
+static size_t snap_chunk_slots(const eavgSnapshot *s) {
+    const struct eavgLazy *lz = s->db->lazy;
+    if (!lz || (s->whole & CHK_MASK(CHK_OUT))) return 0;
+    return lz->end[CHK_OUT] - lz->first[CHK_OUT];
+}
+
+static bool snap_sees_key(const eavgSnapshot *s, int section, eavg_u64 key) {
+    struct eavgLazy *lz = s->db->lazy;
+    size_t           lo, hi;
+    lazy_range(lz, section, key, &lo, &hi);
+    while (lo < hi && chk_seen(lz, lo, s->epoch)) lo++;
+    return lo == hi;
+}
+
+/* Walks the out-edges of the keys whose first chunk s did not see loaded
+ * is chunk j, which eavgSnapshot_forEachEdgeInRange gives a slot of its
+ * own past the table's. */
+static int snap_walk_chunk(eavgSnapshot *s, size_t j, eavgEdgeCallback cb, void *userData) {
+    struct eavgLazy *lz = s->db->lazy;
+    j += lz->first[CHK_OUT];
+    eavg_u64        *keys;
+    size_t           nkeys;
+    if (chk_seen(lz, j, s->epoch) || lazy_load(s->db, j, j + 1) < 0) return 0;
+    pthread_mutex_lock(&s->lazyLock);
+    int rc = snap_decode(s, CHK_OUT, j, j + 1, &keys, &nkeys);
+    pthread_mutex_unlock(&s->lazyLock);
+    for (size_t k = 0; rc == 0 && k < nkeys; k++) {
+        size_t lo, hi;
+        lazy_range(lz, CHK_OUT, keys[k], &lo, &hi);
+        while (lo < j && chk_seen(lz, lo, s->epoch)) lo++;
+        if (lo != j) continue;   /* walked from an earlier chunk */
+        const eavgAdjList *al = snap_list(s, CHK_OUT, keys[k]);
+        for (size_t e = 0; al && e < al->count && rc == 0; e++)
+            rc = cb(s->db, &al->edges[e], userData);
+    }
+    free(keys);
+    return rc;
+}
+
+/* Loads entities, attributes and relation types; the rest waits for
+ * lazy_fault or lazy_settle. */
+static eavgDB *chunked_open(const char *filename,
+                            void (*onBadChunk)(const eavgChunkError*, void*), void *userData)
+{
+    struct eavgLazy *lz = chk_open(filename);
+    eavgDB          *db = lz ? eavgDB_create(128) : NULL;
+    if (!db) {
+        lazy_free(lz);
+        return NULL;
+    }
+    size_t entities = 0;
+    for (size_t i = lz->first[CHK_ENTITIES]; i < lz->end[CHK_ENTITIES]; i++)
+        entities += lz->index[i].records;
+    u64_map_reserve(db->entitiesById, entities);
+    lz->onBadChunk     = onBadChunk;
+    lz->onBadChunkData = userData;
+    db->lazy = lz;
+    if (lazy_load(db, 0, lz->first[CHK_VALUES]) < 0) {
+        eavgDB_destroy(db);
+        return NULL;
+    }
+    db->nextEntityId       = lz->trailer.nextIds[0];
+    db->nextAttributeId    = lz->trailer.nextIds[1];
+    db->nextRelationTypeId = lz->trailer.nextIds[2];
+    db->nextValueId        = lz->trailer.nextIds[3];
+    db->nextEdgeId         = lz->trailer.nextIds[4];
+    return db;
+}
+
+static eavgDB *chunked_load(const char *filename) {
+    eavgDB *db = chunked_open(filename, NULL, NULL);
+    if (db && lazy_settle(db, CHK_ALL) < 0) {
+        eavgDB_destroy(db);
+        db = NULL;
+    }
+    return db;
+}
+
+eavgDB *eavgDB_openLazyEx(const char *filename,
+                          void (*onBadChunk)(const eavgChunkError *err, void *userData),
+                          void *userData)
+{
+    STATS_OP(EAVG_OP_LOAD);
+    eavgDB *db = chunked_open(filename, onBadChunk, userData);
+    if (db) base_set(db, filename);
+    if (db && wal_replay(db, filename) < 0) {
+        eavgDB_destroy(db);
+        db = NULL;
+    }
+    return db;
+}
+
+eavgDB *eavgDB_openLazy(const char *filename) {
+    return eavgDB_openLazyEx(filename, NULL, NULL);
+}
+
+size_t eavgDB_lazyBadChunks(eavgDB *db) {
+    size_t bad = 0;
+    for (int sec = 0; db->lazy && sec < CHK_SECTIONS; sec++) bad += atomic_load(&db->lazy->bad[sec]);
+    return bad;
+}
+
+size_t eavgDB_lazyUnloadedChunks(eavgDB *db) {
+    size_t left = 0;
+    for (int sec = 0; db->lazy && sec < CHK_SECTIONS; sec++)
+        left += atomic_load(&db->lazy->unloaded[sec]);
+    return left;
+}
+
+int eavgDB_lazyLoadValues(eavgDB *db) {
+    return lazy_settle(db, CHK_MASK(CHK_VALUES));
+}
+
+long eavgDB_verify(const char *filename, void (*cb)(const eavgChunkError*, void*),
+                   void *userData)
+{
+    struct eavgLazy *lz = chk_open(filename);
+    long             bad = 0;
+    if (!lz) return -1;
+    for (size_t i = 0; i < lz->count; i++) {
+        if (chk_intact(lz, i)) continue;
+        bad++;
+        if (cb) {
+            eavgChunkError err;
+            chk_error(lz, i, &err);
+            cb(&err, userData);
+        }
+    }
+    lazy_free(lz);
+    return bad;
+}
+
+/* Delta files.  After the header (magic, u32 version, the parent's name,
+ * size and modification time in ns, the five id counters) come all
+ * attributes and relation types, then one record per dirty entity (u32
+ * present, then the entity's record or just its id), then every dirty value
+ * list and out-edge list (u64 key, u64 count, records in the stream
+ * encoding), and last a CRC-32C of everything before it.  Applying a delta
+ * removes the entities and relation types it lacks and replaces the lists
+ * it holds. */
+#define EAVG_DELTA_VERSION    1
+#define EAVG_DELTA_MAX_CHAIN  1024
+
+struct delta_enc {
+    save_buf      buf;
+    eavgSnapshot *snap;
+};
+
+static int delta_entity(uint64_t id, void *ud) {
+    struct delta_enc *d = ud;
+    const eavgEntity *e = u64_map_get(d->snap->maps[SNAP_ENTITIES], id);
+    sb_u32(&d->buf, e != NULL);
+    sb_u64(&d->buf, id);
+    if (e) {
+        sb_u32(&d->buf, e->typeId);
+        sb_cstr(&d->buf, e->name);
+    }
+    return 0;
+}
+
+static int delta_value_list(uint64_t id, void *ud) {
+    struct delta_enc    *d  = ud;
+    const eavgValueList *vl = u64_map_get(d->snap->maps[SNAP_VALUES], id);
+    sb_u64(&d->buf, id);
+    sb_u64(&d->buf, vl ? vl->count : 0);
+    for (size_t k = 0; vl && k < vl->count; k++)
+        save_value(&d->buf, d->snap->maps[SNAP_ATTRIBUTES], id, &vl->values[k]);
+    return 0;
+}
+
+static int delta_edge_list(uint64_t id, void *ud) {
+    struct delta_enc  *d  = ud;
+    const eavgAdjList *al = u64_map_get(d->snap->maps[SNAP_OUT], id);
+    sb_u64(&d->buf, id);
+    sb_u64(&d->buf, al ? al->count : 0);
+    for (size_t k = 0; al && k < al->count; k++) save_edge(&d->buf, &al->edges[k]);
+    return 0;
+}
+
+static int delta_save(eavgSnapshot *s, id_bitmap **sets, const char *filename,
+                      const char *parent)
+{
+    struct stat st;
+    if (stat(parent, &st) != 0) return -1;
+    struct delta_enc d   = { .snap = s };
+    eavgDB          *db  = s->db;
+    save_buf        *b   = &d.buf;
+    uint64_t         ns  = (uint64_t)st.st_mtim.tv_sec * 1000000000u + (uint64_t)st.st_mtim.tv_nsec;
+    sb_put(b, EAVG_DELTA_MAGIC, 8);
+    sb_u32(b, EAVG_DELTA_VERSION);
+    sb_cstr(b, parent);
+    sb_u64(b, (uint64_t)st.st_size);
+    sb_u64(b, ns);
+    sb_u64(b, atomic_load(&db->nextEntityId));
+    sb_u64(b, atomic_load(&db->nextAttributeId));
+    sb_u64(b, atomic_load(&db->nextRelationTypeId));
+    sb_u64(b, atomic_load(&db->nextValueId));
+    sb_u64(b, atomic_load(&db->nextEdgeId));
+
+    u64_map *attrs = s->maps[SNAP_ATTRIBUTES], *rels = s->maps[SNAP_RELTYPES];
+    sb_u64(b, attrs->count);
+    for (size_t i = 0; i < attrs->capacity; i++) {
+        const eavgAttribute *a = attrs->values[i];
+        if (!a) continue;
+        sb_u64(b, a->id);
+        sb_u32(b, a->dataType);
+        sb_cstr(b, a->name);
+    }
+    sb_u64(b, rels->count);
+    for (size_t i = 0; i < rels->capacity; i++) {
+        const eavgRelationType *r = rels->values[i];
+        if (!r) continue;
+        sb_u64(b, r->id);
+        sb_cstr(b, r->name);
+    }
+    sb_u64(b, id_bitmap_cardinality(sets[DIRTY_ENTITIES]));
+    id_bitmap_foreach(sets[DIRTY_ENTITIES], delta_entity, &d);
+    sb_u64(b, id_bitmap_cardinality(sets[DIRTY_VALUES]));
+    id_bitmap_foreach(sets[DIRTY_VALUES], delta_value_list, &d);
+    sb_u64(b, id_bitmap_cardinality(sets[DIRTY_EDGES]));
+    id_bitmap_foreach(sets[DIRTY_EDGES], delta_edge_list, &d);
+    sb_u32(b, wal_crc32c(b->p, b->len));
+
+    size_t tmpLen = strlen(filename) + sizeof ".tmp";
+    char  *tmp    = malloc(tmpLen);
+    int    rc     = -1;
+    int    fd     = -1;
+    if (!b->oom && tmp) {
+        snprintf(tmp, tmpLen, "%s.tmp", filename);
+        fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (fd >= 0) {
+        rc = save_write_fd(fd, b->p, b->len) == 0 && fsync(fd) == 0 ? 0 : -1;
+        if (close(fd) != 0) rc = -1;
+        if (rc == 0) rc = rename(tmp, filename) == 0 ? wal_sync_dir(filename) : -1;
+        if (rc != 0) unlink(tmp);
+    }
+    free(tmp);
+    free(b->p);
+    return rc;
+}
+
+int eavgDB_saveIncremental(eavgDB *db, const char *filename, const char *parent) {
+    STATS_OP(EAVG_OP_SAVE);
+    id_bitmap    *sets[DIRTY_SETS];
+    bool          takes;
+    eavgSnapshot *snap = save_begin(db, sets, filename, parent, &takes);
+    if (!snap) return -1;
+    return save_end(snap, sets, filename, delta_save(snap, sets, filename, parent));
+}
+
+/* Adds the attributes and relation types the db lacks; relation types the
+ * delta does not list are gone, and their ids land in *gone. */
+static int delta_schema(eavgDB *db, load_cursor *c, const struct load_format *fmt,
+                        id_bitmap *gone)
+{
+    uint64_t n;
+    if (lc_count(c, 16, &n) < 0) return -1;
+    for (uint64_t i = 0; i < n; i++) {
+        eavgAttribute *a = arena_alloc(&db->attributeArena, sizeof *a);
+        if (!a || load_attribute(db, c, fmt, a) < 0) return -1;
+    }
+    id_bitmap *seen = id_bitmap_create();
+    if (!seen || lc_count(c, 12, &n) < 0) {
+        id_bitmap_destroy(seen);
+        return -1;
+    }
+    for (uint64_t i = 0; i < n; i++) {
+        eavgRelationType *rt = arena_alloc(&db->attributeArena, sizeof *rt);
+        if (!rt || load_reltype(db, c, fmt, rt) < 0) {
+            id_bitmap_destroy(seen);
+            return -1;
+        }
+        id_bitmap_add(seen, rt->id);
+    }
+    u64_map *rels = db->relationTypesById;
+    for (size_t i = 0; i < rels->capacity; i++) {
+        if (rels->values[i] && !id_bitmap_contains(seen, rels->keys[i]))
+            id_bitmap_add(gone, rels->keys[i]);
+    }
+    id_bitmap_destroy(seen);
+    return 0;
+}
+
+/* Adds the entities the delta holds and puts those it removed in *gone. */
+static int delta_entities(eavgDB *db, load_cursor *c, const struct load_format *fmt,
+                          id_bitmap *gone)
+{
+    uint64_t n;
+    if (lc_count(c, 12, &n) < 0) return -1;
+    for (uint64_t i = 0; i < n; i++) {
+        uint32_t present;
+        uint64_t id;
+        if (lc_u32(c, &present) < 0) return -1;
+        if (!present) {
+            if (lc_u64(c, &id) < 0) return -1;
+            id_bitmap_add(gone, id);
+            continue;
+        }
+        eavgEntity *e = arena_alloc(&db->entityArena, sizeof *e);
+        if (!e || load_entity(db, c, fmt, e) < 0) return -1;
+    }
+    return 0;
+}
+
+/* Replaces each list the delta holds, value by value. */
+static int delta_values(eavgDB *db, load_cursor *c, const struct load_format *fmt) {
+    uint64_t lists;
+    if (lc_count(c, 16, &lists) < 0) return -1;
+    for (uint64_t i = 0; i < lists; i++) {
+        uint64_t key, n;
+        if (lc_u64(c, &key) < 0 || lc_count(c, 28, &n) < 0) return -1;
+        eavgValueList *vl = u64_map_get(db->valuesByEntity, key);
+        if (vl && !(vl = valuelist_unshare(db, vl))) return -1;
+        for (size_t k = 0; vl && k < vl->count; k++) {
+            index_remove(db->entitiesByAttribute, vl->values[k].attributeId, key);
+            value_index_drop(db, vl->values[k].id);
+        }
+        if (vl) vl->count = 0;
+        if (!n) continue;
+        if (!(vl = valuelist_get_or_create(db, key)) || valuelist_reserve(db, vl, n) < 0)
+            return -1;
+        for (uint64_t k = 0; k < n; k++) {
+            struct load_value v;
+            eavgValRec       *rec = &vl->values[vl->count];
+            if (load_value_next(c, fmt, NULL, &v) < 0 || v.entityId != key ||
+                load_value_set(&db->valueArena, rec, &v) < 0 ||
+                value_index_put(db, vl, vl->count) < 0) return -1;
+            vl->count++;
+            index_add(db->entitiesByAttribute, v.attributeId, key);
+        }
+    }
+    return 0;
+}
+
+static void adjlist_drop_id(eavgAdjList *al, eavg_u64 id) {
+    size_t w = 0;
+    for (size_t j = 0; j < al->count; j++) {
+        if (al->edges[j].id != id) al->edges[w++] = al->edges[j];
+    }
+    al->count = w;
+}
+
+/* Replaces each out-edge list the delta holds, fixing the reverse lists
+ * of the old and new targets. */
+static int delta_edges(eavgDB *db, load_cursor *c, const struct load_format *fmt) {
+    u64_map *fwdIndex = db->adjIndexBySource, *revIndex = db->reverseAdjIndexByTarget;
+    uint64_t lists;
+    if (lc_count(c, 16, &lists) < 0) return -1;
+    for (uint64_t i = 0; i < lists; i++) {
+        uint64_t key, n;
+        if (lc_u64(c, &key) < 0 || lc_count(c, 56, &n) < 0) return -1;
+        eavgAdjList *fwd = u64_map_get(fwdIndex, key);
+        if (fwd && !(fwd = adjlist_unshare(db, fwdIndex, fwd))) return -1;
+        for (size_t k = 0; fwd && k < fwd->count; k++) {
+            eavgAdjList *rev = u64_map_get(revIndex, fwd->edges[k].targetEntity);
+            if (rev && !(rev = adjlist_unshare(db, revIndex, rev))) return -1;
+            if (rev) adjlist_drop_id(rev, fwd->edges[k].id);
         }
+        if (fwd) fwd->count = 0;
+        if (!n) continue;
+        if (!(fwd = adjlist_get_or_create(db, fwdIndex, key)) ||
+            adjlist_reserve(db, fwd, n) < 0) return -1;
+        for (uint64_t k = 0; k < n; k++) {
+            const unsigned char *label;
+            uint32_t             len;
+            eavgEdgeRec          e;
+            if (load_edge_next(c, fmt, NULL, &e, &label, &len) < 0 || e.sourceEntity != key ||
+                edge_label(&db->edgeArena, &e, label, len) < 0)
+                return -1;
+            eavgAdjList *rev = adjlist_get_or_create(db, revIndex, e.targetEntity);
+            if (!rev || adjlist_reserve(db, rev, rev->count + 1) < 0) return -1;
+            fwd->edges[fwd->count++] = e;
+            rev->edges[rev->count++] = e;
+        }
+    }
+    return 0;
+}
+
+static void delta_id_counter(_Atomic eavg_u64 *counter, uint64_t next) {
+    if (next > atomic_load(counter)) atomic_store(counter, next);
+}
+
+static int delta_remove_entity(uint64_t id, void *ud) {
+    eavgDB_removeEntity(ud, id);
+    return 0;
+}
+
+static int delta_remove_reltype(uint64_t id, void *ud) {
+    eavgDB_removeRelationType(ud, id);
+    return 0;
+}
+
+static _Thread_local unsigned delta_depth;
+
+/* c sits just past the magic.  Loads the parent, checks it is the file
+ * the delta was saved against, then applies the delta. */
+static eavgDB *delta_load(load_cursor *c, const eavgLoadOptions *opt) {
+    static const struct load_format v2 = { .version = EAVG_PERS_VERSION };
+    const unsigned char *start = c->p - 8, *name;
+    uint32_t             version, len, crc;
+    uint64_t             size, ns, next[5];
+    if ((size_t)(c->end - start) < 12) return NULL;
+    memcpy(&crc, c->end - 4, 4);
+    if (wal_crc32c(start, (size_t)(c->end - start) - 4) != crc) return NULL;
+    c->end -= 4;
+    if (lc_u32(c, &version) < 0 || version != EAVG_DELTA_VERSION ||
+        lc_bytes(c, &name, &len) < 0 || !len ||
+        lc_u64(c, &size) < 0 || lc_u64(c, &ns) < 0 ||
+        lc_take(c, next, sizeof next) < 0) return NULL;
+
+    char       *parent = strndup((const char*)name, len);
+    struct stat st;
+    eavgDB     *db = NULL;
+    if (parent && delta_depth < EAVG_DELTA_MAX_CHAIN && stat(parent, &st) == 0 &&
+        (uint64_t)st.st_size == size &&
+        (uint64_t)st.st_mtim.tv_sec * 1000000000u + (uint64_t)st.st_mtim.tv_nsec == ns) {
+        delta_depth++;
+        db = snapshot_load(parent, opt);
+        delta_depth--;
+    }
+    free(parent);
+    if (!db) return NULL;
+    /* the delta rewrites lists directly, so a mapped parent resolves them first */
+    if (lazy_settle(db, CHK_ALL) < 0) {
+        eavgDB_destroy(db);
+        return NULL;
+    }
+
+    /* removals go through the public calls, which fix every index */
+    id_bitmap *goneRels = id_bitmap_create(), *goneEntities = id_bitmap_create();
+    int        rc       = goneRels && goneEntities ? 0 : -1;
+    if (rc == 0) {
+        LOCK_WR(db);
+        rc = delta_schema(db, c, &v2, goneRels) < 0 ||
+             delta_entities(db, c, &v2, goneEntities) < 0 ? -1 : 0;
+        UNLOCK_WR(db);
+    }
+    if (rc == 0) {
+        id_bitmap_foreach(goneRels, delta_remove_reltype, db);
+        id_bitmap_foreach(goneEntities, delta_remove_entity, db);
+        LOCK_WR(db);
+        rc = delta_values(db, c, &v2) < 0 || delta_edges(db, c, &v2) < 0 ||
+             c->p != c->end ? -1 : 0;
+        delta_id_counter(&db->nextEntityId, next[0]);
+        delta_id_counter(&db->nextAttributeId, next[1]);
+        delta_id_counter(&db->nextRelationTypeId, next[2]);
+        delta_id_counter(&db->nextValueId, next[3]);
+        delta_id_counter(&db->nextEdgeId, next[4]);
+        /* what the delta applied is saved already */
+        for (int i = 0; i < DIRTY_SETS; i++) {
+            id_bitmap *fresh = id_bitmap_create();
+            if (!fresh) continue;
+            id_bitmap_destroy(db->dirty[i]);
+            db->dirty[i] = fresh;
+        }
+        UNLOCK_WR(db);
+    }
+    id_bitmap_destroy(goneRels);
+    id_bitmap_destroy(goneEntities);
+    if (rc < 0) {
+        eavgDB_destroy(db);
+        db = NULL;
+    }
+    return db;
+}
+
+int eavgDB_mergeChain(const char *deltaPath, const char *outPath, const eavgSaveOptions *opt) {
+    eavgDB *db = snapshot_load(deltaPath, NULL);
+    if (!db) return -1;
+    int rc = eavgDB_saveEx(db, outPath, opt);
+    eavgDB_destroy(db);
+    return rc;
+}
+
+eavgDB *eavgDB_loadEx(const char *filename, const eavgLoadOptions *opt) {
+    STATS_OP(EAVG_OP_LOAD);
+    eavgDB *db;
+    if (access(filename, F_OK) == 0) {
+        db = snapshot_load(filename, opt);
+    } else {
+        char *log = wal_path(filename, EAVG_WAL_SUFFIX);
+        db = log && access(log, F_OK) == 0 ? eavgDB_create(128) : NULL;
+        free(log);
     }
+    if (db && access(filename, F_OK) == 0) base_set(db, filename);
+    if (db && wal_replay(db, filename) < 0) {
+        eavgDB_destroy(db);
+        db = NULL;
+    }
+    return db;
+}
+
+eavgDB *eavgDB_load(const char *filename) {
+    return eavgDB_loadEx(filename, NULL);
+}
+
+int eavgDB_walOpen(eavgDB *db, const char *snapshotPath, const eavgWalOptions *opt) {
+    if (db->wal) return -1;
+    struct eavgWal *w = wal_open(snapshotPath, opt);
+    if (!w) return -1;
+    LOCK_WR(db);
+    db->wal = w;
     UNLOCK_WR(db);
-    return removed ? 0 : -1;
+    return 0;
 }
 
-const char *eavgValRec_getString(const eavgValRec *rec) {
-    return rec->data.stringValue;
+int eavgDB_walSync(eavgDB *db) {
+    return wal_sync(db->wal);
 }
 
-long eavgValRec_getInt(const eavgValRec *rec) {
-    return rec->data.intValue;
+/* The snapshot and the log mark are taken under one read lock, which no
+ * append can slip between, so the records after the mark are exactly
+ * what the snapshot lacks.  A crash between the rename and the truncation
+ * leaves records the snapshot already holds, which replay skips. */
+int eavgDB_checkpoint(eavgDB *db) {
+    STATS_OP(EAVG_OP_CHECKPOINT);
+    struct eavgWal *w = db->wal;
+    if (!w || lazy_settle(db, CHK_ALL) < 0) return -1;
+    id_bitmap    *sets[DIRTY_SETS];
+    eavgSnapshot *s = malloc(sizeof *s);
+    if (!s || dirty_alloc(sets) < 0) {
+        free(s);
+        return -1;
+    }
+    const char *path = wal_snapshot_path(w);
+    LOCK_RD(db);
+    snapshot_pin(db, s);
+    bool takes = dirty_swap(db, sets, path, NULL) > 0;
+    uint64_t mark = wal_mark(w);
+    UNLOCK_RD(db);
+
+    int rc = save_end(s, sets, takes ? path : NULL, save_snapshot(s, path, NULL));
+    return rc == 0 ? wal_truncate(w, mark) : rc;
 }
 
-eavg_u64 eavgValRec_getEntityRef(const eavgValRec *rec) {
-    return rec->data.entityRef;
+/* Mapped images.  An image holds the db's records, lists and hash tables
+ * in their in-memory layout, except that every pointer is stored as a
+ * file offset (0 for NULL).  Loading maps the file privately wherever
+ * mmap places it and resolves those offsets against the mapping: the
+ * tables, entities, attributes and relation types at once, and each
+ * value or edge list when an operation first faults it in (through
+ * lazy_fault, as for a lazily opened db).  Pages are read as they are
+ * touched and the first write to one copies it.  Every offset is checked
+ * before it is followed; a list that fails the checks is bad, and the
+ * operations needing it fail.  Edges hold an index into the image's label
+ * table, which loading maps to this db's names and symbols once per
+ * label.  Since records keep the struct layout, an image only loads into
+ * a build with the same layout; stream saves stay the portable format. */
+#define EAVG_IMAGE_VERSION  2
+#define EAVG_IMAGE_ALIGN    64
+
+#define IMG_PTR(off)  ((void*)(uintptr_t)(off))
+#define IMG_OFF(ptr)  ((uint64_t)(uintptr_t)(ptr))
+
+/* sections, in file order; the string pool goes last */
+enum {
+    IMG_ENTITIES, IMG_ATTRIBUTES, IMG_RELTYPES,
+    IMG_VALUE_LISTS, IMG_VALUES,
+    IMG_OUT_LISTS, IMG_OUT_EDGES, IMG_IN_LISTS, IMG_IN_EDGES,
+    IMG_LABELS,              /* pool offsets of the distinct edge labels */
+    IMG_SECTIONS
+};
+
+/* Tables map keys to record offsets; IMGT_VALUES maps a value id to the
+ * offset of its entity's list. */
+enum {
+    IMGT_ENTITIES, IMGT_ATTRIBUTES, IMGT_RELTYPES, IMGT_VALUE_LISTS,
+    IMGT_VALUES, IMGT_OUT, IMGT_IN,
+    IMGT_U64_TABLES,
+    IMGT_ENTITY_NAMES = IMGT_U64_TABLES, IMGT_ATTRIBUTE_NAMES, IMGT_RELTYPE_NAMES,
+    IMG_TABLES
+};
+
+typedef struct {
+    uint64_t offset;
+    uint64_t count;          /* records */
+} img_section;
+
+typedef struct {
+    uint64_t keys, values;   /* offsets of the two arrays */
+    uint64_t capacity, count;
+} img_table;
+
+typedef struct {
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    layout;      /* img_layout() of the writer */
+    uint64_t    size;        /* whole file */
+    uint64_t    strings, stringBytes;
+    uint64_t    nextIds[5];  /* entity, attribute, value, relation type, edge */
+    img_section sections[IMG_SECTIONS];
+    img_table   tables[IMG_TABLES];
+} img_header;
+
+static const size_t img_record_size[IMG_SECTIONS] = {
+    sizeof(eavgEntity), sizeof(eavgAttribute), sizeof(eavgRelationType),
+    sizeof(eavgValueList), sizeof(eavgValRec),
+    sizeof(eavgAdjList), sizeof(eavgEdgeRec), sizeof(eavgAdjList), sizeof(eavgEdgeRec),
+    sizeof(uint64_t),
+};
+
+/* the record section each u64 table points into */
+static const int img_table_section[IMGT_U64_TABLES] = {
+    IMG_ENTITIES, IMG_ATTRIBUTES, IMG_RELTYPES, IMG_VALUE_LISTS,
+    IMG_VALUE_LISTS, IMG_OUT_LISTS, IMG_IN_LISTS,
+};
+
+/* the list and record sections of CHK_VALUES, CHK_OUT and CHK_IN */
+static const int img_list_sections[3][2] = {
+    { IMG_VALUE_LISTS, IMG_VALUES },
+    { IMG_OUT_LISTS,   IMG_OUT_EDGES },
+    { IMG_IN_LISTS,    IMG_IN_EDGES },
+};
+
+/* A loaded image: the mapping, the heap arrays its tables were resolved
+ * into, the db's name and symbol for each label, and which lists are
+ * resolved yet (CHK_UNLOADED, CHK_LOADED or CHK_BAD, per list record of
+ * CHK_VALUES, CHK_OUT and CHK_IN). */
+struct eavgImage {
+    char                  *map;
+    img_header             hdr;
+    void                 **values[IMG_TABLES];
+    char                 **names[IMG_TABLES - IMGT_U64_TABLES];
+    u64_map               *valueLists;   /* IMGT_VALUES, read in place */
+    char                 **labels;
+    eavgSymbol            *labelSyms;
+    _Atomic unsigned char *state[3];
+    _Atomic size_t         unresolved[3];
+    _Atomic size_t         bad[3];
+};
+
+/* Fingerprint of everything an image depends on besides its contents. */
+static uint32_t img_layout(void) {
+    const uint16_t probe = 1;
+    uint32_t h = 2166136261u ^ *(const uint8_t*)&probe;
+    h = (h ^ (uint32_t)sizeof(void*)) * 16777619u;
+    h = (h ^ (uint32_t)offsetof(eavgValRec, data)) * 16777619u;
+    h = (h ^ (uint32_t)offsetof(eavgEdgeRec, label)) * 16777619u;
+    h = (h ^ (uint32_t)offsetof(eavgEdgeRec, labelSym)) * 16777619u;
+    for (int i = 0; i < IMG_SECTIONS; i++) h = (h ^ (uint32_t)img_record_size[i]) * 16777619u;
+    return h;
 }
 
-int eavgDB_updateEdgeLabel(eavgDB *db, eavg_u64 edgeId, const char *newLabel) {
-    int updated = 0;
-    LOCK_WR(db);
-    char *copy = newLabel
-        ? strdup_arena(&db->edgeArena, newLabel)
-        : NULL;
+static uint64_t img_align(uint64_t x) {
+    return (x + EAVG_IMAGE_ALIGN - 1) & ~(uint64_t)(EAVG_IMAGE_ALIGN - 1);
+}
 
-    for (size_t i = 0; i < db->adjIndexBySource->capacity; i++) {
-        eavgAdjList *al = (eavgAdjList*)db->adjIndexBySource->values[i];
-        if (!al) continue;
-        for (size_t j = 0; j < al->count; j++) {
-            if (al->edges[j].id == edgeId) {
-                al->edges[j].label = copy;
-                updated++;
-                break;
-            }
-        }
-    }
-    for (size_t i = 0; i < db->reverseAdjIndexByTarget->capacity; i++) {
-        eavgAdjList *al = (eavgAdjList*)db->reverseAdjIndexByTarget->values[i];
-        if (!al) continue;
-        for (size_t j = 0; j < al->count; j++) {
-            if (al->edges[j].id == edgeId) {
-                al->edges[j].label = copy;
-                updated++;
-                break;
-            }
-        }
+struct img_writer {
+    FILE       *f;
+    uint64_t    pos;
+    int         err;
+    const img_header *hdr;
+    char       *pool;
+    size_t      poolLen, poolCap;
+    str_map    *labels;      /* label -> index in IMG_LABELS + 1 */
+    const char **labelNames; /* by index */
+};
+
+static void img_put(struct img_writer *w, const void *p, size_t n) {
+    if (!w->err && n && fwrite(p, 1, n, w->f) != n) w->err = -1;
+    w->pos += n;
+}
+
+static void img_pad(struct img_writer *w, uint64_t to) {
+    static const char zero[EAVG_IMAGE_ALIGN];
+    while (w->pos < to) {
+        size_t n = to - w->pos < sizeof zero ? (size_t)(to - w->pos) : sizeof zero;
+        img_put(w, zero, n);
     }
-    UNLOCK_WR(db);
-    return updated ? 0 : -1;
 }
 
-int eavgDB_updateEdgeWeight(eavgDB *db, eavg_u64 edgeId, double newWeight) {
-    int updated = 0;
-    LOCK_WR(db);
-    for (size_t i = 0; i < db->adjIndexBySource->capacity; i++) {
-        eavgAdjList *al = (eavgAdjList*)db->adjIndexBySource->values[i];
-        if (!al) continue;
-        for (size_t j = 0; j < al->count; j++) {
-            if (al->edges[j].id == edgeId) {
-                al->edges[j].weight = newWeight;
-                updated++;
-                break;
-            }
+/* Appends a payload to the string pool; returns its file offset. */
+static uint64_t img_string(struct img_writer *w, const void *s, size_t len, bool terminate) {
+    size_t need = len + (terminate ? 1 : 0);
+    if (w->poolLen + need > w->poolCap) {
+        size_t cap = w->poolCap ? w->poolCap : 4096;
+        while (cap < w->poolLen + need) cap *= 2;
+        char *p = realloc(w->pool, cap);
+        if (!p) {
+            w->err = -1;
+            return 0;
         }
+        w->pool    = p;
+        w->poolCap = cap;
     }
-    for (size_t i = 0; i < db->reverseAdjIndexByTarget->capacity; i++) {
-        eavgAdjList *al = (eavgAdjList*)db->reverseAdjIndexByTarget->values[i];
-        if (!al) continue;
-        for (size_t j = 0; j < al->count; j++) {
-            if (al->edges[j].id == edgeId) {
-                al->edges[j].weight = newWeight;
-                updated++;
-                break;
-            }
+    size_t off = w->poolLen;
+    if (len) memcpy(w->pool + off, s, len);
+    if (terminate) w->pool[off + len] = '\0';
+    w->poolLen += need;
+    return w->hdr->strings + off;
+}
+
+static uint64_t img_name(struct img_writer *w, const char *s) {
+    return s ? img_string(w, s, strlen(s), true) : 0;
+}
+
+/* Numbers the distinct labels of index's edges from *count + 1 on. */
+static int img_count_labels(struct img_writer *w, u64_map *index, uint64_t *count) {
+    for (size_t i = 0; i < index->capacity; i++) {
+        eavgAdjList *al = index->values[i];
+        for (size_t j = 0; al && j < al->count; j++) {
+            const char *label = al->edges[j].label;
+            if (!label || str_map_get(w->labels, label)) continue;
+            if (str_map_put(w->labels, label, (void*)(uintptr_t)++*count) < 0) return -1;
         }
     }
-    UNLOCK_WR(db);
-    return updated ? 0 : -1;
+    return 0;
 }
 
-eavgEntity **eavgDB_findEntitiesByType(eavgDB *db,
-                                       eavg_u32 typeId,
-                                       size_t *outCount)
+static uint64_t img_record(const img_header *h, int section, uint64_t index) {
+    return h->sections[section].offset + index * img_record_size[section];
+}
+
+/* Tables built for the image map keys to record index + 1. */
+static void img_put_u64_table(struct img_writer *w, const u64_map *t, int section,
+                              const img_table *at)
 {
-    LOCK_RD(db);
-    size_t cap = db->entitiesById->capacity;
-    size_t cnt = 0;
+    img_pad(w, at->keys);
+    img_put(w, t->keys, t->capacity * sizeof *t->keys);
+    img_pad(w, at->values);
+    for (size_t i = 0; i < t->capacity; i++) {
+        uint64_t v = t->values[i] ? img_record(w->hdr, section, (uintptr_t)t->values[i] - 1) : 0;
+        img_put(w, &v, sizeof v);
+    }
+}
 
-    for (size_t i = 0; i < cap; i++) {
-        eavgEntity *e = (eavgEntity*)db->entitiesById->values[i];
-        if (e && e->typeId == typeId) cnt++;
+static void img_put_str_table(struct img_writer *w, const str_map *t, int section,
+                              const uint64_t *names, const img_table *at)
+{
+    img_pad(w, at->keys);
+    for (size_t i = 0; i < t->capacity; i++) {
+        uint64_t k = t->keys[i] ? names[(uintptr_t)t->values[i] - 1] : 0;
+        img_put(w, &k, sizeof k);
     }
+    img_pad(w, at->values);
+    for (size_t i = 0; i < t->capacity; i++) {
+        uint64_t v = t->values[i] ? img_record(w->hdr, section, (uintptr_t)t->values[i] - 1) : 0;
+        img_put(w, &v, sizeof v);
+    }
+}
 
-    eavgEntity **results = NULL;
-    if (cnt) {
-        results = malloc(cnt * sizeof *results);
-        size_t idx = 0;
-        for (size_t i = 0; i < cap; i++) {
-            eavgEntity *e = (eavgEntity*)db->entitiesById->values[i];
-            if (e && e->typeId == typeId) {
-                results[idx++] = e;
-            }
+static void img_put_lists(struct img_writer *w, u64_map *index, int listSection,
+                          int edgeSection)
+{
+    uint64_t first = 0;
+    img_pad(w, w->hdr->sections[listSection].offset);
+    for (size_t i = 0; i < index->capacity; i++) {
+        eavgAdjList *al = index->values[i];
+        if (!al) continue;
+        eavgAdjList r = { al->srcId,
+                          al->count ? IMG_PTR(img_record(w->hdr, edgeSection, first)) : NULL,
+                          al->count, al->count, 0, false };
+        img_put(w, &r, sizeof r);
+        first += al->count;
+    }
+    img_pad(w, w->hdr->sections[edgeSection].offset);
+    for (size_t i = 0; i < index->capacity; i++) {
+        eavgAdjList *al = index->values[i];
+        for (size_t j = 0; al && j < al->count; j++) {
+            /* labelSym holds the label's index + 1 (0: none) */
+            eavgEdgeRec r = al->edges[j];
+            r.labelSym = r.label ? (eavgSymbol)(uintptr_t)str_map_get(w->labels, r.label) : 0;
+            r.label    = NULL;
+            img_put(w, &r, sizeof r);
         }
     }
-    UNLOCK_RD(db);
-
-    *outCount = cnt;
-    return results;
 }
 
-eavgEdgeRec *eavgDB_getFilteredEdges(
-    eavgDB *db,
-    eavg_u64 entityId,
-    eavgEdgeDir dir,
-    eavgEdgeFilter filter,
-    void *userData,
-    size_t *outCount)
+static void img_count_lists(u64_map *index, u64_map *table, img_section *lists,
+                            img_section *edges)
 {
-    LOCK_RD(db);
-
-    eavgAdjList *fwd = NULL, *rev = NULL;
-    if (dir & EAVG_EDGE_DIR_OUT) {
-        fwd = u64_map_get(db->adjIndexBySource, entityId);
+    for (size_t i = 0; i < index->capacity; i++) {
+        eavgAdjList *al = index->values[i];
+        if (!al) continue;
+        u64_map_put(table, al->srcId, (void*)(uintptr_t)(++lists->count));
+        edges->count += al->count;
     }
-    if (dir & EAVG_EDGE_DIR_IN) {
-        rev = u64_map_get(db->reverseAdjIndexByTarget, entityId);
+}
+
+int eavgDB_saveImage(eavgDB *db, const char *filename) {
+    STATS_OP(EAVG_OP_SAVE);
+    id_bitmap *sets[DIRTY_SETS];
+    bool       takes;
+    if (lazy_settle(db, CHK_ALL) < 0) return -1;
+    FILE *f = fopen(filename, "wb");
+    if (!f) return -1;
+    eavgSnapshot *s = save_begin(db, sets, filename, NULL, &takes);
+    if (!s) {
+        fclose(f);
+        return -1;
     }
+    u64_map *entities   = s->maps[SNAP_ENTITIES];
+    u64_map *attrs      = s->maps[SNAP_ATTRIBUTES];
+    u64_map *relTypes   = s->maps[SNAP_RELTYPES];
+    u64_map *valueLists = s->maps[SNAP_VALUES];
 
-    eavgEdgeRec *results = NULL;
-    size_t       count   = 0;
+    img_header        h = { .version = EAVG_IMAGE_VERSION, .layout = img_layout() };
+    struct img_writer w = { .f = f, .hdr = &h, .labels = str_map_create(64) };
+    u64_map  *u64t[IMGT_U64_TABLES] = { 0 };
+    str_map  *strt[IMG_TABLES - IMGT_U64_TABLES] = { 0 };
+    uint64_t *names[3] = { 0 };
+    int       rc = -1;
 
-    #define TRY_APPEND(edge_ptr)                                       \
-        do {                                                           \
-            if (!filter || filter(edge_ptr, userData)) {              \
-                eavgEdgeRec *tmp =                                     \
-                  realloc(results, (count + 1) * sizeof *results);    \
-                if (!tmp) {                                            \
-                    free(results);                                     \
-                    UNLOCK_RD(db);                                     \
-                    *outCount = 0;                                     \
-                    return NULL;                                       \
-                }                                                      \
-                results = tmp;                                         \
-                results[count++] = *(edge_ptr);                       \
-            }                                                          \
-        } while (0)
+    memcpy(h.magic, EAVG_IMAGE_MAGIC, 8);
+    h.nextIds[0] = db->nextEntityId;
+    h.nextIds[1] = db->nextAttributeId;
+    h.nextIds[2] = db->nextValueId;
+    h.nextIds[3] = db->nextRelationTypeId;
+    h.nextIds[4] = db->nextEdgeId;
 
-    if (fwd) {
-        for (size_t i = 0; i < fwd->count; i++) {
-            TRY_APPEND(&fwd->edges[i]);
+    for (int t = 0; t < IMGT_U64_TABLES; t++) {
+        u64t[t] = u64_map_create(16);
+        if (!u64t[t]) goto out;
+    }
+    for (int t = 0; t < IMG_TABLES - IMGT_U64_TABLES; t++) {
+        strt[t] = str_map_create(16);
+        if (!strt[t]) goto out;
+    }
+    if (!w.labels) goto out;
+
+    /* pass 1: count records and build the image's tables */
+    u64_map *named[3] = { entities, attrs, relTypes };
+    for (int k = 0; k < 3; k++) {
+        img_section *sec = &h.sections[IMG_ENTITIES + k];
+        for (size_t i = 0; i < named[k]->capacity; i++) {
+            if (!named[k]->values[i]) continue;
+            /* entities, attributes and relation types all start { id, ...name } */
+            const char *name = k == 0 ? ((eavgEntity*)named[k]->values[i])->name
+                             : k == 1 ? ((eavgAttribute*)named[k]->values[i])->name
+                                      : ((eavgRelationType*)named[k]->values[i])->name;
+            sec->count++;
+            u64_map_put(u64t[IMGT_ENTITIES + k], named[k]->keys[i], (void*)(uintptr_t)sec->count);
+            if (name) str_map_put(strt[k], name, (void*)(uintptr_t)sec->count);
         }
+        names[k] = calloc(sec->count ? sec->count : 1, sizeof *names[k]);
+        if (!names[k]) goto out;
     }
-    if (rev) {
-        for (size_t i = 0; i < rev->count; i++) {
-            TRY_APPEND(&rev->edges[i]);
+    for (size_t i = 0; i < valueLists->capacity; i++) {
+        eavgValueList *vl = valueLists->values[i];
+        if (!vl) continue;
+        uintptr_t list = ++h.sections[IMG_VALUE_LISTS].count;
+        u64_map_put(u64t[IMGT_VALUE_LISTS], vl->entityId, (void*)list);
+        for (size_t j = 0; j < vl->count; j++)
+            u64_map_put(u64t[IMGT_VALUES], vl->values[j].id, (void*)list);
+        h.sections[IMG_VALUES].count += vl->count;
+    }
+    img_count_lists(s->maps[SNAP_OUT], u64t[IMGT_OUT],
+                    &h.sections[IMG_OUT_LISTS], &h.sections[IMG_OUT_EDGES]);
+    img_count_lists(s->maps[SNAP_IN], u64t[IMGT_IN],
+                    &h.sections[IMG_IN_LISTS], &h.sections[IMG_IN_EDGES]);
+    if (img_count_labels(&w, s->maps[SNAP_OUT], &h.sections[IMG_LABELS].count) < 0 ||
+        img_count_labels(&w, s->maps[SNAP_IN], &h.sections[IMG_LABELS].count) < 0 ||
+        !(w.labelNames = calloc(h.sections[IMG_LABELS].count + 1, sizeof *w.labelNames)))
+        goto out;
+    for (size_t i = 0; i < w.labels->capacity; i++)
+        if (w.labels->keys[i]) w.labelNames[(uintptr_t)w.labels->values[i] - 1] = w.labels->keys[i];
+
+    /* layout: sections, then tables, then the pool */
+    uint64_t pos = img_align(sizeof h);
+    for (int i = 0; i < IMG_SECTIONS; i++) {
+        h.sections[i].offset = pos;
+        pos = img_align(pos + h.sections[i].count * img_record_size[i]);
+    }
+    for (int t = 0; t < IMG_TABLES; t++) {
+        size_t cap = t < IMGT_U64_TABLES ? u64t[t]->capacity : strt[t - IMGT_U64_TABLES]->capacity;
+        h.tables[t].capacity = cap;
+        h.tables[t].count    = t < IMGT_U64_TABLES ? u64t[t]->count
+                                                   : strt[t - IMGT_U64_TABLES]->count;
+        h.tables[t].keys     = pos;
+        h.tables[t].values   = img_align(pos + cap * sizeof(uint64_t));
+        pos = img_align(h.tables[t].values + cap * sizeof(uint64_t));
+    }
+    h.strings = pos;
+
+    /* pass 2: records, in the order pass 1 numbered them */
+    img_pad(&w, h.sections[IMG_ENTITIES].offset);
+    for (size_t i = 0, k = 0; i < entities->capacity; i++) {
+        eavgEntity *e = entities->values[i];
+        if (!e) continue;
+        eavgEntity r = *e;
+        r.name = IMG_PTR(names[0][k++] = img_name(&w, e->name));
+        img_put(&w, &r, sizeof r);
+    }
+    img_pad(&w, h.sections[IMG_ATTRIBUTES].offset);
+    for (size_t i = 0, k = 0; i < attrs->capacity; i++) {
+        eavgAttribute *a = attrs->values[i];
+        if (!a) continue;
+        eavgAttribute r = *a;
+        r.name         = IMG_PTR(names[1][k++] = img_name(&w, a->name));
+        r.nameSym      = 0;
+        r.onValueAdded = NULL;
+        r.userData     = NULL;
+        img_put(&w, &r, sizeof r);
+    }
+    img_pad(&w, h.sections[IMG_RELTYPES].offset);
+    for (size_t i = 0, k = 0; i < relTypes->capacity; i++) {
+        eavgRelationType *rt = relTypes->values[i];
+        if (!rt) continue;
+        eavgRelationType r = *rt;
+        r.name    = IMG_PTR(names[2][k++] = img_name(&w, rt->name));
+        r.nameSym = 0;
+        img_put(&w, &r, sizeof r);
+    }
+
+    img_pad(&w, h.sections[IMG_VALUE_LISTS].offset);
+    uint64_t first = 0;
+    for (size_t i = 0; i < valueLists->capacity; i++) {
+        eavgValueList *vl = valueLists->values[i];
+        if (!vl) continue;
+        eavgValueList r = { vl->entityId,
+                            vl->count ? IMG_PTR(img_record(&h, IMG_VALUES, first)) : NULL,
+                            vl->count, vl->count, 0, false };
+        img_put(&w, &r, sizeof r);
+        first += vl->count;
+    }
+    img_pad(&w, h.sections[IMG_VALUES].offset);
+    for (size_t i = 0; i < valueLists->capacity; i++) {
+        eavgValueList *vl = valueLists->values[i];
+        for (size_t j = 0; vl && j < vl->count; j++) {
+            eavgValRec     r  = vl->values[j];
+            eavgAttribute *at = u64_map_get(attrs, r.attributeId);
+            bool str = at && at->dataType == EAVG_DATA_TYPE_STRING;
+            bool bin = at && at->dataType == EAVG_DATA_TYPE_BINARY;
+            if ((str || bin) && !(r.length & EAVG_VALUE_INLINE))
+                r.data.binaryValue = r.data.binaryValue
+                                   ? IMG_PTR(img_string(&w, r.data.binaryValue, r.length, str))
+                                   : NULL;
+            img_put(&w, &r, sizeof r);
         }
     }
+    img_put_lists(&w, s->maps[SNAP_OUT], IMG_OUT_LISTS, IMG_OUT_EDGES);
+    img_put_lists(&w, s->maps[SNAP_IN],  IMG_IN_LISTS,  IMG_IN_EDGES);
+    img_pad(&w, h.sections[IMG_LABELS].offset);
+    for (uint64_t i = 0; i < h.sections[IMG_LABELS].count; i++) {
+        uint64_t at = img_name(&w, w.labelNames[i]);
+        img_put(&w, &at, sizeof at);
+    }
 
-    #undef TRY_APPEND
+    for (int t = 0; t < IMGT_U64_TABLES; t++)
+        img_put_u64_table(&w, u64t[t], img_table_section[t], &h.tables[t]);
+    for (int k = 0; k < 3; k++)
+        img_put_str_table(&w, strt[k], IMG_ENTITIES + k, names[k], &h.tables[IMGT_U64_TABLES + k]);
 
-    UNLOCK_RD(db);
+    img_pad(&w, h.strings);
+    img_put(&w, w.pool, w.poolLen);
+    h.stringBytes = w.poolLen;
+    h.size        = w.pos;
+    if (!w.err && fseek(f, 0, SEEK_SET) == 0) {
+        img_put(&w, &h, sizeof h);
+        rc = w.err;
+    }
 
-    *outCount = count;
-    return results;
+ out:
+    if (fclose(f) != 0) rc = -1;
+    for (int t = 0; t < IMGT_U64_TABLES; t++) u64_map_destroy(u64t[t]);
+    for (int t = 0; t < IMG_TABLES - IMGT_U64_TABLES; t++) str_map_destroy(strt[t]);
+    for (int k = 0; k < 3; k++) free(names[k]);
+    str_map_destroy(w.labels);
+    free(w.labelNames);
+    free(w.pool);
+    return save_end(s, sets, takes ? filename : NULL, rc);
 }
 
-static int write_all(FILE *f, const void *buf, size_t sz) {
-    return fwrite(buf, 1, sz, f) == sz ? 0 : -1;
-}
-static int read_all(FILE *f, void *buf, size_t sz) {
-    return fread(buf, 1, sz, f) == sz ? 0 : -1;
+static bool img_span_ok(const img_header *h, uint64_t offset, uint64_t count, size_t size) {
+    return offset % 8 == 0 && offset >= sizeof *h && offset <= h->size &&
+           count <= (h->size - offset) / size;
 }
 
-static int write_u32(FILE *f, uint32_t v) {
-    uint32_t le = v;
-    return write_all(f, &le, sizeof le);
-}
-static int write_u64(FILE *f, uint64_t v) {
-    uint64_t le = v;
-    return write_all(f, &le, sizeof le);
+static bool img_header_ok(const img_header *h, uint64_t fileSize) {
+    if (memcmp(h->magic, EAVG_IMAGE_MAGIC, 8) != 0 || h->version != EAVG_IMAGE_VERSION ||
+        h->layout != img_layout() || h->size != fileSize ||
+        !img_span_ok(h, h->strings, h->stringBytes, 1)) return false;
+    for (int i = 0; i < IMG_SECTIONS; i++) {
+        if (!img_span_ok(h, h->sections[i].offset, h->sections[i].count, img_record_size[i]))
+            return false;
+    }
+    for (int t = 0; t < IMG_TABLES; t++) {
+        const img_table *tb = &h->tables[t];
+        if (!tb->capacity || (tb->capacity & (tb->capacity - 1)) || tb->count >= tb->capacity ||
+            !img_span_ok(h, tb->keys, tb->capacity, 8) ||
+            !img_span_ok(h, tb->values, tb->capacity, 8)) return false;
+    }
+    return true;
 }
-static int read_u32(FILE *f, uint32_t *out) {
-    return read_all(f, out, sizeof *out);
+
+/* The index of the record of section at offset off, or SIZE_MAX when off
+ * is not one. */
+static size_t img_index(const img_header *h, int section, uint64_t off) {
+    const img_section *s = &h->sections[section];
+    if (off < s->offset || (off - s->offset) % img_record_size[section]) return SIZE_MAX;
+    uint64_t i = (off - s->offset) / img_record_size[section];
+    return i < s->count ? (size_t)i : SIZE_MAX;
 }
-static int read_u64(FILE *f, uint64_t *out) {
-    return read_all(f, out, sizeof *out);
+
+/* Whether len bytes at off lie in the string pool, followed by a
+ * terminator when terminated. */
+static bool img_bytes_ok(const struct eavgImage *img, uint64_t off, uint64_t len,
+                         bool terminated)
+{
+    const img_header *h = &img->hdr;
+    if (off < h->strings || off - h->strings > h->stringBytes) return false;
+    uint64_t room = h->stringBytes - (off - h->strings);
+    if (len > room || (terminated && (len == room || img->map[off + len] != '\0'))) return false;
+    return true;
 }
 
-static int write_cstr(FILE *f, const char *s) {
-    uint32_t len = s ? (uint32_t)strlen(s) : 0;
-    if (write_u32(f, len)) return -1;
-    return len ? write_all(f, s, len) : 0;
+/* The pool string at off (NULL for 0) in *s; false when it runs past the
+ * pool. */
+static bool img_cstr(const struct eavgImage *img, uint64_t off, char **s) {
+    const img_header *h = &img->hdr;
+    *s = NULL;
+    if (!off) return true;
+    if (!img_bytes_ok(img, off, 0, false)) return false;
+    char *end = memchr(img->map + off, '\0', h->stringBytes - (off - h->strings));
+    if (!end) return false;
+    *s = img->map + off;
+    return true;
 }
-static char *read_cstr(FILE *f, Arena *arena) {
-    uint32_t len;
-    if (read_u32(f, &len)) return NULL;
-    if (len == 0) return NULL;
-    char *buf = arena_alloc(arena, len+1);
-    if (!buf) return NULL;
-    if (read_all(f, buf, len)) { return NULL; }
-    buf[len] = '\0';
-    return buf;
+
+/* Resolves table t's record offsets into a heap array, checking each is
+ * a record of its section whose key field (every record starts with it)
+ * matches the slot's, and that lists are not marked as heap copies. */
+static void **img_u64_values(const struct eavgImage *img, int t) {
+    const img_table *tb      = &img->hdr.tables[t];
+    int              section = img_table_section[t];
+    const uint64_t  *keys    = (const uint64_t*)(img->map + tb->keys);
+    const uint64_t  *offs    = (const uint64_t*)(img->map + tb->values);
+    void           **values  = calloc(tb->capacity, sizeof *values);
+    uint64_t         n       = 0;
+    if (!values) return NULL;
+    for (uint64_t i = 0; i < tb->capacity; i++) {
+        if (!keys[i]) continue;
+        char *rec = img->map + offs[i];
+        if (img_index(&img->hdr, section, offs[i]) == SIZE_MAX ||
+            *(const eavg_u64*)rec != keys[i]) goto bad;
+        if (section == IMG_VALUE_LISTS ? ((eavgValueList*)rec)->heap
+            : section == IMG_OUT_LISTS || section == IMG_IN_LISTS ? ((eavgAdjList*)rec)->heap
+            : false) goto bad;
+        values[i] = rec;
+        n++;
+    }
+    if (n == tb->count) return values;
+ bad:
+    free(values);
+    return NULL;
 }
 
-int eavgDB_save(eavgDB *db, const char *filename) {
-    FILE *f = fopen(filename, "wb");
-    if (!f) return -1;
-    
-    if (write_all(f, EAVG_PERS_MAGIC, 8) ||
-        write_u32(f, EAVG_PERS_VERSION)) {
-        fclose(f);
-        return -1;
+/* As img_u64_values for a name table, whose keys are the names' offsets:
+ * resolves them into *names, checking each is the name of its record. */
+static void **img_str_values(const struct eavgImage *img, int t, char ***names) {
+    static const size_t nameAt[3] = {
+        offsetof(eavgEntity, name), offsetof(eavgAttribute, name), offsetof(eavgRelationType, name),
+    };
+    const img_table *tb      = &img->hdr.tables[t];
+    int              k       = t - IMGT_U64_TABLES;
+    const uint64_t  *keys    = (const uint64_t*)(img->map + tb->keys);
+    const uint64_t  *offs    = (const uint64_t*)(img->map + tb->values);
+    void           **values  = calloc(tb->capacity, sizeof *values);
+    uint64_t         n       = 0;
+    *names = calloc(tb->capacity, sizeof **names);
+    if (!values || !*names) goto bad;
+    for (uint64_t i = 0; i < tb->capacity; i++) {
+        if (!keys[i]) continue;
+        char *rec = img->map + offs[i];
+        if (img_index(&img->hdr, IMG_ENTITIES + k, offs[i]) == SIZE_MAX ||
+            IMG_OFF(*(char**)(rec + nameAt[k])) != keys[i] ||
+            !img_cstr(img, keys[i], &(*names)[i])) goto bad;
+        values[i] = rec;
+        n++;
     }
+    if (n == tb->count) return values;
+ bad:
+    free(values);
+    free(*names);
+    *names = NULL;
+    return NULL;
+}
 
-    LOCK_RD(db);
-    
-    size_t ecount = 0;
-    for (size_t i = 0; i < db->entitiesById->capacity; i++) {
-        if (db->entitiesById->values[i]) ++ecount;
+/* Resolves the entity, attribute and relation type records in place:
+ * entity names point into the pool, attribute and relation type names
+ * are interned again, since symbols are per process. */
+static int img_schema(eavgDB *db, struct eavgImage *img) {
+    const img_header *h = &img->hdr;
+    eavgEntity *ents = (eavgEntity*)(img->map + h->sections[IMG_ENTITIES].offset);
+    for (uint64_t i = 0; i < h->sections[IMG_ENTITIES].count; i++) {
+        if (!img_cstr(img, IMG_OFF(ents[i].name), &ents[i].name)) return -1;
+        index_add(db->entitiesByType, EAVG_TYPE_KEY(ents[i].typeId), ents[i].id);
     }
-    if (write_u64(f, ecount)) goto fail;
-    for (size_t i = 0; i < db->entitiesById->capacity; i++) {
-        eavgEntity *e = (eavgEntity*)db->entitiesById->values[i];
-        if (!e) continue;
-        write_u64(f, e->id);
-        write_u32(f, e->typeId);
-        write_cstr(f, e->name);
+    eavgAttribute *attrs = (eavgAttribute*)(img->map + h->sections[IMG_ATTRIBUTES].offset);
+    for (uint64_t i = 0; i < h->sections[IMG_ATTRIBUTES].count; i++) {
+        char *s;
+        if (!img_cstr(img, IMG_OFF(attrs[i].name), &s) ||
+            name_intern(s, s ? strlen(s) : 0, &attrs[i].name, &attrs[i].nameSym) < 0)
+            return -1;
+        attrs[i].onValueAdded = NULL;
+        attrs[i].userData     = NULL;
     }
-
-    size_t acount = 0;
-    for (size_t i = 0; i < db->attributesById->capacity; i++) {
-        if (db->attributesById->values[i]) ++acount;
+    eavgRelationType *rts = (eavgRelationType*)(img->map + h->sections[IMG_RELTYPES].offset);
+    for (uint64_t i = 0; i < h->sections[IMG_RELTYPES].count; i++) {
+        char *s;
+        if (!img_cstr(img, IMG_OFF(rts[i].name), &s) ||
+            name_intern(s, s ? strlen(s) : 0, &rts[i].name, &rts[i].nameSym) < 0)
+            return -1;
     }
-    write_u64(f, acount);
-    for (size_t i = 0; i < db->attributesById->capacity; i++) {
-        eavgAttribute *a = (eavgAttribute*)db->attributesById->values[i];
-        if (!a) continue;
-        write_u64(f, a->id);
-        write_u32(f, a->dataType);
-        write_cstr(f, a->name);
+    return 0;
+}
+
+/* Builds the db's label table: each of the image's labels interned once,
+ * or pointing into the pool when the symbol pool does not take it. */
+static int img_labels(struct eavgImage *img) {
+    const img_section *sec = &img->hdr.sections[IMG_LABELS];
+    const uint64_t    *off = (const uint64_t*)(img->map + sec->offset);
+    img->labels    = calloc(sec->count ? sec->count : 1, sizeof *img->labels);
+    img->labelSyms = calloc(sec->count ? sec->count : 1, sizeof *img->labelSyms);
+    if (!img->labels || !img->labelSyms) return -1;
+    for (uint64_t i = 0; i < sec->count; i++) {
+        char *s;
+        if (!img_cstr(img, off[i], &s) || !s) return -1;
+        img->labelSyms[i] = label_sym(s, strlen(s));
+        img->labels[i]    = img->labelSyms[i] ? (char*)eavgSymbol_name(img->labelSyms[i]) : s;
     }
+    return 0;
+}
+
+/* The records of a list in the image: NULL when its offset and count do
+ * not name a run of records in section. */
+static void *img_records(const struct eavgImage *img, int section, const void *at, size_t count,
+                         size_t cap)
+{
+    size_t first = img_index(&img->hdr, section, IMG_OFF(at));
+    if (count != cap || first == SIZE_MAX || count > img->hdr.sections[section].count - first)
+        return NULL;
+    return img->map + IMG_OFF(at);
+}
 
-    size_t rcount = 0;
-    for (size_t i = 0; i < db->relationTypesById->capacity; i++) {
-        if (db->relationTypesById->values[i]) ++rcount;
+static int img_resolve_values(eavgDB *db, eavgValueList *vl) {
+    struct eavgImage *img  = db->image;
+    eavgValRec       *recs = NULL;
+    if (vl->count && !(recs = img_records(img, IMG_VALUES, vl->values, vl->count, vl->cap)))
+        return -1;
+    /* check everything before changing anything */
+    for (size_t j = 0; j < vl->count; j++) {
+        const eavgValRec    *r  = &recs[j];
+        const eavgAttribute *at = u64_map_get(db->attributesById, r->attributeId);
+        bool str = at && at->dataType == EAVG_DATA_TYPE_STRING;
+        bool bin = at && at->dataType == EAVG_DATA_TYPE_BINARY;
+        if ((str || bin) && !(r->length & EAVG_VALUE_INLINE) && r->data.binaryValue &&
+            !img_bytes_ok(img, IMG_OFF(r->data.binaryValue), r->length, str)) return -1;
     }
-    write_u64(f, rcount);
-    for (size_t i = 0; i < db->relationTypesById->capacity; i++) {
-        eavgRelationType *r = (eavgRelationType*)db->relationTypesById->values[i];
-        if (!r) continue;
-        write_u64(f, r->id);
-        write_cstr(f, r->name);
+    vl->values = recs;
+    for (size_t j = 0; j < vl->count; j++) {
+        eavgValRec          *r  = &recs[j];
+        const eavgAttribute *at = u64_map_get(db->attributesById, r->attributeId);
+        if (at && (at->dataType == EAVG_DATA_TYPE_STRING ||
+                   at->dataType == EAVG_DATA_TYPE_BINARY) &&
+            !(r->length & EAVG_VALUE_INLINE) && r->data.binaryValue)
+            r->data.binaryValue = (unsigned char*)img->map + IMG_OFF(r->data.binaryValue);
+        if (value_index_put(db, vl, j) < 0) return -1;
+        index_add(db->entitiesByAttribute, r->attributeId, vl->entityId);
     }
+    return 0;
+}
 
-    size_t vcount = 0;
-    for (size_t i = 0; i < db->valuesByEntity->capacity; i++) {
-        eavgValueList *vl = (eavgValueList*)db->valuesByEntity->values[i];
-        if (!vl) continue;
-        vcount += vl->count;
+/* Maps each edge's label index through the db's label table. */
+static int img_resolve_edges(struct eavgImage *img, eavgAdjList *al, int section) {
+    eavgEdgeRec *recs = NULL;
+    if (al->count && !(recs = img_records(img, section, al->edges, al->count, al->cap)))
+        return -1;
+    for (size_t j = 0; j < al->count; j++) {
+        if (recs[j].labelSym > img->hdr.sections[IMG_LABELS].count) return -1;
     }
-    write_u64(f, vcount);
-    for (size_t i = 0; i < db->valuesByEntity->capacity; i++) {
-        eavgValueList *vl = (eavgValueList*)db->valuesByEntity->values[i];
-        if (!vl) continue;
-        for (size_t j = 0; j < vl->count; j++) {
-            eavgValRec *r = &vl->values[j];
-            write_u64(f, r->id);
-            write_u64(f, vl->entityId);
-            write_u64(f, r->attributeId);
-            
-            eavgAttribute *at = u64_map_get(db->attributesById, r->attributeId);
-            write_u32(f, at->dataType);
-            switch (at->dataType) {
-            case EAVG_DATA_TYPE_INT:
-                write_all(f, &r->data.intValue, sizeof r->data.intValue);
-                break;
-            case EAVG_DATA_TYPE_DOUBLE:
-                write_all(f, &r->data.doubleValue, sizeof r->data.doubleValue);
-                break;
-            case EAVG_DATA_TYPE_STRING:
-                write_cstr(f, r->data.stringValue);
-                break;
-            case EAVG_DATA_TYPE_ENTITY:
-                write_u64(f, r->data.entityRef);
-                break;
-            default:
-                /* skip unsupported types */
-                break;
-            }
-        }
+    al->edges = recs;
+    for (size_t j = 0; j < al->count; j++) {
+        eavgSymbol label = recs[j].labelSym;
+        recs[j].label    = label ? img->labels[label - 1] : NULL;
+        recs[j].labelSym = label ? img->labelSyms[label - 1] : 0;
     }
+    return 0;
+}
+
+/* Resolves list record i of section k (0 values, 1 out, 2 in), unless it
+ * is already.  Under the write lock; returns the list's state. */
+static unsigned char img_resolve_locked(eavgDB *db, int k, size_t i) {
+    struct eavgImage *img = db->image;
+    unsigned char     st  = atomic_load_explicit(&img->state[k][i], memory_order_relaxed);
+    if (st != CHK_UNLOADED) return st;
+    char *list = img->map + img_record(&img->hdr, img_list_sections[k][0], i);
+    int   rc   = k == 0 ? img_resolve_values(db, (eavgValueList*)list)
+                        : img_resolve_edges(img, (eavgAdjList*)list, img_list_sections[k][1]);
+    st = rc == 0 ? CHK_LOADED : CHK_BAD;
+    if (st == CHK_BAD) atomic_fetch_add(&img->bad[k], 1);
+    atomic_store_explicit(&img->state[k][i], st, memory_order_release);
+    atomic_fetch_sub(&img->unresolved[k], 1);
+    return st;
+}
 
-    size_t edgeCount = 0;
-    for (size_t i = 0; i < db->adjIndexBySource->capacity; i++) {
-        eavgAdjList *al = (eavgAdjList*)db->adjIndexBySource->values[i];
-        if (al) edgeCount += al->count;
+/* Resolves list, a list of section (CHK_VALUES, CHK_OUT or CHK_IN), if it
+ * is one of the image's and not resolved yet; the copies writers make
+ * are left alone.  -1 when the list is bad. */
+static int img_resolve(eavgDB *db, int section, void *list) {
+    struct eavgImage *img = db->image;
+    int               k   = section - CHK_VALUES;
+    int               ls  = img_list_sections[k][0];
+    uint64_t          off = (uintptr_t)list - (uintptr_t)img->map;
+    size_t            i;
+    if (!list || (uintptr_t)list < (uintptr_t)img->map ||
+        (i = img_index(&img->hdr, ls, off)) == SIZE_MAX) return 0;
+    unsigned char st = atomic_load_explicit(&img->state[k][i], memory_order_acquire);
+    if (st == CHK_UNLOADED) {
+        br_lock_wr(&db->lock);
+        st = img_resolve_locked(db, k, i);
+        br_unlock_wr(&db->lock);
     }
-    write_u64(f, edgeCount);
-    for (size_t i = 0; i < db->adjIndexBySource->capacity; i++) {
-        eavgAdjList *al = (eavgAdjList*)db->adjIndexBySource->values[i];
-        if (!al) continue;
-        for (size_t j = 0; j < al->count; j++) {
-            eavgEdgeRec *e = &al->edges[j];
-            write_u64(f, e->id);
-            write_u64(f, al->srcId);
-            write_u64(f, e->targetEntity);
-            write_u64(f, e->relationTypeId);
-            write_all(f, &e->weight, sizeof e->weight);
-            write_u32(f, (uint32_t)e->direction);
-            write_u64(f, e->timestamp);
-            write_cstr(f, e->label);
+    return st == CHK_BAD ? -1 : 0;
+}
+
+static int img_fault(eavgDB *db, int section, eavg_u64 key) {
+    if (section < CHK_VALUES || (!img_pending(db->image, section) && !img_bad(db->image, section)))
+        return 0;
+    LOCK_RD(db);
+    void *list = u64_map_get(*snap_field(db, chk_table[section]), key);
+    UNLOCK_RD(db);
+    return img_resolve(db, section, list);
+}
+
+/* Faults in the list holding value id, when the image has it. */
+static int img_find_value(eavgDB *db, eavg_u64 id) {
+    struct eavgImage *img = db->image;
+    uint64_t          off = IMG_OFF(u64_map_get(img->valueLists, id));
+    if (!off) return 0;
+    if (img_index(&img->hdr, IMG_VALUE_LISTS, off) == SIZE_MAX) return -1;
+    return img_resolve(db, CHK_VALUES, img->map + off);
+}
+
+static int img_settle(eavgDB *db, unsigned sections) {
+    struct eavgImage *img = db->image;
+    int               rc  = 0;
+    for (int sec = CHK_VALUES; sec < CHK_SECTIONS; sec++) {
+        int k = sec - CHK_VALUES;
+        if (!(sections & CHK_MASK(sec))) continue;
+        if (atomic_load(&img->unresolved[k])) {
+            br_lock_wr(&db->lock);
+            for (uint64_t i = 0; i < img->hdr.sections[img_list_sections[k][0]].count; i++)
+                img_resolve_locked(db, k, (size_t)i);
+            br_unlock_wr(&db->lock);
         }
+        if (atomic_load(&img->bad[k])) rc = -1;
     }
+    return rc;
+}
 
-    UNLOCK_RD(db);
-    fclose(f);
-    return 0;
+static bool img_pending(const struct eavgImage *img, int section) {
+    return section >= CHK_VALUES && atomic_load(&img->unresolved[section - CHK_VALUES]);
+}
 
- fail:
-    UNLOCK_RD(db);
-    fclose(f);
-    return -1;
+static bool img_bad(const struct eavgImage *img, int section) {
+    return section >= CHK_VALUES && atomic_load(&img->bad[section - CHK_VALUES]);
 }
 
-eavgDB *eavgDB_load(const char *filename) {
-    FILE *f = fopen(filename, "rb");
-    if (!f) return NULL;
+static void img_free(struct eavgImage *img) {
+    if (!img) return;
+    if (img->map) munmap(img->map, img->hdr.size);
+    for (int t = 0; t < IMG_TABLES; t++) free(img->values[t]);
+    for (int t = 0; t < IMG_TABLES - IMGT_U64_TABLES; t++) free(img->names[t]);
+    u64_map_destroy(img->valueLists);
+    free(img->labels);
+    free(img->labelSyms);
+    for (int k = 0; k < 3; k++) free((void*)img->state[k]);
+    free(img);
+}
 
-    char magic[8];
-    if (read_all(f, magic, 8) != 0 ||
-        memcmp(magic, EAVG_PERS_MAGIC, 8) != 0) {
-        fclose(f);
+/* Maps filename and resolves its tables and schema records; the lists
+ * wait for img_fault or img_settle. */
+static eavgDB *image_load(const char *filename) {
+    struct eavgImage *img = calloc(1, sizeof *img);
+    struct stat       st;
+    int               fd  = open(filename, O_RDONLY);
+    if (!img || fd < 0 || fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof img->hdr ||
+        pread(fd, &img->hdr, sizeof img->hdr, 0) != (ssize_t)sizeof img->hdr ||
+        !img_header_ok(&img->hdr, (uint64_t)st.st_size)) {
+        if (fd >= 0) close(fd);
+        free(img);
         return NULL;
     }
-    uint32_t version;
-    if (read_u32(f, &version) != 0 || version != EAVG_PERS_VERSION) {
-        fclose(f);
+    img->map = mmap(NULL, img->hdr.size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (img->map == MAP_FAILED) {
+        free(img);
         return NULL;
     }
 
-    eavgDB *db = eavgDB_create(128);
-    if (!db) {
-        fclose(f);
-        return NULL;
+    const img_header *h = &img->hdr;
+    for (int t = 0; t < IMGT_U64_TABLES; t++) {
+        if (t != IMGT_VALUES && !(img->values[t] = img_u64_values(img, t))) goto fail;
+    }
+    for (int t = IMGT_U64_TABLES; t < IMG_TABLES; t++) {
+        if (!(img->values[t] = img_str_values(img, t, &img->names[t - IMGT_U64_TABLES])))
+            goto fail;
+    }
+    /* value ids -> list offsets, checked as they are looked up */
+    img->valueLists = u64_map_adopt((uint64_t*)(img->map + h->tables[IMGT_VALUES].keys),
+                                    (void**)(img->map + h->tables[IMGT_VALUES].values),
+                                    h->tables[IMGT_VALUES].capacity, h->tables[IMGT_VALUES].count);
+    if (!img->valueLists || img_labels(img) < 0) goto fail;
+    for (int k = 0; k < 3; k++) {
+        uint64_t n = h->sections[img_list_sections[k][0]].count;
+        img->state[k] = calloc(n ? n : 1, sizeof *img->state[k]);
+        if (!img->state[k]) goto fail;
+        atomic_init(&img->unresolved[k], n);
+        atomic_init(&img->bad[k], 0);
     }
 
-    LOCK_WR(db);
-
-    uint64_t ecount;
-    if (read_u64(f, &ecount) != 0) goto fail;
-    for (uint64_t i = 0; i < ecount; i++) {
-        uint64_t id;
-        uint32_t typeId;
-        char *name;
-        if (read_u64(f, &id) != 0 ||
-            read_u32(f, &typeId) != 0) goto fail;
-        name = read_cstr(f, &db->entityArena);
-        eavgEntity *e = EAVG_ENTITY_ALLOC(db);
-        e->id     = id;
-        e->typeId = typeId;
-        e->name   = name;
-        u64_map_put(db->entitiesById, id, e);
-        if (name) str_map_put(db->entitiesByName, name, e);
-        if (id >= db->nextEntityId) db->nextEntityId = id + 1;
+    eavgDB *db = eavgDB_create(16);
+    if (!db) goto fail;
+    if (img_schema(db, img) < 0) {
+        eavgDB_destroy(db);
+        goto fail;
     }
+    db->image = img;
 
-    uint64_t acount;
-    if (read_u64(f, &acount) != 0) goto fail;
-    for (uint64_t i = 0; i < acount; i++) {
-        uint64_t id;
-        uint32_t dataType;
-        char *name;
-        if (read_u64(f, &id) != 0 ||
-            read_u32(f, &dataType) != 0) goto fail;
-        name = read_cstr(f, &db->attributeArena);
-        eavgAttribute *a = EAVG_ATTR_ALLOC(db);
-        a->id            = id;
-        a->dataType      = dataType;
-        a->name          = name;
-        a->onValueAdded  = NULL;
-        a->userData      = NULL;
-        u64_map_put(db->attributesById, id, a);
-        if (name) str_map_put(db->attributesByName, name, a);
-        if (id >= db->nextAttributeId) db->nextAttributeId = id + 1;
-    }
-
-    uint64_t rcount;
-    if (read_u64(f, &rcount) != 0) goto fail;
-    for (uint64_t i = 0; i < rcount; i++) {
-        uint64_t id;
-        char *name;
-        if (read_u64(f, &id) != 0) goto fail;
-        name = read_cstr(f, &db->attributeArena);
-        eavgRelationType *rt = EAVG_RELTYPE_ALLOC(db);
-        rt->id   = id;
-        rt->name = name;
-        u64_map_put(db->relationTypesById, id, rt);
-        if (name) str_map_put(db->relationTypesByName, name, rt);
-        if (id >= db->nextRelationTypeId) db->nextRelationTypeId = id + 1;
-    }
-
-    uint64_t vcount;
-    if (read_u64(f, &vcount) != 0) goto fail;
-    for (uint64_t i = 0; i < vcount; i++) {
-        uint64_t recId, entityId, attributeId;
-        uint32_t dtype;
-        if (read_u64(f, &recId)     != 0 ||
-            read_u64(f, &entityId)  != 0 ||
-            read_u64(f, &attributeId) != 0 ||
-            read_u32(f, &dtype)     != 0) goto fail;
-            
-        eavgValueList *vl = u64_map_get(db->valuesByEntity, entityId);
-        if (!vl) {
-            vl = arena_alloc(&db->valueArena, sizeof *vl);
-            vl->entityId = entityId;
-            vl->values   = NULL;
-            vl->count    = vl->cap = 0;
-            u64_map_put(db->valuesByEntity, entityId, vl);
-        }
-        if (vl->count == vl->cap) {
-            size_t newCap = vl->cap ? vl->cap * 2 : 4;
-            vl->values    = arena_alloc(&db->valueArena,
-                                        newCap * sizeof *vl->values);
-            vl->cap       = newCap;
-        }
-        eavgValRec *r = &vl->values[vl->count++];
-        r->id          = recId;
-        r->attributeId = attributeId;
-        
-        switch (dtype) {
-          case EAVG_DATA_TYPE_INT:
-            read_all(f, &r->data.intValue, sizeof r->data.intValue);
-            break;
-          case EAVG_DATA_TYPE_DOUBLE:
-            read_all(f, &r->data.doubleValue, sizeof r->data.doubleValue);
-            break;
-          case EAVG_DATA_TYPE_STRING:
-            r->data.stringValue = read_cstr(f, &db->valueArena);
-            break;
-          case EAVG_DATA_TYPE_ENTITY:
-            read_u64(f, &r->data.entityRef);
-            break;
-          default:
-            /* skip unknown */
-            break;
-        }
-        if (recId >= db->nextValueId) db->nextValueId = recId + 1;
-    }
-
-    uint64_t edgeCount;
-    if (read_u64(f, &edgeCount) != 0) goto fail;
-    for (uint64_t i = 0; i < edgeCount; i++) {
-        uint64_t edgeId, srcId, tgtId, relTypeId, ts;
-        double   weight;
-        uint32_t dir;
-        char    *label;
-        if (read_u64(f, &edgeId)     != 0 ||
-            read_u64(f, &srcId)      != 0 ||
-            read_u64(f, &tgtId)      != 0 ||
-            read_u64(f, &relTypeId)  != 0 ||
-            read_all(f, &weight, sizeof weight) != 0 ||
-            read_u32(f, &dir)        != 0 ||
-            read_u64(f, &ts)         != 0) goto fail;
-        label = read_cstr(f, &db->edgeArena);
-
-        eavgAdjList *fwd = u64_map_get(db->adjIndexBySource, srcId);
-        if (!fwd) {
-            fwd       = EAVG_ADJLIST_ALLOC(db);
-            fwd->srcId = srcId;
-            fwd->edges = NULL;
-            fwd->count = fwd->cap = 0;
-            u64_map_put(db->adjIndexBySource, srcId, fwd);
-        }
-        if (fwd->count == fwd->cap) {
-            size_t nc = fwd->cap ? fwd->cap*2 : 4;
-            fwd->edges = arena_alloc(&db->edgeArena, nc * sizeof *fwd->edges);
-            fwd->cap   = nc;
-        }
-        eavgEdgeRec *e = &fwd->edges[fwd->count++];
-        e->id             = edgeId;
-        e->relationTypeId = relTypeId;
-        e->targetEntity   = tgtId;
-        e->weight         = weight;
-        e->direction      = (eavgEdgeDir)dir;
-        e->timestamp      = ts;
-        e->label          = label;
-
-        eavgAdjList *rev = u64_map_get(db->reverseAdjIndexByTarget, tgtId);
-        if (!rev) {
-            rev       = EAVG_ADJLIST_ALLOC(db);
-            rev->srcId = tgtId;
-            rev->edges = NULL;
-            rev->count = rev->cap = 0;
-            u64_map_put(db->reverseAdjIndexByTarget, tgtId, rev);
-        }
-        if (rev->count == rev->cap) {
-            size_t nc = rev->cap ? rev->cap*2 : 4;
-            rev->edges = arena_alloc(&db->edgeArena, nc * sizeof *rev->edges);
-            rev->cap   = nc;
-        }
-        rev->edges[rev->count++] = *e;
-
-        if (edgeId >= db->nextEdgeId) db->nextEdgeId = edgeId + 1;
+    u64_map **u64[IMGT_U64_TABLES] = {
+        &db->entitiesById, &db->attributesById, &db->relationTypesById,
+        &db->valuesByEntity, NULL, &db->adjIndexBySource, &db->reverseAdjIndexByTarget,
+    };
+    str_map **str[IMG_TABLES - IMGT_U64_TABLES] = {
+        &db->entitiesByName, &db->attributesByName, &db->relationTypesByName,
+    };
+    for (int t = 0; t < IMGT_U64_TABLES; t++) {
+        if (!u64[t]) continue;
+        u64_map *m = u64_map_adopt((uint64_t*)(img->map + h->tables[t].keys), img->values[t],
+                                   h->tables[t].capacity, h->tables[t].count);
+        if (!m) goto fail_db;
+        u64_map_destroy(*u64[t]);
+        *u64[t] = m;
+    }
+    for (int t = 0; t < IMG_TABLES - IMGT_U64_TABLES; t++) {
+        const img_table *tb = &h->tables[IMGT_U64_TABLES + t];
+        str_map *m = str_map_adopt(img->names[t], img->values[IMGT_U64_TABLES + t],
+                                   tb->capacity, tb->count);
+        if (!m) goto fail_db;
+        str_map_destroy(*str[t]);
+        *str[t] = m;
     }
 
-    UNLOCK_WR(db);
-    fclose(f);
+    db->nextEntityId       = h->nextIds[0];
+    db->nextAttributeId    = h->nextIds[1];
+    db->nextValueId        = h->nextIds[2];
+    db->nextRelationTypeId = h->nextIds[3];
+    db->nextEdgeId         = h->nextIds[4];
     return db;
 
-fail:
-    UNLOCK_WR(db);
-    fclose(f);
+ fail_db:
     eavgDB_destroy(db);
     return NULL;
+ fail:
+    img_free(img);
+    return NULL;
 }
@@ -6,9 +6,12 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <pthread.h>
+#include <string.h>
 
 #include "hashmap.h"
 #include "arena.h"
+#include "bitmap.h"
+#include "brlock.h"
 
 #define Borrows        	/* pointer is borrowed, not owned */
 #define Owns           	/* pointer is owned by caller */
@@ -24,6 +27,10 @@
 typedef uint64_t  eavg_u64;
 typedef uint32_t   eavg_u32;
 
+/** A dense id for a string in the process-wide pool (eavgSymbol_*); 0 is
+ *  no string. */
+typedef eavg_u32   eavgSymbol;
+
 #define EAVG_DATA_TYPE_INT      1
 #define EAVG_DATA_TYPE_DOUBLE   2
 #define EAVG_DATA_TYPE_STRING   3
@@ -40,6 +47,12 @@ typedef uint32_t   eavg_u32;
 struct eavgDB;
 struct eavgValRec;
 struct eavgAttribute;
+struct eavgValueLoc;
+struct eavgFeed;
+struct eavgSnapshot;
+struct eavgRetiredMap;
+struct eavgLazy;
+struct eavgImage;
 
 /** A node in the graph.  
  *  typeId is a user-defined tag for classification.  
@@ -52,29 +65,50 @@ typedef struct {
 
 typedef struct eavgAttribute {
     eavg_u64    id;
-    char       *name;       /**< Borrows from attributeArena */
+    char       *name;       /**< Borrows from the symbol pool */
     eavg_u32    dataType;
+    eavgSymbol  nameSym;
+    /** Runs on the writer's thread after the write lock is released;
+     *  prefer eavgDB_subscribe for anything slow. */
     void    (*onValueAdded)(struct eavgAttribute*, struct eavgValRec*, void*);
     void       *userData;
 } eavgAttribute;
 
+/** Strings (with their terminator) and blobs up to this size live inside
+ *  the record instead of valueArena. */
+#define EAVG_VALUE_INLINE_MAX   16
+#define EAVG_VALUE_INLINE       0x80000000u   /**< length flag: payload is inline */
+#define EAVG_VALUE_LENGTH_MAX   0x7fffffffu
+
 typedef union {
     long           intValue;
     double         doubleValue;
     char          *stringValue;
     unsigned char *binaryValue;
     eavg_u64       entityRef;
+    unsigned char  inlineBytes[EAVG_VALUE_INLINE_MAX];
 } eavgValueData;
 
+/** 32 bytes.  For STRING and BINARY values, length holds the byte count
+ *  (without the string terminator) ORed with EAVG_VALUE_INLINE when the
+ *  payload sits in data.inlineBytes.  Read payloads through the
+ *  eavgValRec_get* accessors. */
+
 typedef struct eavgValRec {
     eavg_u64        id;
-    eavg_u64        attributeId;
+    eavg_u32        attributeId;
+    eavg_u32        length;
     eavgValueData   data;
 } eavgValRec;
 
+/* Attribute ids fit eavgValRec.attributeId: eavgDB_addAttribute fails and
+ * loads reject files past this. */
+#define EAVG_ATTRIBUTE_ID_MAX  UINT32_MAX
+
 typedef struct {
-    eavg_u64   id;
-    char      *name;      /**< Borrows from attributeArena */
+    eavg_u64    id;
+    char       *name;      /**< Borrows from the symbol pool */
+    eavgSymbol  nameSym;
 } eavgRelationType;
 
 /** Edge direction mask for filtering:  
@@ -90,23 +124,42 @@ typedef enum {
 typedef struct eavgEdgeRec {
     eavg_u64      id;
     eavg_u64      relationTypeId;
+    eavg_u64      sourceEntity;
     eavg_u64      targetEntity;
     double        weight;
     eavgEdgeDir   direction;
-    char         *label;
+    eavgSymbol    labelSym;   /**< 0 for a label the symbol pool did not take */
+    char         *label;      /**< the symbol's name or the db's copy; do not modify */
     uint64_t      timestamp;
 } eavgEdgeRec;
 
+/* Whether e is labelled label (NULL: unlabelled), where sym is
+ * eavgSymbol_find(label), looked up once for many edges. */
+static inline bool eavgEdgeRec_hasLabel(const eavgEdgeRec *e, const char *label, eavgSymbol sym) {
+    if (e->labelSym) return e->labelSym == sym;
+    if (!e->label || !label) return e->label == label;
+    return strcmp(e->label, label) == 0;
+}
+
+/** Lists are copy-on-write while a snapshot can see them: a writer
+ *  replaces the list instead of changing it, so version is the db epoch
+ *  the list was created or last copied at.  Copies are malloc'd (heap),
+ *  and freed once they are replaced or dropped and no snapshot can reach
+ *  them any more. */
 typedef struct {
     eavg_u64      srcId;
     eavgEdgeRec  *edges;
     size_t        count, cap;
+    eavg_u64      version;
+    bool          heap;
 } eavgAdjList;
 
 typedef struct {
     eavg_u64     entityId;
     eavgValRec  *values;
     size_t       count, cap;
+    eavg_u64     version;
+    bool         heap;
 } eavgValueList;
 
 typedef int (*eavgEntityCallback)(struct eavgDB*, eavgEntity*, void*);
@@ -120,31 +173,345 @@ typedef struct eavgDB {
     u64_map   *relationTypesById;
     str_map   *relationTypesByName;
     u64_map   *valuesByEntity;
+    u64_map   *valuesById;            /**< value id -> eavgValueLoc (list + slot) */
     u64_map   *adjIndexBySource;
     u64_map   *reverseAdjIndexByTarget;
+    u64_map   *entitiesByType;        /**< typeId+1 -> id_bitmap of entity ids */
+    u64_map   *entitiesByAttribute;   /**< attributeId -> id_bitmap of entity ids */
 
     Arena      entityArena;
     Arena      attributeArena;
     Arena      valueArena;
     Arena      edgeArena;
 
-    eavg_u64   nextEntityId;
-    eavg_u64   nextAttributeId;
-    eavg_u64   nextValueId;
-    eavg_u64   nextRelationTypeId;
-    eavg_u64   nextEdgeId;
-
-    pthread_rwlock_t lock;
+    Arena            insertArena;   /**< carved into per-thread insert chunks */
+    pthread_mutex_t  insertLock;    /**< guards insertArena only */
+    eavg_u64         serial;        /**< tells per-thread caches of different dbs apart */
+    _Atomic size_t   idBlock;       /**< ids a thread reserves at a time; <= 1: none */
+
+    _Atomic eavg_u64 nextEntityId;
+    _Atomic eavg_u64 nextAttributeId;
+    _Atomic eavg_u64 nextValueId;
+    _Atomic eavg_u64 nextRelationTypeId;
+    _Atomic eavg_u64 nextEdgeId;
+
+    struct eavgValueLoc *freeValueLocs;
+    struct eavgFeed     *feed;
+    struct eavgWal      *wal;             /**< NULL unless eavgDB_walOpen */
+    struct eavgCache    *cache;           /**< NULL unless eavgDB_cacheEnable */
+    /** Workers for parallel walks and imports not given an executor
+     *  and for bulk edge fills; started by the first of them. */
+    struct eavgExecutor * _Atomic walkPool;
+    eavg_u64             nextChangeSeq;   /**< guarded by the write lock */
+    /** Ids of the entities whose record, value list or out-edge list
+     *  changed since the last save, for eavgDB_saveIncremental; guarded
+     *  by the write lock. */
+    id_bitmap           *dirty[3];
+    /** The saved file the dirty sets count from, and the generation of it
+     *  that save wrote (device, inode, size, mtime in ns); guarded by
+     *  snapLock. */
+    char                *basePath;
+    eavg_u64             baseGen[4];
+
+    /* snapshots, oldest to newest, and the map tables they still pin */
+    eavg_u64               epoch;
+    struct eavgSnapshot   *snapOldest, *snapNewest;
+    struct eavgRetiredMap *retiredMaps;
+    pthread_mutex_t        snapLock;
+
+    struct eavgImage *image;        /**< mapped image the db was loaded from, or NULL */
+    struct eavgLazy *lazy;          /**< chunks not yet loaded (eavgDB_openLazy), or NULL */
+
+    br_lock          lock;   /**< reader-biased; see brlock.h */
 } eavgDB;
 
+/** Bulk ingest.  Values and edges may refer to an entity of the same
+ *  batch with EAVG_BULK_REF(index) instead of an id. */
+#define EAVG_BULK_REF_BIT   (1ULL << 63)
+#define EAVG_BULK_REF(i)    (EAVG_BULK_REF_BIT | (eavg_u64)(i))
+
+typedef struct {
+    eavg_u32     typeId;
+    const char  *name;
+} eavgBulkEntity;
+
+typedef struct {
+    eavg_u64       entityId;
+    eavg_u64       attributeId;
+    eavgValueData  data;       /**< strings and blobs are copied */
+    size_t         length;     /**< byte length of a BINARY value */
+} eavgBulkValue;
+
+typedef struct {
+    eavg_u64     src, tgt;
+    eavg_u64     relationTypeId;
+    double       weight;
+    eavgEdgeDir  direction;
+    const char  *label;        /**< interned */
+    uint64_t     timestamp;
+} eavgBulkEdge;
+
+typedef struct {
+    const eavgBulkEntity *entities;   size_t entityCount;
+    const eavgBulkValue  *values;     size_t valueCount;
+    const eavgBulkEdge   *edges;      size_t edgeCount;
+    unsigned              threads;    /**< >1 fills adjacency lists in parallel on the db's pool */
+
+    eavg_u64             *entityIds;  /**< optional out, one id per entity */
+    eavg_u64              firstValueId; /**< out: values get consecutive ids */
+    eavg_u64              firstEdgeId;  /**< out: edges get consecutive ids */
+} eavgBulkBatch;
+
+/** Importer for edge and value dumps, one row per line:
+ *    edges:  src, tgt, rel[, weight[, label]]   names; relation types are
+ *                                               created as needed
+ *    values: entity, attribute, value           the attribute must exist;
+ *                                               ENTITY values name an entity
+ *  CSV fields may be quoted ("" for a quote).  NDJSON rows are flat objects
+ *  with those keys.  Entities are named, and the ones the db lacks are
+ *  created with entityType; rows that do not parse are skipped. */
+typedef enum {
+    EAVG_IMPORT_CSV    = 0,
+    EAVG_IMPORT_NDJSON = 1
+} eavgImportFormat;
+
+typedef enum {
+    EAVG_IMPORT_EDGES  = 0,
+    EAVG_IMPORT_VALUES = 1
+} eavgImportKind;
+
+typedef struct {
+    eavgImportFormat  format;
+    eavgImportKind    kind;
+    unsigned          threads;      /**< parsers; 0: one per online CPU (at most 16) */
+    char              delimiter;    /**< CSV; 0: ',' */
+    bool              header;       /**< CSV: skip the first line */
+    eavg_u32          entityType;   /**< for the entities the import creates */
+    size_t            batchRows;    /**< rows per eavgDB_bulkInsert; 0: 65536 */
+    /** Runs the parsers past the first; NULL: the db's own pool */
+    struct eavgExecutor *executor;
+} eavgImportOptions;
+
+typedef struct {
+    size_t  bytes, rows, skipped;
+    size_t  entitiesCreated, edges, values;
+    double  parseSeconds;     /**< splitting and parsing rows, and looking up known names */
+    double  resolveSeconds;   /**< new names, relation types and attributes */
+    double  insertSeconds;    /**< bulk inserts */
+    double  totalSeconds;
+} eavgImportStats;
+
+/** Change feed.  Every committed entity, value and edge mutation becomes
+ *  one eavgChange; seq follows commit order, although events of concurrent
+ *  writers may reach a subscriber slightly out of order.  Removing an
+ *  entity emits a single ENTITY/REMOVE for it, its values and its edges. */
+#define EAVG_CHANGE_ENTITY  1
+#define EAVG_CHANGE_VALUE   2
+#define EAVG_CHANGE_EDGE    3
+
+#define EAVG_CHANGE_ADD     1
+#define EAVG_CHANGE_REMOVE  2
+#define EAVG_CHANGE_UPDATE  3
+
+/** Records are copies taken at commit time; string, blob and label
+ *  pointers in them refer to arenas, which are never freed. */
+typedef struct {
+    eavg_u64     seq;
+    eavg_u32     kind;        /**< EAVG_CHANGE_ENTITY / VALUE / EDGE */
+    eavg_u32     op;          /**< EAVG_CHANGE_ADD / REMOVE / UPDATE */
+    eavg_u64     entityId;    /**< the entity, the value's owner or the edge's source */
+    union {
+        eavgEntity   entity;
+        eavgValRec   value;
+        eavgEdgeRec  edge;
+    };
+} eavgChange;
+
+typedef enum {
+    EAVG_FEED_DROP  = 0,   /**< a full ring drops the event and counts it */
+    EAVG_FEED_BLOCK = 1    /**< a full ring stalls the publishing writer */
+} eavgFeedPolicy;
+
+/** Transactions.  Operations are buffered in the tx and applied by
+ *  commit under one write lock: the adds first, as one bulk insert, then
+ *  the removes and updates in the order they were made.  Each of those
+ *  is logged to an undo log as it is applied, so a commit that fails part
+ *  way (a missing id, OOM) is rolled back and readers see all of the tx
+ *  or none of it.  Entities added in a tx are named by provisional
+ *  EAVG_BULK_REF ids until commit. */
+typedef struct eavgTx eavgTx;
+
+typedef struct {
+    size_t     entities, values, edges, ops;
+    ArenaMark  arena;
+} eavgTxSavepoint;
+
+/** Parallel walks.  Workers pull chunks of table slots off a shared
+ *  counter and walk them on one snapshot.  The calling thread is one
+ *  worker; the others run as jobs on an executor, so walks reuse its
+ *  threads instead of starting their own.  With stateSize > 0 every
+ *  worker gets its own zeroed state, handed to the callback in place of
+ *  userData, and reduce folds each state into userData on the calling
+ *  thread afterwards.  A nonzero callback return stops further chunks
+ *  from being handed out. */
+typedef struct {
+    unsigned  threads;      /**< 0: one per online CPU */
+    size_t    chunkSlots;   /**< 0: derived from table size and threads */
+    size_t    stateSize;
+    void    (*init)(void *state, void *userData);     /**< optional */
+    void    (*reduce)(void *state, void *userData);   /**< optional */
+    /** NULL: the db's own pool, one thread per online CPU */
+    struct eavgExecutor *executor;
+} eavgParallelOptions;
+
+/** Stream saves encode chunks of each section on several threads while
+ *  the calling thread writes them out in order. */
+typedef struct {
+    unsigned  threads;    /**< 0: one per online CPU (at most 16) */
+    bool      directIO;   /**< bypass the page cache where the file system allows */
+    /** Varint ids and deltas, names and labels from a shared string table,
+     *  values and edges grouped by list.  Older loaders cannot read it. */
+    bool      compact;
+    /** Called on the writing thread after each chunk goes out; total is
+     *  the number of chunks in the file. */
+    void    (*progress)(size_t done, size_t total, void *userData);
+    void     *progressData;
+} eavgSaveOptions;
+
+/** Stream loads decode the value and edge sections on several threads
+ *  into maps and lists sized from the file before they are filled. */
+typedef struct {
+    unsigned  threads;    /**< 0: one per online CPU (at most 16) */
+} eavgLoadOptions;
+
+/** Async queries.  An executor runs queries on its own worker threads;
+ *  each submission returns a future to poll, wait on or cancel.  The
+ *  optional completion callback runs once, on the thread that finishes
+ *  the future (a worker, or the canceller), and may release it. */
+typedef struct eavgExecutor eavgExecutor;
+typedef struct eavgFuture   eavgFuture;
+
+typedef enum {
+    EAVG_FUTURE_PENDING   = 0,
+    EAVG_FUTURE_RUNNING   = 1,
+    EAVG_FUTURE_DONE      = 2,   /**< this and later states are final */
+    EAVG_FUTURE_FAILED    = 3,
+    EAVG_FUTURE_CANCELLED = 4
+} eavgFutureState;
+
+typedef void (*eavgFutureCallback)(eavgFuture *f, void *userData);
+/* A custom query: returns its status (< 0 fails the future) and should
+ * poll eavgFuture_cancelled when it runs long. */
+typedef int  (*eavgJobFn)(eavgDB *db, eavgFuture *f, void *arg);
+
+/** Write-ahead log.  Every mutation appends a record to the log next to
+ *  the snapshot file, so a crash loses at most what the sync policy has
+ *  not yet made durable; eavgDB_load replays the log over the snapshot,
+ *  and a checkpoint rewrites the snapshot and empties the log. */
+typedef enum {
+    EAVG_WAL_SYNC_ALWAYS   = 0,  /**< writes return once fsynced; concurrent writers share fsyncs */
+    EAVG_WAL_SYNC_PERIODIC = 1,  /**< a background thread writes and fsyncs every syncIntervalMs */
+    EAVG_WAL_SYNC_NONE     = 2   /**< written at once, never fsynced: survives process crashes only */
+} eavgWalSync;
+
+typedef struct {
+    eavgWalSync  sync;
+    unsigned     syncIntervalMs;   /**< 0: 100 */
+} eavgWalOptions;
+
+typedef struct eavgSubscription eavgSubscription;
+typedef struct eavgSnapshot     eavgSnapshot;
+typedef void (*eavgChangeCallback)(const eavgChange *events, size_t count, void *userData);
+
 typedef bool (*eavgEdgeFilter)(const eavgEdgeRec *e, void *userData);
+typedef bool (*eavgValueFilter)(const eavgValRec *v, void *userData);
 
 Owns eavgDB *eavgDB_create(size_t initial_capacity);
 void    eavgDB_destroy(Owns eavgDB *db);
 
+/* Replaces filename atomically (temporary file, fsync, rename), so a
+ * failed or interrupted save leaves the old file in place. */
 int eavgDB_save(eavgDB *db, const char *filename);
+int eavgDB_saveEx(eavgDB *db, const char *filename, const eavgSaveOptions *opt);
+
+/* Writes a delta file holding what changed since the baseline: the file
+ * the db was loaded from, the last full save to that same file (any save,
+ * image or checkpoint; the first one when there is no baseline yet), or
+ * the last eavgDB_saveIncremental.  Saves to other files leave the
+ * baseline alone.  The delta holds the entities added or removed and the
+ * value and out-edge lists of every entity touched, whole.  parent must
+ * name the baseline as that save wrote it, or this fails; the delta
+ * records its size and modification time, and loading refuses the chain
+ * once they no longer match.
+ * eavgDB_load on a delta loads its parent (relative paths resolve from the
+ * working directory), recursively, then applies it. */
+int eavgDB_saveIncremental(eavgDB *db, const char *filename, const char *parent);
+/* Loads the chain ending in deltaPath and saves it as one new base file. */
+int eavgDB_mergeChain(const char *deltaPath, const char *outPath, const eavgSaveOptions *opt);
+/* Writes a mapped image: eavgDB_load then maps the file and uses it in
+ * place instead of parsing it, resolving each value or edge list the
+ * first time it is touched.  Images are tied to this build's struct
+ * layout; eavgDB_save files load anywhere. */
+int eavgDB_saveImage(eavgDB *db, const char *filename);
+/* Loads either kind of file, telling them apart by their magic, then
+ * replays filename's write-ahead log if there is one.  With only a log,
+ * replay starts from an empty db. */
 Owns eavgDB *eavgDB_load(const char *filename);
+Owns eavgDB *eavgDB_loadEx(const char *filename, const eavgLoadOptions *opt);
+
+/* Chunked files cut every section into checksummed chunks of about 64 KiB,
+ * with value and edge lists in entity id order and an index at the end
+ * mapping id ranges to chunks.  eavgDB_load reads them whole and fails on
+ * a bad chunk.  eavgDB_openLazy reads entities, attributes and relation
+ * types up front, and an entity's values or edges the first time an
+ * operation reads or writes them, snapshots included.  Only what cannot
+ * be found by entity loads a whole section: lookups by value or edge id
+ * that miss what is loaded (values, edges), the attribute index
+ * (eavgDB_findEntitiesByValueBitmap, queries filtering on attributes:
+ * values) and full saves (everything).  The write-ahead log replays the
+ * same way. */
+int          eavgDB_saveChunked(eavgDB *db, const char *filename);
+Owns eavgDB *eavgDB_openLazy(const char *filename);
 
+typedef struct {
+    size_t       chunk;             /**< position in the file's index */
+    const char  *section;           /**< "entities", "values", "out-edges", ... */
+    eavg_u64     offset;            /**< in the file */
+    eavg_u64     firstKey, lastKey; /**< ids the chunk covers */
+} eavgChunkError;
+
+/* An operation that needs a chunk failing its checksum or its records
+ * fails: reads return NULL, writes NULL or -1, saves -1.  onBadChunk (if
+ * not NULL) hears of each such chunk once, when an operation first
+ * touches it, from that operation's thread with no lock held. */
+Owns eavgDB *eavgDB_openLazyEx(const char *filename,
+                               void (*onBadChunk)(const eavgChunkError *err, void *userData),
+                               void *userData);
+/* Bad chunks met so far, and chunks no operation has needed yet. */
+size_t       eavgDB_lazyBadChunks(eavgDB *db);
+size_t       eavgDB_lazyUnloadedChunks(eavgDB *db);
+
+/* Checks every chunk of a chunked file, calling cb (if not NULL) for each
+ * one that fails.  Returns the number of bad chunks, or -1 when the file
+ * is not a chunked file or its index is damaged. */
+long eavgDB_verify(const char *filename,
+                   void (*cb)(const eavgChunkError *err, void *userData), void *userData);
+
+/* Logs every later mutation to snapshotPath + ".wal" (opt may be NULL:
+ * SYNC_ALWAYS).  Attach it right after eavgDB_load(snapshotPath), or to a
+ * new db, before other threads use the db: earlier writes only become
+ * durable at the next checkpoint.  The log is closed by eavgDB_destroy. */
+int eavgDB_walOpen(eavgDB*, const char *snapshotPath, const eavgWalOptions *opt);
+/* Writes and fsyncs the log now.  Returns -1 if a log write has failed;
+ * mutations themselves cannot report that. */
+int eavgDB_walSync(eavgDB*);
+/* Saves a snapshot to the log's snapshotPath (via a temporary file and a
+ * rename) and drops the log records it covers.  Writers keep going. */
+int eavgDB_checkpoint(eavgDB*);
+
+/* NULL both when nothing matches and on failure (out of memory, a lazily
+ * loaded chunk that cannot be read); the Ex form tells them apart by
+ * returning -1 on failure. */
 eavgEdgeRec *eavgDB_getFilteredEdges(
     eavgDB *db,
     eavg_u64 entityId,
@@ -152,13 +519,25 @@ eavgEdgeRec *eavgDB_getFilteredEdges(
     eavgEdgeFilter filter,
     void *userData,
     size_t *outCount);
+int eavgDB_getFilteredEdgesEx(eavgDB*, eavg_u64 entityId, eavgEdgeDir dir,
+                              eavgEdgeFilter filter, void *userData,
+                              eavgEdgeRec **out, size_t *outCount);
+
+/* Entities and edges get their ids and records before the write lock is
+ * taken, so ids follow allocation rather than commit order.  With a block
+ * size above 1, each thread reserves entity and edge ids that many at a
+ * time; ids a thread has not used yet are skipped. */
+void eavgDB_setIdBlock(eavgDB*, size_t ids);
 
 Owns eavgEntity *eavgDB_addEntity(        eavgDB*, eavg_u32 typeId, const char* name);
 Borrows LT_db eavgEntity *eavgDB_findEntityById(    eavgDB*, eavg_u64 id);
 Borrows LT_db eavgEntity *eavgDB_findEntityByName(  eavgDB*, const char* name);
 int     eavgDB_removeEntity(eavgDB*, eavg_u64 entityId);
 int 	eavgDB_removeRelationType(eavgDB*, eavg_u64 id);
+/* Swap-removes in O(1); the entity's remaining values change order. */
 int 	eavgDB_removeValue(eavgDB*, eavg_u64 id);
+/* Keeps the entity's values in insertion order at O(values per entity). */
+int 	eavgDB_removeValueOrdered(eavgDB*, eavg_u64 id);
 int 	eavgDB_removeEdge(eavgDB*, eavg_u64 id);
 
 void    eavgDB_forEachEntity(               eavgDB*, eavgEntityCallback, void*);
@@ -173,15 +552,34 @@ eavgValRec *eavgDB_addStringValue( eavgDB*, eavg_u64, eavg_u64, const char*);
 eavgValRec *eavgDB_addBinaryValue( eavgDB*, eavg_u64, eavg_u64, const unsigned char*, size_t);
 eavgValRec *eavgDB_addEntityRefValue(eavgDB*, eavg_u64, eavg_u64, eavg_u64);
 
-const char *eavgValRec_getString(const eavgValRec *rec);
-long        eavgValRec_getInt(const eavgValRec *rec);
-eavg_u64    eavgValRec_getEntityRef(const eavgValRec *rec);
+/* Rewrites a value in place; the id, attribute and slot stay the same.
+ * length is only read for BINARY attributes. */
+int eavgDB_updateValue(eavgDB*, eavg_u64 valueId, eavgValueData data, size_t length);
+Borrows LT_db eavgValRec    *eavgDB_findValueById( eavgDB*, eavg_u64 valueId);
+Borrows LT_db eavgValueList *eavgDB_getValueList(  eavgDB*, eavg_u64 entityId);
+
+/* Inline payloads point into the record itself, so they move with it. */
+const char          *eavgValRec_getString(const eavgValRec *rec);
+const unsigned char *eavgValRec_getBinary(const eavgValRec *rec, size_t *outLen);
+size_t               eavgValRec_getLength(const eavgValRec *rec);
+long                 eavgValRec_getInt(const eavgValRec *rec);
+double               eavgValRec_getDouble(const eavgValRec *rec);
+eavg_u64             eavgValRec_getEntityRef(const eavgValRec *rec);
 
 int eavgDB_updateEdgeLabel(eavgDB*, eavg_u64 edgeId, const char *newLabel);
 int eavgDB_updateEdgeWeight(eavgDB*, eavg_u64 edgeId, double newWeight);
 
 eavgEntity **eavgDB_findEntitiesByType(eavgDB*, eavg_u32 typeId, size_t *outCount);
 
+/* Entity sets as compressed bitmaps, for combining predicates with
+ * id_bitmap_and/or/andnot instead of intersecting arrays by hand. */
+Owns id_bitmap *eavgDB_findEntitiesByTypeBitmap(eavgDB*, eavg_u32 typeId);
+Owns id_bitmap *eavgDB_findEntitiesByValueBitmap(eavgDB*, eavg_u64 attributeId,
+                                                 eavgValueFilter filter, void *userData);
+Owns id_bitmap *eavgDB_expandNeighbors(eavgDB*, const id_bitmap *from, eavgEdgeDir dir,
+                                       eavgEdgeFilter filter, void *userData);
+void eavgDB_forEachEntityIn(eavgDB*, const id_bitmap *ids, eavgEntityCallback, void*);
+
 Owns eavgRelationType *eavgDB_addRelationType(       eavgDB*, const char* name);
 Borrows LT_db eavgRelationType *eavgDB_findRelationTypeById(   eavgDB*, eavg_u64 id);
 Borrows LT_db eavgRelationType *eavgDB_findRelationTypeByName( eavgDB*, const char* name);
@@ -190,10 +588,301 @@ eavgEdgeRec *eavgDB_addEdge(   eavgDB*, eavg_u64 src, eavg_u64 tgt, eavg_u64 rel
 eavgEdgeRec *eavgDB_addEdgeEx( eavgDB*, eavg_u64 src, eavg_u64 tgt, eavg_u64 relTypeId,
                                double weight, eavgEdgeDir direction, const char* label, uint64_t timestamp);
 
+/* Inserts a whole batch under one write lock, all or nothing: a batch
+ * rejected up front (unknown attribute, type mismatch, bad EAVG_BULK_REF)
+ * or failing part way (OOM, an oversized value) is taken back out before
+ * the lock is released, so readers, the change feed and the WAL never see
+ * any of it.  Ids it took are not reused. */
+int eavgDB_bulkInsert(eavgDB*, eavgBulkBatch *batch);
+/* Maps filename and parses it on several threads, then inserts the rows
+ * in file order.  opt may be NULL (CSV edges); stats may be NULL.  Rows
+ * inserted before a failure stay in. */
+int eavgDB_import(eavgDB*, const char *filename, const eavgImportOptions *opt,
+                  eavgImportStats *stats);
+
+/* Commit fills entityIds (optional, one per eavgTx_addEntity) and frees
+ * the tx whatever the outcome; a failed commit changes nothing.  Adding a
+ * value returns -1 for an unknown attribute or a type mismatch; any
+ * operation returns -1 (0 for entities) when out of memory, and the tx
+ * then refuses to commit.  Removes and updates name existing records
+ * only, not ones the tx adds; one whose record is gone by commit time
+ * fails the commit. */
+Owns eavgTx *eavgDB_txBegin(eavgDB*);
+int  eavgDB_txCommit(Owns eavgTx *tx, eavg_u64 *entityIds);
+void eavgDB_txAbort(Owns eavgTx *tx);
+eavgTxSavepoint eavgTx_savepoint(const eavgTx *tx);
+void eavgTx_rollbackTo(eavgTx *tx, eavgTxSavepoint sp);
+
+eavg_u64 eavgTx_addEntity(eavgTx*, eavg_u32 typeId, const char *name);
+int eavgTx_addIntValue(      eavgTx*, eavg_u64, eavg_u64, long);
+int eavgTx_addDoubleValue(   eavgTx*, eavg_u64, eavg_u64, double);
+int eavgTx_addStringValue(   eavgTx*, eavg_u64, eavg_u64, const char*);
+int eavgTx_addBinaryValue(   eavgTx*, eavg_u64, eavg_u64, const unsigned char*, size_t);
+int eavgTx_addEntityRefValue(eavgTx*, eavg_u64, eavg_u64, eavg_u64);
+int eavgTx_addEdge(  eavgTx*, eavg_u64 src, eavg_u64 tgt, eavg_u64 relTypeId, double weight);
+int eavgTx_addEdgeEx(eavgTx*, eavg_u64 src, eavg_u64 tgt, eavg_u64 relTypeId,
+                     double weight, eavgEdgeDir direction, const char *label, uint64_t timestamp);
+
+int eavgTx_removeEntity(      eavgTx*, eavg_u64 entityId);
+int eavgTx_removeValue(       eavgTx*, eavg_u64 valueId);
+int eavgTx_removeValueOrdered(eavgTx*, eavg_u64 valueId);
+int eavgTx_updateValue(       eavgTx*, eavg_u64 valueId, eavgValueData data, size_t length);
+int eavgTx_removeEdge(        eavgTx*, eavg_u64 edgeId);
+int eavgTx_updateEdgeWeight(  eavgTx*, eavg_u64 edgeId, double newWeight);
+int eavgTx_updateEdgeLabel(   eavgTx*, eavg_u64 edgeId, const char *newLabel);
+
+/* threads 0 picks a default.  Submissions beyond queueCapacity pending
+ * queries (0: default) are refused with NULL, as are submissions that run
+ * out of memory.  Filters run on worker threads.  Destroy cancels what is
+ * still queued and waits for running queries; futures stay readable until
+ * released. */
+Owns eavgExecutor *eavgExecutor_create(eavgDB*, unsigned threads, size_t queueCapacity);
+void eavgExecutor_destroy(Owns eavgExecutor*);
+
+/* Results, owned by the future: expand yields an id_bitmap of `from` and
+ * everything within `hops` hops, filteredEdges an eavgEdgeRec array,
+ * lookup one eavgEntity* per id (NULL if absent), save only a status. */
+Owns eavgFuture *eavgExecutor_expand(eavgExecutor*, const id_bitmap *from, unsigned hops,
+                                     eavgEdgeDir dir, eavgEdgeFilter filter, void *filterData,
+                                     eavgFutureCallback cb, void *cbData);
+Owns eavgFuture *eavgExecutor_filteredEdges(eavgExecutor*, eavg_u64 entityId, eavgEdgeDir dir,
+                                            eavgEdgeFilter filter, void *filterData,
+                                            eavgFutureCallback cb, void *cbData);
+Owns eavgFuture *eavgExecutor_lookup(eavgExecutor*, const eavg_u64 *ids, size_t count,
+                                     eavgFutureCallback cb, void *cbData);
+Owns eavgFuture *eavgExecutor_save(eavgExecutor*, const char *filename,
+                                   eavgFutureCallback cb, void *cbData);
+/* Pins a snapshot, so the file holds the db as of this call, and returns;
+ * a worker then writes it like eavgDB_saveEx while writers carry on.  The
+ * snapshot stays pinned until the save runs or is cancelled.  Plain
+ * eavgExecutor_save is this with default options. */
+Owns eavgFuture *eavgExecutor_saveEx(eavgExecutor*, const char *filename,
+                                     const eavgSaveOptions *opt,
+                                     eavgFutureCallback cb, void *cbData);
+Owns eavgFuture *eavgExecutor_submit(eavgExecutor*, eavgJobFn job, void *arg,
+                                     eavgFutureCallback cb, void *cbData);
+
+eavgFutureState eavgFuture_poll(const eavgFuture*);
+/* Returns 0 once the future is final, -1 on timeout; timeoutMs < 0 waits
+ * indefinitely. */
+int  eavgFuture_wait(eavgFuture*, long timeoutMs);
+/* Stops a pending query outright (returns true) or asks a running one to
+ * stop early (returns false; it ends CANCELLED). */
+bool eavgFuture_cancel(eavgFuture*);
+bool eavgFuture_cancelled(const eavgFuture*);
+int  eavgFuture_status(const eavgFuture*);
+/* For saves, the chunks written so far and in all; either may be NULL. */
+void eavgFuture_progress(const eavgFuture*, size_t *done, size_t *total);
+Borrows void *eavgFuture_result(const eavgFuture*, size_t *outCount);
+void eavgFuture_release(Owns eavgFuture*);
+
+/* Starts a consumer thread that receives batches of up to batchMax events
+ * from a ring of `capacity` slots (0 picks a default for either).  The
+ * callback must not unsubscribe itself, and under EAVG_FEED_BLOCK must not
+ * write to the db.  Unsubscribing delivers what is queued, then joins. */
+Owns eavgSubscription *eavgDB_subscribe(eavgDB*, size_t capacity, size_t batchMax,
+                                        eavgFeedPolicy policy,
+                                        eavgChangeCallback cb, void *userData);
+int      eavgDB_unsubscribe(eavgDB*, Owns eavgSubscription *sub);
+eavg_u64 eavgSubscription_dropped(const eavgSubscription *sub);
+
+/* Snapshot reads.  Begin and end briefly take the db lock; everything in
+ * between takes none, and writers carry on meanwhile.  Pointers returned
+ * through a snapshot stay valid and unchanged until it ends. */
+Owns eavgSnapshot *eavgDB_snapshotBegin(eavgDB*);
+/* Calls pinned(db, userData) under the read lock that pins the snapshot,
+ * so whatever it reads through the NoLock accessors below (indexes the
+ * snapshot does not carry) matches the snapshot exactly. */
+Owns eavgSnapshot *eavgDB_snapshotBeginWith(eavgDB*, void (*pinned)(eavgDB*, void*),
+                                            void *userData);
+void eavgDB_snapshotEnd(Owns eavgSnapshot*);
+Borrows eavgEntity    *eavgSnapshot_findEntityById(   eavgSnapshot*, eavg_u64 id);
+Borrows eavgEntity    *eavgSnapshot_findEntityByName( eavgSnapshot*, const char *name);
+Borrows eavgValueList *eavgSnapshot_getValueList(     eavgSnapshot*, eavg_u64 entityId);
+Borrows eavgAdjList   *eavgSnapshot_getAdjList(       eavgSnapshot*, eavg_u64 src);
+Borrows eavgAdjList   *eavgSnapshot_getReverseAdjList(eavgSnapshot*, eavg_u64 tgt);
+void eavgSnapshot_forEachEntity(eavgSnapshot*, eavgEntityCallback, void*);
+void eavgSnapshot_forEachEdge(  eavgSnapshot*, eavgEdgeCallback, void*);
+
+/* Chunked iteration for callers with their own executors: split
+ * [0, slots) into ranges and walk each independently, from any thread.
+ * Returns the nonzero value that stopped the walk, else 0. */
+size_t eavgSnapshot_entitySlots(const eavgSnapshot*);
+size_t eavgSnapshot_edgeSlots(  const eavgSnapshot*);
+int eavgSnapshot_forEachEntityInRange(eavgSnapshot*, size_t begin, size_t end,
+                                      eavgEntityCallback, void*);
+int eavgSnapshot_forEachEdgeInRange(  eavgSnapshot*, size_t begin, size_t end,
+                                      eavgEdgeCallback, void*);
+
+/* Returns 0 when the walk completed, 1 when a callback stopped it, -1
+ * when out of memory (nothing walked).  opt may be NULL. */
+int eavgDB_parallelForEachEntity(eavgDB*, const eavgParallelOptions *opt,
+                                 eavgEntityCallback, void *userData);
+int eavgDB_parallelForEachEdge(  eavgDB*, const eavgParallelOptions *opt,
+                                 eavgEdgeCallback, void *userData);
+
+/* Live lists: one stays valid until a write replaces or drops it while
+ * a snapshot is open.  Read through a snapshot to keep what you read. */
 Borrows LT_db eavgAdjList *eavgDB_getAdjList(        eavgDB*, eavg_u64 src);
 Borrows LT_db eavgAdjList *eavgDB_getReverseAdjList( eavgDB*, eavg_u64 tgt);
+/* Runs on a snapshot, so writers are not held up by a long walk. */
 void eavgDB_forEachEdge(           eavgDB*, eavgEdgeCallback, void*);
 
+/** Result cache.  Off by default.  Once enabled, eavgDB_getFilteredEdges,
+ *  eavgDB_findEntitiesByType(Bitmap) and eavgDB_expandNeighbors (from at
+ *  most 256 entities) remember their results, and a repeated call costs
+ *  a hash probe and a copy.  Each result is dropped at the next write to
+ *  the edges of an entity it read or, for type listings, at the next add
+ *  or removal of an entity of the type.  Results not hit lately are
+ *  evicted to stay within the budget.
+ *
+ *  Calls with a filter are only cached with `filtered` set, which
+ *  promises that every filter passed to them answers from the edge and
+ *  *userData alone, and that userData is not changed or reused for
+ *  another filter while the cache is on: the filter and userData
+ *  pointers are part of the key. */
+typedef struct {
+    size_t  budget;     /**< bytes; 0: 64 MiB */
+    bool    filtered;
+} eavgCacheOptions;
+
+typedef struct {
+    eavg_u64  hits, misses;
+    eavg_u64  invalidated;  /**< found stale at lookup */
+    eavg_u64  evicted;      /**< dropped for the budget */
+    eavg_u64  inserts;
+    size_t    bytes, entries;
+} eavgCacheStats;
+
+/* Replaces any cache already enabled, emptying it; opt may be NULL.
+ * Returns -1 when out of memory. */
+int  eavgDB_cacheEnable(eavgDB*, const eavgCacheOptions *opt);
+void eavgDB_cacheDisable(eavgDB*);
+/* All zero when no cache is enabled. */
+void eavgDB_cacheStats(eavgDB*, eavgCacheStats *out);
+
+/** Pattern queries.  A pattern is a path of nodes and edges:
+ *
+ *    (a:2 {age>=30, name="Alice"})-[knows]->(b)<-[likes {weight>0.5}]-(c)
+ *        RETURN a, c.city LIMIT 10
+ *
+ *  A node is ([var][:typeId][{preds}]); an edge is -[rel{preds}]->,
+ *  <-[rel{preds}]- or -[rel{preds}]- (either way), where rel, the preds
+ *  and the brackets may be left out (-->).  Node predicates test an
+ *  attribute (some value of it must match) or, under the key name, the
+ *  entity's name; edge predicates test weight or label.  Operators are
+ *  = != < <= > >=, literals integers, decimals or quoted strings, and
+ *  names that are not plain identifiers go in backquotes.  A variable
+ *  used twice must bind the same entity both times.  RETURN picks the
+ *  columns, variables or var.attribute (default: every named variable);
+ *  keywords are case-insensitive.
+ *
+ *  Each run plans afresh: it starts from the node the name, type and
+ *  attribute indexes say matches fewest entities, then walks the
+ *  adjacency lists outwards in both directions, a batch of partial
+ *  matches at a time, on a snapshot. */
+typedef struct eavgQuery eavgQuery;
+
+typedef struct {
+    eavg_u64    entityId;   /**< the variable's entity, or the value's owner */
+    bool        hasValue;   /**< var.attribute columns: the entity has one */
+    eavgValRec  value;      /**< var.attribute columns: its first value, copied */
+} eavgQueryCell;
+
+/* rows holds count rows of eavgQuery_columnCount cells, valid during the
+ * call; a nonzero return stops the query. */
+typedef int (*eavgQueryCallback)(const eavgQueryCell *rows, size_t count, void *userData);
+
+/* Parses pattern; names are resolved when it runs.  On a syntax error
+ * returns NULL and, if err is not NULL, describes it there. */
+Owns eavgQuery *eavgQuery_compile(eavgDB*, const char *pattern, char *err, size_t errLen);
+void        eavgQuery_free(Owns eavgQuery*);
+size_t      eavgQuery_columnCount(const eavgQuery*);
+const char *eavgQuery_columnName(const eavgQuery*, size_t column);
+/* Returns 0 once every match went to cb (or the limit was reached), 1
+ * when cb stopped it, -1 when out of memory or a literal does not fit
+ * its attribute's type.  Unknown relation types and attributes match
+ * nothing.  A query may run on several threads at once. */
+int         eavgQuery_run(eavgQuery*, eavgQueryCallback cb, void *userData);
+/* Plans as eavgQuery_run would and describes the plan, one step a line,
+ * snprintf-style; -1 as for eavgQuery_run. */
+int         eavgQuery_explain(eavgQuery*, char *buf, size_t len);
+
+/** String interning.  One pool per process maps strings to dense
+ *  symbols, so relation type and attribute names and edge labels are
+ *  stored once however many dbs and edges use them, and compared as
+ *  integers (eavgEdgeRec_hasLabel).  Thread-safe; interned strings are
+ *  never freed, so keep the pool to small vocabularies rather than
+ *  unique strings.  Edge labels only add to it up to a budget: past
+ *  that, a label the pool does not know yet is kept by the db instead,
+ *  with labelSym 0. */
+/* 0 for NULL, an embedded NUL (internLen) or out of memory. */
+eavgSymbol  eavgSymbol_intern(const char *s);
+eavgSymbol  eavgSymbol_internLen(const char *s, size_t n);
+/* As internLen, but once the label budget (EAVG_SYMBOL_LABEL_MAX unless
+ * set) of strings were added this way, returns 0 for strings not
+ * interned yet rather than adding them. */
+#define EAVG_SYMBOL_LABEL_MAX  (1u << 16)
+eavgSymbol  eavgSymbol_internLabel(const char *s, size_t n);
+void        eavgSymbol_setLabelBudget(eavg_u32 max);
+/* 0 when s was never interned. */
+eavgSymbol  eavgSymbol_find(const char *s);
+/* NULL for 0 or an unknown symbol; the string lives as long as the process. */
+const char *eavgSymbol_name(eavgSymbol sym);
+size_t      eavgSymbol_count(void);
+
+/** Instrumentation: process-wide counts and latency histograms for the
+ *  public calls, read and write lock wait and hold times, map rehashes
+ *  and arena block allocations.  Compiled in unless EAVG_NO_STATS is
+ *  defined, and off until eavgStats_enable(true).  Threads record into
+ *  per-thread shards, which a snapshot sums. */
+typedef enum {
+    EAVG_OP_ADD_ENTITY, EAVG_OP_FIND_ENTITY, EAVG_OP_REMOVE_ENTITY, EAVG_OP_FOR_EACH_ENTITY,
+    EAVG_OP_ADD_ATTRIBUTE, EAVG_OP_FIND_ATTRIBUTE,
+    EAVG_OP_ADD_VALUE, EAVG_OP_UPDATE_VALUE, EAVG_OP_REMOVE_VALUE, EAVG_OP_FIND_VALUE,
+    EAVG_OP_ADD_RELTYPE, EAVG_OP_FIND_RELTYPE, EAVG_OP_REMOVE_RELTYPE,
+    EAVG_OP_ADD_EDGE, EAVG_OP_UPDATE_EDGE, EAVG_OP_REMOVE_EDGE, EAVG_OP_GET_EDGES,
+    EAVG_OP_FOR_EACH_EDGE,
+    EAVG_OP_FIND_BY_TYPE, EAVG_OP_FIND_BY_VALUE, EAVG_OP_EXPAND,
+    EAVG_OP_BULK_INSERT, EAVG_OP_TX_COMMIT, EAVG_OP_IMPORT, EAVG_OP_SNAPSHOT,
+    EAVG_OP_SAVE, EAVG_OP_LOAD, EAVG_OP_CHECKPOINT, EAVG_OP_QUERY,
+    EAVG_OP_COUNT
+} eavgOp;
+
+/* Log-linear buckets in ns: exact below 8, then 8 per power of two up to
+ * 2^40 (about 18 minutes), so a bucket is within 12.5% of its values. */
+#define EAVG_HIST_SUB_BITS  3
+#define EAVG_HIST_BUCKETS   ((40 - EAVG_HIST_SUB_BITS + 1) << EAVG_HIST_SUB_BITS)
+
+typedef struct {
+    uint64_t  count;
+    uint64_t  totalNs;
+    uint64_t  maxNs;
+    uint64_t  buckets[EAVG_HIST_BUCKETS];
+} eavgHistogram;
+
+/* About 80 KiB: keep it off small stacks. */
+typedef struct {
+    eavgHistogram  ops[EAVG_OP_COUNT];
+    eavgHistogram  readLockWait, readLockHold;
+    eavgHistogram  writeLockWait, writeLockHold;
+    eavgHistogram  mapGrow;          /**< one per u64_map/str_map rehash */
+    uint64_t       arenaBlocks;
+    uint64_t       arenaBytes;
+} eavgStats;
+
+/* Returns the previous setting; always false when compiled out. */
+bool        eavgStats_enable(bool on);
+/* Sums the shards into out.  Counters being written meanwhile may be
+ * caught halfway, so a histogram's count and buckets can differ by the
+ * ops in flight. */
+void        eavgStats_snapshot(eavgStats *out);
+void        eavgStats_reset(void);
+const char *eavgStats_opName(eavgOp op);
+/* The highest value in the bucket holding the p-th fraction (0..1) of h,
+ * or 0 for an empty histogram. */
+uint64_t    eavgHistogram_percentile(const eavgHistogram *h, double p);
+
 /* unsafe */
 
 static inline eavgEntity  *eavgDB_findEntityByIdNoLock(const eavgDB *db, eavg_u64 id) {
@@ -205,6 +894,24 @@ static inline eavgEntity  *eavgDB_findEntityByNameNoLock(const eavgDB *db, const
 static inline eavgAttribute*eavgDB_findAttributeByIdNoLock(const eavgDB *db, eavg_u64 id) {
     return (eavgAttribute*)u64_map_get(db->attributesById, id);
 }
+static inline eavgAttribute*eavgDB_findAttributeByNameNoLock(const eavgDB *db, const char *name) {
+    return (eavgAttribute*)str_map_get(db->attributesByName, name);
+}
+static inline eavgRelationType *eavgDB_findRelationTypeByNameNoLock(const eavgDB *db, const char *name) {
+    return (eavgRelationType*)str_map_get(db->relationTypesByName, name);
+}
+/* typeId 0 is a valid tag but 0 is the empty key in u64_map */
+#define EAVG_TYPE_KEY(typeId)  ((eavg_u64)(typeId) + 1)
+/* The index entries themselves (NULL: no such entity), not copies. */
+static inline id_bitmap *eavgDB_entitiesByTypeNoLock(const eavgDB *db, eavg_u32 typeId) {
+    return (id_bitmap*)u64_map_get(db->entitiesByType, EAVG_TYPE_KEY(typeId));
+}
+/* A lazily opened db only indexes the values it has loaded: call
+ * eavgDB_lazyLoadValues (0, or -1 on a bad chunk) first. */
+int eavgDB_lazyLoadValues(eavgDB *db);
+static inline id_bitmap *eavgDB_entitiesByAttributeNoLock(const eavgDB *db, eavg_u64 attributeId) {
+    return (id_bitmap*)u64_map_get(db->entitiesByAttribute, attributeId);
+}
 static inline eavgAdjList *eavgDB_getAdjListNoLock(const eavgDB *db, eavg_u64 src) {
     return (eavgAdjList*)u64_map_get(db->adjIndexBySource, src);
 }
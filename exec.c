@@ -0,0 +1,405 @@
+#include "eavg.h"
+#include "save.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define EXEC_MAX_THREADS     64
+#define EXEC_DEFAULT_QUEUE   256
+#define EXEC_CANCEL_STRIDE   4096    /* lookups between cancellation checks */
+
+struct eavgFuture {
+    _Atomic int         state;      /* eavgFutureState */
+    _Atomic int         cancel;
+    _Atomic unsigned    refs;       /* caller + executor */
+    pthread_mutex_t     mu;         /* guards the wait on cv only */
+    pthread_cond_t      cv;
+
+    eavgDB             *db;
+    int               (*run)(eavgFuture *f);
+    eavgFutureCallback  cb;
+    void               *cbData;
+
+    int                 status;
+    void               *result;
+    size_t              count;
+    void              (*freeResult)(void *result);
+
+    /* query arguments; which are used depends on run */
+    id_bitmap          *from;
+    unsigned            hops;
+    eavgEdgeDir         dir;
+    eavgEdgeFilter      filter;
+    void               *filterData;
+    eavg_u64            entityId;
+    eavg_u64           *ids;
+    char               *filename;
+    eavgPinnedSave     *pinned;     /* a save not yet written */
+    eavgSaveOptions     saveOpt;
+    _Atomic size_t      progressDone, progressTotal;
+    eavgJobFn           job;
+    void               *jobArg;
+};
+
+struct eavgExecutor {
+    eavgDB           *db;
+    eavgFuture      **queue;        /* ring of pending futures */
+    size_t            cap, head, count;
+    bool              stop;
+    pthread_mutex_t   mu;
+    pthread_cond_t    cv;
+    unsigned          threads;
+    pthread_t        *tids;
+};
+
+static void future_release(eavgFuture *f) {
+    if (atomic_fetch_sub(&f->refs, 1) != 1) return;
+    if (f->result && f->freeResult) f->freeResult(f->result);
+    id_bitmap_destroy(f->from);
+    free(f->ids);
+    free(f->filename);
+    save_unpin(f->pinned);
+    pthread_mutex_destroy(&f->mu);
+    pthread_cond_destroy(&f->cv);
+    free(f);
+}
+
+/* Publishes the terminal state, wakes waiters and runs the callback on
+ * the finishing thread. */
+static void future_finish(eavgFuture *f, eavgFutureState state) {
+    pthread_mutex_lock(&f->mu);
+    atomic_store(&f->state, state);
+    pthread_cond_broadcast(&f->cv);
+    pthread_mutex_unlock(&f->mu);
+    if (f->cb) f->cb(f, f->cbData);
+}
+
+static void *exec_main(void *arg) {
+    eavgExecutor *ex = arg;
+    for (;;) {
+        pthread_mutex_lock(&ex->mu);
+        while (!ex->count && !ex->stop) pthread_cond_wait(&ex->cv, &ex->mu);
+        if (!ex->count) {
+            pthread_mutex_unlock(&ex->mu);
+            return NULL;
+        }
+        eavgFuture *f = ex->queue[ex->head];
+        ex->head = (ex->head + 1) % ex->cap;
+        ex->count--;
+        pthread_mutex_unlock(&ex->mu);
+
+        int pending = EAVG_FUTURE_PENDING;
+        if (atomic_compare_exchange_strong(&f->state, &pending, EAVG_FUTURE_RUNNING)) {
+            f->status = f->run(f);
+            future_finish(f, atomic_load(&f->cancel) ? EAVG_FUTURE_CANCELLED
+                           : f->status < 0           ? EAVG_FUTURE_FAILED
+                                                     : EAVG_FUTURE_DONE);
+        }
+        future_release(f);
+    }
+}
+
+eavgExecutor *eavgExecutor_create(eavgDB *db, unsigned threads, size_t queueCapacity) {
+    eavgExecutor *ex = calloc(1, sizeof *ex);
+    if (!ex) return NULL;
+    if (!threads) threads = 4;
+    if (threads > EXEC_MAX_THREADS) threads = EXEC_MAX_THREADS;
+    ex->db    = db;
+    ex->cap   = queueCapacity ? queueCapacity : EXEC_DEFAULT_QUEUE;
+    ex->queue = malloc(ex->cap * sizeof *ex->queue);
+    ex->tids  = malloc(threads * sizeof *ex->tids);
+    if (!ex->queue || !ex->tids) {
+        free(ex->queue);
+        free(ex->tids);
+        free(ex);
+        return NULL;
+    }
+    pthread_mutex_init(&ex->mu, NULL);
+    pthread_cond_init(&ex->cv, NULL);
+    for (; ex->threads < threads; ex->threads++) {
+        if (pthread_create(&ex->tids[ex->threads], NULL, exec_main, ex) != 0) break;
+    }
+    if (!ex->threads) {
+        eavgExecutor_destroy(ex);
+        return NULL;
+    }
+    return ex;
+}
+
+/* Pending queries are cancelled once the lock is dropped, since their
+ * callbacks run on this thread. */
+void eavgExecutor_destroy(eavgExecutor *ex) {
+    if (!ex) return;
+    pthread_mutex_lock(&ex->mu);
+    ex->stop = true;
+    size_t head = ex->head, pending = ex->count;
+    ex->count = 0;
+    pthread_cond_broadcast(&ex->cv);
+    pthread_mutex_unlock(&ex->mu);
+
+    for (size_t i = 0; i < pending; i++) {
+        eavgFuture *f = ex->queue[(head + i) % ex->cap];
+        eavgFuture_cancel(f);
+        future_release(f);
+    }
+    for (unsigned i = 0; i < ex->threads; i++) pthread_join(ex->tids[i], NULL);
+    pthread_mutex_destroy(&ex->mu);
+    pthread_cond_destroy(&ex->cv);
+    free(ex->queue);
+    free(ex->tids);
+    free(ex);
+}
+
+static eavgFuture *future_create(eavgExecutor *ex, int (*run)(eavgFuture*),
+                                 eavgFutureCallback cb, void *cbData)
+{
+    eavgFuture *f = calloc(1, sizeof *f);
+    if (!f) return NULL;
+    atomic_init(&f->state, EAVG_FUTURE_PENDING);
+    atomic_init(&f->cancel, 0);
+    atomic_init(&f->refs, 1);
+    pthread_mutex_init(&f->mu, NULL);
+    pthread_cond_init(&f->cv, NULL);
+    f->db     = ex->db;
+    f->run    = run;
+    f->cb     = cb;
+    f->cbData = cbData;
+    return f;
+}
+
+/* Queues f, handing the executor its own reference.  A full queue (or a
+ * stopping executor) rejects the query and frees f. */
+static eavgFuture *future_submit(eavgExecutor *ex, eavgFuture *f) {
+    if (!f) return NULL;
+    pthread_mutex_lock(&ex->mu);
+    if (ex->stop || ex->count == ex->cap) {
+        pthread_mutex_unlock(&ex->mu);
+        future_release(f);
+        return NULL;
+    }
+    atomic_fetch_add(&f->refs, 1);
+    ex->queue[(ex->head + ex->count) % ex->cap] = f;
+    ex->count++;
+    pthread_cond_signal(&ex->cv);
+    pthread_mutex_unlock(&ex->mu);
+    return f;
+}
+
+static void free_bitmap(void *b) {
+    id_bitmap_destroy(b);
+}
+
+static int run_expand(eavgFuture *f) {
+    id_bitmap *seen     = id_bitmap_copy(f->from);
+    id_bitmap *frontier = f->from;
+    f->from = NULL;
+    if (!seen) {
+        id_bitmap_destroy(frontier);
+        return -1;
+    }
+    for (unsigned hop = 0; hop < f->hops && !atomic_load(&f->cancel); hop++) {
+        id_bitmap *next  = eavgDB_expandNeighbors(f->db, frontier, f->dir, f->filter,
+                                                  f->filterData);
+        id_bitmap *fresh = next ? id_bitmap_andnot(next, seen) : NULL;
+        id_bitmap_destroy(next);
+        id_bitmap_destroy(frontier);
+        frontier = fresh;
+        if (!fresh || id_bitmap_or_into(seen, fresh) < 0) {
+            id_bitmap_destroy(fresh);
+            id_bitmap_destroy(seen);
+            return -1;
+        }
+        if (!id_bitmap_cardinality(fresh)) break;
+    }
+    id_bitmap_destroy(frontier);
+    f->result     = seen;
+    f->count      = id_bitmap_cardinality(seen);
+    f->freeResult = free_bitmap;
+    return 0;
+}
+
+static int run_edges(eavgFuture *f) {
+    eavgEdgeRec *edges;
+    int rc = eavgDB_getFilteredEdgesEx(f->db, f->entityId, f->dir, f->filter,
+                                       f->filterData, &edges, &f->count);
+    f->result     = edges;
+    f->freeResult = free;
+    return rc;
+}
+
+static int run_lookup(eavgFuture *f) {
+    eavgEntity  **out = calloc(f->count ? f->count : 1, sizeof *out);
+    eavgSnapshot *s   = out ? eavgDB_snapshotBegin(f->db) : NULL;
+    if (!s) {
+        free(out);
+        return -1;
+    }
+    for (size_t i = 0; i < f->count; i++) {
+        if (i % EXEC_CANCEL_STRIDE == 0 && atomic_load(&f->cancel)) break;
+        out[i] = eavgSnapshot_findEntityById(s, f->ids[i]);
+    }
+    eavgDB_snapshotEnd(s);
+    f->result     = out;
+    f->freeResult = free;
+    return 0;
+}
+
+static void save_progress(size_t done, size_t total, void *userData) {
+    eavgFuture *f = userData;
+    atomic_store(&f->progressTotal, total);
+    atomic_store(&f->progressDone, done);
+    if (f->saveOpt.progress) f->saveOpt.progress(done, total, f->saveOpt.progressData);
+}
+
+static int run_save(eavgFuture *f) {
+    eavgSaveOptions opt = f->saveOpt;
+    opt.progress     = save_progress;
+    opt.progressData = f;
+    eavgPinnedSave *p = f->pinned;
+    f->pinned = NULL;
+    return save_pinned(p, &opt);
+}
+
+static int run_job(eavgFuture *f) {
+    return f->job(f->db, f, f->jobArg);
+}
+
+eavgFuture *eavgExecutor_expand(eavgExecutor *ex, const id_bitmap *from, unsigned hops,
+                                eavgEdgeDir dir, eavgEdgeFilter filter, void *filterData,
+                                eavgFutureCallback cb, void *cbData)
+{
+    eavgFuture *f = future_create(ex, run_expand, cb, cbData);
+    if (!f) return NULL;
+    f->from       = id_bitmap_copy(from);
+    f->hops       = hops;
+    f->dir        = dir;
+    f->filter     = filter;
+    f->filterData = filterData;
+    if (!f->from) {
+        future_release(f);
+        return NULL;
+    }
+    return future_submit(ex, f);
+}
+
+eavgFuture *eavgExecutor_filteredEdges(eavgExecutor *ex, eavg_u64 entityId, eavgEdgeDir dir,
+                                       eavgEdgeFilter filter, void *filterData,
+                                       eavgFutureCallback cb, void *cbData)
+{
+    eavgFuture *f = future_create(ex, run_edges, cb, cbData);
+    if (!f) return NULL;
+    f->entityId   = entityId;
+    f->dir        = dir;
+    f->filter     = filter;
+    f->filterData = filterData;
+    return future_submit(ex, f);
+}
+
+eavgFuture *eavgExecutor_lookup(eavgExecutor *ex, const eavg_u64 *ids, size_t count,
+                                eavgFutureCallback cb, void *cbData)
+{
+    eavgFuture *f = future_create(ex, run_lookup, cb, cbData);
+    if (!f) return NULL;
+    f->count = count;
+    f->ids   = malloc((count ? count : 1) * sizeof *f->ids);
+    if (!f->ids) {
+        future_release(f);
+        return NULL;
+    }
+    if (count) memcpy(f->ids, ids, count * sizeof *ids);
+    return future_submit(ex, f);
+}
+
+eavgFuture *eavgExecutor_save(eavgExecutor *ex, const char *filename,
+                              eavgFutureCallback cb, void *cbData)
+{
+    return eavgExecutor_saveEx(ex, filename, NULL, cb, cbData);
+}
+
+eavgFuture *eavgExecutor_saveEx(eavgExecutor *ex, const char *filename,
+                                const eavgSaveOptions *opt,
+                                eavgFutureCallback cb, void *cbData)
+{
+    eavgFuture *f = future_create(ex, run_save, cb, cbData);
+    if (!f) return NULL;
+    if (opt) f->saveOpt = *opt;
+    f->pinned = save_pin(ex->db, filename);
+    if (!f->pinned) {
+        future_release(f);
+        return NULL;
+    }
+    return future_submit(ex, f);
+}
+
+eavgFuture *eavgExecutor_submit(eavgExecutor *ex, eavgJobFn job, void *arg,
+                                eavgFutureCallback cb, void *cbData)
+{
+    eavgFuture *f = future_create(ex, run_job, cb, cbData);
+    if (!f) return NULL;
+    f->job    = job;
+    f->jobArg = arg;
+    return future_submit(ex, f);
+}
+
+eavgFutureState eavgFuture_poll(const eavgFuture *f) {
+    return (eavgFutureState)atomic_load(&f->state);
+}
+
+static bool future_terminal(const eavgFuture *f) {
+    return eavgFuture_poll(f) >= EAVG_FUTURE_DONE;
+}
+
+int eavgFuture_wait(eavgFuture *f, long timeoutMs) {
+    struct timespec ts;
+    if (timeoutMs >= 0) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec  += timeoutMs / 1000;
+        ts.tv_nsec += (timeoutMs % 1000) * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+    }
+    pthread_mutex_lock(&f->mu);
+    while (!future_terminal(f)) {
+        if (timeoutMs < 0) pthread_cond_wait(&f->cv, &f->mu);
+        else if (pthread_cond_timedwait(&f->cv, &f->mu, &ts) != 0) break;
+    }
+    pthread_mutex_unlock(&f->mu);
+    return future_terminal(f) ? 0 : -1;
+}
+
+bool eavgFuture_cancel(eavgFuture *f) {
+    atomic_store(&f->cancel, 1);
+    int pending = EAVG_FUTURE_PENDING;
+    if (!atomic_compare_exchange_strong(&f->state, &pending, EAVG_FUTURE_CANCELLED))
+        return false;
+    save_unpin(f->pinned);
+    f->pinned = NULL;
+    future_finish(f, EAVG_FUTURE_CANCELLED);
+    return true;
+}
+
+bool eavgFuture_cancelled(const eavgFuture *f) {
+    return atomic_load(&f->cancel) != 0;
+}
+
+int eavgFuture_status(const eavgFuture *f) {
+    return f->status;
+}
+
+void eavgFuture_progress(const eavgFuture *f, size_t *done, size_t *total) {
+    eavgFuture *m = (eavgFuture*)f;
+    if (done)  *done  = atomic_load(&m->progressDone);
+    if (total) *total = atomic_load(&m->progressTotal);
+}
+
+void *eavgFuture_result(const eavgFuture *f, size_t *outCount) {
+    if (outCount) *outCount = f->result ? f->count : 0;
+    return f->result;
+}
+
+void eavgFuture_release(eavgFuture *f) {
+    if (f) future_release(f);
+}
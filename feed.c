@@ -0,0 +1,254 @@
+#include "feed.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <time.h>
+
+#define FEED_IDLE_WAIT_NS  (10 * 1000 * 1000)
+
+typedef struct {
+    _Atomic size_t seq;
+    eavgChange     ev;
+} feed_cell;
+
+struct eavgSubscription {
+    feed_cell          *cells;
+    size_t              mask;
+    _Alignas(64) _Atomic size_t enqueuePos;
+    _Alignas(64) _Atomic size_t dequeuePos;
+
+    eavgFeedPolicy      policy;
+    size_t              batchMax;
+    eavgChange         *batch;
+    eavgChangeCallback  cb;
+    void               *userData;
+
+    _Atomic eavg_u64    dropped;
+    _Atomic int         sleeping;
+    _Atomic int         stop;
+    pthread_mutex_t     mu;
+    pthread_cond_t      cv;
+    pthread_t           thread;
+};
+
+struct eavgFeed {
+    _Atomic(eavgSubscription*) subs[EAVG_FEED_MAX_SUBSCRIBERS];
+    _Atomic unsigned           users[EAVG_FEED_MAX_SUBSCRIBERS]; /* publishers inside slot i */
+    _Atomic unsigned           active;
+    pthread_mutex_t            mu;                               /* serializes (un)subscribe */
+};
+
+static bool ring_push(eavgSubscription *s, const eavgChange *ev) {
+    size_t pos = atomic_load_explicit(&s->enqueuePos, memory_order_relaxed);
+    for (;;) {
+        feed_cell *c   = &s->cells[pos & s->mask];
+        size_t     seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+        intptr_t   dif = (intptr_t)seq - (intptr_t)pos;
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&s->enqueuePos, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                c->ev = *ev;
+                atomic_store_explicit(&c->seq, pos + 1, memory_order_release);
+                return true;
+            }
+        } else if (dif < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&s->enqueuePos, memory_order_relaxed);
+        }
+    }
+}
+
+static bool ring_pop(eavgSubscription *s, eavgChange *out) {
+    size_t pos = atomic_load_explicit(&s->dequeuePos, memory_order_relaxed);
+    for (;;) {
+        feed_cell *c   = &s->cells[pos & s->mask];
+        size_t     seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+        intptr_t   dif = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&s->dequeuePos, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                *out = c->ev;
+                atomic_store_explicit(&c->seq, pos + s->mask + 1, memory_order_release);
+                return true;
+            }
+        } else if (dif < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&s->dequeuePos, memory_order_relaxed);
+        }
+    }
+}
+
+static bool ring_empty(eavgSubscription *s) {
+    return atomic_load(&s->enqueuePos) == atomic_load(&s->dequeuePos);
+}
+
+/* The consumer flags itself before re-checking the ring, so a producer
+ * that pushed first either sees the flag or the consumer sees the event. */
+static void sub_wake(eavgSubscription *s) {
+    if (!atomic_load(&s->sleeping)) return;
+    pthread_mutex_lock(&s->mu);
+    pthread_cond_signal(&s->cv);
+    pthread_mutex_unlock(&s->mu);
+}
+
+static void *sub_main(void *arg) {
+    eavgSubscription *s = arg;
+    for (;;) {
+        size_t n = 0;
+        while (n < s->batchMax && ring_pop(s, &s->batch[n])) n++;
+        if (n) {
+            s->cb(s->batch, n, s->userData);
+            continue;
+        }
+        if (atomic_load(&s->stop)) break;
+
+        pthread_mutex_lock(&s->mu);
+        atomic_store(&s->sleeping, 1);
+        if (ring_empty(s) && !atomic_load(&s->stop)) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += FEED_IDLE_WAIT_NS;
+            if (ts.tv_nsec >= 1000000000L) { ts.tv_sec++; ts.tv_nsec -= 1000000000L; }
+            pthread_cond_timedwait(&s->cv, &s->mu, &ts);
+        }
+        atomic_store(&s->sleeping, 0);
+        pthread_mutex_unlock(&s->mu);
+    }
+    return NULL;
+}
+
+static void sub_free(eavgSubscription *s) {
+    pthread_mutex_destroy(&s->mu);
+    pthread_cond_destroy(&s->cv);
+    free(s->cells);
+    free(s->batch);
+    free(s);
+}
+
+eavgFeed *change_feed_create(void) {
+    eavgFeed *f = calloc(1, sizeof *f);
+    if (!f) return NULL;
+    for (size_t i = 0; i < EAVG_FEED_MAX_SUBSCRIBERS; i++) {
+        atomic_init(&f->subs[i], NULL);
+        atomic_init(&f->users[i], 0);
+    }
+    atomic_init(&f->active, 0);
+    pthread_mutex_init(&f->mu, NULL);
+    return f;
+}
+
+void change_feed_destroy(eavgFeed *f) {
+    if (!f) return;
+    for (size_t i = 0; i < EAVG_FEED_MAX_SUBSCRIBERS; i++) {
+        eavgSubscription *s = atomic_load(&f->subs[i]);
+        if (s) change_feed_unsubscribe(f, s);
+    }
+    pthread_mutex_destroy(&f->mu);
+    free(f);
+}
+
+bool change_feed_active(const eavgFeed *f) {
+    return f && atomic_load_explicit(&f->active, memory_order_relaxed) != 0;
+}
+
+void change_feed_publish(eavgFeed *f, const eavgChange *events, size_t count) {
+    if (!count || !change_feed_active(f)) return;
+    for (size_t i = 0; i < EAVG_FEED_MAX_SUBSCRIBERS; i++) {
+        atomic_fetch_add(&f->users[i], 1);
+        eavgSubscription *s = atomic_load(&f->subs[i]);
+        if (s) {
+            for (size_t j = 0; j < count; j++) {
+                if (!events[j].kind) continue;
+                while (!ring_push(s, &events[j])) {
+                    if (s->policy == EAVG_FEED_DROP) {
+                        atomic_fetch_add(&s->dropped, 1);
+                        break;
+                    }
+                    sub_wake(s);
+                    sched_yield();
+                }
+            }
+            sub_wake(s);
+        }
+        atomic_fetch_sub(&f->users[i], 1);
+    }
+}
+
+eavgSubscription *change_feed_subscribe(eavgFeed *f, size_t capacity, size_t batchMax,
+                                        eavgFeedPolicy policy,
+                                        eavgChangeCallback cb, void *userData)
+{
+    if (!f || !cb) return NULL;
+    size_t cap = 2;
+    while (cap < (capacity ? capacity : EAVG_FEED_DEFAULT_CAPACITY)) cap *= 2;
+
+    eavgSubscription *s = calloc(1, sizeof *s);
+    if (!s) return NULL;
+    s->cells    = malloc(cap * sizeof *s->cells);
+    s->batchMax = batchMax ? batchMax : EAVG_FEED_DEFAULT_BATCH;
+    s->batch    = malloc(s->batchMax * sizeof *s->batch);
+    if (!s->cells || !s->batch) {
+        free(s->cells);
+        free(s->batch);
+        free(s);
+        return NULL;
+    }
+    for (size_t i = 0; i < cap; i++) atomic_init(&s->cells[i].seq, i);
+    s->mask     = cap - 1;
+    s->policy   = policy;
+    s->cb       = cb;
+    s->userData = userData;
+    atomic_init(&s->enqueuePos, 0);
+    atomic_init(&s->dequeuePos, 0);
+    atomic_init(&s->dropped, 0);
+    atomic_init(&s->sleeping, 0);
+    atomic_init(&s->stop, 0);
+    pthread_mutex_init(&s->mu, NULL);
+    pthread_cond_init(&s->cv, NULL);
+
+    pthread_mutex_lock(&f->mu);
+    size_t slot = 0;
+    while (slot < EAVG_FEED_MAX_SUBSCRIBERS && atomic_load(&f->subs[slot])) slot++;
+    if (slot == EAVG_FEED_MAX_SUBSCRIBERS ||
+        pthread_create(&s->thread, NULL, sub_main, s) != 0) {
+        pthread_mutex_unlock(&f->mu);
+        sub_free(s);
+        return NULL;
+    }
+    atomic_store(&f->subs[slot], s);
+    atomic_fetch_add(&f->active, 1);
+    pthread_mutex_unlock(&f->mu);
+    return s;
+}
+
+int change_feed_unsubscribe(eavgFeed *f, eavgSubscription *s) {
+    size_t slot = 0;
+    pthread_mutex_lock(&f->mu);
+    while (slot < EAVG_FEED_MAX_SUBSCRIBERS && atomic_load(&f->subs[slot]) != s) slot++;
+    if (slot == EAVG_FEED_MAX_SUBSCRIBERS) {
+        pthread_mutex_unlock(&f->mu);
+        return -1;
+    }
+    atomic_store(&f->subs[slot], NULL);
+    atomic_fetch_sub(&f->active, 1);
+    pthread_mutex_unlock(&f->mu);
+
+    /* publishers that loaded s before the slot was cleared still hold it */
+    while (atomic_load(&f->users[slot]) != 0) sched_yield();
+
+    atomic_store(&s->stop, 1);
+    pthread_mutex_lock(&s->mu);
+    pthread_cond_signal(&s->cv);
+    pthread_mutex_unlock(&s->mu);
+    pthread_join(s->thread, NULL);
+    sub_free(s);
+    return 0;
+}
+
+eavg_u64 eavgSubscription_dropped(const eavgSubscription *s) {
+    return atomic_load(&((eavgSubscription*)s)->dropped);
+}
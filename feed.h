@@ -0,0 +1,31 @@
+#ifndef FEED_H
+#define FEED_H
+
+#include "eavg.h"
+
+/* Change feed: every subscription owns a bounded lock-free MPMC ring
+ * (Vyukov) and a consumer thread that hands events to its callback in
+ * batches.  Writers publish after releasing the db lock, so a slow
+ * subscriber only ever delays the writer that hits its full ring, and
+ * only under EAVG_FEED_BLOCK. */
+
+#define EAVG_FEED_MAX_SUBSCRIBERS  16
+#define EAVG_FEED_DEFAULT_CAPACITY 1024
+#define EAVG_FEED_DEFAULT_BATCH    64
+
+typedef struct eavgFeed eavgFeed;
+
+eavgFeed *change_feed_create(void);
+/* Unsubscribes everyone; pending events are still delivered. */
+void      change_feed_destroy(eavgFeed *f);
+
+bool      change_feed_active(const eavgFeed *f);
+/* Events whose kind is 0 are skipped. */
+void      change_feed_publish(eavgFeed *f, const eavgChange *events, size_t count);
+
+eavgSubscription *change_feed_subscribe(eavgFeed *f, size_t capacity, size_t batchMax,
+                                        eavgFeedPolicy policy,
+                                        eavgChangeCallback cb, void *userData);
+int       change_feed_unsubscribe(eavgFeed *f, eavgSubscription *s);
+
+#endif /* FEED_H */
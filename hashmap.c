@@ -1,4 +1,5 @@
 #include "hashmap.h"
+#include "stats.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -30,6 +31,7 @@ u64_map *u64_map_create(size_t initial_capacity) {
     if (!m) return NULL;
     m->capacity = cap;
     m->count    = 0;
+    m->borrowed = false;
     m->keys     = calloc(cap, sizeof *m->keys);
     m->values   = calloc(cap, sizeof *m->values);
     if (!m->keys || !m->values) {
@@ -43,16 +45,48 @@ u64_map *u64_map_create(size_t initial_capacity) {
 
 void u64_map_destroy(u64_map *m) {
     if (!m) return;
-    free(m->keys);
-    free(m->values);
+    if (!m->borrowed) {
+        free(m->keys);
+        free(m->values);
+    }
     free(m);
 }
 
-static int u64_map_grow(u64_map *m) {
+u64_map *u64_map_adopt(uint64_t *keys, void **values, size_t capacity, size_t count) {
+    u64_map *m = malloc(sizeof *m);
+    if (!m) return NULL;
+    m->capacity = capacity;
+    m->count    = count;
+    m->keys     = keys;
+    m->values   = values;
+    m->borrowed = true;
+    return m;
+}
+
+u64_map *u64_map_copy(const u64_map *m) {
+    u64_map *c = malloc(sizeof *c);
+    if (!c) return NULL;
+    c->capacity = m->capacity;
+    c->count    = m->count;
+    c->borrowed = false;
+    c->keys     = malloc(m->capacity * sizeof *c->keys);
+    c->values   = malloc(m->capacity * sizeof *c->values);
+    if (!c->keys || !c->values) {
+        free(c->keys);
+        free(c->values);
+        free(c);
+        return NULL;
+    }
+    memcpy(c->keys,   m->keys,   m->capacity * sizeof *c->keys);
+    memcpy(c->values, m->values, m->capacity * sizeof *c->values);
+    return c;
+}
+
+static int u64_map_rehash(u64_map *m, size_t newcap) {
     size_t i;
-    size_t newcap     = m->capacity * 2;
+    uint64_t t0 = stats_enabled() ? stats_now() : 0;
     uint64_t *newkeys = calloc(newcap, sizeof *newkeys);
-    void     *newvals = calloc(newcap, sizeof *newvals);
+    void    **newvals = calloc(newcap, sizeof *newvals);
     if (!newkeys || !newvals) {
         free(newkeys);
         free(newvals);
@@ -64,17 +98,33 @@ static int u64_map_grow(u64_map *m) {
             size_t idx = (k * 11400714819323198485ULL) & (newcap - 1);
             while (newkeys[idx]) idx = (idx + 1) & (newcap - 1);
             newkeys[idx]       = k;
-            ((void**)newvals)[idx] = m->values[i];
+            newvals[idx]       = m->values[i];
         }
     }
-    free(m->keys);
-    free(m->values);
+    if (!m->borrowed) {
+        free(m->keys);
+        free(m->values);
+    }
     m->keys     = newkeys;
     m->values   = newvals;
     m->capacity = newcap;
+    m->borrowed = false;
+    if (t0) stats_map_grow(stats_now() - t0);
     return 0;
 }
 
+static int u64_map_grow(u64_map *m) {
+    return u64_map_rehash(m, m->capacity * 2);
+}
+
+/* Makes room for `additional` more keys with at most one rehash. */
+int u64_map_reserve(u64_map *m, size_t additional) {
+    size_t need   = m->count + additional;
+    size_t newcap = m->capacity;
+    while (need * 100 >= newcap * 70) newcap <<= 1;
+    return newcap == m->capacity ? 0 : u64_map_rehash(m, newcap);
+}
+
 int u64_map_put(u64_map *m, uint64_t key, void *value) {
     if (m->count * 100 >= m->capacity * 70) {
         if (u64_map_grow(m) < 0) {
@@ -170,6 +220,7 @@ str_map *str_map_create(size_t initial_capacity) {
     if (!m) return NULL;
     m->capacity = cap;
     m->count    = 0;
+    m->borrowed = false;
     m->keys     = calloc(cap, sizeof *m->keys);
     m->values   = calloc(cap, sizeof *m->values);
     if (!m->keys || !m->values) {
@@ -183,14 +234,46 @@ str_map *str_map_create(size_t initial_capacity) {
 
 void str_map_destroy(str_map *m) {
     if (!m) return;
-    free(m->keys);
-    free(m->values);
+    if (!m->borrowed) {
+        free(m->keys);
+        free(m->values);
+    }
     free(m);
 }
 
-static int str_map_grow(str_map *m) {
+str_map *str_map_adopt(char **keys, void **values, size_t capacity, size_t count) {
+    str_map *m = malloc(sizeof *m);
+    if (!m) return NULL;
+    m->capacity = capacity;
+    m->count    = count;
+    m->keys     = keys;
+    m->values   = values;
+    m->borrowed = true;
+    return m;
+}
+
+str_map *str_map_copy(const str_map *m) {
+    str_map *c = malloc(sizeof *c);
+    if (!c) return NULL;
+    c->capacity = m->capacity;
+    c->count    = m->count;
+    c->borrowed = false;
+    c->keys     = malloc(m->capacity * sizeof *c->keys);
+    c->values   = malloc(m->capacity * sizeof *c->values);
+    if (!c->keys || !c->values) {
+        free(c->keys);
+        free(c->values);
+        free(c);
+        return NULL;
+    }
+    memcpy(c->keys,   m->keys,   m->capacity * sizeof *c->keys);
+    memcpy(c->values, m->values, m->capacity * sizeof *c->values);
+    return c;
+}
+
+static int str_map_rehash(str_map *m, size_t newcap) {
     size_t i;
-    size_t newcap    = m->capacity * 2;
+    uint64_t t0 = stats_enabled() ? stats_now() : 0;
     char   **nkeys   = calloc(newcap, sizeof *nkeys);
     void    **nvals  = calloc(newcap, sizeof *nvals);
     if (!nkeys || !nvals) {
@@ -213,14 +296,29 @@ static int str_map_grow(str_map *m) {
             nvals[idx] = m->values[i];
         }
     }
-    free(m->keys);
-    free(m->values);
+    if (!m->borrowed) {
+        free(m->keys);
+        free(m->values);
+    }
     m->keys     = nkeys;
     m->values   = nvals;
     m->capacity = newcap;
+    m->borrowed = false;
+    if (t0) stats_map_grow(stats_now() - t0);
     return 0;
 }
 
+static int str_map_grow(str_map *m) {
+    return str_map_rehash(m, m->capacity * 2);
+}
+
+int str_map_reserve(str_map *m, size_t additional) {
+    size_t need   = m->count + additional;
+    size_t newcap = m->capacity;
+    while (need * 100 >= newcap * 70) newcap <<= 1;
+    return newcap == m->capacity ? 0 : str_map_rehash(m, newcap);
+}
+
 int str_map_put(str_map *m, const char *key, void *value) {
     if (m->count * 100 >= m->capacity * 70) {
         if (str_map_grow(m) < 0) {
@@ -3,12 +3,14 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 typedef struct {
     size_t    capacity;
     size_t    count;
     uint64_t *keys;
     void    **values;
+    bool      borrowed;   /* keys/values are not ours to free */
 } u64_map;
 
 typedef struct {
@@ -16,6 +18,7 @@ typedef struct {
     size_t   count;
     char   **keys;
     void    **values;
+    bool     borrowed;
 } str_map;
 
 #ifndef NDEBUG
@@ -32,12 +35,22 @@ void     u64_map_destroy(u64_map *m);
 int      u64_map_put(u64_map *m, uint64_t key, void *value);
 void    *u64_map_get(u64_map *m, uint64_t key);
 int u64_map_remove(u64_map *m, uint64_t key);
+int u64_map_reserve(u64_map *m, size_t additional);
+/* Shallow: keys and values are shared with m. */
+u64_map *u64_map_copy(const u64_map *m);
+/* Wraps a prebuilt table (e.g. in a file mapping) without copying it.
+ * The map writes to it in place but never frees it; the first rehash
+ * moves the map onto the heap. */
+u64_map *u64_map_adopt(uint64_t *keys, void **values, size_t capacity, size_t count);
 
 str_map *str_map_create(size_t initial_capacity);
 void     str_map_destroy(str_map *m);
 int      str_map_put(str_map *m, const char *key, void *value);
 void    *str_map_get(str_map *m, const char *key);
 int str_map_remove(str_map *m, const char *key);
+int str_map_reserve(str_map *m, size_t additional);
+str_map *str_map_copy(const str_map *m);
+str_map *str_map_adopt(char **keys, void **values, size_t capacity, size_t count);
 
 #endif /* HASHMAP_H */
 
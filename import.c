@@ -0,0 +1,581 @@
+#include "eavg.h"
+#include "stats.h"
+#include "pool.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Imports run window by window: each window of the mapped file is cut at
+ * line boundaries into one part per thread; the calling thread and jobs
+ * on an executor (the db's own pool unless the options name one) parse
+ * the parts into rows of NUL-terminated fields and look the entity names up
+ * in a snapshot, without the db lock.  Then, on the calling thread, the
+ * names the snapshot lacked are resolved (once each, however many rows
+ * use them), relation types and attributes are found, and the rows go to
+ * eavgDB_bulkInsert batchRows at a time. */
+#define IMPORT_MAX_THREADS  16
+#define IMPORT_BATCH_ROWS   65536
+#define IMPORT_WINDOW       (16u << 20)    /* bytes per thread and window */
+#define IMPORT_FIELDS       5
+
+/* field numbers: edges, then values */
+enum { F_SRC, F_TGT, F_REL, F_WEIGHT, F_LABEL };
+enum { F_ENTITY, F_ATTRIBUTE, F_VALUE };
+
+static const char *const import_keys[2][IMPORT_FIELDS] = {
+    { "src", "tgt", "rel", "weight", "label" },
+    { "entity", "attribute", "value", NULL, NULL },
+};
+
+typedef struct {
+    char     *field[IMPORT_FIELDS];   /* NULL: empty or absent */
+    eavg_u64  known[2];               /* ids the snapshot had for F_SRC / F_TGT or F_ENTITY */
+} import_row;
+
+struct import_part {
+    const char               *begin, *end;
+    const eavgImportOptions  *opt;
+    eavgSnapshot             *snap;
+    Arena                     arena;
+    import_row               *rows;
+    size_t                    count, cap;
+    size_t                    skipped;
+    bool                      failed;
+    eavgFuture               *job;      /* parts past the first, on the executor */
+};
+
+static double import_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* Word-at-a-time scanning: a byte equal to the pattern's sets the high
+ * bit of its lane.  Lanes above a match may light up too, never below,
+ * so the lowest set bit is always a real match. */
+#define SWAR_ONES   0x0101010101010101ULL
+#define SWAR_HIGHS  0x8080808080808080ULL
+
+static inline uint64_t swar_eq(uint64_t w, uint64_t pattern) {
+    uint64_t x = w ^ pattern;
+    return (x - SWAR_ONES) & ~x & SWAR_HIGHS;
+}
+
+/* First byte in [p, end) equal to a, b or c, or end. */
+static const char *scan3(const char *p, const char *end, char a, char b, char c) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t pa = SWAR_ONES * (unsigned char)a;
+    uint64_t pb = SWAR_ONES * (unsigned char)b;
+    uint64_t pc = SWAR_ONES * (unsigned char)c;
+    for (; end - p >= 8; p += 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        uint64_t m = swar_eq(w, pa) | swar_eq(w, pb) | swar_eq(w, pc);
+        if (m) return p + (__builtin_ctzll(m) >> 3);
+    }
+#endif
+    while (p < end && *p != a && *p != b && *p != c) p++;
+    return p;
+}
+
+static const char *line_end(const char *p, const char *end) {
+    const char *nl = memchr(p, '\n', (size_t)(end - p));
+    return nl ? nl : end;
+}
+
+static char *part_copy(struct import_part *pt, const char *p, size_t n) {
+    char *s = arena_alloc(&pt->arena, n + 1);
+    if (!s) {
+        pt->failed = true;
+        return NULL;
+    }
+    memcpy(s, p, n);
+    s[n] = '\0';
+    return s;
+}
+
+/* One CSV line [p, end).  Quoted fields may hold the delimiter and ""
+ * for a quote, but not a line break. */
+static bool csv_row(struct import_part *pt, const char *p, const char *end, import_row *row) {
+    char delim = pt->opt->delimiter ? pt->opt->delimiter : ',';
+    for (int f = 0;; f++) {
+        const char *q;
+        char       *s = NULL;
+        if (p < end && *p == '"') {
+            size_t quotes = 0;
+            for (q = ++p;; q++) {
+                q = memchr(q, '"', (size_t)(end - q));
+                if (!q) return false;
+                if (q + 1 < end && q[1] == '"') {
+                    quotes++;
+                    q++;
+                    continue;
+                }
+                break;
+            }
+            if (f < IMPORT_FIELDS && q > p) {
+                char *w = s = arena_alloc(&pt->arena, (size_t)(q - p) - quotes + 1);
+                if (!s) {
+                    pt->failed = true;
+                    return false;
+                }
+                for (const char *r = p; r < q; r++) {
+                    *w++ = *r;
+                    if (*r == '"') r++;
+                }
+                *w = '\0';
+            }
+            p = q + 1;
+            if (p < end && *p != delim && *p != '\r') return false;
+        } else {
+            q = scan3(p, end, delim, '\r', '"');
+            if (q < end && *q == '"') return false;
+            if (f < IMPORT_FIELDS && q > p) s = part_copy(pt, p, (size_t)(q - p));
+            p = q;
+        }
+        if (f < IMPORT_FIELDS) row->field[f] = s;
+        if (p >= end || *p == '\r') return true;
+        p++;   /* the delimiter */
+    }
+}
+
+/* A JSON string starting after its opening quote; *p ends past the
+ * closing one.  \u escapes outside the BMP's surrogates become UTF-8. */
+static char *json_string(struct import_part *pt, const char **p, const char *end) {
+    const char *q = *p;
+    size_t      escapes = 0;
+    for (;; q++) {
+        q = scan3(q, end, '"', '\\', '\n');
+        if (q >= end || *q != '\\') break;
+        escapes++;
+        if (++q >= end) return NULL;
+    }
+    if (q >= end || *q != '"') return NULL;
+    if (!escapes) {
+        char *s = part_copy(pt, *p, (size_t)(q - *p));
+        *p = q + 1;
+        return s;
+    }
+    char *s = arena_alloc(&pt->arena, (size_t)(q - *p) + 1), *w = s;
+    if (!s) {
+        pt->failed = true;
+        return NULL;
+    }
+    for (const char *r = *p; r < q; r++) {
+        if (*r != '\\') {
+            *w++ = *r;
+            continue;
+        }
+        switch (*++r) {
+        case 'b': *w++ = '\b'; break;
+        case 'f': *w++ = '\f'; break;
+        case 'n': *w++ = '\n'; break;
+        case 'r': *w++ = '\r'; break;
+        case 't': *w++ = '\t'; break;
+        case 'u': {
+            unsigned cp = 0;
+            for (int k = 0; k < 4; k++) {
+                char h = ++r < q ? *r : 0;
+                cp <<= 4;
+                if (h >= '0' && h <= '9')      cp |= (unsigned)(h - '0');
+                else if (h >= 'a' && h <= 'f') cp |= (unsigned)(h - 'a' + 10);
+                else if (h >= 'A' && h <= 'F') cp |= (unsigned)(h - 'A' + 10);
+                else return NULL;
+            }
+            if (cp < 0x80) {
+                *w++ = (char)cp;
+            } else if (cp < 0x800) {
+                *w++ = (char)(0xc0 | cp >> 6);
+                *w++ = (char)(0x80 | (cp & 0x3f));
+            } else {
+                *w++ = (char)(0xe0 | cp >> 12);
+                *w++ = (char)(0x80 | (cp >> 6 & 0x3f));
+                *w++ = (char)(0x80 | (cp & 0x3f));
+            }
+            break;
+        }
+        default: *w++ = *r; break;   /* \" \\ \/ */
+        }
+    }
+    *w = '\0';
+    *p = q + 1;
+    return s;
+}
+
+static const char *json_space(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    return p;
+}
+
+/* One NDJSON line: a flat object.  Numbers and true/false keep their
+ * text; null leaves the field empty; unknown keys are ignored. */
+static bool json_row(struct import_part *pt, const char *p, const char *end, import_row *row) {
+    const char *const *keys = import_keys[pt->opt->kind];
+    p = json_space(p, end);
+    if (p >= end || *p++ != '{') return false;
+    p = json_space(p, end);
+    if (p < end && *p == '}') return true;
+    for (;;) {
+        if (p >= end || *p++ != '"') return false;
+        char *key = json_string(pt, &p, end);
+        p = json_space(p, end);
+        if (!key || p >= end || *p++ != ':') return false;
+        p = json_space(p, end);
+        if (p >= end) return false;
+
+        char *value = NULL;
+        if (*p == '"') {
+            p++;
+            if (!(value = json_string(pt, &p, end))) return false;
+            if (!*value) value = NULL;
+        } else if (*p == '{' || *p == '[') {
+            return false;
+        } else {
+            const char *q = scan3(p, end, ',', '}', ' ');
+            if (q == p) return false;
+            if (!(q - p == 4 && memcmp(p, "null", 4) == 0))
+                value = part_copy(pt, p, (size_t)(q - p));
+            p = q;
+        }
+        for (int f = 0; f < IMPORT_FIELDS; f++) {
+            if (keys[f] && strcmp(keys[f], key) == 0) row->field[f] = value;
+        }
+        p = json_space(p, end);
+        if (p < end && *p == ',') {
+            p = json_space(p + 1, end);
+            continue;
+        }
+        return p < end && *p == '}';
+    }
+}
+
+static void import_parse(struct import_part *pt) {
+    const char         *p      = pt->begin;
+    bool                ndjson = pt->opt->format == EAVG_IMPORT_NDJSON;
+    while (p < pt->end && !pt->failed) {
+        const char *eol = line_end(p, pt->end);
+        const char *q   = p;
+        while (q < eol && (*q == ' ' || *q == '\t' || *q == '\r')) q++;
+        if (q == eol) {   /* blank line */
+            p = eol + 1;
+            continue;
+        }
+        if (pt->count == pt->cap) {
+            size_t      cap  = pt->cap ? pt->cap * 2 : 1024;
+            import_row *rows = realloc(pt->rows, cap * sizeof *rows);
+            if (!rows) {
+                pt->failed = true;
+                break;
+            }
+            pt->rows = rows;
+            pt->cap  = cap;
+        }
+        import_row *row = &pt->rows[pt->count];
+        memset(row, 0, sizeof *row);
+        bool ok = ndjson ? json_row(pt, p, eol, row) : csv_row(pt, p, eol, row);
+        p = eol + 1;
+        if (!ok || !row->field[0] || !row->field[1]) {
+            pt->skipped++;
+            continue;
+        }
+        /* names the db holds already resolve here, on every thread */
+        for (int k = 0; k < 2; k++) {
+            const char *name = row->field[k];
+            if (k == 1 && pt->opt->kind == EAVG_IMPORT_VALUES) break;
+            eavgEntity *e = eavgSnapshot_findEntityByName(pt->snap, name);
+            row->known[k] = e ? e->id : 0;
+        }
+        pt->count++;
+    }
+}
+
+static int import_parse_job(eavgDB *db, eavgFuture *f, void *arg) {
+    (void)db;
+    (void)f;
+    import_parse(arg);
+    return 0;
+}
+
+/* The calling thread's side: names, types and the batch being filled. */
+struct import_run {
+    eavgDB                   *db;
+    const eavgImportOptions  *opt;
+    eavgImportStats          *stats;
+    eavgSnapshot             *snap;
+    Arena                     names;      /* names of entities the import created */
+    str_map                  *pending;    /* name -> id, or EAVG_BULK_REF into the batch */
+    str_map                  *lookups;    /* relation type or attribute name -> record */
+    eavgBulkEntity           *entities;
+    eavgBulkEdge             *edges;
+    eavgBulkValue            *values;
+    eavg_u64                 *entityIds;
+    size_t                    entityCount, rowCount, batchRows;
+    uint64_t                  timestamp;
+};
+
+static int import_flush(struct import_run *r) {
+    if (!r->rowCount && !r->entityCount) return 0;
+    eavgBulkBatch b = {
+        .entities  = r->entities, .entityCount = r->entityCount,
+        .threads   = r->opt->threads,
+        .entityIds = r->entityIds,
+    };
+    if (r->opt->kind == EAVG_IMPORT_EDGES) {
+        b.edges     = r->edges;
+        b.edgeCount = r->rowCount;
+    } else {
+        b.values     = r->values;
+        b.valueCount = r->rowCount;
+    }
+    double t  = import_now();
+    int    rc = eavgDB_bulkInsert(r->db, &b);
+    r->stats->insertSeconds += import_now() - t;
+    if (rc < 0) return -1;
+    for (size_t i = 0; i < r->entityCount; i++)
+        str_map_put(r->pending, r->entities[i].name, (void*)(uintptr_t)r->entityIds[i]);
+    r->stats->entitiesCreated += r->entityCount;
+    if (r->opt->kind == EAVG_IMPORT_EDGES) r->stats->edges  += r->rowCount;
+    else                                   r->stats->values += r->rowCount;
+    r->entityCount = r->rowCount = 0;
+    return 0;
+}
+
+/* An id, or a reference to an entity this batch creates. */
+static int import_entity(struct import_run *r, const char *name, eavg_u64 known, eavg_u64 *out) {
+    if (known) {
+        *out = known;
+        return 0;
+    }
+    void *v = str_map_get(r->pending, name);
+    if (v) {
+        *out = (eavg_u64)(uintptr_t)v;
+        return 0;
+    }
+    size_t len  = strlen(name);
+    char  *copy = arena_alloc(&r->names, len + 1);
+    if (!copy) return -1;
+    memcpy(copy, name, len + 1);
+    r->entities[r->entityCount] = (eavgBulkEntity){ r->opt->entityType, copy };
+    *out = EAVG_BULK_REF(r->entityCount++);
+    return str_map_put(r->pending, copy, (void*)(uintptr_t)*out);
+}
+
+static const eavgRelationType *import_reltype(struct import_run *r, const char *name) {
+    const eavgRelationType *rt = str_map_get(r->lookups, name);
+    if (rt) return rt;
+    if (!(rt = eavgDB_findRelationTypeByName(r->db, name)) &&
+        !(rt = eavgDB_addRelationType(r->db, name))) return NULL;
+    str_map_put(r->lookups, rt->name, (void*)rt);
+    return rt;
+}
+
+static const eavgAttribute *import_attribute(struct import_run *r, const char *name) {
+    const eavgAttribute *a = str_map_get(r->lookups, name);
+    if (a) return a;
+    if ((a = eavgDB_findAttributeByName(r->db, name))) str_map_put(r->lookups, a->name, (void*)a);
+    return a;
+}
+
+static bool parse_double(const char *s, double *out) {
+    char *end;
+    *out = strtod(s, &end);
+    return end != s && !*end;
+}
+
+/* Returns 1 for a row that goes in, 0 for one that is skipped. */
+static int import_edge(struct import_run *r, const import_row *row) {
+    const char   *const *f = (const char *const *)row->field;
+    eavgBulkEdge *e = &r->edges[r->rowCount];
+    double        weight = 1.0;
+    if (!f[F_REL] || (f[F_WEIGHT] && !parse_double(f[F_WEIGHT], &weight))) return 0;
+    const eavgRelationType *rt = import_reltype(r, f[F_REL]);
+    if (!rt) return -1;
+    *e = (eavgBulkEdge){
+        .relationTypeId = rt->id, .weight = weight, .direction = EAVG_EDGE_DIR_OUT,
+        .label = f[F_LABEL], .timestamp = r->timestamp,
+    };
+    if (import_entity(r, f[F_SRC], row->known[0], &e->src) < 0 ||
+        import_entity(r, f[F_TGT], row->known[1], &e->tgt) < 0) return -1;
+    return 1;
+}
+
+static int import_value(struct import_run *r, const import_row *row) {
+    const char *const   *f  = (const char *const *)row->field;
+    const eavgAttribute *at = import_attribute(r, f[F_ATTRIBUTE]);
+    const char          *s  = f[F_VALUE];
+    eavgBulkValue       *v  = &r->values[r->rowCount];
+    char                *end;
+    if (!at || (!s && at->dataType != EAVG_DATA_TYPE_STRING)) return 0;
+    *v = (eavgBulkValue){ .attributeId = at->id };
+    switch (at->dataType) {
+    case EAVG_DATA_TYPE_INT:
+        v->data.intValue = strtol(s, &end, 10);
+        if (end == s || *end) return 0;
+        break;
+    case EAVG_DATA_TYPE_DOUBLE:
+        if (!parse_double(s, &v->data.doubleValue)) return 0;
+        break;
+    case EAVG_DATA_TYPE_STRING:
+        v->data.stringValue = (char*)s;
+        break;
+    case EAVG_DATA_TYPE_BINARY:
+        v->data.binaryValue = (unsigned char*)s;
+        v->length           = strlen(s);
+        break;
+    case EAVG_DATA_TYPE_ENTITY: {
+        eavgEntity *known = eavgSnapshot_findEntityByName(r->snap, s);
+        if (import_entity(r, s, known ? known->id : 0, &v->data.entityRef) < 0) return -1;
+        break;
+    }
+    default:
+        return 0;
+    }
+    return import_entity(r, f[F_ENTITY], row->known[0], &v->entityId) < 0 ? -1 : 1;
+}
+
+static int import_rows(struct import_run *r, const struct import_part *pt) {
+    for (size_t i = 0; i < pt->count; i++) {
+        /* a row adds at most two entities */
+        if (r->rowCount == r->batchRows && import_flush(r) < 0) return -1;
+        int rc = r->opt->kind == EAVG_IMPORT_EDGES ? import_edge(r, &pt->rows[i])
+                                                   : import_value(r, &pt->rows[i]);
+        if (rc < 0) return -1;
+        if (rc) r->rowCount++;
+        else    r->stats->skipped++;
+    }
+    return 0;
+}
+
+/* Cuts [p, end) into n parts, each ending after a newline. */
+static void import_split(const char *p, const char *end, struct import_part *parts, unsigned n) {
+    for (unsigned t = 0; t < n; t++) {
+        const char *stop = t + 1 == n ? end : p + (size_t)(end - p) / (n - t);
+        if (stop < end) stop = line_end(stop, end);
+        if (stop < end) stop++;
+        parts[t].begin = p;
+        parts[t].end   = stop;
+        p = stop;
+    }
+}
+
+int eavgDB_import(eavgDB *db, const char *filename, const eavgImportOptions *opt,
+                  eavgImportStats *stats)
+{
+    STATS_OP(EAVG_OP_IMPORT);
+    static const eavgImportOptions defaults = { 0 };
+    eavgImportStats ignored;
+    if (!opt)   opt   = &defaults;
+    if (!stats) stats = &ignored;
+    memset(stats, 0, sizeof *stats);
+    double start = import_now();
+
+    unsigned threads = opt->threads;
+    if (!threads) {
+        long n  = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = n > 0 ? (unsigned)n : 1;
+    }
+    if (threads > IMPORT_MAX_THREADS) threads = IMPORT_MAX_THREADS;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    void       *map = NULL;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size > 0) {
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) map = NULL;
+    }
+    close(fd);
+    if (!map) return st.st_size == 0 ? 0 : -1;
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+    stats->bytes = (size_t)st.st_size;
+
+    struct import_run r = {
+        .db = db, .opt = opt, .stats = stats,
+        .batchRows = opt->batchRows ? opt->batchRows : IMPORT_BATCH_ROWS,
+        .timestamp = (uint64_t)time(NULL) * 1000,
+    };
+    struct import_part parts[IMPORT_MAX_THREADS];
+    memset(parts, 0, sizeof parts);
+    arena_init(&r.names, 1 << 16);
+    r.pending   = str_map_create(1024);
+    r.lookups   = str_map_create(16);
+    r.entities  = malloc(2 * r.batchRows * sizeof *r.entities);
+    r.entityIds = malloc(2 * r.batchRows * sizeof *r.entityIds);
+    if (opt->kind == EAVG_IMPORT_EDGES) r.edges  = malloc(r.batchRows * sizeof *r.edges);
+    else                                r.values = malloc(r.batchRows * sizeof *r.values);
+    int rc = r.pending && r.lookups && r.entities && r.entityIds && (r.edges || r.values) ? 0 : -1;
+
+    const char *p = map, *end = p + st.st_size;
+    if (rc == 0 && opt->format == EAVG_IMPORT_CSV && opt->header) {
+        p = line_end(p, end);
+        if (p < end) p++;
+    }
+    while (rc == 0 && p < end) {
+        /* one window, parsed on every thread against a fresh snapshot */
+        const char *stop = (size_t)(end - p) > (size_t)IMPORT_WINDOW * threads
+                         ? line_end(p + (size_t)IMPORT_WINDOW * threads, end) : end;
+        if (stop < end) stop++;
+        double t = import_now();
+        if (!(r.snap = eavgDB_snapshotBegin(db))) {
+            rc = -1;
+            break;
+        }
+        import_split(p, stop, parts, threads);
+        for (unsigned i = 0; i < threads; i++) {
+            parts[i].opt   = opt;
+            parts[i].snap  = r.snap;
+            parts[i].count = parts[i].skipped = 0;
+            parts[i].failed = false;
+            parts[i].job    = NULL;
+            arena_init(&parts[i].arena, 1 << 20);
+        }
+        /* a part the executor has not started yet is cancelled and parsed
+         * here instead, so the import never waits on a busy executor */
+        eavgExecutor *ex = threads > 1 ? (opt->executor ? opt->executor : db_pool(db)) : NULL;
+        for (unsigned i = 1; ex && i < threads; i++)
+            parts[i].job = eavgExecutor_submit(ex, import_parse_job, &parts[i], NULL, NULL);
+        import_parse(&parts[0]);
+        for (unsigned i = 1; i < threads; i++) {
+            if (!parts[i].job || eavgFuture_cancel(parts[i].job))
+                import_parse(&parts[i]);
+            else
+                eavgFuture_wait(parts[i].job, -1);
+            eavgFuture_release(parts[i].job);
+        }
+        double parsed = import_now();
+        stats->parseSeconds += parsed - t;
+
+        /* rows go in file order; resolving and inserting alternate */
+        double inserting = stats->insertSeconds;
+        for (unsigned i = 0; i < threads; i++) {
+            stats->rows    += parts[i].count + parts[i].skipped;
+            stats->skipped += parts[i].skipped;
+            if (parts[i].failed || (rc == 0 && import_rows(&r, &parts[i]) < 0)) rc = -1;
+        }
+        if (rc == 0) rc = import_flush(&r);
+        eavgDB_snapshotEnd(r.snap);
+        for (unsigned i = 0; i < threads; i++) arena_destroy(&parts[i].arena);
+        stats->resolveSeconds += import_now() - parsed - (stats->insertSeconds - inserting);
+        p = stop;
+    }
+
+    for (unsigned i = 0; i < threads; i++) free(parts[i].rows);
+    arena_destroy(&r.names);
+    str_map_destroy(r.pending);
+    str_map_destroy(r.lookups);
+    free(r.entities);
+    free(r.entityIds);
+    free(r.edges);
+    free(r.values);
+    munmap(map, (size_t)st.st_size);
+    stats->totalSeconds = import_now() - start;
+    return rc;
+}
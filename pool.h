@@ -0,0 +1,12 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "eavg.h"
+
+/* The db's own workers (db->walkPool), for the parallel work in db.c and
+ * import.c that is not handed an executor: one thread per online CPU,
+ * started on first use; a racing first user that loses keeps the
+ * winner's.  NULL when the pool cannot be started. */
+eavgExecutor *db_pool(eavgDB *db);
+
+#endif /* POOL_H */
@@ -0,0 +1,870 @@
+#include "eavg.h"
+#include "stats.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+/* A query is parsed once into a path of nodes and the edges between
+ * them.  Each run pins a snapshot and, under the same read lock, resolves
+ * names and sizes up every node's start set from the indexes; the node
+ * expected to match fewest entities becomes the start, and the steps walk
+ * outwards from it, rightwards to the end of the path, then leftwards to
+ * its beginning.  Partial matches travel between steps QUERY_BATCH rows
+ * at a time: a step fills its output buffer from its input and hands it
+ * on whenever it is full, so matches reach the callback while most of
+ * the start set is still unvisited, and a LIMIT ends the walk early. */
+
+#define QUERY_MAX_NODES   16
+#define QUERY_MAX_PREDS   16      /* per node or edge */
+#define QUERY_BATCH       256     /* rows handed from step to step */
+#define QUERY_ARENA       1024
+
+/* Guesses at the share of an attribute's entities a predicate keeps;
+ * without a value index there is nothing better to ask. */
+#define QUERY_SEL_EQ      0.1
+#define QUERY_SEL_NE      0.9
+#define QUERY_SEL_RANGE   0.3
+
+enum { OP_EQ, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE };
+enum { LIT_INT, LIT_DOUBLE, LIT_STRING };
+enum { KEY_ATTR, KEY_NAME, KEY_WEIGHT, KEY_LABEL };
+enum { SRC_NAME, SRC_INDEX, SRC_SCAN };
+
+typedef struct {
+    int          key;       /* KEY_* */
+    const char  *attr;      /* KEY_ATTR */
+    int          op;        /* OP_* */
+    int          lit;       /* LIT_* */
+    long         i;
+    double       d;         /* set for LIT_INT too */
+    const char  *s;
+    size_t       idx;       /* into q_exec.bound */
+} q_pred;
+
+typedef struct {
+    const char  *var;       /* NULL: anonymous */
+    size_t       slot;      /* column of the match row holding its entity */
+    bool         typed;
+    eavg_u32     typeId;
+    q_pred      *preds;
+    size_t       npreds;
+} q_node;
+
+typedef struct {
+    const char  *rel;       /* NULL: any relation type */
+    eavgEdgeDir  dir;       /* OUT: from node i to node i + 1 */
+    q_pred      *preds;
+    size_t       npreds;
+} q_edge;
+
+typedef struct {
+    const char  *name;
+    size_t       slot;
+    const char  *attr;      /* NULL: the entity itself */
+    size_t       idx;       /* attr: into q_exec.bound */
+} q_column;
+
+struct eavgQuery {
+    eavgDB    *db;
+    Arena      arena;       /* everything the parse allocates */
+    q_node     nodes[QUERY_MAX_NODES];
+    q_edge     edges[QUERY_MAX_NODES - 1];
+    size_t     nnodes;
+    size_t     slots;       /* distinct variables, anonymous nodes included */
+    q_column  *cols;
+    size_t     ncols;
+    size_t     nbound;      /* attribute and label names to resolve per run */
+    size_t     limit;       /* 0: none */
+};
+
+/* ---- parsing ---- */
+
+typedef struct {
+    eavgQuery   *q;
+    const char  *src, *p;
+    char        *err;
+    size_t       errLen;
+    bool         failed;
+} q_parser;
+
+static bool q_fail(q_parser *P, const char *fmt, ...) {
+    if (P->failed) return false;
+    P->failed = true;
+    if (P->err && P->errLen) {
+        char    msg[128];
+        va_list ap;
+        va_start(ap, fmt);
+        vsnprintf(msg, sizeof msg, fmt, ap);
+        va_end(ap);
+        snprintf(P->err, P->errLen, "%s at offset %zu", msg, (size_t)(P->p - P->src));
+    }
+    return false;
+}
+
+static void q_skip(q_parser *P) {
+    while (*P->p == ' ' || *P->p == '\t' || *P->p == '\n' || *P->p == '\r') P->p++;
+}
+
+static bool q_accept(q_parser *P, const char *tok) {
+    q_skip(P);
+    size_t n = strlen(tok);
+    if (strncmp(P->p, tok, n) != 0) return false;
+    P->p += n;
+    return true;
+}
+
+static bool q_expect(q_parser *P, const char *tok) {
+    return q_accept(P, tok) || q_fail(P, "expected '%s'", tok);
+}
+
+static bool q_ident_char(char c, bool first) {
+    return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (!first && c >= '0' && c <= '9');
+}
+
+static bool q_keyword(q_parser *P, const char *kw) {
+    q_skip(P);
+    size_t n = strlen(kw);
+    if (strncasecmp(P->p, kw, n) != 0 || q_ident_char(P->p[n], false)) return false;
+    P->p += n;
+    return true;
+}
+
+static char *q_strndup(q_parser *P, const char *s, size_t n) {
+    char *copy = arena_alloc(&P->q->arena, n + 1);
+    if (!copy) {
+        q_fail(P, "out of memory");
+        return NULL;
+    }
+    memcpy(copy, s, n);
+    copy[n] = '\0';
+    return copy;
+}
+
+/* A plain identifier or a `backquoted` name; NULL when there is neither. */
+static const char *q_ident(q_parser *P) {
+    q_skip(P);
+    const char *b = P->p;
+    if (*b == '`') {
+        const char *e = strchr(b + 1, '`');
+        if (!e) {
+            q_fail(P, "unterminated `");
+            return NULL;
+        }
+        P->p = e + 1;
+        return q_strndup(P, b + 1, (size_t)(e - b - 1));
+    }
+    if (!q_ident_char(*b, true)) return NULL;
+    while (q_ident_char(*P->p, false)) P->p++;
+    return q_strndup(P, b, (size_t)(P->p - b));
+}
+
+static bool q_literal(q_parser *P, q_pred *pr) {
+    q_skip(P);
+    char quote = *P->p;
+    if (quote == '"' || quote == '\'') {
+        const char *b = ++P->p;
+        size_t      n = 0;
+        for (; *P->p && *P->p != quote; P->p++, n++)
+            if (*P->p == '\\' && P->p[1]) P->p++;
+        if (*P->p != quote) return q_fail(P, "unterminated string");
+        char *s = arena_alloc(&P->q->arena, n + 1);
+        if (!s) return q_fail(P, "out of memory");
+        for (size_t k = 0; b < P->p; b++) {
+            if (*b == '\\') b++;
+            s[k++] = *b;
+        }
+        s[n] = '\0';
+        P->p++;
+        pr->lit = LIT_STRING;
+        pr->s   = s;
+        return true;
+    }
+    char *dEnd, *iEnd;
+    double d = strtod(P->p, &dEnd);
+    long   i = strtol(P->p, &iEnd, 10);
+    if (dEnd == P->p) return q_fail(P, "expected a literal");
+    pr->lit = iEnd == dEnd ? LIT_INT : LIT_DOUBLE;
+    pr->i   = i;
+    pr->d   = d;
+    P->p    = dEnd;
+    return true;
+}
+
+static bool q_op(q_parser *P, int *op) {
+    static const struct { const char *tok; int op; } ops[] = {
+        { "!=", OP_NE }, { "<=", OP_LE }, { ">=", OP_GE },
+        { "=", OP_EQ }, { "<", OP_LT }, { ">", OP_GT },
+    };
+    for (size_t k = 0; k < sizeof ops / sizeof *ops; k++)
+        if (q_accept(P, ops[k].tok)) {
+            *op = ops[k].op;
+            return true;
+        }
+    return q_fail(P, "expected a comparison");
+}
+
+/* {key op literal, ...}, if there is one. */
+static bool q_preds(q_parser *P, bool edge, q_pred **out, size_t *count) {
+    *out   = NULL;
+    *count = 0;
+    if (!q_accept(P, "{")) return true;
+    q_pred tmp[QUERY_MAX_PREDS];
+    size_t n = 0;
+    do {
+        if (n == QUERY_MAX_PREDS) return q_fail(P, "more than %d predicates", QUERY_MAX_PREDS);
+        q_pred *pr = memset(&tmp[n], 0, sizeof tmp[n]);
+        const char *key = q_ident(P);
+        if (!key) return q_fail(P, "expected a key");
+        if (!q_op(P, &pr->op) || !q_literal(P, pr)) return false;
+        bool text = pr->lit == LIT_STRING;
+        if (!edge && strcmp(key, "name") == 0) {
+            pr->key = KEY_NAME;
+            if (!text) return q_fail(P, "name takes a string");
+        } else if (!edge) {
+            pr->key  = KEY_ATTR;
+            pr->attr = key;
+            pr->idx  = P->q->nbound++;
+        } else if (strcmp(key, "weight") == 0) {
+            pr->key = KEY_WEIGHT;
+            if (text) return q_fail(P, "weight takes a number");
+        } else if (strcmp(key, "label") == 0) {
+            pr->key = KEY_LABEL;
+            pr->idx = P->q->nbound++;
+            if (!text) return q_fail(P, "label takes a string");
+        } else {
+            return q_fail(P, "edges have only weight and label");
+        }
+        n++;
+    } while (q_accept(P, ","));
+    if (!q_expect(P, "}")) return false;
+    if (!(*out = arena_alloc(&P->q->arena, n * sizeof **out))) return q_fail(P, "out of memory");
+    memcpy(*out, tmp, n * sizeof **out);
+    *count = n;
+    return true;
+}
+
+static size_t q_slot(eavgQuery *q, const char *var) {
+    for (size_t i = 0; var && i < q->nnodes; i++)
+        if (q->nodes[i].var && strcmp(q->nodes[i].var, var) == 0) return q->nodes[i].slot;
+    return q->slots++;
+}
+
+/* ([var][:typeId][{preds}]) */
+static bool q_node_parse(q_parser *P) {
+    eavgQuery *q = P->q;
+    if (q->nnodes == QUERY_MAX_NODES) return q_fail(P, "more than %d nodes", QUERY_MAX_NODES);
+    if (!q_expect(P, "(")) return false;
+    q_node *n = &q->nodes[q->nnodes];
+    n->var  = q_ident(P);
+    if (P->failed) return false;
+    n->slot = q_slot(q, n->var);
+    if (q_accept(P, ":")) {
+        q_skip(P);
+        char *end;
+        unsigned long t = strtoul(P->p, &end, 10);
+        if (end == P->p || t > UINT32_MAX) return q_fail(P, "expected a type id");
+        P->p      = end;
+        n->typed  = true;
+        n->typeId = (eavg_u32)t;
+    }
+    if (!q_preds(P, false, &n->preds, &n->npreds) || !q_expect(P, ")")) return false;
+    q->nnodes++;
+    return true;
+}
+
+/* -[rel{preds}]->, <-[rel{preds}]- or -[rel{preds}]-; returns false with
+ * P->failed unset when the path ends instead. */
+static bool q_edge_parse(q_parser *P) {
+    q_edge *e    = &P->q->edges[P->q->nnodes - 1];
+    bool    left = q_accept(P, "<-");
+    if (!left && !q_accept(P, "-")) return false;
+    if (q_accept(P, "[")) {
+        q_accept(P, ":");
+        e->rel = q_ident(P);
+        if (P->failed || !q_preds(P, true, &e->preds, &e->npreds) || !q_expect(P, "]"))
+            return false;
+    }
+    if (left)                  e->dir = EAVG_EDGE_DIR_IN;
+    else if (q_accept(P, "->")) e->dir = EAVG_EDGE_DIR_OUT;
+    else                        e->dir = EAVG_EDGE_DIR_BOTH;
+    if ((left || e->dir == EAVG_EDGE_DIR_BOTH) && !q_expect(P, "-")) return false;
+    return true;
+}
+
+/* RETURN var[.attr], ... */
+static bool q_columns(q_parser *P) {
+    eavgQuery *q = P->q;
+    q_column   tmp[QUERY_MAX_NODES * 2];
+    size_t     n = 0;
+    do {
+        if (n == sizeof tmp / sizeof *tmp) return q_fail(P, "too many columns");
+        q_column   *c   = memset(&tmp[n], 0, sizeof tmp[n]);
+        const char *var = q_ident(P);
+        size_t      i   = 0;
+        while (var && i < q->nnodes && !(q->nodes[i].var && strcmp(q->nodes[i].var, var) == 0)) i++;
+        if (!var || i == q->nnodes) return q_fail(P, "expected a variable of the pattern");
+        c->slot = q->nodes[i].slot;
+        c->name = var;
+        if (q_accept(P, ".")) {
+            if (!(c->attr = q_ident(P))) return q_fail(P, "expected an attribute");
+            size_t len  = strlen(var) + strlen(c->attr) + 2;
+            char  *name = arena_alloc(&q->arena, len);
+            if (!name) return q_fail(P, "out of memory");
+            snprintf(name, len, "%s.%s", var, c->attr);
+            c->name = name;
+            c->idx  = q->nbound++;
+        }
+        n++;
+    } while (q_accept(P, ","));
+    if (!(q->cols = arena_alloc(&q->arena, n * sizeof *q->cols))) return q_fail(P, "out of memory");
+    memcpy(q->cols, tmp, n * sizeof *q->cols);
+    q->ncols = n;
+    return true;
+}
+
+/* Every named variable once, in order of appearance. */
+static bool q_default_columns(q_parser *P) {
+    eavgQuery *q = P->q;
+    if (!(q->cols = arena_alloc(&q->arena, q->nnodes * sizeof *q->cols)))
+        return q_fail(P, "out of memory");
+    for (size_t i = 0; i < q->nnodes; i++) {
+        const q_node *n = &q->nodes[i];
+        bool          seen = false;
+        for (size_t c = 0; c < q->ncols; c++) seen |= q->cols[c].slot == n->slot;
+        if (n->var && !seen) q->cols[q->ncols++] = (q_column){ .name = n->var, .slot = n->slot };
+    }
+    return true;
+}
+
+static bool q_parse(q_parser *P) {
+    if (!q_node_parse(P)) return false;
+    while (q_edge_parse(P))
+        if (!q_node_parse(P)) return false;
+    if (P->failed) return false;
+    if (q_keyword(P, "RETURN") ? !q_columns(P) : !q_default_columns(P)) return false;
+    if (q_keyword(P, "LIMIT")) {
+        q_skip(P);
+        char *end;
+        unsigned long long n = strtoull(P->p, &end, 10);
+        if (end == P->p || n == 0) return q_fail(P, "expected a positive limit");
+        P->q->limit = (size_t)n;
+        P->p = end;
+    }
+    q_skip(P);
+    return *P->p == '\0' || q_fail(P, "unexpected '%c'", *P->p);
+}
+
+eavgQuery *eavgQuery_compile(eavgDB *db, const char *pattern, char *err, size_t errLen) {
+    eavgQuery *q = calloc(1, sizeof *q);
+    if (!q) return NULL;
+    q->db = db;
+    arena_init(&q->arena, QUERY_ARENA);
+    q_parser P = { q, pattern, pattern, err, errLen, false };
+    if (!q_parse(&P)) {
+        eavgQuery_free(q);
+        return NULL;
+    }
+    return q;
+}
+
+void eavgQuery_free(eavgQuery *q) {
+    if (!q) return;
+    arena_destroy(&q->arena);
+    free(q);
+}
+
+size_t eavgQuery_columnCount(const eavgQuery *q) {
+    return q->ncols;
+}
+
+const char *eavgQuery_columnName(const eavgQuery *q, size_t column) {
+    return column < q->ncols ? q->cols[column].name : NULL;
+}
+
+/* ---- planning ---- */
+
+typedef struct {
+    eavg_u64    id;         /* attribute; 0: the db has none by that name */
+    eavg_u32    dataType;
+    eavgSymbol  sym;        /* label predicates */
+} q_bound;
+
+typedef struct {
+    size_t       from, to;  /* node positions */
+    eavgEdgeDir  dir;       /* lists of `from` to read: OUT its out-edges */
+    eavg_u64     rel;       /* 0: any */
+    const q_edge *edge;
+    bool         join;      /* to's variable is bound already: compare */
+} q_step;
+
+enum { Q_RUNNING, Q_STOPPED, Q_DONE, Q_FAILED };
+
+typedef struct {
+    eavgQuery          *q;
+    eavgSnapshot       *snap;
+    int                 state;
+    bool                empty;      /* some lookup came up empty: nothing matches */
+    q_bound            *bound;
+    eavg_u64            rels[QUERY_MAX_NODES - 1];
+
+    int                 source[QUERY_MAX_NODES];
+    double              est[QUERY_MAX_NODES];      /* matches expected */
+    uint64_t            visit[QUERY_MAX_NODES];    /* entities looked at to find them */
+    eavg_u64            named[QUERY_MAX_NODES];    /* SRC_NAME: the entity, 0 for none */
+    size_t              start;
+    id_bitmap          *cands;                     /* SRC_INDEX start set */
+    q_step              steps[QUERY_MAX_NODES - 1];
+    size_t              nsteps;
+
+    eavg_u64           *buf[QUERY_MAX_NODES];      /* output rows of each stage */
+    size_t              fill[QUERY_MAX_NODES];
+    eavgQueryCell      *cells;
+    size_t              emitted;
+    eavgQueryCallback   cb;
+    void               *userData;
+} q_exec;
+
+static bool q_types_fit(const q_pred *p, eavg_u32 dataType) {
+    switch (dataType) {
+    case EAVG_DATA_TYPE_INT:
+    case EAVG_DATA_TYPE_DOUBLE: return p->lit != LIT_STRING;
+    case EAVG_DATA_TYPE_STRING: return p->lit == LIT_STRING;
+    case EAVG_DATA_TYPE_ENTITY: return p->lit == LIT_INT;
+    default:                    return false;
+    }
+}
+
+static void q_bind_attr(q_exec *x, eavgDB *db, const char *name, size_t idx) {
+    eavgAttribute *a = eavgDB_findAttributeByNameNoLock(db, name);
+    if (a) x->bound[idx] = (q_bound){ .id = a->id, .dataType = a->dataType };
+}
+
+/* Resolves the names the query uses. */
+static void q_resolve(q_exec *x, eavgDB *db) {
+    eavgQuery *q = x->q;
+    for (size_t i = 0; i < q->nnodes; i++) {
+        const q_node *n = &q->nodes[i];
+        for (size_t k = 0; k < n->npreds; k++) {
+            const q_pred *p = &n->preds[k];
+            if (p->key != KEY_ATTR) continue;
+            q_bind_attr(x, db, p->attr, p->idx);
+            if (!x->bound[p->idx].id) x->empty = true;
+            else if (!q_types_fit(p, x->bound[p->idx].dataType)) x->state = Q_FAILED;
+        }
+    }
+    for (size_t i = 0; i + 1 < q->nnodes; i++) {
+        const q_edge *e = &q->edges[i];
+        if (e->rel) {
+            eavgRelationType *rt = eavgDB_findRelationTypeByNameNoLock(db, e->rel);
+            if (rt) x->rels[i] = rt->id;
+            else    x->empty   = true;
+        }
+        for (size_t k = 0; k < e->npreds; k++)
+            if (e->preds[k].key == KEY_LABEL)
+                x->bound[e->preds[k].idx].sym = eavgSymbol_find(e->preds[k].s);
+    }
+    for (size_t c = 0; c < q->ncols; c++)
+        if (q->cols[c].attr) q_bind_attr(x, db, q->cols[c].attr, q->cols[c].idx);
+}
+
+static double q_selectivity(int op) {
+    return op == OP_EQ ? QUERY_SEL_EQ : op == OP_NE ? QUERY_SEL_NE : QUERY_SEL_RANGE;
+}
+
+/* The index sets a node's entities must all be in; returns how many, or
+ * -1 when one of them is empty. */
+static int q_sets(q_exec *x, eavgDB *db, size_t node, id_bitmap **sets) {
+    const q_node *n = &x->q->nodes[node];
+    int           count = 0;
+    if (n->typed && !(sets[count++] = eavgDB_entitiesByTypeNoLock(db, n->typeId))) return -1;
+    for (size_t k = 0; k < n->npreds; k++) {
+        const q_pred *p = &n->preds[k];
+        if (p->key == KEY_ATTR &&
+            !(sets[count++] = eavgDB_entitiesByAttributeNoLock(db, x->bound[p->idx].id)))
+            return -1;
+    }
+    return count;
+}
+
+static void q_estimate(q_exec *x, eavgDB *db, size_t node) {
+    const q_node *n = &x->q->nodes[node];
+    double        sel = 1;
+    for (size_t k = 0; k < n->npreds; k++) {
+        const q_pred *p = &n->preds[k];
+        if (p->key == KEY_NAME && p->op == OP_EQ) {
+            eavgEntity *e = eavgDB_findEntityByNameNoLock(db, p->s);
+            x->source[node] = SRC_NAME;
+            x->named[node]  = e ? e->id : 0;
+            x->visit[node]  = e != NULL;
+            x->est[node]    = e != NULL;
+            if (!e) x->empty = true;
+            return;
+        }
+        sel *= q_selectivity(p->op);
+    }
+
+    id_bitmap *sets[QUERY_MAX_PREDS + 1];
+    int        count = q_sets(x, db, node, sets);
+    if (count < 0) {
+        x->empty = true;
+        return;
+    }
+    uint64_t visit = db->entitiesById->count;
+    for (int k = 0; k < count; k++) {
+        uint64_t c = id_bitmap_cardinality(sets[k]);
+        if (c < visit) visit = c;
+    }
+    x->source[node] = count ? SRC_INDEX : SRC_SCAN;
+    x->visit[node]  = visit;
+    x->est[node]    = (double)visit * sel;
+}
+
+/* The start set of an index start: the intersection of its sets. */
+static void q_candidates(q_exec *x, eavgDB *db) {
+    id_bitmap *sets[QUERY_MAX_PREDS + 1];
+    int        count = q_sets(x, db, x->start, sets), first = 0;
+    for (int k = 1; k < count; k++)
+        if (id_bitmap_cardinality(sets[k]) < id_bitmap_cardinality(sets[first])) first = k;
+    x->cands = id_bitmap_copy(sets[first]);
+    for (int k = 0; k < count && x->cands; k++) {
+        if (k == first) continue;
+        id_bitmap *both = id_bitmap_and(x->cands, sets[k]);
+        id_bitmap_destroy(x->cands);
+        x->cands = both;
+    }
+    if (!x->cands) x->state = Q_FAILED;
+}
+
+/* Runs under the read lock that pins x->snap. */
+static void q_plan_pinned(eavgDB *db, void *arg) {
+    q_exec    *x = arg;
+    eavgQuery *q = x->q;
+    q_resolve(x, db);
+    for (size_t i = 0; i < q->nnodes && !x->empty; i++) q_estimate(x, db, i);
+    if (x->empty || x->state == Q_FAILED) return;
+
+    x->start = 0;
+    for (size_t i = 1; i < q->nnodes; i++)
+        if (x->est[i] < x->est[x->start] ||
+            (x->est[i] == x->est[x->start] && x->visit[i] < x->visit[x->start]))
+            x->start = i;
+    if (x->source[x->start] == SRC_INDEX) q_candidates(x, db);
+}
+
+static eavgEdgeDir q_flip(eavgEdgeDir dir) {
+    return dir == EAVG_EDGE_DIR_BOTH ? dir : dir ^ EAVG_EDGE_DIR_BOTH;
+}
+
+/* Orders the steps outwards from the start. */
+static void q_steps(q_exec *x) {
+    eavgQuery *q = x->q;
+    bool       bound[QUERY_MAX_NODES] = { false };
+    bound[q->nodes[x->start].slot] = true;
+    x->nsteps = 0;
+    for (size_t to = x->start + 1; to < q->nnodes; to++) {
+        const q_edge *e = &q->edges[to - 1];
+        x->steps[x->nsteps++] = (q_step){ to - 1, to, e->dir, x->rels[to - 1], e,
+                                          bound[q->nodes[to].slot] };
+        bound[q->nodes[to].slot] = true;
+    }
+    for (size_t to = x->start; to-- > 0; ) {
+        const q_edge *e = &q->edges[to];
+        x->steps[x->nsteps++] = (q_step){ to + 1, to, q_flip(e->dir), x->rels[to], e,
+                                          bound[q->nodes[to].slot] };
+        bound[q->nodes[to].slot] = true;
+    }
+}
+
+static int q_prepare(q_exec *x, eavgQuery *q) {
+    memset(x, 0, sizeof *x);
+    x->q = q;
+    if (q->nbound && !(x->bound = calloc(q->nbound, sizeof *x->bound))) return -1;
+    /* the attribute index only covers the values a lazy db has loaded */
+    for (size_t i = 0; i < q->nnodes; i++) {
+        for (size_t k = 0; k < q->nodes[i].npreds; k++) {
+            if (q->nodes[i].preds[k].key == KEY_ATTR && eavgDB_lazyLoadValues(q->db) < 0) {
+                free(x->bound);
+                return -1;
+            }
+        }
+    }
+    if (!(x->snap = eavgDB_snapshotBeginWith(q->db, q_plan_pinned, x))) {
+        free(x->bound);
+        return -1;
+    }
+    q_steps(x);
+    return 0;
+}
+
+static void q_finish(q_exec *x) {
+    eavgDB_snapshotEnd(x->snap);
+    id_bitmap_destroy(x->cands);
+    for (size_t j = 0; j <= x->nsteps; j++) free(x->buf[j]);
+    free(x->cells);
+    free(x->bound);
+}
+
+/* ---- execution ---- */
+
+static int q_cmp_long(long a, long b)       { return (a > b) - (a < b); }
+static int q_cmp_double(double a, double b) { return (a > b) - (a < b); }
+
+static bool q_holds(int op, int cmp) {
+    switch (op) {
+    case OP_EQ: return cmp == 0;
+    case OP_NE: return cmp != 0;
+    case OP_LT: return cmp < 0;
+    case OP_LE: return cmp <= 0;
+    case OP_GT: return cmp > 0;
+    default:    return cmp >= 0;
+    }
+}
+
+/* A NULL string matches no predicate. */
+static bool q_value_ok(const q_pred *p, eavg_u32 dataType, const eavgValRec *v) {
+    int         cmp;
+    const char *str;
+    switch (dataType) {
+    case EAVG_DATA_TYPE_INT:
+        cmp = p->lit == LIT_INT ? q_cmp_long(v->data.intValue, p->i)
+                                : q_cmp_double((double)v->data.intValue, p->d);
+        break;
+    case EAVG_DATA_TYPE_DOUBLE:
+        cmp = q_cmp_double(v->data.doubleValue, p->d);
+        break;
+    case EAVG_DATA_TYPE_STRING:
+        if (!(str = eavgValRec_getString(v))) return false;
+        cmp = strcmp(str, p->s);
+        break;
+    default:
+        cmp = (v->data.entityRef > (eavg_u64)p->i) - (v->data.entityRef < (eavg_u64)p->i);
+        break;
+    }
+    return q_holds(p->op, cmp);
+}
+
+/* e may be NULL when the caller has not looked the entity up; it is only
+ * looked up for a type or a name, as edges lead to live entities. */
+static bool q_node_ok(q_exec *x, const q_node *n, eavg_u64 id, const eavgEntity *e) {
+    if (n->typed) {
+        if (!e && !(e = eavgSnapshot_findEntityById(x->snap, id))) return false;
+        if (e->typeId != n->typeId) return false;
+    }
+    const eavgValueList *vl = NULL;
+    for (size_t k = 0; k < n->npreds; k++) {
+        const q_pred *p = &n->preds[k];
+        if (p->key == KEY_NAME) {
+            if (!e && !(e = eavgSnapshot_findEntityById(x->snap, id))) return false;
+            if (!e->name || !q_holds(p->op, strcmp(e->name, p->s))) return false;
+            continue;
+        }
+        const q_bound *b = &x->bound[p->idx];
+        if (!vl && !(vl = eavgSnapshot_getValueList(x->snap, id))) return false;
+        size_t i = 0;
+        while (i < vl->count &&
+               !(vl->values[i].attributeId == b->id && q_value_ok(p, b->dataType, &vl->values[i])))
+            i++;
+        if (i == vl->count) return false;
+    }
+    return true;
+}
+
+static bool q_edge_ok(q_exec *x, const q_step *s, const eavgEdgeRec *e) {
+    if (s->rel && e->relationTypeId != s->rel) return false;
+    for (size_t k = 0; k < s->edge->npreds; k++) {
+        const q_pred *p = &s->edge->preds[k];
+        if (p->key == KEY_WEIGHT) {
+            if (!q_holds(p->op, q_cmp_double(e->weight, p->d))) return false;
+        } else if (!e->label) {
+            return false;
+        } else if (p->op == OP_EQ || p->op == OP_NE) {
+            if (eavgEdgeRec_hasLabel(e, p->s, x->bound[p->idx].sym) != (p->op == OP_EQ)) return false;
+        } else if (!q_holds(p->op, strcmp(e->label, p->s))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void q_push(q_exec *x, size_t stage, const eavg_u64 *rows, size_t count);
+
+/* Appends row (NULL: an empty row) with slot set to id to stage's output,
+ * handing the buffer on once it is full. */
+static void q_out(q_exec *x, size_t stage, const eavg_u64 *row, size_t slot, eavg_u64 id) {
+    size_t    slots = x->q->slots;
+    eavg_u64 *dst   = x->buf[stage] + x->fill[stage] * slots;
+    if (row) memcpy(dst, row, slots * sizeof *dst);
+    else     memset(dst, 0, slots * sizeof *dst);
+    dst[slot] = id;
+    if (++x->fill[stage] == QUERY_BATCH) {
+        x->fill[stage] = 0;
+        q_push(x, stage + 1, x->buf[stage], QUERY_BATCH);
+    }
+}
+
+static void q_reach(q_exec *x, size_t stage, const q_step *s, const eavg_u64 *row, eavg_u64 id) {
+    const q_node *to = &x->q->nodes[s->to];
+    if (s->join && row[to->slot] != id) return;
+    if (q_node_ok(x, to, id, NULL)) q_out(x, stage, row, to->slot, id);
+}
+
+static void q_expand(q_exec *x, size_t stage, const eavg_u64 *rows, size_t count) {
+    const q_step *s     = &x->steps[stage - 1];
+    size_t        slots = x->q->slots;
+    size_t        from  = x->q->nodes[s->from].slot;
+    for (size_t r = 0; r < count && x->state == Q_RUNNING; r++) {
+        const eavg_u64 *row = rows + r * slots;
+        if (s->dir & EAVG_EDGE_DIR_OUT) {
+            const eavgAdjList *al = eavgSnapshot_getAdjList(x->snap, row[from]);
+            for (size_t i = 0; al && i < al->count && x->state == Q_RUNNING; i++)
+                if (q_edge_ok(x, s, &al->edges[i]))
+                    q_reach(x, stage, s, row, al->edges[i].targetEntity);
+        }
+        if (s->dir & EAVG_EDGE_DIR_IN) {
+            const eavgAdjList *al = eavgSnapshot_getReverseAdjList(x->snap, row[from]);
+            for (size_t i = 0; al && i < al->count && x->state == Q_RUNNING; i++) {
+                const eavgEdgeRec *e = &al->edges[i];
+                /* either way: the out-edges had this loop already */
+                if (s->dir == EAVG_EDGE_DIR_BOTH && e->sourceEntity == e->targetEntity) continue;
+                if (q_edge_ok(x, s, e)) q_reach(x, stage, s, row, e->sourceEntity);
+            }
+        }
+    }
+}
+
+static void q_emit(q_exec *x, const eavg_u64 *rows, size_t count) {
+    eavgQuery *q = x->q;
+    if (q->limit && count > q->limit - x->emitted) count = q->limit - x->emitted;
+    memset(x->cells, 0, count * q->ncols * sizeof *x->cells);
+    for (size_t r = 0; r < count; r++) {
+        const eavg_u64 *row = rows + r * q->slots;
+        for (size_t c = 0; c < q->ncols; c++) {
+            const q_column *col  = &q->cols[c];
+            eavgQueryCell  *cell = &x->cells[r * q->ncols + c];
+            cell->entityId = row[col->slot];
+            if (!col->attr || !x->bound[col->idx].id) continue;
+            const eavgValueList *vl = eavgSnapshot_getValueList(x->snap, cell->entityId);
+            for (size_t i = 0; vl && i < vl->count; i++)
+                if (vl->values[i].attributeId == x->bound[col->idx].id) {
+                    cell->hasValue = true;
+                    cell->value    = vl->values[i];
+                    break;
+                }
+        }
+    }
+    x->emitted += count;
+    if (x->cb(x->cells, count, x->userData) != 0) x->state = Q_STOPPED;
+    else if (q->limit && x->emitted == q->limit) x->state = Q_DONE;
+}
+
+static void q_push(q_exec *x, size_t stage, const eavg_u64 *rows, size_t count) {
+    if (x->state != Q_RUNNING) return;
+    if (stage > x->nsteps) q_emit(x, rows, count);
+    else                   q_expand(x, stage, rows, count);
+}
+
+static int q_start_id(eavg_u64 id, void *arg) {
+    q_exec       *x = arg;
+    const q_node *n = &x->q->nodes[x->start];
+    if (q_node_ok(x, n, id, NULL)) q_out(x, 0, NULL, n->slot, id);
+    return x->state != Q_RUNNING;
+}
+
+static int q_start_entity(eavgDB *db, eavgEntity *e, void *arg) {
+    (void)db;
+    q_exec       *x = arg;
+    const q_node *n = &x->q->nodes[x->start];
+    if (q_node_ok(x, n, e->id, e)) q_out(x, 0, NULL, n->slot, e->id);
+    return x->state != Q_RUNNING;
+}
+
+static void q_execute(q_exec *x) {
+    eavgQuery *q = x->q;
+    for (size_t j = 0; j <= x->nsteps; j++)
+        if (!(x->buf[j] = malloc(QUERY_BATCH * q->slots * sizeof *x->buf[j]))) goto oom;
+    if (!(x->cells = malloc(QUERY_BATCH * (q->ncols ? q->ncols : 1) * sizeof *x->cells))) goto oom;
+
+    switch (x->source[x->start]) {
+    case SRC_NAME:  q_start_id(x->named[x->start], x);                 break;
+    case SRC_INDEX: id_bitmap_foreach(x->cands, q_start_id, x);         break;
+    default:        eavgSnapshot_forEachEntity(x->snap, q_start_entity, x); break;
+    }
+    /* what is left in the buffers, front to back */
+    for (size_t j = 0; j <= x->nsteps && x->state == Q_RUNNING; j++) {
+        size_t count = x->fill[j];
+        x->fill[j] = 0;
+        if (count) q_push(x, j + 1, x->buf[j], count);
+    }
+    return;
+oom:
+    x->state = Q_FAILED;
+}
+
+int eavgQuery_run(eavgQuery *q, eavgQueryCallback cb, void *userData) {
+    STATS_OP(EAVG_OP_QUERY);
+    q_exec x;
+    if (q_prepare(&x, q) < 0) return -1;
+    x.cb       = cb;
+    x.userData = userData;
+    if (x.state == Q_RUNNING && !x.empty) q_execute(&x);
+    q_finish(&x);
+    return x.state == Q_FAILED ? -1 : x.state == Q_STOPPED ? 1 : 0;
+}
+
+/* ---- explain ---- */
+
+typedef struct {
+    char   *buf;
+    size_t  len;
+    int     total;
+} q_text;
+
+static void q_printf(q_text *t, const char *fmt, ...) {
+    size_t  off = (size_t)t->total < t->len ? (size_t)t->total : t->len;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(t->buf ? t->buf + off : NULL, t->buf ? t->len - off : 0, fmt, ap);
+    va_end(ap);
+    if (n > 0) t->total += n;
+}
+
+static void q_print_node(q_text *t, const eavgQuery *q, size_t node) {
+    if (q->nodes[node].var) q_printf(t, "(%s)", q->nodes[node].var);
+    else                    q_printf(t, "(#%zu)", node);
+}
+
+int eavgQuery_explain(eavgQuery *q, char *buf, size_t len) {
+    q_exec x;
+    if (q_prepare(&x, q) < 0) return -1;
+    q_text t = { buf, len, 0 };
+    if (buf && len) buf[0] = '\0';
+    if (x.state == Q_FAILED) {
+        q_finish(&x);
+        return -1;
+    }
+    if (x.empty) {
+        q_printf(&t, "empty: a name or index lookup found nothing\n");
+    } else {
+        static const char *const how[] = { "name index", "index", "scan" };
+        q_printf(&t, "start ");
+        q_print_node(&t, q, x.start);
+        q_printf(&t, " by %s, %llu visited, ~%.0f expected\n", how[x.source[x.start]],
+                 (unsigned long long)x.visit[x.start], x.est[x.start]);
+        for (size_t j = 0; j < x.nsteps; j++) {
+            const q_step *s   = &x.steps[j];
+            const char   *rel = s->edge->rel ? s->edge->rel : "";
+            q_printf(&t, "expand ");
+            q_print_node(&t, q, s->from);
+            q_printf(&t, s->dir == EAVG_EDGE_DIR_OUT ? "-[%s]->" :
+                         s->dir == EAVG_EDGE_DIR_IN  ? "<-[%s]-" : "-[%s]-", rel);
+            q_print_node(&t, q, s->to);
+            q_printf(&t, s->join ? " join\n" : "\n");
+        }
+        if (q->limit) q_printf(&t, "limit %zu\n", q->limit);
+    }
+    q_finish(&x);
+    return t.total;
+}
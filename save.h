@@ -0,0 +1,20 @@
+#ifndef SAVE_H
+#define SAVE_H
+
+#include "eavg.h"
+
+/* Pinned saves, for the executor.  save_pin pins a snapshot (and takes
+ * the dirty sets over, as a full save to filename would), which fixes
+ * what the file will hold; save_pinned writes it later from any thread,
+ * and save_unpin drops one that will not be written.  Both free p; the
+ * db must outlive it. */
+
+typedef struct eavgPinnedSave eavgPinnedSave;
+
+/* NULL on OOM, or when a lazily loaded chunk cannot be read. */
+eavgPinnedSave *save_pin(eavgDB *db, const char *filename);
+int             save_pinned(eavgPinnedSave *p, const eavgSaveOptions *opt);
+/* p may be NULL. */
+void            save_unpin(eavgPinnedSave *p);
+
+#endif /* SAVE_H */
@@ -0,0 +1,193 @@
+#include "stats.h"
+#include <string.h>
+
+static const char *const opNames[EAVG_OP_COUNT] = {
+    [EAVG_OP_ADD_ENTITY]      = "addEntity",
+    [EAVG_OP_FIND_ENTITY]     = "findEntity",
+    [EAVG_OP_REMOVE_ENTITY]   = "removeEntity",
+    [EAVG_OP_FOR_EACH_ENTITY] = "forEachEntity",
+    [EAVG_OP_ADD_ATTRIBUTE]   = "addAttribute",
+    [EAVG_OP_FIND_ATTRIBUTE]  = "findAttribute",
+    [EAVG_OP_ADD_VALUE]       = "addValue",
+    [EAVG_OP_UPDATE_VALUE]    = "updateValue",
+    [EAVG_OP_REMOVE_VALUE]    = "removeValue",
+    [EAVG_OP_FIND_VALUE]      = "findValue",
+    [EAVG_OP_ADD_RELTYPE]     = "addRelationType",
+    [EAVG_OP_FIND_RELTYPE]    = "findRelationType",
+    [EAVG_OP_REMOVE_RELTYPE]  = "removeRelationType",
+    [EAVG_OP_ADD_EDGE]        = "addEdge",
+    [EAVG_OP_UPDATE_EDGE]     = "updateEdge",
+    [EAVG_OP_REMOVE_EDGE]     = "removeEdge",
+    [EAVG_OP_GET_EDGES]       = "getEdges",
+    [EAVG_OP_FOR_EACH_EDGE]   = "forEachEdge",
+    [EAVG_OP_FIND_BY_TYPE]    = "findEntitiesByType",
+    [EAVG_OP_FIND_BY_VALUE]   = "findEntitiesByValue",
+    [EAVG_OP_EXPAND]          = "expandNeighbors",
+    [EAVG_OP_BULK_INSERT]     = "bulkInsert",
+    [EAVG_OP_TX_COMMIT]       = "txCommit",
+    [EAVG_OP_IMPORT]          = "import",
+    [EAVG_OP_SNAPSHOT]        = "snapshotBegin",
+    [EAVG_OP_SAVE]            = "save",
+    [EAVG_OP_LOAD]            = "load",
+    [EAVG_OP_CHECKPOINT]      = "checkpoint",
+    [EAVG_OP_QUERY]           = "query",
+};
+
+const char *eavgStats_opName(eavgOp op) {
+    return (unsigned)op < EAVG_OP_COUNT ? opNames[op] : NULL;
+}
+
+static uint64_t bucket_high(size_t b) {
+    if (b < 8) return b;
+    unsigned e = (unsigned)(b >> EAVG_HIST_SUB_BITS) + 2;
+    uint64_t sub = (b & 7) | 8;
+    return ((sub + 1) << (e - EAVG_HIST_SUB_BITS)) - 1;
+}
+
+uint64_t eavgHistogram_percentile(const eavgHistogram *h, double p) {
+    if (!h->count) return 0;
+    if (p < 0) p = 0;
+    if (p > 1) p = 1;
+    uint64_t rank = (uint64_t)(p * (double)(h->count - 1)) + 1, seen = 0;
+    for (size_t b = 0; b < EAVG_HIST_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen >= rank) {
+            uint64_t v = bucket_high(b);
+            return v < h->maxNs ? v : h->maxNs;
+        }
+    }
+    return h->maxNs;
+}
+
+#ifndef EAVG_NO_STATS
+
+#define STATS_SHARDS  16
+
+typedef struct {
+    atomic_uint_fast64_t  count;
+    atomic_uint_fast64_t  totalNs;
+    atomic_uint_fast64_t  maxNs;
+    atomic_uint_fast64_t  buckets[EAVG_HIST_BUCKETS];
+} shard_hist;
+
+/* Threads are dealt shards round-robin; past STATS_SHARDS threads share
+ * them, which the atomic adds keep correct. */
+typedef struct {
+    shard_hist            ops[EAVG_OP_COUNT];
+    shard_hist            lockWait[2], lockHold[2];   /* [write] */
+    shard_hist            mapGrow;
+    atomic_uint_fast64_t  arenaBlocks, arenaBytes;
+} __attribute__((aligned(64))) stats_shard;
+
+atomic_bool stats_on;
+_Thread_local stats_hold stats_held[STATS_HELD_MAX];
+_Thread_local unsigned   stats_depth;
+
+static stats_shard           shards[STATS_SHARDS];
+static atomic_uint           nextShard;
+static _Thread_local stats_shard *myShard;
+
+static stats_shard *shard(void) {
+    if (!myShard)
+        myShard = &shards[atomic_fetch_add_explicit(&nextShard, 1, memory_order_relaxed) %
+                          STATS_SHARDS];
+    return myShard;
+}
+
+static size_t bucket_of(uint64_t ns) {
+    if (ns < 8) return (size_t)ns;
+    unsigned e = 63 - (unsigned)__builtin_clzll(ns);
+    if (e >= 40) return EAVG_HIST_BUCKETS - 1;
+    return ((size_t)(e - 2) << EAVG_HIST_SUB_BITS) |
+           (size_t)((ns >> (e - EAVG_HIST_SUB_BITS)) & 7);
+}
+
+static void hist_add(shard_hist *h, uint64_t ns) {
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->totalNs, ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->buckets[bucket_of(ns)], 1, memory_order_relaxed);
+    uint_fast64_t max = atomic_load_explicit(&h->maxNs, memory_order_relaxed);
+    while (ns > max &&
+           !atomic_compare_exchange_weak_explicit(&h->maxNs, &max, ns,
+                                                  memory_order_relaxed, memory_order_relaxed))
+        ;
+}
+
+void stats_record_op(eavgOp op, uint64_t ns)      { hist_add(&shard()->ops[op], ns); }
+void stats_record_lock(bool write, uint64_t ns)   { hist_add(&shard()->lockWait[write], ns); }
+void stats_record_hold(bool write, uint64_t ns)   { hist_add(&shard()->lockHold[write], ns); }
+
+void stats_map_grow(uint64_t ns) {
+    hist_add(&shard()->mapGrow, ns);
+}
+
+void stats_arena_block(size_t bytes) {
+    stats_shard *s = shard();
+    atomic_fetch_add_explicit(&s->arenaBlocks, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s->arenaBytes, bytes, memory_order_relaxed);
+}
+
+bool eavgStats_enable(bool on) {
+    return atomic_exchange(&stats_on, on);
+}
+
+static void hist_sum(eavgHistogram *out, shard_hist *h) {
+    out->count   += atomic_load_explicit(&h->count, memory_order_relaxed);
+    out->totalNs += atomic_load_explicit(&h->totalNs, memory_order_relaxed);
+    uint64_t max = atomic_load_explicit(&h->maxNs, memory_order_relaxed);
+    if (max > out->maxNs) out->maxNs = max;
+    for (size_t b = 0; b < EAVG_HIST_BUCKETS; b++)
+        out->buckets[b] += atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+}
+
+static void hist_clear(shard_hist *h) {
+    atomic_store_explicit(&h->count, 0, memory_order_relaxed);
+    atomic_store_explicit(&h->totalNs, 0, memory_order_relaxed);
+    atomic_store_explicit(&h->maxNs, 0, memory_order_relaxed);
+    for (size_t b = 0; b < EAVG_HIST_BUCKETS; b++)
+        atomic_store_explicit(&h->buckets[b], 0, memory_order_relaxed);
+}
+
+void eavgStats_snapshot(eavgStats *out) {
+    memset(out, 0, sizeof *out);
+    for (size_t i = 0; i < STATS_SHARDS; i++) {
+        stats_shard *s = &shards[i];
+        for (size_t op = 0; op < EAVG_OP_COUNT; op++) hist_sum(&out->ops[op], &s->ops[op]);
+        hist_sum(&out->readLockWait,  &s->lockWait[0]);
+        hist_sum(&out->readLockHold,  &s->lockHold[0]);
+        hist_sum(&out->writeLockWait, &s->lockWait[1]);
+        hist_sum(&out->writeLockHold, &s->lockHold[1]);
+        hist_sum(&out->mapGrow, &s->mapGrow);
+        out->arenaBlocks += atomic_load_explicit(&s->arenaBlocks, memory_order_relaxed);
+        out->arenaBytes  += atomic_load_explicit(&s->arenaBytes, memory_order_relaxed);
+    }
+}
+
+void eavgStats_reset(void) {
+    for (size_t i = 0; i < STATS_SHARDS; i++) {
+        stats_shard *s = &shards[i];
+        for (size_t op = 0; op < EAVG_OP_COUNT; op++) hist_clear(&s->ops[op]);
+        for (int w = 0; w < 2; w++) {
+            hist_clear(&s->lockWait[w]);
+            hist_clear(&s->lockHold[w]);
+        }
+        hist_clear(&s->mapGrow);
+        atomic_store_explicit(&s->arenaBlocks, 0, memory_order_relaxed);
+        atomic_store_explicit(&s->arenaBytes, 0, memory_order_relaxed);
+    }
+}
+
+#else  /* EAVG_NO_STATS */
+
+bool eavgStats_enable(bool on) {
+    (void)on;
+    return false;
+}
+
+void eavgStats_snapshot(eavgStats *out) {
+    memset(out, 0, sizeof *out);
+}
+
+void eavgStats_reset(void) {}
+
+#endif /* EAVG_NO_STATS */
@@ -0,0 +1,117 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "eavg.h"
+
+/* Recording side of the eavgStats_* instrumentation.  STATS_OP times the
+ * rest of the enclosing block as one op; the lock wrappers time the wait
+ * for a lock and, through a per-thread stack of acquire times, how long
+ * it is held.  Disabled at run time each costs a relaxed load (and the
+ * locks a push and pop); with EAVG_NO_STATS they compile to nothing. */
+
+#ifndef EAVG_NO_STATS
+
+#include <stdatomic.h>
+#include <time.h>
+
+extern atomic_bool stats_on;
+
+static inline bool stats_enabled(void) {
+    return atomic_load_explicit(&stats_on, memory_order_relaxed);
+}
+
+static inline uint64_t stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void stats_record_op(eavgOp op, uint64_t ns);
+void stats_record_lock(bool write, uint64_t waitNs);
+void stats_record_hold(bool write, uint64_t holdNs);
+void stats_map_grow(uint64_t ns);
+void stats_arena_block(size_t bytes);
+
+typedef struct {
+    eavgOp    op;
+    uint64_t  t0;   /* 0: not timed */
+} stats_timer;
+
+static inline stats_timer stats_op_begin(eavgOp op) {
+    stats_timer t = { op, stats_enabled() ? stats_now() : 0 };
+    return t;
+}
+
+static inline void stats_op_end(stats_timer *t) {
+    if (t->t0) stats_record_op(t->op, stats_now() - t->t0);
+}
+
+#define STATS_OP(op) \
+    stats_timer stats_op_ __attribute__((cleanup(stats_op_end), unused)) = stats_op_begin(op)
+
+/* Acquire times of the locks this thread holds, by lock, innermost last;
+ * 0 for a lock taken while recording was off.  Read locks may be released
+ * out of order, so an unlock takes the newest entry for its own lock.
+ * Deeper nesting goes untimed. */
+#define STATS_HELD_MAX  (BR_MAX_HELD + 2)
+typedef struct {
+    const br_lock *lock;
+    uint64_t       t;
+} stats_hold;
+extern _Thread_local stats_hold stats_held[STATS_HELD_MAX];
+extern _Thread_local unsigned   stats_depth;
+
+static inline void stats_held_push(const br_lock *l, uint64_t t) {
+    if (stats_depth < STATS_HELD_MAX) stats_held[stats_depth++] = (stats_hold){ l, t };
+}
+
+static inline uint64_t stats_held_pop(const br_lock *l) {
+    for (unsigned i = stats_depth; i-- > 0; ) {
+        if (stats_held[i].lock != l) continue;
+        uint64_t t = stats_held[i].t;
+        for (; i + 1 < stats_depth; i++) stats_held[i] = stats_held[i + 1];
+        stats_depth--;
+        return t;
+    }
+    return 0;
+}
+
+static inline void stats_lock(br_lock *l, bool write) {
+    if (!stats_enabled()) {
+        if (write) br_lock_wr(l); else br_lock_rd(l);
+        stats_held_push(l, 0);
+        return;
+    }
+    uint64_t t0 = stats_now();
+    if (write) br_lock_wr(l); else br_lock_rd(l);
+    uint64_t t1 = stats_now();
+    stats_record_lock(write, t1 - t0);
+    stats_held_push(l, t1);
+}
+
+static inline void stats_unlock(br_lock *l, bool write) {
+    uint64_t t = stats_held_pop(l);
+    if (write) br_unlock_wr(l); else br_unlock_rd(l);
+    if (t && stats_enabled()) stats_record_hold(write, stats_now() - t);
+}
+
+#define stats_lock_rd(l)    stats_lock((l), false)
+#define stats_unlock_rd(l)  stats_unlock((l), false)
+#define stats_lock_wr(l)    stats_lock((l), true)
+#define stats_unlock_wr(l)  stats_unlock((l), true)
+
+#else  /* EAVG_NO_STATS */
+
+#define STATS_OP(op)             ((void)0)
+#define stats_enabled()          false
+#define stats_now()              ((uint64_t)0)
+#define stats_map_grow(ns)       ((void)0)
+#define stats_arena_block(n)     ((void)0)
+#define stats_lock_rd(l)         br_lock_rd(l)
+#define stats_unlock_rd(l)       br_unlock_rd(l)
+#define stats_lock_wr(l)         br_lock_wr(l)
+#define stats_unlock_wr(l)       br_unlock_wr(l)
+
+#endif /* EAVG_NO_STATS */
+
+#endif /* STATS_H */
@@ -0,0 +1,162 @@
+#include "eavg.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Strings live in one arena for the life of the process, so a symbol's
+ * name never moves.  Names are found by id through segments that double
+ * in size and are never reallocated, which lets eavgSymbol_name skip the
+ * lock; the string -> id map sits behind a rwlock, with a small
+ * per-thread cache in front so repeated labels rarely reach it. */
+
+#define SYM_SEG0    256
+#define SYM_SEGS    25      /* SYM_SEG0 * (2^25 - 1) ids cover all of eavg_u32 */
+#define SYM_CACHE   64
+
+static pthread_rwlock_t     symLock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_once_t       symOnce = PTHREAD_ONCE_INIT;
+static str_map             *byName;      /* pool copy -> id */
+static Arena                pool;
+static const char *_Atomic *_Atomic segs[SYM_SEGS];
+static _Atomic eavg_u32     symCount;   /* ids 1..symCount are published */
+static eavg_u32             labelCount; /* symbols eavgSymbol_internLabel added */
+static eavg_u32             labelBudget = EAVG_SYMBOL_LABEL_MAX;
+
+static _Thread_local struct {
+    uint64_t    hash;
+    eavgSymbol  sym;
+} symCache[SYM_CACHE];
+
+static void sym_init(void) {
+    byName = str_map_create(64);
+    arena_init(&pool, 1 << 16);
+}
+
+static void sym_slot(eavg_u32 idx, unsigned *seg, size_t *off) {
+    uint64_t x = (uint64_t)idx / SYM_SEG0 + 1;
+    *seg = 63 - (unsigned)__builtin_clzll(x);
+    *off = idx - (size_t)SYM_SEG0 * (((size_t)1 << *seg) - 1);
+}
+
+const char *eavgSymbol_name(eavgSymbol sym) {
+    if (!sym || sym > atomic_load_explicit(&symCount, memory_order_acquire)) return NULL;
+    unsigned seg;
+    size_t   off;
+    sym_slot(sym - 1, &seg, &off);
+    const char *_Atomic *s = atomic_load_explicit(&segs[seg], memory_order_acquire);
+    return atomic_load_explicit(&s[off], memory_order_relaxed);
+}
+
+size_t eavgSymbol_count(void) {
+    return atomic_load_explicit(&symCount, memory_order_acquire);
+}
+
+static uint64_t sym_hash(const char *s, size_t n) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < n; i++) { h ^= (unsigned char)s[i]; h *= 1099511628211ULL; }
+    return h;
+}
+
+static eavgSymbol cache_get(uint64_t h, const char *s, size_t n) {
+    eavgSymbol sym = symCache[h & (SYM_CACHE - 1)].sym;
+    if (!sym || symCache[h & (SYM_CACHE - 1)].hash != h) return 0;
+    const char *name = eavgSymbol_name(sym);
+    return memcmp(name, s, n) == 0 && name[n] == '\0' ? sym : 0;
+}
+
+static void cache_put(uint64_t h, eavgSymbol sym) {
+    symCache[h & (SYM_CACHE - 1)].hash = h;
+    symCache[h & (SYM_CACHE - 1)].sym  = sym;
+}
+
+/* s is NUL-terminated at n.  Called with symLock held for writing. */
+static eavgSymbol sym_add(const char *s, size_t n) {
+    eavg_u32 idx = atomic_load_explicit(&symCount, memory_order_relaxed);
+    if (idx == UINT32_MAX) return 0;
+    unsigned seg;
+    size_t   off;
+    sym_slot(idx, &seg, &off);
+    const char *_Atomic *slots = atomic_load_explicit(&segs[seg], memory_order_relaxed);
+    if (!slots) {
+        if (!(slots = calloc((size_t)SYM_SEG0 << seg, sizeof *slots))) return 0;
+        atomic_store_explicit(&segs[seg], slots, memory_order_release);
+    }
+    char *copy = arena_alloc(&pool, n + 1);
+    if (!copy) return 0;
+    memcpy(copy, s, n + 1);
+    if (str_map_put(byName, copy, (void*)(uintptr_t)(idx + 1)) < 0) return 0;
+    atomic_store_explicit(&slots[off], copy, memory_order_relaxed);
+    atomic_store_explicit(&symCount, idx + 1, memory_order_release);
+    return idx + 1;
+}
+
+/* s is NUL-terminated at n.  A label is only added while labelCount is
+ * under labelBudget. */
+static eavgSymbol sym_intern(const char *s, size_t n, uint64_t h, bool label) {
+    pthread_once(&symOnce, sym_init);
+    pthread_rwlock_rdlock(&symLock);
+    eavgSymbol sym = byName ? (eavgSymbol)(uintptr_t)str_map_get(byName, s) : 0;
+    pthread_rwlock_unlock(&symLock);
+    if (!sym) {
+        pthread_rwlock_wrlock(&symLock);
+        if (byName && !(sym = (eavgSymbol)(uintptr_t)str_map_get(byName, s)) &&
+            (!label || labelCount < labelBudget) &&
+            (sym = sym_add(s, n)) && label)
+            labelCount++;
+        pthread_rwlock_unlock(&symLock);
+    }
+    if (sym) cache_put(h, sym);
+    return sym;
+}
+
+static eavgSymbol sym_intern_len(const char *s, size_t n, bool label) {
+    if (!s || memchr(s, '\0', n)) return 0;
+    uint64_t   h   = sym_hash(s, n);
+    eavgSymbol sym = cache_get(h, s, n);
+    if (sym) return sym;
+
+    char  buf[256];
+    char *key = n < sizeof buf ? buf : malloc(n + 1);
+    if (!key) return 0;
+    memcpy(key, s, n);
+    key[n] = '\0';
+    sym = sym_intern(key, n, h, label);
+    if (key != buf) free(key);
+    return sym;
+}
+
+eavgSymbol eavgSymbol_internLen(const char *s, size_t n) {
+    return sym_intern_len(s, n, false);
+}
+
+eavgSymbol eavgSymbol_internLabel(const char *s, size_t n) {
+    return sym_intern_len(s, n, true);
+}
+
+void eavgSymbol_setLabelBudget(eavg_u32 max) {
+    pthread_once(&symOnce, sym_init);
+    pthread_rwlock_wrlock(&symLock);
+    labelBudget = max;
+    pthread_rwlock_unlock(&symLock);
+}
+
+eavgSymbol eavgSymbol_intern(const char *s) {
+    if (!s) return 0;
+    size_t     n   = strlen(s);
+    uint64_t   h   = sym_hash(s, n);
+    eavgSymbol sym = cache_get(h, s, n);
+    return sym ? sym : sym_intern(s, n, h, false);
+}
+
+eavgSymbol eavgSymbol_find(const char *s) {
+    if (!s) return 0;
+    size_t     n   = strlen(s);
+    uint64_t   h   = sym_hash(s, n);
+    eavgSymbol sym = cache_get(h, s, n);
+    if (sym) return sym;
+    pthread_once(&symOnce, sym_init);
+    pthread_rwlock_rdlock(&symLock);
+    sym = byName ? (eavgSymbol)(uintptr_t)str_map_get(byName, s) : 0;
+    pthread_rwlock_unlock(&symLock);
+    return sym;
+}
@@ -13,6 +13,19 @@ TEST(test_add_and_find_attribute) {
     ASSERT(byId   == a);
     ASSERT(byName == a);
 
+    /* ids stop where eavgValRec.attributeId does */
+    db->nextAttributeId = EAVG_ATTRIBUTE_ID_MAX;
+    eavgAttribute *last = eavgDB_addAttribute(db, "last", EAVG_DATA_TYPE_INT);
+    ASSERT(last && last->id == EAVG_ATTRIBUTE_ID_MAX);
+    ASSERT(eavgDB_addAttribute(db, "past", EAVG_DATA_TYPE_INT) == NULL);
+    ASSERT(eavgDB_findAttributeByName(db, "past") == NULL);
+    eavgEntity *e = eavgDB_addEntity(db, 1, NULL);
+    eavgValRec *v = eavgDB_addIntValue(db, e->id, last->id, 7);
+    ASSERT(v && v->attributeId == last->id);
+    id_bitmap *has = eavgDB_findEntitiesByValueBitmap(db, last->id, NULL, NULL);
+    ASSERT(has && id_bitmap_cardinality(has) == 1 && id_bitmap_contains(has, e->id));
+    id_bitmap_destroy(has);
+
     eavgDB_destroy(db);
 }
 
@@ -0,0 +1,97 @@
+#include "tests.h"
+#include "../eavg.h"
+#include <string.h>
+
+static bool status_is_active(const eavgValRec *v, void *ud) {
+    (void)ud;
+    return strcmp(eavgValRec_getString(v), "active") == 0;
+}
+
+TEST(test_bitmap_set_algebra) {
+    id_bitmap *evens = id_bitmap_create();
+    id_bitmap *low   = id_bitmap_create();
+    ASSERT(evens && low);
+
+    /* crosses the array -> bitset threshold within one container */
+    for (uint64_t i = 0; i < 20000; i += 2) ASSERT(id_bitmap_add(evens, i) == 0);
+    for (uint64_t i = 0; i < 100; i++)      ASSERT(id_bitmap_add(low, i) == 0);
+    ASSERT(id_bitmap_add(low, (1ULL << 40) + 7) == 0);
+
+    ASSERT(id_bitmap_cardinality(evens) == 10000);
+    ASSERT(id_bitmap_contains(evens, 19998));
+    ASSERT(!id_bitmap_contains(evens, 19999));
+
+    id_bitmap *both = id_bitmap_and(evens, low);
+    ASSERT(both && id_bitmap_cardinality(both) == 50);
+    ASSERT(id_bitmap_and_cardinality(evens, low) == 50);
+
+    id_bitmap *either = id_bitmap_or(evens, low);
+    ASSERT(either && id_bitmap_cardinality(either) == 10000 + 50 + 1);
+    ASSERT(id_bitmap_contains(either, (1ULL << 40) + 7));
+
+    id_bitmap *odd = id_bitmap_andnot(low, evens);
+    ASSERT(odd && id_bitmap_cardinality(odd) == 51);
+    ASSERT(id_bitmap_contains(odd, 99) && !id_bitmap_contains(odd, 98));
+
+    for (uint64_t i = 0; i < 20000; i += 4) ASSERT(id_bitmap_remove(evens, i) == 0);
+    ASSERT(id_bitmap_cardinality(evens) == 5000);
+    ASSERT(id_bitmap_remove(evens, 0) == -1);
+
+    uint64_t ids[4];
+    ASSERT(id_bitmap_to_array(evens, ids, 4) == 4);
+    ASSERT(ids[0] == 2 && ids[1] == 6 && ids[3] == 14);
+
+    id_bitmap_destroy(both);
+    id_bitmap_destroy(either);
+    id_bitmap_destroy(odd);
+    id_bitmap_destroy(evens);
+    id_bitmap_destroy(low);
+}
+
+TEST(test_bitmap_compound_query) {
+    eavgDB *db = eavgDB_create(16);
+    eavgAttribute    *status = eavgDB_addAttribute(db, "status", EAVG_DATA_TYPE_STRING);
+    eavgRelationType *rel    = eavgDB_addRelationType(db, "knows");
+
+    eavgEntity *x = eavgDB_addEntity(db, 1, "X");
+    eavgEntity *a = eavgDB_addEntity(db, 3, "A");
+    eavgEntity *b = eavgDB_addEntity(db, 3, "B");
+    eavgEntity *c = eavgDB_addEntity(db, 3, "C");
+    eavgEntity *d = eavgDB_addEntity(db, 4, "D");
+
+    eavgDB_addStringValue(db, a->id, status->id, "active");
+    eavgDB_addStringValue(db, b->id, status->id, "inactive");
+    eavgDB_addStringValue(db, c->id, status->id, "active");
+    eavgDB_addStringValue(db, d->id, status->id, "active");
+
+    eavgDB_addEdge(db, x->id, a->id, rel->id, 1.0);
+    eavgDB_addEdge(db, x->id, b->id, rel->id, 1.0);
+    eavgDB_addEdge(db, d->id, x->id, rel->id, 1.0);
+
+    id_bitmap *typed  = eavgDB_findEntitiesByTypeBitmap(db, 3);
+    id_bitmap *active = eavgDB_findEntitiesByValueBitmap(db, status->id, status_is_active, NULL);
+    id_bitmap *start  = id_bitmap_create();
+    id_bitmap_add(start, x->id);
+    id_bitmap *nbrs   = eavgDB_expandNeighbors(db, start, EAVG_EDGE_DIR_BOTH, NULL, NULL);
+    ASSERT(typed && active && nbrs);
+    ASSERT(id_bitmap_cardinality(typed) == 3);
+    ASSERT(id_bitmap_cardinality(active) == 3);
+    ASSERT(id_bitmap_cardinality(nbrs) == 3);
+
+    id_bitmap *tmp = id_bitmap_and(typed, active);
+    id_bitmap *hit = id_bitmap_and(tmp, nbrs);
+    ASSERT(hit && id_bitmap_cardinality(hit) == 1 && id_bitmap_contains(hit, a->id));
+
+    ASSERT(eavgDB_removeEntity(db, d->id) == 0);
+    id_bitmap *after = eavgDB_expandNeighbors(db, start, EAVG_EDGE_DIR_IN, NULL, NULL);
+    ASSERT(after && id_bitmap_cardinality(after) == 0);
+
+    id_bitmap_destroy(typed);
+    id_bitmap_destroy(active);
+    id_bitmap_destroy(start);
+    id_bitmap_destroy(nbrs);
+    id_bitmap_destroy(tmp);
+    id_bitmap_destroy(hit);
+    id_bitmap_destroy(after);
+    eavgDB_destroy(db);
+}
@@ -0,0 +1,98 @@
+#include "tests.h"
+#include "../eavg.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+struct lock_job {
+    br_lock     lock;
+    _Atomic int writerIn;
+};
+
+static void *take_write(void *arg) {
+    struct lock_job *job = arg;
+    br_lock_wr(&job->lock);
+    atomic_store(&job->writerIn, 1);
+    br_unlock_wr(&job->lock);
+    return NULL;
+}
+
+TEST(test_brlock_writer_waits_for_readers) {
+    struct lock_job job = { .writerIn = 0 };
+    ASSERT(br_lock_init(&job.lock) == 0);
+
+    /* a biased reader takes the fast path and nests without deadlocking */
+    br_lock_rd(&job.lock);
+    br_lock_rd(&job.lock);
+
+    pthread_t tid;
+    ASSERT(pthread_create(&tid, NULL, take_write, &job) == 0);
+    usleep(20 * 1000);
+    ASSERT(atomic_load(&job.writerIn) == 0);
+
+    br_unlock_rd(&job.lock);
+    usleep(5 * 1000);
+    ASSERT(atomic_load(&job.writerIn) == 0);
+
+    br_unlock_rd(&job.lock);
+    pthread_join(tid, NULL);
+    ASSERT(atomic_load(&job.writerIn) == 1);
+
+    /* right after a revocation readers go through the rwlock */
+    ASSERT(atomic_load(&job.lock.rbias) == 0);
+    br_lock_rd(&job.lock);
+    br_unlock_rd(&job.lock);
+    br_lock_destroy(&job.lock);
+
+    /* more locks than a thread tracks, nested, released out of order */
+    enum { MANY = BR_MAX_HELD + 8 };
+    static br_lock many[MANY];
+    for (int i = 0; i < MANY; i++) {
+        ASSERT(br_lock_init(&many[i]) == 0);
+        br_lock_rd(&many[i]);
+        br_lock_rd(&many[i]);
+    }
+    for (int i = 0; i < MANY; i++) br_unlock_rd(&many[(i * 7) % MANY]);
+    for (int i = MANY - 1; i >= 0; i--) br_unlock_rd(&many[i]);
+    for (int i = 0; i < MANY; i++) {
+        br_lock_wr(&many[i]);
+        br_unlock_wr(&many[i]);
+        br_lock_destroy(&many[i]);
+    }
+}
+
+struct lookup_job {
+    eavgDB    *db;
+    eavg_u64   first;
+    int        misses;
+};
+
+static void *lookup_loop(void *arg) {
+    struct lookup_job *job = arg;
+    for (int i = 0; i < 20000; i++) {
+        if (!eavgDB_findEntityById(job->db, job->first + (eavg_u64)(i % 100)))
+            job->misses++;
+    }
+    return NULL;
+}
+
+TEST(test_brlock_concurrent_lookups) {
+    eavgDB *db = eavgDB_create(256);
+    eavg_u64 first = eavgDB_addEntity(db, 0, NULL)->id;
+    for (int i = 1; i < 100; i++) eavgDB_addEntity(db, 0, NULL);
+
+    enum { READERS = 8 };
+    struct lookup_job jobs[READERS];
+    pthread_t         tids[READERS];
+    for (int t = 0; t < READERS; t++) {
+        jobs[t] = (struct lookup_job){ db, first, 0 };
+        ASSERT(pthread_create(&tids[t], NULL, lookup_loop, &jobs[t]) == 0);
+    }
+    for (int i = 0; i < 500; i++) eavgDB_addEntity(db, 1, NULL);
+    for (int t = 0; t < READERS; t++) {
+        pthread_join(tids[t], NULL);
+        ASSERT(jobs[t].misses == 0);
+    }
+    ASSERT(eavgDB_findEntityById(db, first + 599) != NULL);
+    eavgDB_destroy(db);
+}
@@ -0,0 +1,87 @@
+#include "tests.h"
+#include "../eavg.h"
+#include <string.h>
+
+TEST(test_bulk_insert) {
+    eavgDB *db = eavgDB_create(4);
+    eavgAttribute    *age  = eavgDB_addAttribute(db, "age", EAVG_DATA_TYPE_INT);
+    eavgAttribute    *nick = eavgDB_addAttribute(db, "nick", EAVG_DATA_TYPE_STRING);
+    eavgRelationType *rel  = eavgDB_addRelationType(db, "follows");
+
+    enum { N = 40 };
+    eavgBulkEntity ents[N];
+    eavgBulkValue  vals[N];
+    eavgBulkEdge   edges[2 * N];
+    char           names[N][sizeof "n-2147483648"];
+    for (int i = 0; i < N; i++) {
+        snprintf(names[i], sizeof names[i], "n%d", i);
+        ents[i] = (eavgBulkEntity){ 7, names[i] };
+        vals[i] = (eavgBulkValue){ EAVG_BULK_REF(i), age->id, { .intValue = i }, 0 };
+        edges[i]     = (eavgBulkEdge){ EAVG_BULK_REF(0), EAVG_BULK_REF(i), rel->id,
+                                       1.0, EAVG_EDGE_DIR_OUT, "follows", 0 };
+        edges[N + i] = (eavgBulkEdge){ EAVG_BULK_REF(i), EAVG_BULK_REF((i + 1) % N), rel->id,
+                                       2.0, EAVG_EDGE_DIR_OUT, "follows", 0 };
+    }
+    eavg_u64 ids[N];
+    eavgBulkBatch batch = { ents, N, vals, N, edges, 2 * N, 4, ids, 0, 0 };
+    ASSERT(eavgDB_bulkInsert(db, &batch) == 0);
+
+    eavgEntity *hub = eavgDB_findEntityByName(db, "n0");
+    ASSERT(hub && hub->id == ids[0]);
+    eavgAdjList *out = eavgDB_getAdjList(db, ids[0]);
+    ASSERT(out && out->count == N + 1);
+    for (int i = 0; i < N; i++) {
+        ASSERT(out->edges[i].targetEntity == ids[i]);
+        ASSERT(out->edges[i].id == batch.firstEdgeId + (eavg_u64)i);
+        ASSERT(strcmp(out->edges[i].label, "follows") == 0);
+    }
+    ASSERT(out->edges[0].label == out->edges[N].label);
+    eavgAdjList *in = eavgDB_getReverseAdjList(db, ids[1]);
+    ASSERT(in && in->count == 2 && in->edges[1].sourceEntity == ids[0]);
+
+    size_t cnt = 0;
+    eavgEntity **typed = eavgDB_findEntitiesByType(db, 7, &cnt);
+    ASSERT(cnt == N);
+    free(typed);
+
+    /* a batch referring to an unknown attribute is rejected whole */
+    eavgBulkValue  bad     = { EAVG_BULK_REF(0), 999, { .intValue = 1 }, 0 };
+    eavgBulkEntity one     = { 7, "rejected" };
+    eavgBulkBatch  badBatch = { &one, 1, &bad, 1, NULL, 0, 1, NULL, 0, 0 };
+    ASSERT(eavgDB_bulkInsert(db, &badBatch) == -1);
+    ASSERT(eavgDB_findEntityByName(db, "rejected") == NULL);
+
+    /* single inserts keep earlier records when a list grows */
+    for (int i = 0; i < 10; i++)
+        ASSERT(eavgDB_addStringValue(db, ids[1], nick->id, names[i]));
+    ASSERT(eavgDB_removeValue(db, batch.firstValueId + 1) == 0);
+    eavgValRec *last = eavgDB_addStringValue(db, ids[1], nick->id, "last");
+    ASSERT(last && strcmp(eavgValRec_getString(last), "last") == 0);
+
+    /* a batch failing part way is taken back out whole */
+    eavgAttribute  *blob   = eavgDB_addAttribute(db, "blob", EAVG_DATA_TYPE_BINARY);
+    eavgValueList  *vl1    = eavgDB_getValueList(db, ids[1]);
+    size_t          before = vl1->count;
+    eavgSnapshot   *snap   = eavgDB_snapshotBegin(db);
+    eavgBulkEntity  dup[2] = { { 8, "n1" }, { 8, "fresh" } };
+    eavgBulkValue   part[3] = {
+        { ids[1], age->id, { .intValue = 99 }, 0 },
+        { EAVG_BULK_REF(1), blob->id, { .binaryValue = NULL }, 4 },
+        { ids[1], blob->id, { .binaryValue = NULL }, (size_t)EAVG_VALUE_LENGTH_MAX + 1 },
+    };
+    eavgBulkEdge    link   = { ids[1], EAVG_BULK_REF(0), rel->id, 1.0, EAVG_EDGE_DIR_OUT, NULL, 0 };
+    eavgBulkBatch   failing = { dup, 2, part, 3, &link, 1, 1, NULL, 0, 0 };
+    ASSERT(eavgDB_bulkInsert(db, &failing) == -1);
+    ASSERT(eavgDB_findEntityByName(db, "n1")->id == ids[1]);
+    ASSERT(eavgDB_findEntityByName(db, "fresh") == NULL);
+    ASSERT(eavgDB_findEntitiesByType(db, 8, &cnt) == NULL && cnt == 0);
+    vl1 = eavgDB_getValueList(db, ids[1]);
+    ASSERT(vl1->count == before && vl1->values[before - 1].id == last->id);
+    ASSERT(eavgDB_findValueById(db, failing.firstValueId) == NULL);
+    id_bitmap *blobs = eavgDB_entitiesByAttributeNoLock(db, blob->id);
+    ASSERT(!blobs || id_bitmap_cardinality(blobs) == 0);
+    ASSERT(eavgDB_getAdjList(db, ids[1])->count == 1);
+    eavgDB_snapshotEnd(snap);
+
+    eavgDB_destroy(db);
+}
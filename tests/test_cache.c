@@ -0,0 +1,162 @@
+#include "tests.h"
+#include "../eavg.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+static size_t edge_count(eavgDB *db, eavg_u64 id, eavgEdgeDir dir,
+                         eavgEdgeFilter filter, void *ud)
+{
+    size_t n;
+    free(eavgDB_getFilteredEdges(db, id, dir, filter, ud, &n));
+    return n;
+}
+
+static size_t type_count(eavgDB *db, eavg_u32 typeId) {
+    size_t n;
+    free(eavgDB_findEntitiesByType(db, typeId, &n));
+    return n;
+}
+
+static eavg_u64 expand_count(eavgDB *db, eavg_u64 id) {
+    id_bitmap *from = id_bitmap_create();
+    id_bitmap_add(from, id);
+    id_bitmap *to = eavgDB_expandNeighbors(db, from, EAVG_EDGE_DIR_OUT, NULL, NULL);
+    ASSERT(to);
+    eavg_u64 n = id_bitmap_cardinality(to);
+    id_bitmap_destroy(to);
+    id_bitmap_destroy(from);
+    return n;
+}
+
+static bool heavy(const eavgEdgeRec *e, void *ud) {
+    return e->weight > *(double*)ud;
+}
+
+TEST(test_cache_hits_and_invalidation) {
+    eavgDB *db = eavgDB_create(16);
+    eavg_u64 a = eavgDB_addEntity(db, 1, "a")->id;
+    eavg_u64 b = eavgDB_addEntity(db, 1, "b")->id;
+    eavg_u64 c = eavgDB_addEntity(db, 1, "c")->id;
+    eavg_u64 rel = eavgDB_addRelationType(db, "r")->id;
+    eavg_u64 ab = eavgDB_addEdge(db, a, b, rel, 1.0)->id;
+    ASSERT(eavgDB_cacheEnable(db, NULL) == 0);
+
+    eavgCacheStats st;
+    ASSERT(edge_count(db, a, EAVG_EDGE_DIR_OUT, NULL, NULL) == 1);
+    ASSERT(edge_count(db, a, EAVG_EDGE_DIR_OUT, NULL, NULL) == 1);
+    ASSERT(edge_count(db, b, EAVG_EDGE_DIR_IN, NULL, NULL) == 1);
+    eavgDB_cacheStats(db, &st);
+    ASSERT(st.hits == 1 && st.misses == 2 && st.inserts == 2 && st.entries == 2 && st.bytes > 0);
+
+    /* a new edge out of a drops a's result but not b's */
+    eavgDB_addEdge(db, a, c, rel, 0.2);
+    ASSERT(edge_count(db, a, EAVG_EDGE_DIR_OUT, NULL, NULL) == 2);
+    ASSERT(edge_count(db, b, EAVG_EDGE_DIR_IN, NULL, NULL) == 1);
+    eavgDB_cacheStats(db, &st);
+    ASSERT(st.invalidated == 1 && st.hits == 2);
+
+    /* type listings follow adds and removals of that type only */
+    ASSERT(type_count(db, 1) == 3 && type_count(db, 1) == 3);
+    eavgDB_addEntity(db, 2, NULL);
+    ASSERT(type_count(db, 1) == 3);
+    eavg_u64 d = eavgDB_addEntity(db, 1, NULL)->id;
+    ASSERT(type_count(db, 1) == 4);
+    id_bitmap *ids = eavgDB_findEntitiesByTypeBitmap(db, 1);
+    id_bitmap_destroy(eavgDB_findEntitiesByTypeBitmap(db, 1));
+    ASSERT(ids && id_bitmap_contains(ids, d));
+    id_bitmap_destroy(ids);
+
+    /* removing a neighbour changes the expansion of whoever pointed at it */
+    ASSERT(expand_count(db, a) == 2 && expand_count(db, a) == 2);
+    ASSERT(eavgDB_removeEntity(db, c) == 0);
+    ASSERT(expand_count(db, a) == 1);
+    ASSERT(type_count(db, 1) == 3);
+
+    /* filtered calls bypass the cache unless it is told they may not */
+    double min = 0.5;
+    eavgDB_cacheStats(db, &st);
+    eavg_u64 lookups = st.hits + st.misses;
+    ASSERT(edge_count(db, a, EAVG_EDGE_DIR_OUT, heavy, &min) == 1);
+    eavgDB_cacheStats(db, &st);
+    ASSERT(st.hits + st.misses == lookups);
+
+    eavgCacheOptions opt = { .filtered = true };
+    ASSERT(eavgDB_cacheEnable(db, &opt) == 0);
+    eavgDB_cacheStats(db, &st);
+    ASSERT(st.entries == 0 && st.hits == 0);
+    ASSERT(edge_count(db, a, EAVG_EDGE_DIR_OUT, heavy, &min) == 1);
+    ASSERT(edge_count(db, a, EAVG_EDGE_DIR_OUT, heavy, &min) == 1);
+    ASSERT(eavgDB_updateEdgeWeight(db, ab, 0.1) == 0);
+    ASSERT(edge_count(db, a, EAVG_EDGE_DIR_OUT, heavy, &min) == 0);
+    eavgDB_cacheStats(db, &st);
+    ASSERT(st.hits == 1 && st.invalidated == 1);
+
+    eavgDB_cacheDisable(db);
+    eavgDB_cacheStats(db, &st);
+    ASSERT(st.entries == 0 && st.inserts == 0);
+    ASSERT(edge_count(db, a, EAVG_EDGE_DIR_OUT, NULL, NULL) == 1);
+    eavgDB_destroy(db);
+}
+
+enum { HUB_EDGES = 200 };
+
+struct hub_reader {
+    eavgDB         *db;
+    eavg_u64        hub;
+    _Atomic int    *done;
+    bool            ok;
+};
+
+/* a hit may never show fewer edges than a read before it */
+static void *read_hub(void *arg) {
+    struct hub_reader *r = arg;
+    size_t last = 0;
+    r->ok = true;
+    while (!atomic_load(r->done)) {
+        size_t n = edge_count(r->db, r->hub, EAVG_EDGE_DIR_OUT, NULL, NULL);
+        if (n < last) r->ok = false;
+        last = n;
+    }
+    return NULL;
+}
+
+TEST(test_cache_budget_and_writers) {
+    eavgDB *db = eavgDB_create(1024);
+    eavg_u64 rel = eavgDB_addRelationType(db, "r")->id;
+    eavg_u64 ids[1000];
+    for (int i = 0; i < 1000; i++) ids[i] = eavgDB_addEntity(db, 1, NULL)->id;
+    for (int i = 0; i < 1000; i++)
+        for (int k = 1; k <= 10; k++) eavgDB_addEdge(db, ids[i], ids[(i + k) % 1000], rel, 1.0);
+
+    /* 1000 results of 10 edges each do not fit in 64 KiB */
+    eavgCacheOptions opt = { .budget = 64 << 10 };
+    ASSERT(eavgDB_cacheEnable(db, &opt) == 0);
+    for (int i = 0; i < 1000; i++) ASSERT(edge_count(db, ids[i], EAVG_EDGE_DIR_OUT, NULL, NULL) == 10);
+    eavgCacheStats st;
+    eavgDB_cacheStats(db, &st);
+    ASSERT(st.bytes <= opt.budget && st.evicted > 0 && st.entries < 1000);
+    ASSERT(st.inserts == 1000 && st.entries + st.evicted == 1000);
+
+    /* nor is a result bigger than a shard's share of the budget kept */
+    ASSERT(type_count(db, 1) == 1000);
+    eavgDB_cacheStats(db, &st);
+    ASSERT(st.inserts == 1000);
+
+    /* readers racing a writer never see an edge disappear */
+    eavg_u64 hub = eavgDB_addEntity(db, 3, NULL)->id;
+    _Atomic int done = 0;
+    struct hub_reader readers[3];
+    pthread_t tids[3];
+    for (int t = 0; t < 3; t++) {
+        readers[t] = (struct hub_reader){ db, hub, &done, false };
+        ASSERT(pthread_create(&tids[t], NULL, read_hub, &readers[t]) == 0);
+    }
+    for (int i = 0; i < HUB_EDGES; i++) eavgDB_addEdge(db, hub, ids[i], rel, 1.0);
+    atomic_store(&done, 1);
+    for (int t = 0; t < 3; t++) {
+        pthread_join(tids[t], NULL);
+        ASSERT(readers[t].ok);
+    }
+    ASSERT(edge_count(db, hub, EAVG_EDGE_DIR_OUT, NULL, NULL) == HUB_EDGES);
+    eavgDB_destroy(db);
+}
@@ -0,0 +1,114 @@
+#include "tests.h"
+#include "../eavg.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <sched.h>
+
+static void count_done(eavgFuture *f, void *ud) {
+    (void)f;
+    atomic_fetch_add((_Atomic int*)ud, 1);
+}
+
+TEST(test_exec_queries) {
+    eavgDB *db = eavgDB_create(16);
+    eavgRelationType *rel = eavgDB_addRelationType(db, "next");
+    eavg_u64 chain[5];
+    for (int i = 0; i < 5; i++) chain[i] = eavgDB_addEntity(db, 0, NULL)->id;
+    for (int i = 0; i < 4; i++) eavgDB_addEdge(db, chain[i], chain[i + 1], rel->id, 1.0);
+
+    eavgExecutor *ex = eavgExecutor_create(db, 2, 8);
+    ASSERT(ex);
+    _Atomic int done = 0;
+
+    id_bitmap *from = id_bitmap_create();
+    id_bitmap_add(from, chain[0]);
+    eavgFuture *hop = eavgExecutor_expand(ex, from, 2, EAVG_EDGE_DIR_OUT, NULL, NULL,
+                                          count_done, &done);
+    id_bitmap_destroy(from);                   /* the executor took a copy */
+    eavg_u64    ids[3] = { chain[4], 9999, chain[1] };
+    eavgFuture *look  = eavgExecutor_lookup(ex, ids, 3, count_done, &done);
+    eavgFuture *edges = eavgExecutor_filteredEdges(ex, chain[2], EAVG_EDGE_DIR_BOTH,
+                                                   NULL, NULL, count_done, &done);
+    eavgFuture *save  = eavgExecutor_save(ex, "test_exec.db", count_done, &done);
+    ASSERT(hop && look && edges && save);
+
+    ASSERT(eavgFuture_wait(hop, -1) == 0 && eavgFuture_poll(hop) == EAVG_FUTURE_DONE);
+    size_t           n;
+    const id_bitmap *reached = eavgFuture_result(hop, &n);
+    ASSERT(n == 3 && id_bitmap_contains(reached, chain[2]) &&
+           !id_bitmap_contains(reached, chain[3]));
+
+    ASSERT(eavgFuture_wait(look, 1000) == 0);
+    eavgEntity **found = eavgFuture_result(look, &n);
+    ASSERT(n == 3 && found[0]->id == chain[4] && found[1] == NULL && found[2]->id == chain[1]);
+
+    ASSERT(eavgFuture_wait(edges, 1000) == 0);
+    eavgFuture_result(edges, &n);
+    ASSERT(n == 2);
+
+    ASSERT(eavgFuture_wait(save, 1000) == 0 && eavgFuture_status(save) == 0);
+    eavgDB *copy = eavgDB_load("test_exec.db");
+    ASSERT(copy && eavgDB_getAdjList(copy, chain[3])->count == 1);
+    eavgDB_destroy(copy);
+
+    eavgFuture_release(hop);
+    eavgFuture_release(look);
+    eavgFuture_release(edges);
+    eavgFuture_release(save);
+    eavgExecutor_destroy(ex);
+    ASSERT(atomic_load(&done) == 4);
+    eavgDB_destroy(db);
+}
+
+struct gate {
+    _Atomic int entered;
+    _Atomic int open;
+};
+
+static int wait_at_gate(eavgDB *db, eavgFuture *f, void *arg) {
+    (void)db;
+    struct gate *g = arg;
+    atomic_store(&g->entered, 1);
+    while (!atomic_load(&g->open) && !eavgFuture_cancelled(f)) sched_yield();
+    return 7;
+}
+
+TEST(test_exec_admission_and_cancel) {
+    eavgDB       *db = eavgDB_create(16);
+    eavgExecutor *ex = eavgExecutor_create(db, 1, 2);
+    struct gate   g  = { 0, 0 };
+
+    eavgFuture *busy = eavgExecutor_submit(ex, wait_at_gate, &g, NULL, NULL);
+    while (!atomic_load(&g.entered)) sched_yield();
+
+    /* the only worker is parked: two queue up, the third is turned away */
+    eavg_u64    id = 1;
+    eavgFuture *q1 = eavgExecutor_lookup(ex, &id, 1, NULL, NULL);
+    eavgFuture *q2 = eavgExecutor_lookup(ex, &id, 1, NULL, NULL);
+    ASSERT(q1 && q2);
+    ASSERT(eavgExecutor_lookup(ex, &id, 1, NULL, NULL) == NULL);
+
+    ASSERT(eavgFuture_cancel(q1));
+    ASSERT(eavgFuture_poll(q1) == EAVG_FUTURE_CANCELLED);
+    ASSERT(eavgFuture_wait(busy, 10) == -1);
+    ASSERT(eavgFuture_poll(busy) == EAVG_FUTURE_RUNNING);
+
+    atomic_store(&g.open, 1);
+    ASSERT(eavgFuture_wait(busy, -1) == 0 && eavgFuture_status(busy) == 7);
+    ASSERT(eavgFuture_wait(q2, -1) == 0 && eavgFuture_poll(q2) == EAVG_FUTURE_DONE);
+
+    /* a running query ends CANCELLED when asked to stop */
+    struct gate g2 = { 0, 0 };
+    eavgFuture *stuck = eavgExecutor_submit(ex, wait_at_gate, &g2, NULL, NULL);
+    while (!atomic_load(&g2.entered)) sched_yield();
+    ASSERT(!eavgFuture_cancel(stuck));
+    ASSERT(eavgFuture_wait(stuck, -1) == 0 && eavgFuture_poll(stuck) == EAVG_FUTURE_CANCELLED);
+
+    eavgFuture_release(busy);
+    eavgFuture_release(q1);
+    eavgFuture_release(q2);
+    eavgFuture_release(stuck);
+    eavgExecutor_destroy(ex);
+    eavgDB_destroy(db);
+}
@@ -0,0 +1,97 @@
+#include "tests.h"
+#include "../eavg.h"
+#include <string.h>
+#include <stdatomic.h>
+#include <sched.h>
+
+typedef struct {
+    eavgChange  events[64];
+    size_t      count;
+    size_t      batches;
+    _Atomic int release;
+} feed_log;
+
+static void log_changes(const eavgChange *ev, size_t n, void *ud) {
+    feed_log *log = ud;
+    while (!atomic_load(&log->release)) sched_yield();
+    for (size_t i = 0; i < n && log->count < 64; i++)
+        log->events[log->count++] = ev[i];
+    log->batches++;
+}
+
+TEST(test_change_feed_events) {
+    eavgDB *db = eavgDB_create(16);
+    eavgAttribute    *nick = eavgDB_addAttribute(db, "nick", EAVG_DATA_TYPE_STRING);
+    eavgRelationType *rel  = eavgDB_addRelationType(db, "knows");
+    eavgEntity       *pre  = eavgDB_addEntity(db, 1, "before");   /* not delivered */
+
+    feed_log log = { .release = 1 };
+    eavgSubscription *sub = eavgDB_subscribe(db, 8, 4, EAVG_FEED_BLOCK, log_changes, &log);
+    ASSERT(sub);
+
+    eavgEntity *a = eavgDB_addEntity(db, 1, "a");
+    eavgValRec *v = eavgDB_addStringValue(db, a->id, nick->id, "ann");
+    eavg_u64    valueId = v->id;
+    ASSERT(eavgDB_updateValue(db, valueId, (eavgValueData){ .stringValue = "annie" }, 0) == 0);
+    eavgEdgeRec *e = eavgDB_addEdge(db, a->id, pre->id, rel->id, 1.0);
+    eavg_u64     edgeId = e->id;
+    ASSERT(eavgDB_updateEdgeWeight(db, edgeId, 3.0) == 0);
+    ASSERT(eavgDB_removeEdge(db, edgeId) == 0);
+    ASSERT(eavgDB_removeValue(db, valueId) == 0);
+    ASSERT(eavgDB_removeEntity(db, a->id) == 0);
+
+    eavgBulkEntity ents[2] = { { 2, "b0" }, { 2, "b1" } };
+    eavgBulkEdge   edge    = { EAVG_BULK_REF(0), EAVG_BULK_REF(1), rel->id,
+                               1.0, EAVG_EDGE_DIR_OUT, "knows", 0 };
+    eavgBulkBatch  batch   = { ents, 2, NULL, 0, &edge, 1, 1, NULL, 0, 0 };
+    ASSERT(eavgDB_bulkInsert(db, &batch) == 0);
+
+    ASSERT(eavgDB_unsubscribe(db, sub) == 0);   /* drains the ring */
+
+    static const eavg_u32 expect[][2] = {
+        { EAVG_CHANGE_ENTITY, EAVG_CHANGE_ADD },
+        { EAVG_CHANGE_VALUE,  EAVG_CHANGE_ADD },
+        { EAVG_CHANGE_VALUE,  EAVG_CHANGE_UPDATE },
+        { EAVG_CHANGE_EDGE,   EAVG_CHANGE_ADD },
+        { EAVG_CHANGE_EDGE,   EAVG_CHANGE_UPDATE },
+        { EAVG_CHANGE_EDGE,   EAVG_CHANGE_REMOVE },
+        { EAVG_CHANGE_VALUE,  EAVG_CHANGE_REMOVE },
+        { EAVG_CHANGE_ENTITY, EAVG_CHANGE_REMOVE },
+        { EAVG_CHANGE_ENTITY, EAVG_CHANGE_ADD },
+        { EAVG_CHANGE_ENTITY, EAVG_CHANGE_ADD },
+        { EAVG_CHANGE_EDGE,   EAVG_CHANGE_ADD },
+    };
+    size_t n = sizeof expect / sizeof expect[0];
+    ASSERT(log.count == n);
+    ASSERT(log.batches >= (n + 3) / 4);
+    for (size_t i = 0; i < n; i++) {
+        ASSERT(log.events[i].kind == expect[i][0] && log.events[i].op == expect[i][1]);
+        if (i) ASSERT(log.events[i].seq == log.events[i - 1].seq + 1);
+    }
+    ASSERT(log.events[0].entity.id == a->id && strcmp(log.events[0].entity.name, "a") == 0);
+    ASSERT(strcmp(eavgValRec_getString(&log.events[1].value), "ann") == 0);
+    ASSERT(strcmp(eavgValRec_getString(&log.events[2].value), "annie") == 0);
+    ASSERT(log.events[4].edge.weight == 3.0 && log.events[4].entityId == a->id);
+    ASSERT(log.events[10].edge.sourceEntity == log.events[8].entityId);
+
+    eavgDB_destroy(db);
+}
+
+TEST(test_change_feed_drop_policy) {
+    eavgDB *db = eavgDB_create(16);
+    feed_log log = { .release = 0 };
+    eavgSubscription *sub = eavgDB_subscribe(db, 2, 1, EAVG_FEED_DROP, log_changes, &log);
+    ASSERT(sub);
+
+    /* the consumer is parked in its callback, so writers must not wait */
+    enum { WRITES = 20 };
+    for (int i = 0; i < WRITES; i++) eavgDB_addEntity(db, 0, NULL);
+    eavg_u64 dropped = eavgSubscription_dropped(sub);
+    ASSERT(dropped > 0);
+
+    atomic_store(&log.release, 1);
+    ASSERT(eavgDB_unsubscribe(db, sub) == 0);
+    ASSERT(log.count + dropped == WRITES);
+
+    eavgDB_destroy(db);
+}
@@ -0,0 +1,108 @@
+#include "tests.h"
+#include "../eavg.h"
+#include <string.h>
+
+static void check_image_db(eavgDB *db) {
+    eavgEntity *a = eavgDB_findEntityByName(db, "Alice");
+    eavgEntity *b = eavgDB_findEntityByName(db, "Bob");
+    ASSERT(a && b && a->typeId == 1 && eavgDB_findEntityById(db, b->id) == b);
+
+    eavgAttribute *note = eavgDB_findAttributeByName(db, "note");
+    eavgValueList *vl   = eavgDB_getValueList(db, a->id);
+    ASSERT(note && vl && vl->count == 3);
+    ASSERT(strcmp(eavgValRec_getString(&vl->values[1]), "short") == 0);
+    ASSERT(strcmp(eavgValRec_getString(&vl->values[2]),
+                  "a note far too long to fit inline") == 0);
+    ASSERT(eavgDB_findValueById(db, vl->values[2].id) == &vl->values[2]);
+
+    eavgAdjList *out = eavgDB_getAdjList(db, a->id);
+    eavgAdjList *in  = eavgDB_getReverseAdjList(db, b->id);
+    ASSERT(out && out->count == 2 && in && in->count == 2);
+    ASSERT(strcmp(out->edges[0].label, "knows") == 0 && out->edges[1].targetEntity == b->id);
+    ASSERT(out->edges[0].labelSym && out->edges[0].labelSym == in->edges[1].labelSym);
+    ASSERT(out->edges[0].label == eavgSymbol_name(out->edges[0].labelSym));
+
+    size_t n = 0;
+    eavgEntity **typed = eavgDB_findEntitiesByType(db, 1, &n);
+    ASSERT(n == 2);
+    free(typed);
+}
+
+TEST(test_image_save_load) {
+    eavgDB *db = eavgDB_create(16);
+    eavgEntity       *a    = eavgDB_addEntity(db, 1, "Alice");
+    eavgEntity       *b    = eavgDB_addEntity(db, 1, "Bob");
+    eavgAttribute    *age  = eavgDB_addAttribute(db, "age", EAVG_DATA_TYPE_INT);
+    eavgAttribute    *note = eavgDB_addAttribute(db, "note", EAVG_DATA_TYPE_STRING);
+    eavgRelationType *rel  = eavgDB_addRelationType(db, "knows");
+    eavgDB_addIntValue(db, a->id, age->id, 30);
+    eavgDB_addStringValue(db, a->id, note->id, "short");
+    eavgDB_addStringValue(db, a->id, note->id, "a note far too long to fit inline");
+    eavgDB_addEdgeEx(db, a->id, b->id, rel->id, 1.0, EAVG_EDGE_DIR_OUT, "knows", 0);
+    eavgDB_addEdgeEx(db, a->id, b->id, rel->id, 2.0, EAVG_EDGE_DIR_OUT, "knows", 0);
+    eavg_u64 noteId = note->id, relId = rel->id;
+    ASSERT(eavgDB_saveImage(db, "test_image.img") == 0);
+    ASSERT(eavgDB_save(db, "test_image.db") == 0);
+    eavgDB_destroy(db);
+
+    /* lists resolve as they are touched; a value id finds its list */
+    eavgDB *img  = eavgDB_load("test_image.img");
+    eavgDB *img2 = eavgDB_load("test_image.img");
+    eavgDB *strm = eavgDB_load("test_image.db");
+    ASSERT(img && img2 && strm);
+    ASSERT(img->valuesById->count == 0);
+    a = eavgDB_findEntityByName(img, "Alice");
+    eavgValRec *v = eavgDB_findValueById(img, eavgDB_getValueList(img2, a->id)->values[2].id);
+    ASSERT(v && img->valuesById->count == 3);
+    ASSERT(strcmp(eavgValRec_getString(v), "a note far too long to fit inline") == 0);
+    check_image_db(img);
+    check_image_db(img2);
+    check_image_db(strm);
+    eavgDB_destroy(img2);
+    eavgDB_destroy(strm);
+
+    /* writes copy pages and lists out of the mapping */
+    a = eavgDB_findEntityByName(img, "Alice");
+    eavgEntity *c = eavgDB_addEntity(img, 1, "Carol");
+    ASSERT(c && c->id == 3);
+    ASSERT(eavgDB_addStringValue(img, a->id, noteId, "another long note, past inline"));
+    ASSERT(eavgDB_addEdgeEx(img, a->id, c->id, relId, 3.0, EAVG_EDGE_DIR_OUT, "met", 0));
+    ASSERT(eavgDB_getValueList(img, a->id)->count == 4);
+    ASSERT(eavgDB_getAdjList(img, a->id)->count == 3);
+    ASSERT(eavgDB_removeEdge(img, eavgDB_getAdjList(img, a->id)->edges[0].id) == 0);
+    ASSERT(eavgDB_findEntityByName(img, "Bob") != NULL);
+    eavgDB_destroy(img);
+}
+
+TEST(test_image_bad_list) {
+    eavgDB *db = eavgDB_create(16);
+    eavgEntity       *a    = eavgDB_addEntity(db, 1, "Alice");
+    eavgEntity       *b    = eavgDB_addEntity(db, 1, "Bob");
+    eavgAttribute    *note = eavgDB_addAttribute(db, "note", EAVG_DATA_TYPE_STRING);
+    eavgRelationType *rel  = eavgDB_addRelationType(db, "knows");
+    static const char text[] = "a note far too long to fit inline";
+    eavgDB_addStringValue(db, a->id, note->id, text);
+    eavgDB_addEdgeEx(db, a->id, b->id, rel->id, 1.0, EAVG_EDGE_DIR_OUT, "knows", 0);
+    eavg_u64 aId = a->id, bId = b->id;
+    ASSERT(eavgDB_saveImage(db, "test_image_bad.img") == 0);
+    eavgDB_destroy(db);
+
+    /* cut the long note's terminator: its value list is bad, the rest loads */
+    char  buf[1 << 14];
+    FILE *f = fopen("test_image_bad.img", "r+b");
+    ASSERT(f);
+    size_t n  = fread(buf, 1, sizeof buf, f), at = 0;
+    while (at + sizeof text <= n && memcmp(buf + at, text, sizeof text) != 0) at++;
+    ASSERT(at + sizeof text <= n && fseek(f, (long)(at + sizeof text - 1), SEEK_SET) == 0);
+    ASSERT(fputc('x', f) == 'x' && fclose(f) == 0);
+
+    eavgDB *img = eavgDB_load("test_image_bad.img");
+    ASSERT(img && eavgDB_findEntityById(img, bId));
+    ASSERT(eavgDB_getValueList(img, aId) == NULL);
+    eavgAdjList *out = eavgDB_getAdjList(img, aId);
+    ASSERT(out && out->count == 1 && strcmp(out->edges[0].label, "knows") == 0);
+    ASSERT(eavgDB_save(img, "test_image_bad.db") < 0);
+    eavgDB_destroy(img);
+    remove("test_image_bad.img");
+    remove("test_image_bad.db");
+}
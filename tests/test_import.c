@@ -0,0 +1,82 @@
+#include "tests.h"
+#include "../eavg.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+TEST(test_import_csv_edges) {
+    eavgDB *db = eavgDB_create(16);
+    eavgEntity *hub = eavgDB_addEntity(db, 1, "hub");
+    FILE *f = fopen("test_import.csv", "w");
+    ASSERT(f);
+    fprintf(f, "src;tgt;rel;weight;label\n");
+    for (int i = 0; i < 1500; i++)
+        fprintf(f, "n%d;n%d;next;%d.5;\"say \"\"hi\"\"\"\r\n", i, i + 1, i);
+    fprintf(f, "\nhub;n7;knows\n");
+    fprintf(f, "hub;n8;knows;not-a-number\n");
+    fprintf(f, "\"unterminated;n1;knows\n");
+    fclose(f);
+
+    eavgImportOptions opt = { .format = EAVG_IMPORT_CSV, .kind = EAVG_IMPORT_EDGES,
+                              .threads = 4, .delimiter = ';', .header = true,
+                              .entityType = 3, .batchRows = 400 };
+    eavgImportStats st;
+    ASSERT(eavgDB_import(db, "test_import.csv", &opt, &st) == 0);
+    ASSERT(st.rows == 1503 && st.skipped == 2 && st.edges == 1501 && st.entitiesCreated == 1501);
+    ASSERT(st.totalSeconds >= st.parseSeconds && st.bytes > 0);
+    /* no executor given: the parsers ran on the db's pool */
+    ASSERT(atomic_load(&db->walkPool) != NULL);
+
+    eavgEntity *n0 = eavgDB_findEntityByName(db, "n0"), *n1 = eavgDB_findEntityByName(db, "n1");
+    ASSERT(n0 && n1 && n0->typeId == 3);
+    eavgAdjList *out = eavgDB_getAdjList(db, n0->id);
+    ASSERT(out && out->count == 1 && out->edges[0].targetEntity == n1->id);
+    ASSERT(out->edges[0].weight == 0.5 && strcmp(out->edges[0].label, "say \"hi\"") == 0);
+    ASSERT(eavgDB_getAdjList(db, eavgDB_findEntityByName(db, "n1499")->id)->edges[0].weight == 1499.5);
+    /* existing names resolve to the existing entity */
+    out = eavgDB_getAdjList(db, hub->id);
+    ASSERT(out && out->count == 1 && out->edges[0].weight == 1.0 && !out->edges[0].label);
+    ASSERT(eavgDB_findRelationTypeByName(db, "knows"));
+    eavgDB_destroy(db);
+}
+
+TEST(test_import_ndjson_values) {
+    eavgDB *db = eavgDB_create(16);
+    eavgAttribute *age    = eavgDB_addAttribute(db, "age", EAVG_DATA_TYPE_INT);
+    eavgAttribute *bio    = eavgDB_addAttribute(db, "bio", EAVG_DATA_TYPE_STRING);
+    eavgAttribute *friend = eavgDB_addAttribute(db, "friend", EAVG_DATA_TYPE_ENTITY);
+    FILE *f = fopen("test_import.ndjson", "w");
+    ASSERT(f);
+    for (int i = 0; i < 300; i++) {
+        fprintf(f, "{\"entity\": \"p%d\", \"attribute\": \"age\", \"value\": %d}\n", i, i);
+        fprintf(f, "{\"attribute\":\"friend\",\"entity\":\"p%d\",\"value\":\"p%d\",\"x\":1}\n",
+                i, (i + 1) % 300);
+    }
+    fprintf(f, "{\"entity\":\"p0\",\"attribute\":\"bio\",\"value\":\"line\\none \\u00e9\\\"\"}\n");
+    fprintf(f, "{\"entity\":\"p0\",\"attribute\":\"age\",\"value\":\"old\"}\n");
+    fprintf(f, "{\"entity\":\"p0\",\"attribute\":\"nope\",\"value\":1}\n");
+    fprintf(f, "{\"entity\":\"p0\",\"attribute\":\"age\",\"value\":{}}\n");
+    fclose(f);
+
+    /* more parsers than the executor has threads: what it cannot start
+     * in time is parsed on the calling thread */
+    eavgExecutor     *ex  = eavgExecutor_create(db, 1, 0);
+    eavgImportOptions opt = { .format = EAVG_IMPORT_NDJSON, .kind = EAVG_IMPORT_VALUES,
+                              .threads = 3, .batchRows = 100, .executor = ex };
+    eavgImportStats st;
+    ASSERT(ex && eavgDB_import(db, "test_import.ndjson", &opt, &st) == 0);
+    ASSERT(atomic_load(&db->walkPool) == NULL);
+    eavgExecutor_destroy(ex);
+    ASSERT(st.rows == 604 && st.skipped == 3 && st.values == 601 && st.entitiesCreated == 300);
+
+    eavgEntity    *p5 = eavgDB_findEntityByName(db, "p5"), *p6 = eavgDB_findEntityByName(db, "p6");
+    eavgValueList *vl = eavgDB_getValueList(db, p5->id);
+    ASSERT(vl && vl->count == 2);
+    ASSERT(vl->values[0].attributeId == age->id && eavgValRec_getInt(&vl->values[0]) == 5);
+    ASSERT(vl->values[1].attributeId == friend->id &&
+           eavgValRec_getEntityRef(&vl->values[1]) == p6->id);
+    vl = eavgDB_getValueList(db, eavgDB_findEntityByName(db, "p0")->id);
+    ASSERT(vl->count == 3 && vl->values[2].attributeId == bio->id);
+    ASSERT(strcmp(eavgValRec_getString(&vl->values[2]), "line\none \xc3\xa9\"") == 0);
+    eavgDB_destroy(db);
+}
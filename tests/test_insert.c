@@ -0,0 +1,95 @@
+#include "tests.h"
+#include "../eavg.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+enum { INSERTERS = 4, PER_THREAD = 2000 };
+
+struct insert_job {
+    eavgDB   *db;
+    eavg_u64  rel;
+    eavg_u64  hub;
+};
+
+static void *insert_loop(void *arg) {
+    struct insert_job *job = arg;
+    for (int i = 0; i < PER_THREAD; i++) {
+        eavgEntity *e = eavgDB_addEntity(job->db, 1, NULL);
+        if (e) eavgDB_addEdgeEx(job->db, job->hub, e->id, job->rel, 1.0,
+                                EAVG_EDGE_DIR_OUT, "spoke", 0);
+    }
+    return NULL;
+}
+
+static int count_type_cb(eavgDB *db, eavgEntity *e, void *ud) {
+    (void)db;
+    if (e->typeId == 1) (*(size_t*)ud)++;
+    return 0;
+}
+
+TEST(test_concurrent_insert_id_blocks) {
+    eavgDB *db = eavgDB_create(16);
+    eavgDB_setIdBlock(db, 64);
+    struct insert_job job = { db, eavgDB_addRelationType(db, "r")->id,
+                              eavgDB_addEntity(db, 0, "hub")->id };
+
+    pthread_t tids[INSERTERS];
+    for (int t = 0; t < INSERTERS; t++)
+        ASSERT(pthread_create(&tids[t], NULL, insert_loop, &job) == 0);
+    for (int t = 0; t < INSERTERS; t++) pthread_join(tids[t], NULL);
+
+    /* every id handed out once: no entity overwritten, no edge id repeated */
+    size_t entities = 0;
+    eavgDB_forEachEntity(db, count_type_cb, &entities);
+    ASSERT(entities == INSERTERS * PER_THREAD);
+
+    eavgAdjList *al = eavgDB_getAdjList(db, job.hub);
+    ASSERT(al && al->count == INSERTERS * PER_THREAD);
+    u64_map *seen = u64_map_create(2 * INSERTERS * PER_THREAD);
+    for (size_t i = 0; i < al->count; i++) {
+        ASSERT(u64_map_get(seen, al->edges[i].id) == NULL);
+        u64_map_put(seen, al->edges[i].id, &al->edges[i]);
+        ASSERT(eavgDB_findEntityById(db, al->edges[i].targetEntity) != NULL);
+    }
+    u64_map_destroy(seen);
+
+    /* blocks off again: a fresh id follows everything reserved so far */
+    eavgDB_setIdBlock(db, 0);
+    eavg_u64 last = eavgDB_addEntity(db, 2, NULL)->id;
+    ASSERT(last > al->edges[0].targetEntity);
+    eavgDB_destroy(db);
+}
+
+static size_t insert_bytes(const eavgDB *db) {
+    size_t used = 0;
+    for (const ArenaBlock *b = db->insertArena.blocks; b; b = b->next) used += b->used;
+    return used;
+}
+
+/* One thread inserting into two dbs in turn, then into more dbs than it
+ * keeps caches for: neither should strand a chunk per switch. */
+TEST(test_insert_interleaved_dbs) {
+    enum { DBS = 6, ROUNDS = 5000 };
+    eavgDB *dbs[DBS];
+    char    name[32];
+    for (int d = 0; d < DBS; d++) ASSERT((dbs[d] = eavgDB_create(16)) != NULL);
+
+    for (int i = 0; i < ROUNDS; i++)
+        for (int d = 0; d < 2; d++) {
+            snprintf(name, sizeof name, "a%d", i);
+            ASSERT(eavgDB_addEntity(dbs[d], 1, name));
+        }
+    for (int d = 0; d < 2; d++) ASSERT(insert_bytes(dbs[d]) < ROUNDS * 64 + 64 * 1024);
+
+    for (int i = 0; i < ROUNDS; i++)
+        for (int d = 0; d < DBS; d++) {
+            snprintf(name, sizeof name, "b%d", i);
+            ASSERT(eavgDB_addEntity(dbs[d], 1, name));
+        }
+    for (int d = 0; d < DBS; d++) {
+        ASSERT(insert_bytes(dbs[d]) < (d < 2 ? 2 : 1) * ROUNDS * 64 + 64 * 1024);
+        ASSERT(strcmp(eavgDB_findEntityByName(dbs[d], "b4999")->name, "b4999") == 0);
+        eavgDB_destroy(dbs[d]);
+    }
+}
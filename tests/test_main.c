@@ -9,10 +9,61 @@ extern void test_entity_add_lookup(void);
 extern void test_add_and_find_attribute(void);
 extern void test_add_and_find_relation_type(void);
 extern void test_add_int_double_string_binary_entityref(void);
+extern void test_value_remove_and_update(void);
 extern void test_edges_and_traversal(void);
 
 extern void test_save_load_empty_db(void);
 extern void test_save_load_simple_graph(void);
+extern void test_save_parallel_chunks(void);
+extern void test_load_parallel_lists(void);
+extern void test_save_compact(void);
+extern void test_chunked_lazy(void);
+extern void test_save_background(void);
+extern void test_save_incremental_chain(void);
+
+extern void test_bitmap_set_algebra(void);
+extern void test_bitmap_compound_query(void);
+
+extern void test_bulk_insert(void);
+extern void test_import_csv_edges(void);
+extern void test_import_ndjson_values(void);
+
+extern void test_change_feed_events(void);
+extern void test_change_feed_drop_policy(void);
+
+extern void test_snapshot_isolation(void);
+extern void test_snapshot_cow_reclaim(void);
+extern void test_snapshot_concurrent_scan(void);
+
+extern void test_brlock_writer_waits_for_readers(void);
+extern void test_brlock_concurrent_lookups(void);
+
+extern void test_tx_commit_atomic(void);
+extern void test_tx_abort_and_savepoint(void);
+extern void test_tx_removes_and_updates(void);
+
+extern void test_parallel_for_each(void);
+
+extern void test_concurrent_insert_id_blocks(void);
+extern void test_insert_interleaved_dbs(void);
+
+extern void test_exec_queries(void);
+extern void test_exec_admission_and_cancel(void);
+extern void test_image_save_load(void);
+extern void test_image_bad_list(void);
+extern void test_wal_replay_and_checkpoint(void);
+extern void test_wal_replays_edge_changes(void);
+extern void test_wal_group_commit(void);
+
+extern void test_stats_counts_and_locks(void);
+extern void test_stats_histogram_percentiles(void);
+extern void test_symbol_pool(void);
+extern void test_symbol_edge_labels(void);
+extern void test_symbol_label_budget(void);
+extern void test_query_patterns(void);
+extern void test_query_batches(void);
+extern void test_cache_hits_and_invalidation(void);
+extern void test_cache_budget_and_writers(void);
 
 int main(int argc, char **argv) {
     (void)argc;
@@ -35,10 +86,64 @@ int main(int argc, char **argv) {
     RUN(test_add_and_find_relation_type);
 
     RUN(test_add_int_double_string_binary_entityref);
+    RUN(test_value_remove_and_update);
 
     RUN(test_edges_and_traversal);
     RUN(test_save_load_empty_db);
     RUN(test_save_load_simple_graph);
+    RUN(test_save_parallel_chunks);
+    RUN(test_load_parallel_lists);
+    RUN(test_save_compact);
+    RUN(test_chunked_lazy);
+    RUN(test_save_background);
+    RUN(test_save_incremental_chain);
+
+    RUN(test_bitmap_set_algebra);
+    RUN(test_bitmap_compound_query);
+
+    RUN(test_bulk_insert);
+    RUN(test_import_csv_edges);
+    RUN(test_import_ndjson_values);
+
+    RUN(test_change_feed_events);
+    RUN(test_change_feed_drop_policy);
+
+    RUN(test_snapshot_isolation);
+    RUN(test_snapshot_cow_reclaim);
+    RUN(test_snapshot_concurrent_scan);
+
+    RUN(test_brlock_writer_waits_for_readers);
+    RUN(test_brlock_concurrent_lookups);
+
+    RUN(test_tx_commit_atomic);
+    RUN(test_tx_abort_and_savepoint);
+    RUN(test_tx_removes_and_updates);
+
+    RUN(test_parallel_for_each);
+
+    RUN(test_concurrent_insert_id_blocks);
+    RUN(test_insert_interleaved_dbs);
+
+    RUN(test_exec_queries);
+    RUN(test_exec_admission_and_cancel);
+    RUN(test_image_save_load);
+    RUN(test_image_bad_list);
+    RUN(test_wal_replay_and_checkpoint);
+    RUN(test_wal_replays_edge_changes);
+    RUN(test_wal_group_commit);
+
+    RUN(test_stats_counts_and_locks);
+    RUN(test_stats_histogram_percentiles);
+
+    RUN(test_symbol_pool);
+    RUN(test_symbol_edge_labels);
+    RUN(test_symbol_label_budget);
+
+    RUN(test_query_patterns);
+    RUN(test_query_batches);
+
+    RUN(test_cache_hits_and_invalidation);
+    RUN(test_cache_budget_and_writers);
 
     return 0;
 }
@@ -0,0 +1,79 @@
+#include "tests.h"
+#include "../eavg.h"
+#include <string.h>
+
+typedef struct {
+    size_t   entities;
+    eavg_u64 idSum;
+    double   weightSum;
+} walk_totals;
+
+static int sum_entity_cb(eavgDB *db, eavgEntity *e, void *state) {
+    (void)db;
+    walk_totals *t = state;
+    t->entities++;
+    t->idSum += e->id;
+    return 0;
+}
+
+static int sum_edge_cb(eavgDB *db, eavgEdgeRec *e, void *state) {
+    (void)db;
+    ((walk_totals*)state)->weightSum += e->weight;
+    return 0;
+}
+
+static void merge_totals(void *state, void *userData) {
+    walk_totals *from = state, *into = userData;
+    into->entities  += from->entities;
+    into->idSum     += from->idSum;
+    into->weightSum += from->weightSum;
+}
+
+static int stop_at_type_cb(eavgDB *db, eavgEntity *e, void *ud) {
+    (void)db; (void)ud;
+    return e->typeId == 7;
+}
+
+TEST(test_parallel_for_each) {
+    enum { N = 5000 };
+    eavgDB *db = eavgDB_create(16);
+    eavgRelationType *rel = eavgDB_addRelationType(db, "next");
+    eavg_u64 idSum = 0, prev = 0;
+    for (int i = 0; i < N; i++) {
+        eavg_u64 id = eavgDB_addEntity(db, i == N / 2 ? 7 : 0, NULL)->id;
+        idSum += id;
+        if (prev) eavgDB_addEdge(db, prev, id, rel->id, 0.5);
+        prev = id;
+    }
+
+    eavgParallelOptions opt = { .threads = 4, .chunkSlots = 64,
+                                .stateSize = sizeof(walk_totals), .reduce = merge_totals };
+    walk_totals total = { 0 };
+    ASSERT(eavgDB_parallelForEachEntity(db, &opt, sum_entity_cb, &total) == 0);
+    ASSERT(total.entities == N && total.idSum == idSum);
+    ASSERT(eavgDB_parallelForEachEdge(db, &opt, sum_edge_cb, &total) == 0);
+    ASSERT(total.weightSum == 0.5 * (N - 1));
+
+    ASSERT(eavgDB_parallelForEachEntity(db, NULL, stop_at_type_cb, NULL) == 1);
+
+    /* on a caller's executor, with more workers than it has threads */
+    eavgExecutor *ex = eavgExecutor_create(db, 1, 0);
+    ASSERT(ex);
+    opt.threads  = 8;
+    opt.executor = ex;
+    walk_totals onEx = { 0 };
+    ASSERT(eavgDB_parallelForEachEntity(db, &opt, sum_entity_cb, &onEx) == 0);
+    ASSERT(onEx.entities == N && onEx.idSum == idSum);
+    eavgExecutor_destroy(ex);
+
+    /* the same chunks driven by hand */
+    eavgSnapshot *s = eavgDB_snapshotBegin(db);
+    size_t slots = eavgSnapshot_entitySlots(s);
+    walk_totals byHand = { 0 };
+    for (size_t begin = 0; begin < slots; begin += 100)
+        ASSERT(eavgSnapshot_forEachEntityInRange(s, begin, begin + 100, sum_entity_cb, &byHand) == 0);
+    ASSERT(byHand.entities == N && byHand.idSum == idSum);
+    eavgDB_snapshotEnd(s);
+
+    eavgDB_destroy(db);
+}
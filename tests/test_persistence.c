@@ -3,6 +3,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
+#include <sys/stat.h>
 
 static int countEntitiesCB(eavgDB *db, eavgEntity *e, void *ud) {
     (void)db; (void)e;
@@ -58,6 +59,7 @@ TEST(test_save_load_simple_graph) {
     ASSERT(rt && rt->id == 1);
     eavgEdgeRec *e = eavgDB_addEdge(db, n1->id, n2->id, rt->id, 3.14);
     ASSERT(e && e->id == 1);
+    eavg_u64 rtId = rt->id;
 
     ASSERT(eavgDB_save(db, fname) == 0);
     eavgDB_destroy(db);
@@ -74,7 +76,7 @@ TEST(test_save_load_simple_graph) {
     ASSERT(attrb && attrb->dataType == EAVG_DATA_TYPE_STRING);
 
     eavgRelationType *rtb = eavgDB_findRelationTypeByName(db2, "connects");
-    ASSERT(rtb && rtb->id == rt->id);
+    ASSERT(rtb && rtb->id == rtId);
 
     size_t edcount = 0;
     eavgDB_forEachEdge(db2, countEdgesCB, &edcount);
@@ -89,3 +91,427 @@ TEST(test_save_load_simple_graph) {
 
     eavgDB_destroy(db2);
 }
+
+TEST(test_save_parallel_chunks) {
+    const char *fname = "test_parallel_save.db";
+    eavgDB *db = eavgDB_create(16);
+    eavgAttribute    *note = eavgDB_addAttribute(db, "note", EAVG_DATA_TYPE_STRING);
+    eavgRelationType *rel  = eavgDB_addRelationType(db, "next");
+    eavg_u64 prev = 0;
+    for (int i = 0; i < 6000; i++) {
+        eavgEntity *e = eavgDB_addEntity(db, 3, NULL);
+        if (i % 3 == 0) eavgDB_addStringValue(db, e->id, note->id, "a value long enough to spill");
+        if (prev) eavgDB_addEdge(db, prev, e->id, rel->id, i);
+        prev = e->id;
+    }
+    eavgSaveOptions opt = { .threads = 4, .directIO = true };
+    ASSERT(eavgDB_saveEx(db, fname, &opt) == 0);
+    ASSERT(eavgDB_save(db, "no_such_dir/test.db") == -1);
+    eavgDB_destroy(db);
+
+    eavgDB *db2 = eavgDB_load(fname);
+    ASSERT(db2);
+    size_t ec = 0, edc = 0;
+    eavgDB_forEachEntity(db2, countEntitiesCB, &ec);
+    eavgDB_forEachEdge(db2, countEdgesCB, &edc);
+    ASSERT(ec == 6000 && edc == 5999);
+    eavgValueList *vl = eavgDB_getValueList(db2, 1);
+    ASSERT(vl && vl->count == 1 &&
+           strcmp(eavgValRec_getString(&vl->values[0]), "a value long enough to spill") == 0);
+    ASSERT(eavgDB_getAdjList(db2, prev - 1)->edges[0].weight == 5999);
+    eavgDB_destroy(db2);
+}
+
+TEST(test_load_parallel_lists) {
+    const char *fname = "test_parallel_load.db";
+    eavgDB *db = eavgDB_create(16);
+    eavgAttribute    *n   = eavgDB_addAttribute(db, "n", EAVG_DATA_TYPE_INT);
+    eavgAttribute    *tag = eavgDB_addAttribute(db, "tag", EAVG_DATA_TYPE_STRING);
+    eavgRelationType *rel = eavgDB_addRelationType(db, "to");
+    eavg_u64 hub = eavgDB_addEntity(db, 1, "hub")->id, nId = n->id, last = 0;
+    for (int i = 0; i < 3000; i++) {
+        eavg_u64 id = eavgDB_addEntity(db, 2, NULL)->id;
+        last = eavgDB_addIntValue(db, hub, n->id, i)->id;
+        if (i % 2) last = eavgDB_addStringValue(db, id, tag->id, i % 4 == 1 ? "short" : "long enough to spill")->id;
+        eavgDB_addEdgeEx(db, id, hub, rel->id, i, EAVG_EDGE_DIR_OUT, "in", 0);
+        eavgDB_addEdgeEx(db, hub, id, rel->id, i, EAVG_EDGE_DIR_OUT, NULL, 0);
+    }
+    ASSERT(eavgDB_save(db, fname) == 0);
+    eavgDB_destroy(db);
+
+    /* hub's lists span every run; they must come back in file order */
+    eavgLoadOptions one = { .threads = 1 }, four = { .threads = 4 };
+    eavgDB *a = eavgDB_loadEx(fname, &one), *b = eavgDB_loadEx(fname, &four);
+    ASSERT(a && b);
+    eavgValueList *va = eavgDB_getValueList(a, hub), *vb = eavgDB_getValueList(b, hub);
+    ASSERT(va->count == 3000 && vb->count == 3000 && vb->cap == 3000);
+    for (size_t i = 0; i < 3000; i++) {
+        ASSERT(vb->values[i].id == va->values[i].id &&
+               vb->values[i].data.intValue == va->values[i].data.intValue);
+        ASSERT(eavgDB_findValueById(b, vb->values[i].id) == &vb->values[i]);
+    }
+    eavgAdjList *ra = eavgDB_getReverseAdjList(a, hub), *rb = eavgDB_getReverseAdjList(b, hub);
+    ASSERT(ra->count == 3000 && rb->count == 3000 && rb->cap == 3000);
+    for (size_t i = 0; i < 3000; i++)
+        ASSERT(rb->edges[i].id == ra->edges[i].id && strcmp(rb->edges[i].label, "in") == 0);
+    ASSERT(eavgDB_getAdjList(b, hub)->count == 3000);
+    eavgValueList *t = eavgDB_getValueList(b, hub + 4);
+    ASSERT(t && strcmp(eavgValRec_getString(&t->values[0]), "long enough to spill") == 0);
+
+    /* ids continue after the loaded ones */
+    eavgValRec *v = eavgDB_addIntValue(b, hub, nId, 7);
+    ASSERT(v && v->id == last + 1);
+    eavgDB_destroy(a);
+    eavgDB_destroy(b);
+}
+
+static long file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (long)st.st_size : -1;
+}
+
+TEST(test_save_compact) {
+    eavgDB *db = eavgDB_create(16);
+    eavgAttribute    *num  = eavgDB_addAttribute(db, "num", EAVG_DATA_TYPE_INT);
+    eavgAttribute    *txt  = eavgDB_addAttribute(db, "txt", EAVG_DATA_TYPE_STRING);
+    eavgAttribute    *blob = eavgDB_addAttribute(db, "blob", EAVG_DATA_TYPE_BINARY);
+    eavgAttribute    *ref  = eavgDB_addAttribute(db, "ref", EAVG_DATA_TYPE_ENTITY);
+    eavgRelationType *rel  = eavgDB_addRelationType(db, "knows");
+    eavg_u64 first = 0, prev = 0;
+    for (int i = 0; i < 2000; i++) {
+        eavg_u64 id = eavgDB_addEntity(db, i % 3, i % 5 ? NULL : "named")->id;
+        if (!first) first = id;
+        eavgDB_addIntValue(db, id, num->id, i % 2 ? -i : i * 100000L);
+        if (i % 7 == 0) eavgDB_addStringValue(db, id, txt->id, i % 14 ? NULL : "some text");
+        if (i % 9 == 0) eavgDB_addBinaryValue(db, id, blob->id, (const unsigned char*)"\0\1\2", 3);
+        if (prev) {
+            eavgDB_addEntityRefValue(db, id, ref->id, prev);
+            eavgDB_addEdgeEx(db, prev, id, rel->id, i * 0.5, EAVG_EDGE_DIR_OUT,
+                             "knows", 1700000000u + i);
+            eavgDB_addEdgeEx(db, id, first, rel->id, 1, EAVG_EDGE_DIR_BOTH, NULL, 0);
+        }
+        prev = id;
+    }
+    eavgSaveOptions compact = { .compact = true };
+    ASSERT(eavgDB_save(db, "test_plain.db") == 0);
+    ASSERT(eavgDB_saveEx(db, "test_compact.db", &compact) == 0);
+    eavgDB_destroy(db);
+    ASSERT(file_size("test_compact.db") * 2 < file_size("test_plain.db"));
+
+    eavgLoadOptions four = { .threads = 4 };
+    eavgDB *a = eavgDB_load("test_plain.db"), *b = eavgDB_loadEx("test_compact.db", &four);
+    ASSERT(a && b);
+    ASSERT(strcmp(eavgDB_findAttributeByName(b, "blob")->name, "blob") == 0);
+    for (eavg_u64 id = first; id <= prev; id++) {
+        eavgEntity *ea = eavgDB_findEntityById(a, id), *eb = eavgDB_findEntityById(b, id);
+        ASSERT(eb && eb->typeId == ea->typeId && (eb->name != NULL) == (ea->name != NULL));
+        eavgValueList *va = eavgDB_getValueList(a, id), *vb = eavgDB_getValueList(b, id);
+        ASSERT(vb && vb->count == va->count);
+        for (size_t k = 0; k < va->count; k++) {
+            size_t la, lb;
+            const unsigned char *pa = eavgValRec_getBinary(&va->values[k], &la);
+            const unsigned char *pb = eavgValRec_getBinary(&vb->values[k], &lb);
+            ASSERT(vb->values[k].id == va->values[k].id && la == lb &&
+                   (la ? memcmp(pa, pb, la) == 0 : pa == pb || !pa || !pb));
+        }
+        eavgAdjList *oa = eavgDB_getAdjList(a, id), *ob = eavgDB_getAdjList(b, id);
+        ASSERT(!oa == !ob);
+        for (size_t k = 0; oa && k < oa->count; k++) {
+            eavgEdgeRec *x = &oa->edges[k], *y = &ob->edges[k];
+            ASSERT(x->id == y->id && x->targetEntity == y->targetEntity &&
+                   x->weight == y->weight && x->direction == y->direction &&
+                   x->timestamp == y->timestamp && !x->label == !y->label);
+        }
+        ASSERT(eavgDB_getReverseAdjList(b, id)->count == eavgDB_getReverseAdjList(a, id)->count);
+    }
+    /* every label points at the one copy in the string table */
+    ASSERT(eavgDB_getAdjList(b, first)->edges[0].label &&
+           eavgDB_getAdjList(b, first)->edges[0].label ==
+           eavgDB_getAdjList(b, first + 1)->edges[1].label);
+    eavgDB_destroy(a);
+    eavgDB_destroy(b);
+}
+
+static void count_bad(const eavgChunkError *err, void *userData) {
+    const char **section = userData;
+    if (!*section) *section = err->section;
+    ASSERT(err->firstKey <= err->lastKey);
+}
+
+TEST(test_chunked_lazy) {
+    eavgDB *db = eavgDB_create(16);
+    eavgAttribute    *num = eavgDB_addAttribute(db, "num", EAVG_DATA_TYPE_INT);
+    eavgAttribute    *txt = eavgDB_addAttribute(db, "txt", EAVG_DATA_TYPE_STRING);
+    eavgRelationType *rel = eavgDB_addRelationType(db, "next");
+    eavg_u64 first = 0, prev = 0;
+    for (int i = 0; i < 3000; i++) {
+        eavg_u64 id = eavgDB_addEntity(db, 1, NULL)->id;
+        if (!first) first = id;
+        eavgDB_addIntValue(db, id, num->id, i);
+        eavgDB_addStringValue(db, id, txt->id, "a string long enough to need a few chunks");
+        if (prev) eavgDB_addEdgeEx(db, prev, id, rel->id, i, EAVG_EDGE_DIR_OUT, NULL, 0);
+        prev = id;
+    }
+    eavg_u64 relId = rel->id;
+    ASSERT(eavgDB_saveChunked(db, "test_chunked.db") == 0);
+    eavgDB_destroy(db);
+    ASSERT(eavgDB_verify("test_chunked.db", NULL, NULL) == 0);
+
+    /* touching a few entities loads only their chunks */
+    remove("test_chunked.db.wal");
+    eavgDB *lazy = eavgDB_openLazy("test_chunked.db");
+    ASSERT(lazy && eavgDB_findAttributeByName(lazy, "txt"));
+    size_t unloaded = eavgDB_lazyUnloadedChunks(lazy);
+    eavg_u64 mid = first + 1500;
+    ASSERT(eavgDB_getValueList(lazy, mid)->values[0].data.intValue == 1500);
+    ASSERT(eavgDB_getAdjList(lazy, mid)->edges[0].targetEntity == mid + 1);
+    ASSERT(eavgDB_getReverseAdjList(lazy, mid)->count == 1);
+    ASSERT(!eavgDB_getAdjList(lazy, prev) || eavgDB_getAdjList(lazy, prev)->count == 0);
+    ASSERT(eavgDB_addEntity(lazy, 1, NULL)->id == prev + 1);
+    ASSERT(eavgDB_lazyBadChunks(lazy) == 0);
+    ASSERT(eavgDB_lazyUnloadedChunks(lazy) > 0 && eavgDB_lazyUnloadedChunks(lazy) < unloaded);
+    unloaded = eavgDB_lazyUnloadedChunks(lazy);
+
+    /* a snapshot reads what was unloaded when it began from the file, and
+     * a write loads only the chunks of the entity it changes */
+    eavgSnapshot *snap = eavgDB_snapshotBegin(lazy);
+    eavg_u64 near = first + 10;
+    eavg_u64 v    = eavgDB_getValueList(lazy, near)->values[0].id;
+    ASSERT(eavgDB_updateValue(lazy, v, (eavgValueData){ .intValue = -1 }, 0) == 0);
+    ASSERT(eavgDB_addEdgeEx(lazy, near, mid, relId, 0, EAVG_EDGE_DIR_OUT, NULL, 0));
+    ASSERT(eavgDB_lazyUnloadedChunks(lazy) > 0 && eavgDB_lazyUnloadedChunks(lazy) < unloaded);
+    ASSERT(eavgDB_getValueList(lazy, near)->values[0].data.intValue == -1);
+    ASSERT(eavgSnapshot_getValueList(snap, near)->values[0].data.intValue == 10);
+    ASSERT(eavgSnapshot_getAdjList(snap, near)->count == 1);
+    ASSERT(eavgSnapshot_getValueList(snap, first + 2500)->values[0].data.intValue == 2500);
+    size_t edges = 0;
+    eavgSnapshot_forEachEdge(snap, countEdgesCB, &edges);
+    ASSERT(edges == 2999);
+    eavgDB_snapshotEnd(snap);
+    edges = 0;
+    eavgDB_forEachEdge(lazy, countEdgesCB, &edges);
+    ASSERT(edges == 3000);
+
+    /* replaying a log loads only the chunks its records touch */
+    ASSERT(eavgDB_walOpen(lazy, "test_chunked.db", NULL) == 0);
+    eavg_u64 late = first + 2000;
+    eavg_u64 gone = eavgDB_getAdjList(lazy, late)->edges[0].id;
+    ASSERT(eavgDB_updateValue(lazy, eavgDB_getValueList(lazy, late)->values[0].id,
+                              (eavgValueData){ .intValue = -2 }, 0) == 0);
+    ASSERT(eavgDB_removeEdge(lazy, gone) == 0);
+    ASSERT(eavgDB_walSync(lazy) == 0);
+    eavgDB_destroy(lazy);
+    lazy = eavgDB_openLazy("test_chunked.db");
+    ASSERT(lazy && eavgDB_lazyUnloadedChunks(lazy) > 0);
+    ASSERT(eavgDB_getValueList(lazy, late)->values[0].data.intValue == -2);
+    ASSERT(eavgDB_getAdjList(lazy, late)->count == 0);
+    ASSERT(eavgDB_getReverseAdjList(lazy, late + 1)->count == 0);
+    ASSERT(eavgDB_lazyUnloadedChunks(lazy) > 0);
+
+    /* a by-id lookup that misses what is loaded loads the rest */
+    eavgDB *full = eavgDB_load("test_chunked.db");
+    ASSERT(full);
+    ASSERT(eavgDB_findValueById(lazy, eavgDB_getValueList(full, first)->values[1].id));
+    for (eavg_u64 id = first; id <= prev; id++) {
+        eavgValueList *a = eavgDB_getValueList(full, id), *b = eavgDB_getValueList(lazy, id);
+        ASSERT(a && b && a->count == 2 && b->count == 2);
+        ASSERT(a->values[0].data.intValue == b->values[0].data.intValue &&
+               strcmp(eavgValRec_getString(&b->values[1]), eavgValRec_getString(&a->values[1])) == 0);
+    }
+    eavgDB_destroy(full);
+    eavgDB_destroy(lazy);
+    remove("test_chunked.db.wal");
+
+    /* a flipped byte in the middle of the file lands in a value chunk */
+    FILE *f = fopen("test_chunked.db", "r+b");
+    ASSERT(f && fseek(f, file_size("test_chunked.db") / 3, SEEK_SET) == 0);
+    int c = fgetc(f);
+    ASSERT(fseek(f, -1, SEEK_CUR) == 0 && fputc(c ^ 0xff, f) != EOF);
+    fclose(f);
+    const char *section = NULL;
+    ASSERT(eavgDB_verify("test_chunked.db", count_bad, &section) == 1);
+    ASSERT(section && strcmp(section, "values") == 0);
+    ASSERT(eavgDB_load("test_chunked.db") == NULL);
+
+    /* lazily, only the entities in the bad chunk lose their values, and
+     * the chunk is reported when first read */
+    section = NULL;
+    lazy = eavgDB_openLazyEx("test_chunked.db", count_bad, &section);
+    ASSERT(lazy && !section);
+    size_t missing = 0;
+    for (eavg_u64 id = first; id <= prev; id++) {
+        if (!eavgDB_getValueList(lazy, id)) missing++;
+        ASSERT(eavgDB_getAdjList(lazy, id) || id == prev);
+    }
+    ASSERT(missing > 0 && missing < 1000 && eavgDB_lazyBadChunks(lazy) == 1);
+    ASSERT(section && strcmp(section, "values") == 0);
+    ASSERT(eavgDB_save(lazy, "test_chunked_copy.db") < 0);
+    eavgDB_destroy(lazy);
+    remove("test_chunked_copy.db");
+
+    /* put that byte back and break an edge chunk: an async edge query on
+     * an entity in it fails rather than finding nothing */
+    f = fopen("test_chunked.db", "r+b");
+    ASSERT(f && fseek(f, file_size("test_chunked.db") / 3, SEEK_SET) == 0);
+    ASSERT(fputc(c, f) != EOF && fseek(f, file_size("test_chunked.db") * 9 / 10, SEEK_SET) == 0);
+    c = fgetc(f);
+    ASSERT(fseek(f, -1, SEEK_CUR) == 0 && fputc(c ^ 0xff, f) != EOF);
+    fclose(f);
+    section = NULL;
+    ASSERT(eavgDB_verify("test_chunked.db", count_bad, &section) == 1);
+    ASSERT(section && strcmp(section, "in-edges") == 0);
+    lazy = eavgDB_openLazy("test_chunked.db");
+    eavgExecutor *ex = eavgExecutor_create(lazy, 1, 0);
+    ASSERT(lazy && ex);
+    size_t failed = 0;
+    for (eavg_u64 id = first + 1; id <= prev; id++) {
+        eavgFuture *q = eavgExecutor_filteredEdges(ex, id, EAVG_EDGE_DIR_IN, NULL, NULL,
+                                                   NULL, NULL);
+        ASSERT(q && eavgFuture_wait(q, -1) == 0);
+        size_t n;
+        eavgFuture_result(q, &n);
+        if (eavgFuture_poll(q) == EAVG_FUTURE_FAILED) failed++;
+        else ASSERT(eavgFuture_status(q) == 0 && n == 1);
+        eavgFuture_release(q);
+    }
+    ASSERT(failed > 0 && failed < prev - first);
+    eavgExecutor_destroy(ex);
+    eavgDB_destroy(lazy);
+}
+
+struct bg_counts { size_t calls, last, total; int status; };
+
+static void bg_progress(size_t done, size_t total, void *userData) {
+    struct bg_counts *c = userData;
+    ASSERT(done == c->last + 1 && done <= total);
+    c->calls++;
+    c->last  = done;
+    c->total = total;
+}
+
+static void bg_done(eavgFuture *f, void *userData) {
+    ((struct bg_counts*)userData)->status = eavgFuture_status(f) + 1;
+}
+
+TEST(test_save_background) {
+    eavgDB *db = eavgDB_create(16);
+    eavgAttribute *num = eavgDB_addAttribute(db, "num", EAVG_DATA_TYPE_INT);
+    eavg_u64 first = 0, last = 0;
+    for (int i = 0; i < 3000; i++) {
+        last = eavgDB_addEntity(db, 1, NULL)->id;
+        if (!first) first = last;
+        eavgDB_addIntValue(db, last, num->id, i);
+    }
+    struct bg_counts progress = { 0 }, done = { 0 };
+    eavgSaveOptions opt = { .threads = 2, .progress = bg_progress, .progressData = &progress };
+    eavgExecutor *ex = eavgExecutor_create(db, 1, 0);
+    eavgFuture   *bg = ex ? eavgExecutor_saveEx(ex, "test_bg.db", &opt, bg_done, &done) : NULL;
+    ASSERT(bg);
+    /* writers are not held up, and nothing after the call reaches the file */
+    eavgDB_addIntValue(db, first, num->id, -1);
+    for (int i = 0; i < 100; i++) eavgDB_addEntity(db, 2, NULL);
+    ASSERT(eavgFuture_wait(bg, -1) == 0 && eavgFuture_poll(bg) == EAVG_FUTURE_DONE);
+    size_t chunks, total;
+    eavgFuture_progress(bg, &chunks, &total);
+    ASSERT(chunks == total && total > 0 && progress.last == total);
+    eavgFuture_release(bg);
+    eavgExecutor_destroy(ex);                  /* joins the worker that ran done */
+    ASSERT(done.status == 1);
+    ASSERT(eavgDB_getValueList(db, first)->count == 2);
+    eavgDB_destroy(db);
+
+    eavgDB *back = eavgDB_load("test_bg.db");
+    ASSERT(back && eavgDB_findEntityById(back, last) && !eavgDB_findEntityById(back, last + 1));
+    ASSERT(eavgDB_getValueList(back, first)->count == 1);
+    eavgDB_destroy(back);
+}
+
+/* Same entities, values and edges (in both directions) for ids 1..last. */
+static int same_graph(eavgDB *a, eavgDB *b, eavg_u64 last) {
+    for (eavg_u64 id = 1; id <= last; id++) {
+        eavgEntity *ea = eavgDB_findEntityById(a, id), *eb = eavgDB_findEntityById(b, id);
+        if (!ea != !eb || (ea && ea->typeId != eb->typeId)) return 0;
+        eavgValueList *va = eavgDB_getValueList(a, id), *vb = eavgDB_getValueList(b, id);
+        size_t na = va ? va->count : 0, nb = vb ? vb->count : 0;
+        if (na != nb) return 0;
+        for (size_t k = 0; k < na; k++) {
+            if (va->values[k].id != vb->values[k].id ||
+                va->values[k].data.intValue != vb->values[k].data.intValue) return 0;
+        }
+        for (int rev = 0; rev < 2; rev++) {
+            eavgAdjList *la = rev ? eavgDB_getReverseAdjList(a, id) : eavgDB_getAdjList(a, id);
+            eavgAdjList *lb = rev ? eavgDB_getReverseAdjList(b, id) : eavgDB_getAdjList(b, id);
+            na = la ? la->count : 0;
+            nb = lb ? lb->count : 0;
+            if (na != nb) return 0;
+            for (size_t k = 0; k < na; k++) {
+                if (la->edges[k].id != lb->edges[k].id ||
+                    la->edges[k].weight != lb->edges[k].weight) return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+TEST(test_save_incremental_chain) {
+    eavgDB *db = eavgDB_create(16);
+    eavgAttribute    *num  = eavgDB_addAttribute(db, "num", EAVG_DATA_TYPE_INT);
+    eavgRelationType *next = eavgDB_addRelationType(db, "next");
+    eavgRelationType *old  = eavgDB_addRelationType(db, "old");
+    eavg_u64 last = 0;
+    for (int i = 0; i < 2000; i++) {
+        eavg_u64 id = eavgDB_addEntity(db, 1, NULL)->id;
+        eavgDB_addIntValue(db, id, num->id, i);
+        if (last) eavgDB_addEdgeEx(db, last, id, next->id, 1, EAVG_EDGE_DIR_OUT, "n", 0);
+        last = id;
+    }
+    ASSERT(eavgDB_save(db, "test_inc_base.db") == 0);
+
+    /* first delta: a few values, an entity with edges both ways, a type */
+    eavgValRec *v = eavgDB_getValueList(db, 5)->values;
+    ASSERT(eavgDB_updateValue(db, v->id, (eavgValueData){ .intValue = -5 }, 0) == 0);
+    eavgDB_addIntValue(db, 6, num->id, 66);
+    ASSERT(eavgDB_removeEntity(db, 10) == 0);
+    ASSERT(eavgDB_removeRelationType(db, old->id) == 0);
+    ASSERT(eavgDB_saveIncremental(db, "test_inc_1.db", "test_inc_base.db") == 0);
+    ASSERT(file_size("test_inc_1.db") * 20 < file_size("test_inc_base.db"));
+
+    /* second delta, on top of the first */
+    eavg_u64 added = eavgDB_addEntity(db, 2, NULL)->id;
+    eavgDB_addEdgeEx(db, added, 1, next->id, 2, EAVG_EDGE_DIR_OUT, NULL, 0);
+    eavgEdgeRec *e = eavgDB_addEdgeEx(db, 20, added, next->id, 3, EAVG_EDGE_DIR_OUT, NULL, 0);
+    ASSERT(eavgDB_updateEdgeWeight(db, e->id, 4) == 0);
+    ASSERT(eavgDB_removeEdge(db, eavgDB_getAdjList(db, 30)->edges[0].id) == 0);
+    ASSERT(eavgDB_removeValue(db, eavgDB_getValueList(db, 40)->values[0].id) == 0);
+    ASSERT(eavgDB_saveIncremental(db, "test_inc_2.db", "test_inc_1.db") == 0);
+
+    eavgDB *back = eavgDB_load("test_inc_2.db");
+    ASSERT(back && same_graph(db, back, added));
+    ASSERT(!eavgDB_findRelationTypeById(back, old->id) && eavgDB_findAttributeByName(back, "num"));
+    ASSERT(eavgDB_addEntity(back, 1, NULL)->id == added + 1);
+    eavgDB_destroy(back);
+
+    ASSERT(eavgDB_mergeChain("test_inc_2.db", "test_inc_merged.db", NULL) == 0);
+    eavgDB *merged = eavgDB_load("test_inc_merged.db");
+    ASSERT(merged && same_graph(db, merged, added));
+    eavgDB_destroy(merged);
+
+    /* a copy saved elsewhere leaves the baseline: the next delta still
+     * holds what changed before it, and only the baseline is a parent */
+    eavgDB_addIntValue(db, 7, num->id, 77);
+    ASSERT(eavgDB_save(db, "test_inc_copy.db") == 0);
+    ASSERT(eavgDB_saveImage(db, "test_inc_copy.img") == 0);
+    ASSERT(eavgDB_saveIncremental(db, "test_inc_3.db", "test_inc_1.db") < 0);
+    ASSERT(eavgDB_saveIncremental(db, "test_inc_3.db", "test_inc_copy.db") < 0);
+    ASSERT(eavgDB_saveIncremental(db, "test_inc_3.db", "test_inc_2.db") == 0);
+    back = eavgDB_load("test_inc_3.db");
+    ASSERT(back && same_graph(db, back, added));
+    eavgDB_destroy(back);
+
+    /* nothing changed since: an empty delta; a rewritten base breaks the chain */
+    ASSERT(eavgDB_saveIncremental(db, "test_inc_4.db", "test_inc_3.db") == 0);
+    ASSERT(file_size("test_inc_4.db") < 200);
+    ASSERT(eavgDB_save(db, "test_inc_base.db") == 0);
+    ASSERT(eavgDB_load("test_inc_4.db") == NULL);
+    eavgDB_destroy(db);
+}
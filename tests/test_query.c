@@ -0,0 +1,145 @@
+#include "tests.h"
+#include "../eavg.h"
+#include <string.h>
+
+typedef struct {
+    size_t   rows, columns;
+    eavg_u64 ids[64][4];
+    long     values[64];
+    bool     has[64];
+    int      stopAfter;
+} collected;
+
+static int collect(const eavgQueryCell *rows, size_t count, void *ud) {
+    collected *c = ud;
+    for (size_t r = 0; r < count; r++, c->rows++) {
+        if (c->rows >= 64) continue;
+        for (size_t k = 0; k < c->columns && k < 4; k++) c->ids[c->rows][k] = rows[r * c->columns + k].entityId;
+        const eavgQueryCell *last = &rows[r * c->columns + c->columns - 1];
+        c->has[c->rows]    = last->hasValue;
+        c->values[c->rows] = last->hasValue ? eavgValRec_getInt(&last->value) : 0;
+    }
+    return c->stopAfter && c->rows >= (size_t)c->stopAfter;
+}
+
+static size_t run(eavgDB *db, const char *pattern, collected *c) {
+    char       err[128];
+    eavgQuery *q = eavgQuery_compile(db, pattern, err, sizeof err);
+    ASSERT(q);
+    memset(c, 0, sizeof *c);
+    c->columns = eavgQuery_columnCount(q);
+    ASSERT(eavgQuery_run(q, collect, c) == 0);
+    eavgQuery_free(q);
+    return c->rows;
+}
+
+TEST(test_query_patterns) {
+    eavgDB *db = eavgDB_create(16);
+    eavgEntity *alice = eavgDB_addEntity(db, 1, "Alice");
+    eavgEntity *bob   = eavgDB_addEntity(db, 1, "Bob");
+    eavgEntity *carol = eavgDB_addEntity(db, 1, "Carol");
+    eavgEntity *acme  = eavgDB_addEntity(db, 2, "Acme");
+    eavg_u64 age  = eavgDB_addAttribute(db, "age", EAVG_DATA_TYPE_INT)->id;
+    eavg_u64 city = eavgDB_addAttribute(db, "city", EAVG_DATA_TYPE_STRING)->id;
+    eavg_u64 knows = eavgDB_addRelationType(db, "knows")->id;
+    eavg_u64 works = eavgDB_addRelationType(db, "works at")->id;
+    eavgDB_addIntValue(db, alice->id, age, 34);
+    eavgDB_addIntValue(db, bob->id, age, 27);
+    eavgDB_addIntValue(db, carol->id, age, 41);
+    eavgDB_addStringValue(db, acme->id, city, NULL);
+    eavgDB_addStringValue(db, acme->id, city, "Oslo");
+    eavgDB_addStringValue(db, carol->id, city, NULL);
+    eavgDB_addEdge(db, alice->id, bob->id, knows, 1.0);
+    eavgDB_addEdgeEx(db, bob->id, carol->id, knows, 0.2, EAVG_EDGE_DIR_OUT, "old friend", 0);
+    eavgDB_addEdge(db, carol->id, alice->id, knows, 1.0);
+    eavgDB_addEdge(db, bob->id, acme->id, works, 1.0);
+    eavgDB_addEdge(db, carol->id, acme->id, works, 1.0);
+
+    collected c;
+    /* two hops from a name, with a projected attribute */
+    ASSERT(run(db, "(a {name='Alice'})-[knows]->(b)-[knows]->(c) RETURN c, c.age", &c) == 1);
+    ASSERT(c.ids[0][0] == carol->id && c.has[0] && c.values[0] == 41);
+
+    /* colleagues over 30: a predicate on both ends, an edge walked backwards */
+    ASSERT(run(db, "(p:1 {age>30})-[`works at`]->(co:2 {city=\"Oslo\"})<-[`works at`]-(q)", &c) == 2);
+    ASSERT(c.columns == 3);
+    for (size_t r = 0; r < c.rows; r++) ASSERT(c.ids[r][0] == carol->id && c.ids[r][1] == acme->id);
+
+    /* either way, edge predicates, a cycle through a repeated variable */
+    ASSERT(run(db, "(a {name='Bob'})-[knows]-(b)", &c) == 2);
+    ASSERT(run(db, "(a)-[knows {label='old friend', weight<0.5}]->(b) RETURN b", &c) == 1 &&
+           c.ids[0][0] == carol->id);
+    ASSERT(run(db, "(a)-[knows]->()-[knows]->()-[knows]->(a)", &c) == 3);
+    ASSERT(run(db, "(a)-->(b:2) RETURN a.age LIMIT 1", &c) == 1 && c.has[0]);
+
+    /* a NULL string matches no predicate */
+    ASSERT(run(db, "(n {city=\"Oslo\"})", &c) == 1 && c.ids[0][0] == acme->id);
+    ASSERT(run(db, "(n {city!=\"Oslo\"})", &c) == 0);
+
+    /* unknown names match nothing; bad syntax and mismatched literals fail */
+    ASSERT(run(db, "(a)-[likes]->(b)", &c) == 0);
+    ASSERT(run(db, "(a {height>2})", &c) == 0);
+    char       err[128] = "";
+    ASSERT(!eavgQuery_compile(db, "(a)-[knows]->(b", err, sizeof err) && strstr(err, "')'"));
+    ASSERT(!eavgQuery_compile(db, "(a) RETURN z", NULL, 0));
+    eavgQuery *q = eavgQuery_compile(db, "(a {age='old'})", NULL, 0);
+    ASSERT(q && eavgQuery_run(q, collect, &c) == -1);
+    eavgQuery_free(q);
+
+    /* the planner starts from the name, not the type */
+    char plan[256];
+    q = eavgQuery_compile(db, "(a:1)-[knows]->(b {name='Carol'})", NULL, 0);
+    ASSERT(eavgQuery_explain(q, plan, sizeof plan) > 0);
+    ASSERT(strncmp(plan, "start (b) by name index", 23) == 0 && strstr(plan, "(b)<-[knows]-(a)"));
+    ASSERT(strcmp(eavgQuery_columnName(q, 1), "b") == 0);
+    eavgQuery_free(q);
+    eavgDB_destroy(db);
+}
+
+static int count_rows(const eavgQueryCell *rows, size_t count, void *ud) {
+    (void)rows;
+    *(size_t *)ud += count;
+    return 0;
+}
+
+static int stop_at_once(const eavgQueryCell *rows, size_t count, void *ud) {
+    (void)rows; (void)count; (void)ud;
+    return 1;
+}
+
+TEST(test_query_batches) {
+    /* 40 hubs of type 1, each linked to the same 30 leaves of type 2 of
+     * which every third is marked: 40 * 30 * 10 two-hop paths back to a
+     * hub, many more rows than a batch */
+    enum { HUBS = 40, LEAVES = 30 };
+    eavgDB *db = eavgDB_create(16);
+    eavg_u64 rel  = eavgDB_addRelationType(db, "has")->id;
+    eavg_u64 mark = eavgDB_addAttribute(db, "mark", EAVG_DATA_TYPE_INT)->id;
+    eavg_u64 hubs[HUBS], leaves[LEAVES];
+    for (int i = 0; i < HUBS; i++) hubs[i] = eavgDB_addEntity(db, 1, NULL)->id;
+    for (int i = 0; i < LEAVES; i++) {
+        leaves[i] = eavgDB_addEntity(db, 2, NULL)->id;
+        if (i % 3 == 0) eavgDB_addIntValue(db, leaves[i], mark, i);
+    }
+    for (int h = 0; h < HUBS; h++)
+        for (int l = 0; l < LEAVES; l++) eavgDB_addEdge(db, hubs[h], leaves[l], rel, 1.0);
+
+    eavgQuery *q = eavgQuery_compile(db, "(h:1)-[has]->(l:2 {mark>=0})<-[has]-(g)", NULL, 0);
+    ASSERT(q);
+    size_t rows = 0;
+    ASSERT(eavgQuery_run(q, count_rows, &rows) == 0);
+    ASSERT(rows == (size_t)HUBS * (LEAVES / 3) * HUBS);
+
+    /* the marked leaves are the smallest start set */
+    char plan[256];
+    ASSERT(eavgQuery_explain(q, plan, sizeof plan) > 0);
+    ASSERT(strncmp(plan, "start (l) by index, 10 visited", 30) == 0);
+    ASSERT(eavgQuery_run(q, stop_at_once, NULL) == 1);
+    eavgQuery_free(q);
+
+    q = eavgQuery_compile(db, "(h:1)-->(l) LIMIT 300", NULL, 0);
+    rows = 0;
+    ASSERT(eavgQuery_run(q, count_rows, &rows) == 0 && rows == 300);
+    eavgQuery_free(q);
+    eavgDB_destroy(db);
+}
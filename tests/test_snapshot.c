@@ -0,0 +1,150 @@
+#include "tests.h"
+#include "../eavg.h"
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sched.h>
+
+static int count_edge_cb(eavgDB *db, eavgEdgeRec *e, void *ud) {
+    (void)db; (void)e;
+    (*(size_t*)ud)++;
+    return 0;
+}
+
+TEST(test_snapshot_isolation) {
+    eavgDB *db = eavgDB_create(4);
+    eavgAttribute    *nick = eavgDB_addAttribute(db, "nick", EAVG_DATA_TYPE_STRING);
+    eavgRelationType *rel  = eavgDB_addRelationType(db, "knows");
+    eavgEntity *a = eavgDB_addEntity(db, 1, "a");
+    eavgEntity *b = eavgDB_addEntity(db, 1, "b");
+    eavgValRec *v = eavgDB_addStringValue(db, a->id, nick->id, "old");
+    eavg_u64    valueId = v->id;
+    eavgDB_addEdge(db, a->id, b->id, rel->id, 1.0);
+
+    eavgSnapshot *s = eavgDB_snapshotBegin(db);
+    ASSERT(s);
+
+    /* enough writes to grow every map the snapshot pinned */
+    for (int i = 0; i < 100; i++) {
+        char name[16];
+        snprintf(name, sizeof name, "e%d", i);
+        eavgEntity *e = eavgDB_addEntity(db, 2, name);
+        eavgDB_addEdge(db, a->id, e->id, rel->id, 2.0);
+        eavgDB_addStringValue(db, e->id, nick->id, name);
+    }
+    ASSERT(eavgDB_updateValue(db, valueId, (eavgValueData){ .stringValue = "new" }, 0) == 0);
+    ASSERT(eavgDB_removeEntity(db, b->id) == 0);
+
+    /* the snapshot still sees the graph as it was */
+    ASSERT(eavgSnapshot_findEntityById(s, b->id) == b);
+    ASSERT(eavgSnapshot_findEntityByName(s, "e0") == NULL);
+    eavgAdjList *out = eavgSnapshot_getAdjList(s, a->id);
+    ASSERT(out && out->count == 1 && out->edges[0].targetEntity == b->id);
+    eavgValueList *vl = eavgSnapshot_getValueList(s, a->id);
+    ASSERT(vl && vl->count == 1 && strcmp(eavgValRec_getString(&vl->values[0]), "old") == 0);
+    size_t edges = 0;
+    eavgSnapshot_forEachEdge(s, count_edge_cb, &edges);
+    ASSERT(edges == 1);
+
+    /* ...while the db moved on */
+    ASSERT(eavgDB_findEntityById(db, b->id) == NULL);
+    ASSERT(eavgDB_getAdjList(db, a->id)->count == 100);
+    ASSERT(strcmp(eavgValRec_getString(eavgDB_findValueById(db, valueId)), "new") == 0);
+    eavgDB_snapshotEnd(s);
+    ASSERT(db->retiredMaps == NULL);
+
+    s = eavgDB_snapshotBegin(db);
+    edges = 0;
+    eavgSnapshot_forEachEdge(s, count_edge_cb, &edges);
+    ASSERT(edges == 100);
+    eavgDB_snapshotEnd(s);
+
+    eavgDB_destroy(db);
+}
+
+TEST(test_snapshot_cow_reclaim) {
+    eavgDB *db = eavgDB_create(4);
+    eavgAttribute    *n   = eavgDB_addAttribute(db, "n", EAVG_DATA_TYPE_INT);
+    eavgRelationType *rel = eavgDB_addRelationType(db, "r");
+    eavgEntity *a = eavgDB_addEntity(db, 1, "a");
+    eavgEntity *b = eavgDB_addEntity(db, 1, "b");
+    eavgDB_addEdge(db, a->id, b->id, rel->id, 1.0);
+    eavg_u64 valueId = eavgDB_addIntValue(db, a->id, n->id, 0)->id;
+
+    /* copies live on the heap and go once no snapshot can see them */
+    ArenaMark edges  = arena_mark(&db->edgeArena);
+    ArenaMark values = arena_mark(&db->valueArena);
+    for (int i = 1; i <= 1000; i++) {
+        eavgSnapshot *s = eavgDB_snapshotBegin(db);
+        eavgDB_addEdge(db, a->id, b->id, rel->id, 1.0);
+        eavgDB_updateValue(db, valueId, (eavgValueData){ .intValue = i }, 0);
+        ASSERT(eavgSnapshot_getAdjList(s, a->id)->count == (size_t)i);
+        ASSERT(eavgSnapshot_getValueList(s, a->id)->values[0].data.intValue == i - 1);
+        eavgDB_snapshotEnd(s);
+    }
+    ASSERT(db->retiredMaps == NULL);
+    ArenaMark now = arena_mark(&db->edgeArena);
+    ASSERT(now.block == edges.block && now.used == edges.used);
+    now = arena_mark(&db->valueArena);
+    ASSERT(now.block == values.block && now.used == values.used);
+
+    /* a list dropped under a snapshot outlives the removal */
+    eavgSnapshot *s = eavgDB_snapshotBegin(db);
+    ASSERT(eavgDB_removeEntity(db, a->id) == 0);
+    ASSERT(eavgSnapshot_getAdjList(s, a->id)->count == 1001);
+    ASSERT(eavgSnapshot_getValueList(s, a->id)->values[0].data.intValue == 1000);
+    eavgDB_snapshotEnd(s);
+    ASSERT(db->retiredMaps == NULL);
+
+    eavgDB_destroy(db);
+}
+
+struct scan_job {
+    eavgDB     *db;
+    _Atomic int stop;
+    int         scans;
+    int         torn;
+};
+
+/* Two walks over one snapshot must agree however the writer interleaves. */
+static void *scan_loop(void *arg) {
+    struct scan_job *job = arg;
+    while (!atomic_load(&job->stop)) {
+        eavgSnapshot *s = eavgDB_snapshotBegin(job->db);
+        size_t first = 0, second = 0;
+        eavgSnapshot_forEachEdge(s, count_edge_cb, &first);
+        sched_yield();
+        eavgSnapshot_forEachEdge(s, count_edge_cb, &second);
+        if (first != second) job->torn++;
+        eavgDB_snapshotEnd(s);
+        job->scans++;
+    }
+    return NULL;
+}
+
+TEST(test_snapshot_concurrent_scan) {
+    eavgDB *db = eavgDB_create(4);
+    eavgRelationType *rel = eavgDB_addRelationType(db, "r");
+    eavg_u64 ids[64];
+    for (int i = 0; i < 64; i++) ids[i] = eavgDB_addEntity(db, 0, NULL)->id;
+
+    struct scan_job job = { .db = db };
+    pthread_t tid;
+    ASSERT(pthread_create(&tid, NULL, scan_loop, &job) == 0);
+    for (int i = 0; i < 2000; i++) {
+        eavg_u64 a = ids[i % 64], b = ids[(i * 7 + 1) % 64];
+        eavgDB_addEdge(db, a, b, rel->id, 1.0);
+        if (i % 3 == 0) {
+            eavgAdjList *al = eavgDB_getAdjList(db, a);
+            eavgDB_updateEdgeWeight(db, al->edges[0].id, (double)i);
+        }
+    }
+    atomic_store(&job.stop, 1);
+    pthread_join(tid, NULL);
+    ASSERT(job.scans > 0 && job.torn == 0);
+
+    size_t edges = 0;
+    eavgDB_forEachEdge(db, count_edge_cb, &edges);
+    ASSERT(edges == 2000);
+    eavgDB_destroy(db);
+}
@@ -0,0 +1,79 @@
+#include "tests.h"
+#include "../eavg.h"
+#include <pthread.h>
+#include <string.h>
+
+enum { WRITERS = 4, PER_WRITER = 500 };
+
+static void *add_entities(void *arg) {
+    eavgDB *db = arg;
+    for (int i = 0; i < PER_WRITER; i++) ASSERT(eavgDB_addEntity(db, 1, NULL));
+    return NULL;
+}
+
+TEST(test_stats_counts_and_locks) {
+    eavgStats *st = malloc(sizeof *st);
+    ASSERT(st);
+    eavgStats_enable(true);
+    eavgStats_reset();
+
+    eavgDB *db = eavgDB_create(4);
+    pthread_t tids[WRITERS];
+    for (int t = 0; t < WRITERS; t++) ASSERT(pthread_create(&tids[t], NULL, add_entities, db) == 0);
+    for (int t = 0; t < WRITERS; t++) pthread_join(tids[t], NULL);
+
+    eavg_u64 rel = eavgDB_addRelationType(db, "next")->id;
+    for (eavg_u64 id = 1; id < 50; id++)
+        ASSERT(eavgDB_addEdgeEx(db, id, id + 1, rel, 1.0, EAVG_EDGE_DIR_OUT, NULL, 0));
+    for (eavg_u64 id = 1; id <= 100; id++) ASSERT(eavgDB_findEntityById(db, id));
+
+    eavgStats_snapshot(st);
+    ASSERT(st->ops[EAVG_OP_ADD_ENTITY].count == WRITERS * PER_WRITER);
+    ASSERT(st->ops[EAVG_OP_ADD_EDGE].count == 49);
+    ASSERT(st->ops[EAVG_OP_FIND_ENTITY].count == 100);
+    ASSERT(st->ops[EAVG_OP_ADD_RELTYPE].count == 1);
+    ASSERT(st->ops[EAVG_OP_REMOVE_EDGE].count == 0);
+
+    uint64_t inBuckets = 0;
+    for (size_t b = 0; b < EAVG_HIST_BUCKETS; b++) inBuckets += st->ops[EAVG_OP_ADD_ENTITY].buckets[b];
+    ASSERT(inBuckets == WRITERS * PER_WRITER);
+
+    /* every lock taken is also released, so waits and holds pair up */
+    ASSERT(st->writeLockWait.count >= WRITERS * PER_WRITER + 49);
+    ASSERT(st->writeLockHold.count == st->writeLockWait.count);
+    ASSERT(st->readLockWait.count >= 100);
+    ASSERT(st->readLockHold.count == st->readLockWait.count);
+    ASSERT(st->mapGrow.count > 0);     /* 2000 entities in a map made for 4 */
+    ASSERT(st->arenaBlocks > 0 && st->arenaBytes >= st->arenaBlocks);
+    ASSERT(strcmp(eavgStats_opName(EAVG_OP_ADD_EDGE), "addEdge") == 0);
+
+    /* off: nothing recorded; reset: everything zero */
+    ASSERT(eavgStats_enable(false));
+    eavgDB_findEntityById(db, 1);
+    eavgStats_snapshot(st);
+    ASSERT(st->ops[EAVG_OP_FIND_ENTITY].count == 100);
+    eavgStats_reset();
+    eavgStats_snapshot(st);
+    ASSERT(st->ops[EAVG_OP_ADD_ENTITY].count == 0 && st->writeLockHold.count == 0);
+
+    eavgDB_destroy(db);
+    free(st);
+}
+
+TEST(test_stats_histogram_percentiles) {
+    eavgHistogram h;
+    memset(&h, 0, sizeof h);
+    ASSERT(eavgHistogram_percentile(&h, 0.5) == 0);
+
+    /* 90 values of 5 ns (exact bucket) and 10 of 1000 ns (bucket 960..1023) */
+    h.count = 100;
+    h.maxNs = 1000;
+    h.buckets[5] = 90;
+    h.buckets[((9 - 2) << EAVG_HIST_SUB_BITS) | ((1000 >> 6) & 7)] = 10;
+    ASSERT(eavgHistogram_percentile(&h, 0.0) == 5);
+    ASSERT(eavgHistogram_percentile(&h, 0.5) == 5);
+    ASSERT(eavgHistogram_percentile(&h, 0.9) == 5);
+    ASSERT(eavgHistogram_percentile(&h, 0.95) == 1000);    /* bucket top, capped at max */
+    h.maxNs = 5000;
+    ASSERT(eavgHistogram_percentile(&h, 0.99) == 1023);
+}
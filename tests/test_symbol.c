@@ -0,0 +1,155 @@
+#include "tests.h"
+#include "../eavg.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+enum { INTERNERS = 4, WORDS = 300 };
+
+static void *intern_words(void *arg) {
+    eavgSymbol *out = arg;
+    char buf[32];
+    for (int i = 0; i < WORDS; i++) {
+        snprintf(buf, sizeof buf, "sym-word-%d", i);
+        out[i] = eavgSymbol_intern(buf);
+    }
+    return NULL;
+}
+
+TEST(test_symbol_pool) {
+    eavgSymbol a = eavgSymbol_intern("sym-alpha");
+    ASSERT(a && eavgSymbol_intern("sym-alpha") == a);
+    ASSERT(eavgSymbol_internLen("sym-alphabet", 9) == a);
+    ASSERT(eavgSymbol_internLen("sym\0x", 5) == 0);
+    ASSERT(eavgSymbol_intern("sym-beta") != a);
+    ASSERT(strcmp(eavgSymbol_name(a), "sym-alpha") == 0);
+    ASSERT(eavgSymbol_find("sym-never-interned") == 0);
+    ASSERT(eavgSymbol_name(0) == NULL);
+    ASSERT(eavgSymbol_name((eavgSymbol)eavgSymbol_count() + 1) == NULL);
+
+    /* racing threads agree on every id, and each word is added once */
+    static eavgSymbol ids[INTERNERS][WORDS];
+    size_t before = eavgSymbol_count();
+    pthread_t tids[INTERNERS];
+    for (int t = 0; t < INTERNERS; t++) ASSERT(pthread_create(&tids[t], NULL, intern_words, ids[t]) == 0);
+    for (int t = 0; t < INTERNERS; t++) pthread_join(tids[t], NULL);
+    ASSERT(eavgSymbol_count() == before + WORDS);
+    char buf[32];
+    for (int i = 0; i < WORDS; i++) {
+        for (int t = 1; t < INTERNERS; t++) ASSERT(ids[t][i] == ids[0][i]);
+        snprintf(buf, sizeof buf, "sym-word-%d", i);
+        ASSERT(strcmp(eavgSymbol_name(ids[0][i]), buf) == 0);
+    }
+}
+
+static int check_label(eavgDB *db, eavgEdgeRec *e, void *ud) {
+    (void)db;
+    size_t *n = ud;
+    ASSERT(e->labelSym && e->labelSym == eavgSymbol_find(e->label));
+    ASSERT(e->label == eavgSymbol_name(e->labelSym));
+    (*n)++;
+    return 0;
+}
+
+static void check_labels(eavgDB *db, size_t expect) {
+    size_t n = 0;
+    eavgDB_forEachEdge(db, check_label, &n);
+    ASSERT(n == expect);
+}
+
+TEST(test_symbol_edge_labels) {
+    eavgDB *db = eavgDB_create(8);
+    eavgDB *db2 = eavgDB_create(8);
+    eavgEntity *a = eavgDB_addEntity(db, 1, "a");
+    eavgEntity *b = eavgDB_addEntity(db, 1, "b");
+    eavgRelationType *rel = eavgDB_addRelationType(db, "sym-knows");
+    eavgRelationType *rel2 = eavgDB_addRelationType(db2, "sym-knows");
+    ASSERT(rel->nameSym && rel->nameSym == rel2->nameSym && rel->name == rel2->name);
+    ASSERT(eavgDB_addAttribute(db, "sym-age", EAVG_DATA_TYPE_INT)->nameSym == eavgSymbol_find("sym-age"));
+
+    /* addEdge labels with the relation type's name */
+    eavgEdgeRec *e = eavgDB_addEdge(db, a->id, b->id, rel->id, 1.0);
+    ASSERT(e && e->labelSym == rel->nameSym && strcmp(e->label, "sym-knows") == 0);
+    eavg_u64 relabel = e->id;
+    e = eavgDB_addEdgeEx(db, b->id, a->id, rel->id, 2.0, EAVG_EDGE_DIR_OUT, "sym-likes", 0);
+    ASSERT(e && e->labelSym == eavgSymbol_find("sym-likes"));
+    ASSERT(eavgDB_updateEdgeLabel(db, relabel, "sym-likes") == 0);
+    check_labels(db, 2);
+
+    /* labels are re-interned by every loader */
+    eavgSaveOptions compact = { .compact = true };
+    ASSERT(eavgDB_save(db, "test_symbol.db") == 0);
+    ASSERT(eavgDB_saveEx(db, "test_symbol_c.db", &compact) == 0);
+    ASSERT(eavgDB_saveImage(db, "test_symbol.img") == 0);
+    const char *files[] = { "test_symbol.db", "test_symbol_c.db", "test_symbol.img" };
+    for (int i = 0; i < 3; i++) {
+        eavgDB *l = eavgDB_load(files[i]);
+        ASSERT(l);
+        check_labels(l, 2);
+        ASSERT(eavgDB_findRelationTypeByName(l, "sym-knows")->nameSym == rel->nameSym);
+        eavgDB_destroy(l);
+        remove(files[i]);
+    }
+    eavgDB_destroy(db2);
+    eavgDB_destroy(db);
+}
+
+static int count_unpooled(eavgDB *db, eavgEdgeRec *e, void *ud) {
+    (void)db;
+    if (!e->labelSym) {
+        ASSERT(e->label && strncmp(e->label, "sym-u-", 6) == 0);
+        (*(size_t*)ud)++;
+    }
+    return 0;
+}
+
+TEST(test_symbol_label_budget) {
+    enum { LABELS = 100 };
+    eavgDB *db = eavgDB_create(8);
+    eavg_u64 a = eavgDB_addEntity(db, 1, "a")->id;
+    eavg_u64 b = eavgDB_addEntity(db, 1, "b")->id;
+    eavgRelationType *rel = eavgDB_addRelationType(db, "sym-budget");
+
+    /* past the budget, only labels the pool already holds intern */
+    eavgSymbol_setLabelBudget(0);
+    size_t before = eavgSymbol_count();
+    char label[32];
+    for (int i = 0; i < LABELS; i++) {
+        snprintf(label, sizeof label, "sym-u-%d", i);
+        eavgEdgeRec *e = eavgDB_addEdgeEx(db, a, b, rel->id, 1.0, EAVG_EDGE_DIR_OUT, label, 0);
+        ASSERT(e && !e->labelSym && strcmp(e->label, label) == 0 && e->label != label);
+    }
+    eavgEdgeRec *e = eavgDB_addEdgeEx(db, b, a, rel->id, 1.0, EAVG_EDGE_DIR_OUT, "sym-budget", 0);
+    ASSERT(e && e->labelSym == rel->nameSym);
+    ASSERT(eavgSymbol_internLabel("sym-u-0", 7) == 0);
+    ASSERT(eavgSymbol_count() == before);
+
+    /* names are not labels */
+    ASSERT(eavgDB_addAttribute(db, "sym-budget-attr", EAVG_DATA_TYPE_INT)->nameSym);
+    ASSERT(eavgSymbol_count() == before + 1);
+
+    e = eavgDB_addEdgeEx(db, b, a, rel->id, 1.0, EAVG_EDGE_DIR_OUT, "sym-u-late", 0);
+    ASSERT(eavgEdgeRec_hasLabel(e, "sym-u-late", eavgSymbol_find("sym-u-late")));
+    ASSERT(!eavgEdgeRec_hasLabel(e, "sym-budget", rel->nameSym));
+    ASSERT(eavgDB_updateEdgeLabel(db, e->id, "sym-u-relabelled") == 0);
+
+    /* the db keeps its own copies through saves and loads */
+    eavgSaveOptions compact = { .compact = true };
+    ASSERT(eavgDB_save(db, "test_symbol_b.db") == 0);
+    ASSERT(eavgDB_saveEx(db, "test_symbol_bc.db", &compact) == 0);
+    ASSERT(eavgDB_saveImage(db, "test_symbol_b.img") == 0);
+    const char *files[] = { "test_symbol_b.db", "test_symbol_bc.db", "test_symbol_b.img" };
+    for (int i = 0; i < 3; i++) {
+        eavgDB *l = eavgDB_load(files[i]);
+        ASSERT(l);
+        size_t n = 0;
+        eavgDB_forEachEdge(l, count_unpooled, &n);
+        ASSERT(n == LABELS + 1);
+        ASSERT(eavgDB_findRelationTypeByName(l, "sym-budget")->nameSym == rel->nameSym);
+        eavgDB_destroy(l);
+        remove(files[i]);
+    }
+    ASSERT(eavgSymbol_count() == before + 1);
+    eavgSymbol_setLabelBudget(EAVG_SYMBOL_LABEL_MAX);
+    eavgDB_destroy(db);
+}
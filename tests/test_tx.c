@@ -0,0 +1,221 @@
+#include "tests.h"
+#include "../eavg.h"
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+struct watch_job {
+    eavgDB     *db;
+    _Atomic int stop;
+    int         seen;
+    int         partial;
+};
+
+/* Once the entity is visible, all of its values and edges must be too. */
+static void *watch_loop(void *arg) {
+    struct watch_job *job = arg;
+    while (!atomic_load(&job->stop)) {
+        eavgEntity *e = eavgDB_findEntityByName(job->db, "order");
+        if (!e) continue;
+        eavgValueList *vl = eavgDB_getValueList(job->db, e->id);
+        eavgAdjList   *al = eavgDB_getAdjList(job->db, e->id);
+        if (!vl || vl->count != 10 || !al || al->count != 5) job->partial++;
+        job->seen++;
+        break;
+    }
+    return NULL;
+}
+
+TEST(test_tx_commit_atomic) {
+    eavgDB *db = eavgDB_create(16);
+    eavgAttribute    *qty  = eavgDB_addAttribute(db, "qty", EAVG_DATA_TYPE_INT);
+    eavgAttribute    *note = eavgDB_addAttribute(db, "note", EAVG_DATA_TYPE_STRING);
+    eavgAttribute    *ref  = eavgDB_addAttribute(db, "ref", EAVG_DATA_TYPE_ENTITY);
+    eavgRelationType *has  = eavgDB_addRelationType(db, "has");
+    eavg_u64 items[5];
+    for (int i = 0; i < 5; i++) items[i] = eavgDB_addEntity(db, 2, NULL)->id;
+
+    struct watch_job job = { .db = db };
+    pthread_t tid;
+    ASSERT(pthread_create(&tid, NULL, watch_loop, &job) == 0);
+
+    eavgTx  *tx    = eavgDB_txBegin(db);
+    eavg_u64 order = eavgTx_addEntity(tx, 1, "order");
+    eavg_u64 line  = eavgTx_addEntity(tx, 3, NULL);
+    ASSERT(order && line);
+    char buf[32];
+    for (int i = 0; i < 8; i++) ASSERT(eavgTx_addIntValue(tx, order, qty->id, i) == 0);
+    strcpy(buf, "fragile");
+    ASSERT(eavgTx_addStringValue(tx, order, note->id, buf) == 0);
+    strcpy(buf, "clobbered");                  /* the tx kept its own copy */
+    ASSERT(eavgTx_addEntityRefValue(tx, order, ref->id, line) == 0);
+    for (int i = 0; i < 5; i++) ASSERT(eavgTx_addEdge(tx, order, items[i], has->id, 1.0) == 0);
+    ASSERT(eavgDB_findEntityByName(db, "order") == NULL);
+
+    eavg_u64 ids[2];
+    ASSERT(eavgDB_txCommit(tx, ids) == 0);
+    atomic_store(&job.stop, 1);
+    pthread_join(tid, NULL);
+    ASSERT(job.partial == 0);
+
+    eavgEntity *e = eavgDB_findEntityByName(db, "order");
+    ASSERT(e && e->id == ids[0]);
+    eavgValueList *vl = eavgDB_getValueList(db, ids[0]);
+    ASSERT(vl && vl->count == 10);
+    ASSERT(strcmp(eavgValRec_getString(&vl->values[8]), "fragile") == 0);
+    ASSERT(eavgValRec_getEntityRef(&vl->values[9]) == ids[1]);
+    eavgAdjList *al = eavgDB_getAdjList(db, ids[0]);
+    ASSERT(al && al->count == 5 && strcmp(al->edges[0].label, "has") == 0);
+
+    eavgDB_destroy(db);
+}
+
+TEST(test_tx_abort_and_savepoint) {
+    eavgDB *db = eavgDB_create(16);
+    eavgAttribute *qty  = eavgDB_addAttribute(db, "qty", EAVG_DATA_TYPE_INT);
+    eavgAttribute *note = eavgDB_addAttribute(db, "note", EAVG_DATA_TYPE_STRING);
+
+    eavgTx *tx = eavgDB_txBegin(db);
+    eavgTx_addEntity(tx, 1, "gone");
+    eavgDB_txAbort(tx);
+    ASSERT(eavgDB_findEntityByName(db, "gone") == NULL);
+
+    tx = eavgDB_txBegin(db);
+    eavg_u64 keep = eavgTx_addEntity(tx, 1, "keep");
+    eavgTx_addIntValue(tx, keep, qty->id, 1);
+    eavgTxSavepoint sp = eavgTx_savepoint(tx);
+    for (int i = 0; i < 200; i++) {             /* spills past one arena block */
+        char name[16];
+        snprintf(name, sizeof name, "tmp%03d", i);
+        eavg_u64 tmp = eavgTx_addEntity(tx, 1, name);
+        ASSERT(eavgTx_addStringValue(tx, tmp, note->id, "a string well past the inline size") == 0);
+    }
+    eavgTx_rollbackTo(tx, sp);
+    eavgTx_addIntValue(tx, keep, qty->id, 2);
+    eavg_u64 id;
+    ASSERT(eavgDB_txCommit(tx, &id) == 0);
+    ASSERT(eavgDB_findEntityByName(db, "tmp000") == NULL);
+    ASSERT(eavgDB_getValueList(db, id)->count == 2);
+
+    /* a mismatched value is refused; a dangling reference rejects the tx */
+    tx = eavgDB_txBegin(db);
+    eavg_u64 bad = eavgTx_addEntity(tx, 1, "bad");
+    ASSERT(eavgTx_addDoubleValue(tx, bad, qty->id, 1.5) < 0);
+    ASSERT(eavgTx_addIntValue(tx, bad, qty->id, 1) == 0);
+    ASSERT(eavgTx_addIntValue(tx, EAVG_BULK_REF(7), qty->id, 1) == 0);
+    ASSERT(eavgDB_txCommit(tx, NULL) < 0);
+    ASSERT(eavgDB_findEntityByName(db, "bad") == NULL);
+
+    eavgDB_destroy(db);
+}
+
+static void count_changes(const eavgChange *ev, size_t n, void *ud) {
+    (void)ev;
+    *(size_t*)ud += n;
+}
+
+static uint64_t mix(uint64_t h, uint64_t x) {
+    return (h ^ x) * 1099511628211ULL;
+}
+
+/* Hashes everything readers can see of the given entities, in list order. */
+static uint64_t fingerprint(eavgDB *db, const eavg_u64 *ids, size_t n, eavg_u64 attr) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < n; i++) {
+        eavgEntity *e = eavgDB_findEntityById(db, ids[i]);
+        h = mix(h, e ? e->id : 0);
+        if (e && e->name) h = mix(h, eavgDB_findEntityByName(db, e->name) == e);
+        eavgValueList *vl = eavgDB_getValueList(db, ids[i]);
+        for (size_t j = 0; vl && j < vl->count; j++) {
+            const eavgValRec *r = &vl->values[j];
+            h = mix(mix(h, r->id), eavgDB_findValueById(db, r->id) == r);
+            h = mix(h, r->attributeId == attr ? (uint64_t)eavgValRec_getInt(r)
+                                              : strlen(eavgValRec_getString(r)));
+        }
+        for (int x = 0; x < 2; x++) {
+            eavgAdjList *al = x ? eavgDB_getReverseAdjList(db, ids[i]) : eavgDB_getAdjList(db, ids[i]);
+            for (size_t j = 0; al && j < al->count; j++) {
+                h = mix(mix(h, al->edges[j].id), (uint64_t)al->edges[j].weight);
+                h = mix(h, al->edges[j].label ? strlen(al->edges[j].label) : 0);
+            }
+        }
+    }
+    id_bitmap *typed = eavgDB_findEntitiesByTypeBitmap(db, 1);
+    h = mix(h, id_bitmap_cardinality(typed));
+    id_bitmap_destroy(typed);
+    return mix(h, id_bitmap_cardinality(eavgDB_entitiesByAttributeNoLock(db, attr)));
+}
+
+TEST(test_tx_removes_and_updates) {
+    eavgDB *db = eavgDB_create(16);
+    eavgAttribute    *qty  = eavgDB_addAttribute(db, "qty", EAVG_DATA_TYPE_INT);
+    eavgAttribute    *note = eavgDB_addAttribute(db, "note", EAVG_DATA_TYPE_STRING);
+    eavgRelationType *rel  = eavgDB_addRelationType(db, "knows");
+    eavg_u64 ids[3], vals[3][3];
+    for (int i = 0; i < 3; i++) {
+        char name[8];
+        snprintf(name, sizeof name, "e%d", i);
+        ids[i] = eavgDB_addEntity(db, 1, name)->id;
+        vals[i][0] = eavgDB_addIntValue(db, ids[i], qty->id, i)->id;
+        vals[i][1] = eavgDB_addStringValue(db, ids[i], note->id, "short")->id;
+        vals[i][2] = eavgDB_addIntValue(db, ids[i], qty->id, 10 + i)->id;
+    }
+    eavg_u64 loop = eavgDB_addEdge(db, ids[0], ids[0], rel->id, 1.0)->id;
+    eavg_u64 ab   = eavgDB_addEdge(db, ids[0], ids[1], rel->id, 2.0)->id;
+    eavg_u64 ba   = eavgDB_addEdge(db, ids[1], ids[0], rel->id, 3.0)->id;
+    eavg_u64 bc   = eavgDB_addEdge(db, ids[1], ids[2], rel->id, 4.0)->id;
+    eavgDB_addEdge(db, ids[2], ids[0], rel->id, 5.0);
+    (void)loop;
+
+    size_t            events = 0;
+    eavgSubscription *sub    = eavgDB_subscribe(db, 64, 16, EAVG_FEED_BLOCK, count_changes, &events);
+    eavgSnapshot     *snap   = eavgDB_snapshotBegin(db);
+    uint64_t          before = fingerprint(db, ids, 3, qty->id);
+
+    /* a commit failing on its last op leaves everything as it was */
+    for (int pass = 0; pass < 2; pass++) {
+        eavgTx  *tx  = eavgDB_txBegin(db);
+        eavg_u64 add = eavgTx_addEntity(tx, 1, "e3");
+        ASSERT(eavgTx_addIntValue(tx, ids[1], qty->id, 99) == 0);
+        ASSERT(eavgTx_addEdge(tx, add, ids[0], rel->id, 6.0) == 0);
+        ASSERT(eavgTx_updateValue(tx, vals[1][1],
+                                  (eavgValueData){ .stringValue = "a string well past the inline size" },
+                                  0) == 0);
+        ASSERT(eavgTx_removeValueOrdered(tx, vals[1][0]) == 0);
+        ASSERT(eavgTx_removeValue(tx, vals[2][0]) == 0);
+        ASSERT(eavgTx_updateEdgeWeight(tx, bc, 8.0) == 0);
+        ASSERT(eavgTx_updateEdgeLabel(tx, bc, "likes") == 0);
+        ASSERT(eavgTx_removeEdge(tx, ab) == 0);
+        ASSERT(eavgTx_removeEntity(tx, ids[0]) == 0);
+        ASSERT(eavgTx_removeValue(tx, EAVG_BULK_REF(0)) < 0);
+        if (pass == 0) ASSERT(eavgTx_removeEdge(tx, ba) == 0);   /* gone with e0 */
+        ASSERT(eavgDB_txCommit(tx, NULL) == (pass == 0 ? -1 : 0));
+        if (pass == 0) ASSERT(fingerprint(db, ids, 3, qty->id) == before);
+    }
+    ASSERT(eavgDB_unsubscribe(db, sub) == 0);
+    ASSERT(events == 3 + 7);
+
+    ASSERT(!eavgDB_findEntityById(db, ids[0]) && !eavgDB_findEntityByName(db, "e0"));
+    ASSERT(!eavgDB_findValueById(db, vals[0][0]) && !eavgDB_findValueById(db, vals[1][0]));
+    eavgValueList *vl = eavgDB_getValueList(db, ids[1]);
+    ASSERT(vl && vl->count == 3 && vl->values[0].id == vals[1][1] &&
+           vl->values[1].id == vals[1][2] && eavgValRec_getInt(&vl->values[2]) == 99);
+    ASSERT(strcmp(eavgValRec_getString(eavgDB_findValueById(db, vals[1][1])),
+                  "a string well past the inline size") == 0);
+    vl = eavgDB_getValueList(db, ids[2]);
+    ASSERT(vl && vl->count == 2 && vl->values[0].id == vals[2][2]);
+    eavgAdjList *out = eavgDB_getAdjList(db, ids[1]);
+    ASSERT(out && out->count == 1 && out->edges[0].id == bc && out->edges[0].weight == 8.0 &&
+           strcmp(out->edges[0].label, "likes") == 0);
+    eavgAdjList *in = eavgDB_getReverseAdjList(db, ids[2]);
+    ASSERT(in && in->count == 1 && in->edges[0].weight == 8.0);
+    ASSERT(eavgDB_getAdjList(db, ids[2])->count == 0);
+    eavgEntity *added = eavgDB_findEntityByName(db, "e3");
+    ASSERT(added && eavgDB_getAdjList(db, added->id)->count == 0);
+    ASSERT(eavgDB_getReverseAdjList(db, ids[0]) == NULL);
+
+    /* the snapshot still reads the lists as they were */
+    ASSERT(eavgSnapshot_getAdjList(snap, ids[1])->count == 2);
+    eavgDB_snapshotEnd(snap);
+    eavgDB_destroy(db);
+}
@@ -21,13 +21,16 @@ TEST(test_add_int_double_string_binary_entityref) {
     ASSERT(v2); ASSERT(v2->data.doubleValue == 3.1415);
 
     eavgValRec *v3 = eavgDB_addStringValue(db, ent->id, sA->id, "hello");
-    ASSERT(v3); ASSERT(strcmp(v3->data.stringValue, "hello") == 0);
+    ASSERT(v3); ASSERT(strcmp(eavgValRec_getString(v3), "hello") == 0);
 
     unsigned char blob[] = { 9, 8, 7 };
     eavgValRec *v4 = eavgDB_addBinaryValue(db, ent->id, bA->id, blob, sizeof(blob));
     ASSERT(v4);
+    size_t blobLen = 0;
+    const unsigned char *stored = eavgValRec_getBinary(v4, &blobLen);
+    ASSERT(blobLen == sizeof(blob));
     for (size_t i = 0; i < sizeof(blob); i++) {
-        ASSERT(v4->data.binaryValue[i] == blob[i]);
+        ASSERT(stored[i] == blob[i]);
     }
 
     eavgValRec *v5 = eavgDB_addEntityRefValue(db, ent->id, eA->id, ent->id);
@@ -36,3 +39,42 @@ TEST(test_add_int_double_string_binary_entityref) {
     eavgDB_destroy(db);
 }
 
+
+TEST(test_value_remove_and_update) {
+    eavgDB *db = eavgDB_create(16);
+    eavgEntity    *ent = eavgDB_addEntity(db, 1, "E");
+    eavgAttribute *iA  = eavgDB_addAttribute(db, "aint", EAVG_DATA_TYPE_INT);
+    eavgAttribute *sA  = eavgDB_addAttribute(db, "astr", EAVG_DATA_TYPE_STRING);
+
+    eavg_u64 ids[6];
+    for (int i = 0; i < 6; i++)
+        ids[i] = eavgDB_addIntValue(db, ent->id, iA->id, i * 10)->id;
+
+    /* swap-remove moves the last value into the hole */
+    ASSERT(eavgDB_removeValue(db, ids[1]) == 0);
+    ASSERT(eavgDB_findValueById(db, ids[1]) == NULL);
+    ASSERT(eavgDB_removeValue(db, ids[1]) == -1);
+    eavgValueList *vl = eavgDB_getValueList(db, ent->id);
+    ASSERT(vl && vl->count == 5 && vl->values[1].id == ids[5]);
+    ASSERT(eavgValRec_getInt(eavgDB_findValueById(db, ids[5])) == 50);
+
+    /* ordered removal keeps the rest in place */
+    ASSERT(eavgDB_removeValueOrdered(db, ids[0]) == 0);
+    ASSERT(vl->count == 4);
+    ASSERT(vl->values[0].id == ids[5] && vl->values[1].id == ids[2]);
+    ASSERT(eavgDB_findValueById(db, ids[4]) == &vl->values[3]);
+
+    ASSERT(eavgDB_updateValue(db, ids[2], (eavgValueData){ .intValue = 99 }, 0) == 0);
+    ASSERT(eavgValRec_getInt(eavgDB_findValueById(db, ids[2])) == 99);
+
+    eavgValRec *s = eavgDB_addStringValue(db, ent->id, sA->id, "before");
+    eavg_u64 sid = s->id;
+    ASSERT(eavgDB_updateValue(db, sid, (eavgValueData){ .stringValue = "after" }, 0) == 0);
+    ASSERT(strcmp(eavgValRec_getString(eavgDB_findValueById(db, sid)), "after") == 0);
+    ASSERT(eavgDB_updateValue(db, 12345, (eavgValueData){ .intValue = 1 }, 0) == -1);
+
+    ASSERT(eavgDB_removeEntity(db, ent->id) == 0);
+    ASSERT(eavgDB_findValueById(db, sid) == NULL);
+
+    eavgDB_destroy(db);
+}
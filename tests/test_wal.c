@@ -0,0 +1,162 @@
+#include "tests.h"
+#include "../eavg.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static void remove_db_files(const char *path) {
+    char log[256];
+    snprintf(log, sizeof log, "%s.wal", path);
+    remove(path);
+    remove(log);
+}
+
+static long log_size(const char *path) {
+    char        log[256];
+    struct stat st;
+    snprintf(log, sizeof log, "%s.wal", path);
+    return stat(log, &st) == 0 ? (long)st.st_size : -1;
+}
+
+TEST(test_wal_replay_and_checkpoint) {
+    const char *path = "test_wal.db";
+    remove_db_files(path);
+
+    eavgDB *db = eavgDB_create(16);
+    ASSERT(eavgDB_walOpen(db, path, NULL) == 0);
+    eavgAttribute    *age  = eavgDB_addAttribute(db, "age", EAVG_DATA_TYPE_INT);
+    eavgAttribute    *note = eavgDB_addAttribute(db, "note", EAVG_DATA_TYPE_STRING);
+    eavgRelationType *rel  = eavgDB_addRelationType(db, "knows");
+    eavg_u64 a = eavgDB_addEntity(db, 1, "Alice")->id;
+    eavg_u64 b = eavgDB_addEntity(db, 1, "Bob")->id;
+    eavg_u64 c = eavgDB_addEntity(db, 2, "Carol")->id;
+    eavg_u64 v1 = eavgDB_addIntValue(db, a, age->id, 30)->id;
+    eavg_u64 v2 = eavgDB_addStringValue(db, a, note->id, "a note too long to sit inline")->id;
+    eavgDB_addIntValue(db, b, age->id, 40);
+    eavg_u64 e1 = eavgDB_addEdgeEx(db, a, b, rel->id, 1.0, EAVG_EDGE_DIR_OUT, "friend", 7)->id;
+    eavgDB_addEdgeEx(db, c, a, rel->id, 2.0, EAVG_EDGE_DIR_OUT, NULL, 8);
+    ASSERT(eavgDB_updateValue(db, v1, (eavgValueData){ .intValue = 31 }, 0) == 0);
+    ASSERT(eavgDB_updateEdgeWeight(db, e1, 5.0) == 0);
+    ASSERT(eavgDB_removeValueOrdered(db, v2) == 0);
+    ASSERT(eavgDB_removeEntity(db, c) == 0);
+    ASSERT(eavgDB_walSync(db) == 0);
+    eavgDB_destroy(db);
+
+    /* no snapshot yet: the log alone rebuilds the db, ids included */
+    db = eavgDB_load(path);
+    ASSERT(db);
+    ASSERT(eavgDB_findEntityByName(db, "Alice")->id == a);
+    ASSERT(!eavgDB_findEntityById(db, c) && !eavgDB_findValueById(db, v2));
+    ASSERT(eavgValRec_getInt(eavgDB_findValueById(db, v1)) == 31);
+    eavgAdjList *out = eavgDB_getAdjList(db, a);
+    ASSERT(out && out->count == 1 && out->edges[0].id == e1 && out->edges[0].weight == 5.0);
+    ASSERT(strcmp(out->edges[0].label, "friend") == 0 && out->edges[0].timestamp == 7);
+    ASSERT(!eavgDB_getReverseAdjList(db, a) || eavgDB_getReverseAdjList(db, a)->count == 0);
+    ASSERT(eavgDB_addEntity(db, 0, NULL)->id == c + 1);
+
+    /* a checkpoint moves everything into the snapshot and empties the log */
+    ASSERT(eavgDB_walOpen(db, path, NULL) == 0);
+    long before = log_size(path);
+    ASSERT(eavgDB_checkpoint(db) == 0);
+    ASSERT(log_size(path) < before);
+    eavg_u64 d = eavgDB_addEntity(db, 3, "Dave")->id;
+    eavg_u64 knows = eavgDB_findRelationTypeByName(db, "knows")->id;
+    for (int i = 0; i < 50; i++) eavgDB_addEdge(db, a, d, knows, i);
+    eavgDB_destroy(db);
+
+    /* a torn record at the end is ignored */
+    char  log[256];
+    snprintf(log, sizeof log, "%s.wal", path);
+    FILE *f = fopen(log, "ab");
+    ASSERT(f && fwrite("\x40\0\0\0garbage", 1, 11, f) == 11);
+    fclose(f);
+
+    db = eavgDB_load(path);
+    ASSERT(db);
+    ASSERT(eavgDB_findEntityByName(db, "Dave")->id == d);
+    ASSERT(eavgDB_findEntityByName(db, "Bob")->id == b);
+    out = eavgDB_getAdjList(db, a);
+    ASSERT(out && out->count == 51 && out->edges[0].id == e1 && out->edges[50].weight == 49);
+    ASSERT(eavgValRec_getInt(eavgDB_findValueById(db, v1)) == 31);
+    eavgDB_destroy(db);
+    remove_db_files(path);
+}
+
+TEST(test_wal_replays_edge_changes) {
+    const char *path = "test_wal_edges.db";
+    remove_db_files(path);
+
+    eavgDB *db = eavgDB_create(16);
+    ASSERT(eavgDB_walOpen(db, path, NULL) == 0);
+    eavg_u64 rel = eavgDB_addRelationType(db, "r")->id;
+    eavg_u64 a = eavgDB_addEntity(db, 1, "a")->id;
+    eavg_u64 b = eavgDB_addEntity(db, 1, "b")->id;
+    eavg_u64 c = eavgDB_addEntity(db, 1, "c")->id;
+    eavg_u64 ab[3];
+    for (int i = 0; i < 3; i++) ab[i] = eavgDB_addEdge(db, a, b, rel, i)->id;
+    eavg_u64 loop = eavgDB_addEdge(db, a, a, rel, 1)->id;
+    eavg_u64 cb   = eavgDB_addEdge(db, c, b, rel, 1)->id;
+    ASSERT(eavgDB_updateEdgeWeight(db, ab[1], 9.0) == 0);
+    ASSERT(eavgDB_updateEdgeLabel(db, ab[1], "mid") == 0);
+    ASSERT(eavgDB_removeEdge(db, ab[0]) == 0);
+    ASSERT(eavgDB_removeEdge(db, loop) == 0);
+    ASSERT(eavgDB_updateEdgeLabel(db, cb, "cb") == 0);
+    ASSERT(eavgDB_updateEdgeLabel(db, cb, NULL) == 0);
+    eavgDB_destroy(db);
+
+    db = eavgDB_load(path);
+    ASSERT(db);
+    eavgAdjList *out = eavgDB_getAdjList(db, a);
+    ASSERT(out && out->count == 2 && out->edges[0].id == ab[1] && out->edges[1].id == ab[2]);
+    ASSERT(out->edges[0].weight == 9.0 && strcmp(out->edges[0].label, "mid") == 0);
+    eavgAdjList *in = eavgDB_getReverseAdjList(db, b);
+    ASSERT(in && in->count == 3 && in->edges[0].id == ab[1] && in->edges[2].id == cb);
+    ASSERT(in->edges[0].weight == 9.0 && strcmp(in->edges[0].label, "mid") == 0);
+    ASSERT(!in->edges[2].label && eavgDB_getAdjList(db, c)->edges[0].label == NULL);
+    ASSERT(!eavgDB_getReverseAdjList(db, a) || eavgDB_getReverseAdjList(db, a)->count == 0);
+    ASSERT(eavgDB_removeEdge(db, ab[0]) < 0);
+    eavgDB_destroy(db);
+    remove_db_files(path);
+}
+
+struct wal_writer {
+    eavgDB   *db;
+    eavg_u64  attr;
+};
+
+static void *wal_write_loop(void *arg) {
+    struct wal_writer *w = arg;
+    for (int i = 0; i < 200; i++) {
+        eavgEntity *e = eavgDB_addEntity(w->db, 4, NULL);
+        eavgDB_addIntValue(w->db, e->id, w->attr, i);
+    }
+    return NULL;
+}
+
+TEST(test_wal_group_commit) {
+    const char *path = "test_wal_group.db";
+    remove_db_files(path);
+
+    eavgDB *db = eavgDB_create(16);
+    ASSERT(eavgDB_walOpen(db, path, &(eavgWalOptions){ EAVG_WAL_SYNC_ALWAYS, 0 }) == 0);
+    struct wal_writer w = { db, eavgDB_addAttribute(db, "n", EAVG_DATA_TYPE_INT)->id };
+    enum { WRITERS = 4 };
+    pthread_t tids[WRITERS];
+    for (int t = 0; t < WRITERS; t++) ASSERT(pthread_create(&tids[t], NULL, wal_write_loop, &w) == 0);
+    for (int t = 0; t < WRITERS; t++) pthread_join(tids[t], NULL);
+    eavgDB_destroy(db);
+
+    db = eavgDB_load(path);
+    ASSERT(db);
+    size_t n = 0;
+    eavgEntity **all = eavgDB_findEntitiesByType(db, 4, &n);
+    ASSERT(n == WRITERS * 200);
+    for (size_t i = 0; i < n; i++) {
+        eavgValueList *vl = eavgDB_getValueList(db, all[i]->id);
+        ASSERT(vl && vl->count == 1);
+    }
+    free(all);
+    eavgDB_destroy(db);
+    remove_db_files(path);
+}
@@ -0,0 +1,243 @@
+#include "eavg.h"
+#include "stats.h"
+#include "tx.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TX_ARENA_BLOCK  4096
+#define TX_INITIAL_CAP  16
+
+struct eavgTx {
+    eavgDB          *db;
+    Arena            arena;      /* copies of names, strings, blobs and labels */
+
+    eavgBulkEntity  *entities;   size_t entityCount, entityCap;
+    eavgBulkValue   *values;     size_t valueCount,  valueCap;
+    eavgBulkEdge    *edges;      size_t edgeCount,   edgeCap;
+    eavgTxOp        *ops;        size_t opCount,     opCap;    /* removes and updates */
+
+    bool             failed;     /* an operation ran out of memory; commit refuses */
+};
+
+/* Makes room for one more item: returns the (possibly moved) array, or
+ * NULL with the old one left intact. */
+static void *tx_grow(eavgTx *tx, void *items, size_t count, size_t *cap, size_t size) {
+    if (count < *cap) return items;
+    size_t ncap = *cap ? *cap * 2 : TX_INITIAL_CAP;
+    void  *p    = realloc(items, ncap * size);
+    if (!p) {
+        tx->failed = true;
+        return NULL;
+    }
+    *cap = ncap;
+    return p;
+}
+
+static void *tx_copy(eavgTx *tx, const void *src, size_t len) {
+    if (!src || !len) return NULL;
+    void *p = arena_alloc(&tx->arena, len);
+    if (!p) {
+        tx->failed = true;
+        return NULL;
+    }
+    memcpy(p, src, len);
+    return p;
+}
+
+static char *tx_strdup(eavgTx *tx, const char *s) {
+    return s ? tx_copy(tx, s, strlen(s) + 1) : NULL;
+}
+
+eavgTx *eavgDB_txBegin(eavgDB *db) {
+    eavgTx *tx = calloc(1, sizeof *tx);
+    if (!tx) return NULL;
+    tx->db = db;
+    arena_init(&tx->arena, TX_ARENA_BLOCK);
+    return tx;
+}
+
+void eavgDB_txAbort(eavgTx *tx) {
+    if (!tx) return;
+    arena_destroy(&tx->arena);
+    free(tx->entities);
+    free(tx->values);
+    free(tx->edges);
+    free(tx->ops);
+    free(tx);
+}
+
+/* tx_apply rolls back whatever it applied when a commit fails part way,
+ * which is what makes a failed commit leave no trace. */
+int eavgDB_txCommit(eavgTx *tx, eavg_u64 *entityIds) {
+    STATS_OP(EAVG_OP_TX_COMMIT);
+    if (!tx) return -1;
+    int rc = -1;
+    if (!tx->failed) {
+        eavgBulkBatch b = {
+            .entities = tx->entities, .entityCount = tx->entityCount,
+            .values   = tx->values,   .valueCount  = tx->valueCount,
+            .edges    = tx->edges,    .edgeCount   = tx->edgeCount,
+            .threads  = 1,
+            .entityIds = entityIds,
+        };
+        rc = tx_apply(tx->db, &b, tx->ops, tx->opCount);
+    }
+    eavgDB_txAbort(tx);
+    return rc;
+}
+
+eavgTxSavepoint eavgTx_savepoint(const eavgTx *tx) {
+    eavgTxSavepoint sp = { tx->entityCount, tx->valueCount, tx->edgeCount, tx->opCount,
+                           arena_mark(&tx->arena) };
+    return sp;
+}
+
+/* Values and edges kept across the rollback that still name a dropped
+ * entity make the commit fail validation. */
+void eavgTx_rollbackTo(eavgTx *tx, eavgTxSavepoint sp) {
+    EAVG_ASSERT(sp.entities <= tx->entityCount && sp.values <= tx->valueCount &&
+                sp.edges <= tx->edgeCount && sp.ops <= tx->opCount);
+    tx->entityCount = sp.entities;
+    tx->valueCount  = sp.values;
+    tx->edgeCount   = sp.edges;
+    tx->opCount     = sp.ops;
+    arena_rollback(&tx->arena, sp.arena);
+}
+
+eavg_u64 eavgTx_addEntity(eavgTx *tx, eavg_u32 typeId, const char *name) {
+    char           *copy = tx_strdup(tx, name);
+    eavgBulkEntity *all  = tx_grow(tx, tx->entities, tx->entityCount, &tx->entityCap,
+                                   sizeof *all);
+    if ((name && !copy) || !all) return 0;
+    tx->entities = all;
+    all[tx->entityCount] = (eavgBulkEntity){ typeId, copy };
+    return EAVG_BULK_REF(tx->entityCount++);
+}
+
+/* Attributes are never removed or retyped, so checking the type here
+ * holds at commit time too. */
+static int tx_add_value(eavgTx *tx, eavg_u64 entityId, eavg_u64 attributeId,
+                        eavg_u32 dataType, eavgValueData data, size_t length)
+{
+    eavgAttribute *at = eavgDB_findAttributeById(tx->db, attributeId);
+    if (!at || at->dataType != dataType) return -1;
+    eavgBulkValue *all = tx_grow(tx, tx->values, tx->valueCount, &tx->valueCap,
+                                 sizeof *all);
+    if (!all) return -1;
+    tx->values = all;
+    all[tx->valueCount++] = (eavgBulkValue){ entityId, attributeId, data, length };
+    return 0;
+}
+
+int eavgTx_addIntValue(eavgTx *tx, eavg_u64 entityId, eavg_u64 attributeId, long x) {
+    return tx_add_value(tx, entityId, attributeId, EAVG_DATA_TYPE_INT,
+                        (eavgValueData){ .intValue = x }, 0);
+}
+
+int eavgTx_addDoubleValue(eavgTx *tx, eavg_u64 entityId, eavg_u64 attributeId, double x) {
+    return tx_add_value(tx, entityId, attributeId, EAVG_DATA_TYPE_DOUBLE,
+                        (eavgValueData){ .doubleValue = x }, 0);
+}
+
+int eavgTx_addStringValue(eavgTx *tx, eavg_u64 entityId, eavg_u64 attributeId,
+                          const char *s)
+{
+    char *copy = tx_strdup(tx, s);
+    if (s && !copy) return -1;
+    return tx_add_value(tx, entityId, attributeId, EAVG_DATA_TYPE_STRING,
+                        (eavgValueData){ .stringValue = copy }, 0);
+}
+
+int eavgTx_addBinaryValue(eavgTx *tx, eavg_u64 entityId, eavg_u64 attributeId,
+                          const unsigned char *buf, size_t len)
+{
+    unsigned char *copy = tx_copy(tx, buf, len);
+    if (buf && len && !copy) return -1;
+    return tx_add_value(tx, entityId, attributeId, EAVG_DATA_TYPE_BINARY,
+                        (eavgValueData){ .binaryValue = copy }, len);
+}
+
+int eavgTx_addEntityRefValue(eavgTx *tx, eavg_u64 entityId, eavg_u64 attributeId,
+                             eavg_u64 refId)
+{
+    return tx_add_value(tx, entityId, attributeId, EAVG_DATA_TYPE_ENTITY,
+                        (eavgValueData){ .entityRef = refId }, 0);
+}
+
+/* Like eavgDB_addEdge, labels the edge with its relation type's name. */
+int eavgTx_addEdge(eavgTx *tx, eavg_u64 src, eavg_u64 tgt, eavg_u64 relTypeId,
+                   double weight)
+{
+    const eavgRelationType *rel = eavgDB_findRelationTypeById(tx->db, relTypeId);
+    return eavgTx_addEdgeEx(tx, src, tgt, relTypeId, weight, EAVG_EDGE_DIR_OUT,
+                            rel ? rel->name : NULL, (uint64_t)(time(NULL)) * 1000);
+}
+
+int eavgTx_addEdgeEx(eavgTx *tx, eavg_u64 src, eavg_u64 tgt, eavg_u64 relTypeId,
+                     double weight, eavgEdgeDir direction, const char *label,
+                     uint64_t timestamp)
+{
+    char         *copy = tx_strdup(tx, label);
+    eavgBulkEdge *all  = tx_grow(tx, tx->edges, tx->edgeCount, &tx->edgeCap, sizeof *all);
+    if ((label && !copy) || !all) return -1;
+    tx->edges = all;
+    all[tx->edgeCount++] = (eavgBulkEdge){ src, tgt, relTypeId, weight, direction,
+                                           copy, timestamp };
+    return 0;
+}
+
+/* Provisional ids are refused: a tx's own records are only added at
+ * commit, after its removes and updates could name them. */
+static int tx_add_op(eavgTx *tx, eavgTxOp op) {
+    if (op.id & EAVG_BULK_REF_BIT) return -1;
+    eavgTxOp *all = tx_grow(tx, tx->ops, tx->opCount, &tx->opCap, sizeof *all);
+    if (!all) return -1;
+    tx->ops = all;
+    all[tx->opCount++] = op;
+    return 0;
+}
+
+int eavgTx_removeEntity(eavgTx *tx, eavg_u64 entityId) {
+    return tx_add_op(tx, (eavgTxOp){ .kind = EAVG_TX_REMOVE_ENTITY, .id = entityId });
+}
+
+int eavgTx_removeValue(eavgTx *tx, eavg_u64 valueId) {
+    return tx_add_op(tx, (eavgTxOp){ .kind = EAVG_TX_REMOVE_VALUE, .id = valueId });
+}
+
+int eavgTx_removeValueOrdered(eavgTx *tx, eavg_u64 valueId) {
+    return tx_add_op(tx, (eavgTxOp){ .kind = EAVG_TX_REMOVE_VALUE, .id = valueId,
+                                     .ordered = true });
+}
+
+/* The value's type says whether data points at a payload to copy; a
+ * value gone by now has no type, and would fail the commit anyway. */
+int eavgTx_updateValue(eavgTx *tx, eavg_u64 valueId, eavgValueData data, size_t length) {
+    eavgValRec    *r  = eavgDB_findValueById(tx->db, valueId);
+    eavgAttribute *at = r ? eavgDB_findAttributeById(tx->db, r->attributeId) : NULL;
+    if (!at) return -1;
+    if (at->dataType == EAVG_DATA_TYPE_STRING && data.stringValue) {
+        if (!(data.stringValue = tx_strdup(tx, data.stringValue))) return -1;
+    } else if (at->dataType == EAVG_DATA_TYPE_BINARY && data.binaryValue && length) {
+        if (!(data.binaryValue = tx_copy(tx, data.binaryValue, length))) return -1;
+    }
+    return tx_add_op(tx, (eavgTxOp){ .kind = EAVG_TX_UPDATE_VALUE, .id = valueId,
+                                     .data = data, .length = length });
+}
+
+int eavgTx_removeEdge(eavgTx *tx, eavg_u64 edgeId) {
+    return tx_add_op(tx, (eavgTxOp){ .kind = EAVG_TX_REMOVE_EDGE, .id = edgeId });
+}
+
+int eavgTx_updateEdgeWeight(eavgTx *tx, eavg_u64 edgeId, double newWeight) {
+    return tx_add_op(tx, (eavgTxOp){ .kind = EAVG_TX_UPDATE_EDGE_WEIGHT, .id = edgeId,
+                                     .weight = newWeight });
+}
+
+int eavgTx_updateEdgeLabel(eavgTx *tx, eavg_u64 edgeId, const char *newLabel) {
+    char *copy = tx_strdup(tx, newLabel);
+    if (newLabel && !copy) return -1;
+    return tx_add_op(tx, (eavgTxOp){ .kind = EAVG_TX_UPDATE_EDGE_LABEL, .id = edgeId,
+                                     .label = copy });
+}
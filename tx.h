@@ -0,0 +1,33 @@
+#ifndef TX_H
+#define TX_H
+
+#include "eavg.h"
+
+/* Transaction commit, for tx.c.  The tx buffers its adds as a bulk batch
+ * and its removes and updates as eavgTxOps; tx_apply applies both under
+ * one write lock, logging what each op changes so a failure part way can
+ * be undone, and publishes the events only once the whole tx is in. */
+
+enum {
+    EAVG_TX_REMOVE_ENTITY,
+    EAVG_TX_REMOVE_VALUE,
+    EAVG_TX_UPDATE_VALUE,
+    EAVG_TX_REMOVE_EDGE,
+    EAVG_TX_UPDATE_EDGE_WEIGHT,
+    EAVG_TX_UPDATE_EDGE_LABEL
+};
+
+typedef struct {
+    int            kind;
+    eavg_u64       id;         /* the entity, value or edge */
+    bool           ordered;    /* REMOVE_VALUE */
+    eavgValueData  data;       /* UPDATE_VALUE; payloads are the tx's copies */
+    size_t         length;
+    double         weight;     /* UPDATE_EDGE_WEIGHT */
+    const char    *label;      /* UPDATE_EDGE_LABEL */
+} eavgTxOp;
+
+/* 0, or -1 with the db unchanged. */
+int tx_apply(eavgDB *db, eavgBulkBatch *adds, const eavgTxOp *ops, size_t opCount);
+
+#endif /* TX_H */
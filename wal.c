@@ -0,0 +1,699 @@
+#include "wal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define WAL_MAGIC             "EAVGWAL1"
+#define WAL_HEADER_SIZE       8
+#define WAL_FRAME_SIZE        8         /* length + crc */
+#define WAL_DEFAULT_INTERVAL  100       /* ms */
+#define WAL_BUFFER_MAX        (1 << 20) /* PERIODIC writes (unsynced) past this */
+#define WAL_NULL_LEN          0xffffffffu
+
+enum {
+    WAL_ENTITY_ADD = 1, WAL_ENTITY_REMOVE,
+    WAL_ATTRIBUTE_ADD,
+    WAL_RELTYPE_ADD, WAL_RELTYPE_REMOVE,
+    WAL_VALUE_ADD, WAL_VALUE_UPDATE, WAL_VALUE_REMOVE, WAL_VALUE_REMOVE_ORDERED,
+    WAL_EDGE_ADD, WAL_EDGE_UPDATE, WAL_EDGE_REMOVE
+};
+
+struct eavgWal {
+    pthread_mutex_t  mu;
+    pthread_cond_t   cv;          /* a flush ended, or the syncer should stop */
+    int              fd;
+    char            *path;
+    char            *snapshotPath;
+    eavgWalSync      sync;
+    unsigned         intervalMs;
+
+    /* appends go to buf; a flush swaps in spare and writes the old buf */
+    char            *buf, *spare;
+    size_t           len, cap, spareCap;
+    size_t           frame;       /* start of the record being appended */
+
+    /* log positions count record bytes since the log was created */
+    uint64_t         appended, written, synced;
+    uint64_t         fileBase;    /* position of the file's first record */
+    bool             flushing;
+    bool             failed;
+    bool             stop;
+    bool             hasSyncer;
+    pthread_t        syncer;
+};
+
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = (c >> 1) ^ (0x82f63b78u & -(c & 1));
+        crc_table[i] = c;
+    }
+}
+
+uint32_t wal_crc32c(const void *p, size_t n) {
+    const unsigned char *b = p;
+    uint32_t             c = 0xffffffffu;
+    pthread_once(&crc_once, crc_init);
+    while (n--) c = crc_table[(c ^ *b++) & 0xff] ^ (c >> 8);
+    return ~c;
+}
+
+char *wal_path(const char *path, const char *suffix) {
+    size_t a = strlen(path), b = strlen(suffix);
+    char  *p = malloc(a + b + 1);
+    if (!p) return NULL;
+    memcpy(p, path, a);
+    memcpy(p + a, suffix, b + 1);
+    return p;
+}
+
+static int write_fully(int fd, const void *buf, size_t n) {
+    const char *p = buf;
+    while (n) {
+        ssize_t k = write(fd, p, n);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) return -1;
+        p += k;
+        n -= (size_t)k;
+    }
+    return 0;
+}
+
+int wal_sync_dir(const char *path) {
+    char *copy = strdup(path);
+    if (!copy) return -1;
+    int fd = open(dirname(copy), O_RDONLY);
+    free(copy);
+    if (fd < 0) return -1;
+    int rc = fsync(fd);
+    close(fd);
+    return rc;
+}
+
+static bool wal_reserve(eavgWal *w, size_t n) {
+    if (w->len + n <= w->cap) return true;
+    size_t cap = w->cap ? w->cap : 4096;
+    while (cap < w->len + n) cap *= 2;
+    char *p = realloc(w->buf, cap);
+    if (!p) {
+        w->failed = true;
+        return false;
+    }
+    w->buf = p;
+    w->cap = cap;
+    return true;
+}
+
+static void put(eavgWal *w, const void *p, size_t n) {
+    if (n && wal_reserve(w, n)) {
+        memcpy(w->buf + w->len, p, n);
+        w->len += n;
+    }
+}
+
+static void put_u8(eavgWal *w, uint8_t v)   { put(w, &v, sizeof v); }
+static void put_u32(eavgWal *w, uint32_t v) { put(w, &v, sizeof v); }
+static void put_u64(eavgWal *w, uint64_t v) { put(w, &v, sizeof v); }
+static void put_f64(eavgWal *w, double v)   { put(w, &v, sizeof v); }
+
+static void put_bytes(eavgWal *w, const void *p, size_t n, bool isNull) {
+    put_u32(w, isNull ? WAL_NULL_LEN : (uint32_t)n);
+    if (!isNull) put(w, p, n);
+}
+
+static void put_str(eavgWal *w, const char *s) {
+    put_bytes(w, s, s ? strlen(s) : 0, !s);
+}
+
+/* A record is appended between these two, with w->mu held. */
+static void record_begin(eavgWal *w, uint8_t type) {
+    pthread_mutex_lock(&w->mu);
+    w->frame = w->len;
+    put_u32(w, 0);
+    put_u32(w, 0);
+    put_u8(w, type);
+}
+
+static void record_end(eavgWal *w) {
+    if (!w->failed) {
+        uint32_t len = (uint32_t)(w->len - w->frame - WAL_FRAME_SIZE);
+        uint32_t crc = wal_crc32c(w->buf + w->frame + WAL_FRAME_SIZE, len);
+        memcpy(w->buf + w->frame, &len, sizeof len);
+        memcpy(w->buf + w->frame + 4, &crc, sizeof crc);
+        w->appended += WAL_FRAME_SIZE + len;
+    } else {
+        w->len = w->frame;
+    }
+    pthread_mutex_unlock(&w->mu);
+}
+
+void wal_log_entity(eavgWal *w, eavg_u32 op, const eavgEntity *e) {
+    if (!w) return;
+    record_begin(w, op == EAVG_CHANGE_REMOVE ? WAL_ENTITY_REMOVE : WAL_ENTITY_ADD);
+    put_u64(w, e->id);
+    if (op != EAVG_CHANGE_REMOVE) {
+        put_u32(w, e->typeId);
+        put_str(w, e->name);
+    }
+    record_end(w);
+}
+
+void wal_log_attribute(eavgWal *w, const eavgAttribute *a) {
+    if (!w) return;
+    record_begin(w, WAL_ATTRIBUTE_ADD);
+    put_u64(w, a->id);
+    put_u32(w, a->dataType);
+    put_str(w, a->name);
+    record_end(w);
+}
+
+void wal_log_reltype(eavgWal *w, eavg_u32 op, const eavgRelationType *rt) {
+    if (!w) return;
+    record_begin(w, op == EAVG_CHANGE_REMOVE ? WAL_RELTYPE_REMOVE : WAL_RELTYPE_ADD);
+    put_u64(w, rt->id);
+    if (op != EAVG_CHANGE_REMOVE) put_str(w, rt->name);
+    record_end(w);
+}
+
+void wal_log_value(eavgWal *w, eavg_u32 op, eavg_u64 entityId, const eavgValRec *r,
+                   eavg_u32 dataType)
+{
+    if (!w) return;
+    record_begin(w, op == EAVG_CHANGE_UPDATE ? WAL_VALUE_UPDATE : WAL_VALUE_ADD);
+    put_u64(w, r->id);
+    put_u64(w, entityId);
+    put_u64(w, r->attributeId);
+    put_u32(w, dataType);
+    switch (dataType) {
+    case EAVG_DATA_TYPE_STRING:
+        put_str(w, eavgValRec_getString(r));
+        break;
+    case EAVG_DATA_TYPE_BINARY: {
+        size_t               len;
+        const unsigned char *b = eavgValRec_getBinary(r, &len);
+        put_bytes(w, b, len, false);
+        break;
+    }
+    case EAVG_DATA_TYPE_ENTITY:
+        put_u64(w, r->data.entityRef);
+        break;
+    default:
+        put_u64(w, (uint64_t)r->data.intValue);   /* INT and DOUBLE alike */
+        break;
+    }
+    record_end(w);
+}
+
+void wal_log_value_remove(eavgWal *w, eavg_u64 valueId, eavg_u64 entityId, bool ordered) {
+    if (!w) return;
+    record_begin(w, ordered ? WAL_VALUE_REMOVE_ORDERED : WAL_VALUE_REMOVE);
+    put_u64(w, valueId);
+    put_u64(w, entityId);
+    record_end(w);
+}
+
+void wal_log_edge(eavgWal *w, eavg_u32 op, const eavgEdgeRec *e) {
+    if (!w) return;
+    uint8_t type = op == EAVG_CHANGE_REMOVE ? WAL_EDGE_REMOVE
+                 : op == EAVG_CHANGE_UPDATE ? WAL_EDGE_UPDATE : WAL_EDGE_ADD;
+    record_begin(w, type);
+    put_u64(w, e->id);
+    if (type == WAL_EDGE_ADD) {
+        put_u64(w, e->sourceEntity);
+        put_u64(w, e->targetEntity);
+        put_u64(w, e->relationTypeId);
+        put_u32(w, (uint32_t)e->direction);
+        put_u64(w, e->timestamp);
+    }
+    if (type != WAL_EDGE_REMOVE) {
+        put_f64(w, e->weight);
+        put_str(w, e->label);
+    }
+    if (type != WAL_EDGE_ADD) {
+        put_u64(w, e->sourceEntity);
+        put_u64(w, e->targetEntity);
+    }
+    record_end(w);
+}
+
+/* Gets everything appended before the call written, and synced if asked:
+ * either by flushing it here or by waiting for the flush in progress,
+ * which then covers this caller's records as well.  w->mu held. */
+static int wal_flush_locked(eavgWal *w, bool sync) {
+    uint64_t target = w->appended;
+    for (;;) {
+        if (w->failed) return -1;
+        if ((sync ? w->synced : w->written) >= target) return 0;
+        if (!w->flushing) break;
+        pthread_cond_wait(&w->cv, &w->mu);
+    }
+
+    char    *out    = w->buf;
+    size_t   outCap = w->cap, n = w->len;
+    uint64_t end    = w->appended;
+    w->flushing = true;
+    w->buf      = w->spare;
+    w->cap      = w->spareCap;
+    w->len      = 0;
+    w->spare    = NULL;
+    pthread_mutex_unlock(&w->mu);
+
+    int rc = n ? write_fully(w->fd, out, n) : 0;
+    if (rc == 0 && sync) rc = fdatasync(w->fd);
+
+    pthread_mutex_lock(&w->mu);
+    w->spare    = out;
+    w->spareCap = outCap;
+    w->flushing = false;
+    if (rc == 0) {
+        w->written = end;
+        if (sync) w->synced = end;
+    } else {
+        w->failed = true;
+    }
+    pthread_cond_broadcast(&w->cv);
+    return rc == 0 ? 0 : -1;
+}
+
+int wal_commit(eavgWal *w) {
+    if (!w) return 0;
+    int rc;
+    pthread_mutex_lock(&w->mu);
+    switch (w->sync) {
+    case EAVG_WAL_SYNC_ALWAYS:
+        rc = wal_flush_locked(w, true);
+        break;
+    case EAVG_WAL_SYNC_NONE:
+        rc = wal_flush_locked(w, false);
+        break;
+    default:
+        rc = w->len > WAL_BUFFER_MAX ? wal_flush_locked(w, false) : (w->failed ? -1 : 0);
+        break;
+    }
+    pthread_mutex_unlock(&w->mu);
+    return rc;
+}
+
+int wal_sync(eavgWal *w) {
+    if (!w) return -1;
+    pthread_mutex_lock(&w->mu);
+    int rc = wal_flush_locked(w, true);
+    pthread_mutex_unlock(&w->mu);
+    return rc;
+}
+
+static void *wal_syncer(void *arg) {
+    eavgWal *w = arg;
+    pthread_mutex_lock(&w->mu);
+    while (!w->stop) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec  += w->intervalMs / 1000;
+        ts.tv_nsec += (long)(w->intervalMs % 1000) * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&w->cv, &w->mu, &ts);
+        wal_flush_locked(w, true);
+    }
+    pthread_mutex_unlock(&w->mu);
+    return NULL;
+}
+
+typedef struct {
+    const unsigned char *p, *end;
+    bool                 bad;
+} wal_reader;
+
+static const void *take(wal_reader *r, size_t n) {
+    if (r->bad || (size_t)(r->end - r->p) < n) {
+        r->bad = true;
+        return NULL;
+    }
+    const void *p = r->p;
+    r->p += n;
+    return p;
+}
+
+static uint8_t  take_u8(wal_reader *r)  { const uint8_t *p = take(r, 1); return p ? *p : 0; }
+static uint32_t take_u32(wal_reader *r) { uint32_t v = 0; const void *p = take(r, 4); if (p) memcpy(&v, p, 4); return v; }
+static uint64_t take_u64(wal_reader *r) { uint64_t v = 0; const void *p = take(r, 8); if (p) memcpy(&v, p, 8); return v; }
+static double   take_f64(wal_reader *r) { double v = 0; const void *p = take(r, 8); if (p) memcpy(&v, p, 8); return v; }
+
+/* Payloads point into the log buffer; strings are copied out terminated
+ * into scratch, which the caller frees. */
+static const void *take_bytes(wal_reader *r, size_t *len) {
+    uint32_t n = take_u32(r);
+    *len = 0;
+    if (n == WAL_NULL_LEN) return NULL;
+    *len = n;
+    return take(r, n);
+}
+
+static char *take_str(wal_reader *r, char **scratch) {
+    size_t      n;
+    const char *p = take_bytes(r, &n);
+    if (!p || r->bad) return NULL;
+    char *s = malloc(n + 1);
+    if (!s) {
+        r->bad = true;
+        return NULL;
+    }
+    memcpy(s, p, n);
+    s[n] = '\0';
+    *scratch = s;
+    return s;
+}
+
+/* Length of the intact prefix of a log's records. */
+static size_t wal_valid(const unsigned char *recs, size_t n) {
+    size_t pos = 0;
+    while (n - pos >= WAL_FRAME_SIZE) {
+        uint32_t len, crc;
+        memcpy(&len, recs + pos, 4);
+        memcpy(&crc, recs + pos + 4, 4);
+        if (len == 0 || len > n - pos - WAL_FRAME_SIZE ||
+            wal_crc32c(recs + pos + WAL_FRAME_SIZE, len) != crc) break;
+        pos += WAL_FRAME_SIZE + len;
+    }
+    return pos;
+}
+
+static unsigned char *read_file(int fd, size_t *size) {
+    off_t end = lseek(fd, 0, SEEK_END);
+    if (end < 0) return NULL;
+    unsigned char *buf = malloc(end ? (size_t)end : 1);
+    if (!buf) return NULL;
+    size_t got = 0;
+    while (got < (size_t)end) {
+        ssize_t k = pread(fd, buf + got, (size_t)end - got, (off_t)got);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) {
+            free(buf);
+            return NULL;
+        }
+        got += (size_t)k;
+    }
+    *size = got;
+    return buf;
+}
+
+/* Replay reuses the public calls, steering the id counter so the record
+ * gets its logged id back; a call returning NULL fails the replay. */
+#define WITH_ID(counter, id, call) do {                              \
+        eavg_u64 keep_ = atomic_load(&(counter));                    \
+        atomic_store(&(counter), (id));                              \
+        if (!(call)) rc = -1;                                        \
+        if (keep_ > (id) + 1) atomic_store(&(counter), keep_);       \
+    } while (0)
+
+/* The snapshot holds edges with ids below loadedEdges only, so only
+ * those (logged while a checkpoint was being written) need looking for. */
+static bool edge_present(eavgDB *db, eavg_u64 loadedEdges, eavg_u64 src, eavg_u64 id) {
+    if (id >= loadedEdges) return false;
+    eavgAdjList *al = eavgDB_getAdjList(db, src);
+    for (size_t i = 0; al && i < al->count; i++)
+        if (al->edges[i].id == id) return true;
+    return false;
+}
+
+/* Whether entityId holds value id.  Looking in its own list (rather than
+ * by id) loads only its chunks of a lazily opened db. */
+static bool value_present(eavgDB *db, eavg_u64 entityId, eavg_u64 id) {
+    eavgValueList *vl = eavgDB_getValueList(db, entityId);
+    for (size_t i = 0; vl && i < vl->count; i++)
+        if (vl->values[i].id == id) return true;
+    return false;
+}
+
+/* Records the snapshot already covers are skipped; removals of what is
+ * already gone are no-ops.  Returns -1 when applying a record fails. */
+static int wal_apply(eavgDB *db, eavg_u64 loadedEdges, uint8_t type, wal_reader *r) {
+    char    *name = NULL;
+    int      rc   = 0;
+    eavg_u64 id   = take_u64(r);
+    switch (type) {
+    case WAL_ENTITY_ADD: {
+        eavg_u32 typeId = take_u32(r);
+        char    *n      = take_str(r, &name);
+        if (!r->bad && !eavgDB_findEntityById(db, id))
+            WITH_ID(db->nextEntityId, id, eavgDB_addEntity(db, typeId, n));
+        break;
+    }
+    case WAL_ENTITY_REMOVE:
+        if (!r->bad) eavgDB_removeEntity(db, id);
+        break;
+    case WAL_ATTRIBUTE_ADD: {
+        eavg_u32 dataType = take_u32(r);
+        char    *n        = take_str(r, &name);
+        if (!r->bad && !eavgDB_findAttributeById(db, id))
+            WITH_ID(db->nextAttributeId, id, eavgDB_addAttribute(db, n, dataType));
+        break;
+    }
+    case WAL_RELTYPE_ADD: {
+        char *n = take_str(r, &name);
+        if (!r->bad && !eavgDB_findRelationTypeById(db, id))
+            WITH_ID(db->nextRelationTypeId, id, eavgDB_addRelationType(db, n));
+        break;
+    }
+    case WAL_RELTYPE_REMOVE:
+        if (!r->bad) eavgDB_removeRelationType(db, id);
+        break;
+    case WAL_VALUE_ADD:
+    case WAL_VALUE_UPDATE: {
+        eavg_u64      entityId    = take_u64(r);
+        eavg_u64      attributeId = take_u64(r);
+        eavg_u32      dataType    = take_u32(r);
+        eavgValueData data        = { .entityRef = 0 };
+        size_t        len         = 0;
+        if (dataType == EAVG_DATA_TYPE_STRING)      data.stringValue = take_str(r, &name);
+        else if (dataType == EAVG_DATA_TYPE_BINARY) data.binaryValue = (unsigned char*)take_bytes(r, &len);
+        else                                        data.entityRef   = take_u64(r);
+        if (r->bad) break;
+        if (type == WAL_VALUE_UPDATE) {
+            if (value_present(db, entityId, id) && eavgDB_updateValue(db, id, data, len) < 0)
+                rc = -1;
+            break;
+        }
+        if (value_present(db, entityId, id)) break;
+        switch (dataType) {
+        case EAVG_DATA_TYPE_INT:
+            WITH_ID(db->nextValueId, id, eavgDB_addIntValue(db, entityId, attributeId, data.intValue));
+            break;
+        case EAVG_DATA_TYPE_DOUBLE:
+            WITH_ID(db->nextValueId, id, eavgDB_addDoubleValue(db, entityId, attributeId, data.doubleValue));
+            break;
+        case EAVG_DATA_TYPE_STRING:
+            WITH_ID(db->nextValueId, id, eavgDB_addStringValue(db, entityId, attributeId, data.stringValue));
+            break;
+        case EAVG_DATA_TYPE_BINARY:
+            WITH_ID(db->nextValueId, id, eavgDB_addBinaryValue(db, entityId, attributeId, data.binaryValue, len));
+            break;
+        case EAVG_DATA_TYPE_ENTITY:
+            WITH_ID(db->nextValueId, id, eavgDB_addEntityRefValue(db, entityId, attributeId, data.entityRef));
+            break;
+        }
+        break;
+    }
+    case WAL_VALUE_REMOVE:
+    case WAL_VALUE_REMOVE_ORDERED: {
+        eavg_u64 entityId = take_u64(r);
+        if (r->bad || !value_present(db, entityId, id)) break;
+        int done = type == WAL_VALUE_REMOVE ? eavgDB_removeValue(db, id)
+                                            : eavgDB_removeValueOrdered(db, id);
+        if (done < 0) rc = -1;
+        break;
+    }
+    case WAL_EDGE_ADD: {
+        eavg_u64 src = take_u64(r), tgt = take_u64(r), rel = take_u64(r);
+        eavg_u32 dir = take_u32(r);
+        eavg_u64 ts  = take_u64(r);
+        double   wt  = take_f64(r);
+        char    *lab = take_str(r, &name);
+        if (!r->bad && !edge_present(db, loadedEdges, src, id))
+            WITH_ID(db->nextEdgeId, id,
+                    eavgDB_addEdgeEx(db, src, tgt, rel, wt, (eavgEdgeDir)dir, lab, ts));
+        break;
+    }
+    case WAL_EDGE_UPDATE:
+    case WAL_EDGE_REMOVE: {
+        double wt  = 0;
+        char  *lab = NULL;
+        if (type == WAL_EDGE_UPDATE) {
+            wt  = take_f64(r);
+            lab = take_str(r, &name);
+        }
+        eavg_u64 src = take_u64(r), tgt = take_u64(r);
+        if (!r->bad && wal_replay_edge(db, type == WAL_EDGE_REMOVE, id, src, tgt, wt, lab) < 0)
+            rc = -1;
+        break;
+    }
+    }
+    free(name);
+    return rc;
+}
+
+int wal_replay(eavgDB *db, const char *snapshotPath) {
+    char *path = wal_path(snapshotPath, EAVG_WAL_SUFFIX);
+    if (!path) return -1;
+    int fd = open(path, O_RDONLY);
+    free(path);
+    if (fd < 0) return errno == ENOENT ? 0 : -1;
+
+    size_t         size;
+    unsigned char *buf = read_file(fd, &size);
+    close(fd);
+    if (!buf) return -1;
+    if (size < WAL_HEADER_SIZE || memcmp(buf, WAL_MAGIC, WAL_HEADER_SIZE) != 0) {
+        free(buf);
+        return size == 0 ? 0 : -1;
+    }
+
+    const unsigned char *recs        = buf + WAL_HEADER_SIZE;
+    size_t               n           = wal_valid(recs, size - WAL_HEADER_SIZE);
+    eavg_u64             loadedEdges = atomic_load(&db->nextEdgeId);
+    int                  rc          = 0;
+    for (size_t pos = 0; pos < n && rc == 0;) {
+        uint32_t len;
+        memcpy(&len, recs + pos, 4);
+        wal_reader r = { recs + pos + WAL_FRAME_SIZE, recs + pos + WAL_FRAME_SIZE + len, false };
+        rc = wal_apply(db, loadedEdges, take_u8(&r), &r);
+        pos += WAL_FRAME_SIZE + len;
+    }
+    free(buf);
+    return rc;
+}
+
+eavgWal *wal_open(const char *snapshotPath, const eavgWalOptions *opt) {
+    eavgWal *w = calloc(1, sizeof *w);
+    if (!w) return NULL;
+    w->fd           = -1;
+    w->path         = wal_path(snapshotPath, EAVG_WAL_SUFFIX);
+    w->snapshotPath = wal_path(snapshotPath, "");
+    w->sync         = opt ? opt->sync : EAVG_WAL_SYNC_ALWAYS;
+    w->intervalMs   = opt && opt->syncIntervalMs ? opt->syncIntervalMs : WAL_DEFAULT_INTERVAL;
+    if (!w->path || !w->snapshotPath) goto fail;
+
+    w->fd = open(w->path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (w->fd < 0) goto fail;
+    size_t         size;
+    unsigned char *buf = read_file(w->fd, &size);
+    if (!buf) goto fail;
+    size_t keep = 0;
+    if (size >= WAL_HEADER_SIZE && memcmp(buf, WAL_MAGIC, WAL_HEADER_SIZE) == 0)
+        keep = WAL_HEADER_SIZE + wal_valid(buf + WAL_HEADER_SIZE, size - WAL_HEADER_SIZE);
+    else if (size != 0) {
+        free(buf);   /* not ours: leave it alone */
+        goto fail;
+    }
+    free(buf);
+    if (keep != size && ftruncate(w->fd, (off_t)keep) != 0) goto fail;
+    if (keep == 0) {
+        if (write_fully(w->fd, WAL_MAGIC, WAL_HEADER_SIZE) != 0) goto fail;
+        keep = WAL_HEADER_SIZE;
+    }
+    if (fdatasync(w->fd) != 0) goto fail;
+    w->appended = w->written = w->synced = keep - WAL_HEADER_SIZE;
+
+    pthread_mutex_init(&w->mu, NULL);
+    pthread_cond_init(&w->cv, NULL);
+    if (w->sync == EAVG_WAL_SYNC_PERIODIC) {
+        w->hasSyncer = pthread_create(&w->syncer, NULL, wal_syncer, w) == 0;
+        if (!w->hasSyncer) {
+            wal_close(w);
+            return NULL;
+        }
+    }
+    return w;
+
+ fail:
+    if (w->fd >= 0) close(w->fd);
+    free(w->path);
+    free(w->snapshotPath);
+    free(w);
+    return NULL;
+}
+
+int wal_close(eavgWal *w) {
+    if (!w) return 0;
+    if (w->hasSyncer) {
+        pthread_mutex_lock(&w->mu);
+        w->stop = true;
+        pthread_cond_broadcast(&w->cv);
+        pthread_mutex_unlock(&w->mu);
+        pthread_join(w->syncer, NULL);
+    }
+    int rc = wal_sync(w);
+    if (close(w->fd) != 0) rc = -1;
+    pthread_mutex_destroy(&w->mu);
+    pthread_cond_destroy(&w->cv);
+    free(w->buf);
+    free(w->spare);
+    free(w->path);
+    free(w->snapshotPath);
+    free(w);
+    return rc;
+}
+
+const char *wal_snapshot_path(const eavgWal *w) {
+    return w->snapshotPath;
+}
+
+uint64_t wal_mark(eavgWal *w) {
+    pthread_mutex_lock(&w->mu);
+    uint64_t mark = w->appended;
+    pthread_mutex_unlock(&w->mu);
+    return mark;
+}
+
+/* Copies the records from mark on into a fresh log and renames it over
+ * the old one.  Appends wait meanwhile, so this costs what was written
+ * since mark, not the size of the log. */
+int wal_truncate(eavgWal *w, uint64_t mark) {
+    int   rc  = -1;
+    char *tmp = wal_path(w->path, ".tmp");
+    if (!tmp) return -1;
+    pthread_mutex_lock(&w->mu);
+    if (wal_flush_locked(w, false) < 0) goto out;
+    while (w->flushing) pthread_cond_wait(&w->cv, &w->mu);
+
+    int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0) goto out;
+    off_t from = (off_t)(WAL_HEADER_SIZE + mark - w->fileBase);
+    off_t to   = (off_t)(WAL_HEADER_SIZE + w->written - w->fileBase);
+    char  chunk[1 << 16];
+    bool  ok = write_fully(fd, WAL_MAGIC, WAL_HEADER_SIZE) == 0;
+    while (ok && from < to) {
+        size_t  want = (size_t)(to - from) < sizeof chunk ? (size_t)(to - from) : sizeof chunk;
+        ssize_t k    = pread(w->fd, chunk, want, from);
+        if (k < 0 && errno == EINTR) continue;
+        ok    = k > 0 && write_fully(fd, chunk, (size_t)k) == 0;
+        from += k;
+    }
+    if (!ok || fdatasync(fd) != 0 || rename(tmp, w->path) != 0) {
+        close(fd);
+        unlink(tmp);
+        goto out;
+    }
+    wal_sync_dir(w->path);
+    close(w->fd);
+    w->fd       = fd;
+    w->fileBase = mark;
+    if (w->synced < w->written) w->synced = w->written;
+    rc = 0;
+
+ out:
+    pthread_mutex_unlock(&w->mu);
+    free(tmp);
+    return rc;
+}
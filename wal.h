@@ -0,0 +1,66 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include "eavg.h"
+
+/* Write-ahead log.  Records are framed as [u32 length][u32 crc32c][type]
+ * [payload] after a short file header, and carry the ids the db assigned,
+ * so replay reproduces the same records.  Appends run under the db write
+ * lock, which orders them, into a memory buffer; wal_commit, called once
+ * the lock is released, writes (and fsyncs) the buffer as the sync policy
+ * asks.  Whoever flushes takes everything appended so far, so concurrent
+ * writers share one write and one fsync. */
+
+#define EAVG_WAL_SUFFIX  ".wal"
+
+typedef struct eavgWal eavgWal;
+
+/* Opens (or creates) snapshotPath + EAVG_WAL_SUFFIX for appending, first
+ * cutting off a torn tail left by a crash. */
+eavgWal *wal_open(const char *snapshotPath, const eavgWalOptions *opt);
+/* Flushes and syncs what is left, then closes; returns -1 if any write
+ * of the log failed. */
+int      wal_close(eavgWal *w);
+const char *wal_snapshot_path(const eavgWal *w);
+
+/* Appenders; w may be NULL.  op is an EAVG_CHANGE_* code. */
+void wal_log_entity(   eavgWal *w, eavg_u32 op, const eavgEntity *e);
+void wal_log_attribute(eavgWal *w, const eavgAttribute *a);
+void wal_log_reltype(  eavgWal *w, eavg_u32 op, const eavgRelationType *rt);
+void wal_log_value(    eavgWal *w, eavg_u32 op, eavg_u64 entityId, const eavgValRec *r,
+                       eavg_u32 dataType);
+void wal_log_value_remove(eavgWal *w, eavg_u64 valueId, eavg_u64 entityId, bool ordered);
+void wal_log_edge(     eavgWal *w, eavg_u32 op, const eavgEdgeRec *e);
+
+/* w may be NULL.  Returns -1 once a write of the log has failed. */
+int      wal_commit(eavgWal *w);
+/* Writes and fsyncs everything appended so far, whatever the policy. */
+int      wal_sync(eavgWal *w);
+
+/* The log position after the last append; take it under the db lock. */
+uint64_t wal_mark(eavgWal *w);
+/* Drops the records before mark, which a checkpoint has made redundant. */
+int      wal_truncate(eavgWal *w, uint64_t mark);
+
+/* Applies snapshotPath's log, if there is one, to db.  Records the db
+ * already holds are skipped, so replaying over a checkpoint that outran
+ * its truncation is harmless.  Replay stops at the first torn record.
+ * Returns -1 when the log cannot be read or a record fails to apply. */
+int      wal_replay(eavgDB *db, const char *snapshotPath);
+
+/* Replays an edge removal, or an update of its weight and label, for
+ * wal.c; defined in db.c.  The record's endpoints name the two lists to
+ * look in.  0, 1 when the edge is not there (already removed), or -1. */
+int      wal_replay_edge(eavgDB *db, bool remove, eavg_u64 id, eavg_u64 src, eavg_u64 tgt,
+                         double weight, const char *label);
+
+/* malloc'd path + suffix, or NULL. */
+char    *wal_path(const char *path, const char *suffix);
+
+/* CRC-32C (Castagnoli) of n bytes; chunked snapshots use it too. */
+uint32_t wal_crc32c(const void *p, size_t n);
+
+/* fsyncs the directory holding path, making a rename in it durable. */
+int      wal_sync_dir(const char *path);
+
+#endif /* WAL_H */